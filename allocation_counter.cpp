@@ -0,0 +1,64 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(COUNT_ALLOCATIONS)
+
+namespace {
+
+    thread_local uint64_t thread_allocation_count = 0;
+
+    void* CountedAllocate(std::size_t size) {
+        ++thread_allocation_count;
+        if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+
+}  // namespace
+
+uint64_t GetThreadAllocationCount() {
+    return thread_allocation_count;
+}
+
+bool IsAllocationCountingEnabled() {
+    return true;
+}
+
+void* operator new(std::size_t size) {
+    return CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return CountedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+#else
+
+uint64_t GetThreadAllocationCount() {
+    return 0;
+}
+
+bool IsAllocationCountingEnabled() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of operator new calls made by the calling thread so far.
+// Counted only in builds with COUNT_ALLOCATIONS defined (the test target), where
+// allocation_counter.cpp replaces the global operator new and delete; elsewhere it stays 0.
+uint64_t GetThreadAllocationCount();
+
+// Whether this build counts allocations
+bool IsAllocationCountingEnabled();
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Relaxed atomic counter for statistics updated from const (query) methods.
+// Copying takes a snapshot, so classes holding counters stay copyable and movable.
+class AtomicCounter {
+public:
+    AtomicCounter() = default;
+    AtomicCounter(const AtomicCounter& other)
+        : value_(other.Get()) {
+    }
+    AtomicCounter& operator=(const AtomicCounter& other) {
+        value_.store(other.Get(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void Add(uint64_t delta = 1) {
+        value_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    uint64_t Get() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+    void Reset() {
+        value_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{ 0 };
+};
@@ -0,0 +1,271 @@
+#include "batch_query_evaluator.h"
+#include "score_kernels.h"
+
+#include <algorithm>
+#include <exception>
+#include <execution>
+#include <limits>
+#include <map>
+#include <tuple>
+
+namespace {
+
+    const size_t GROUP_QUERIES = 1024;
+    const size_t BLOCK_ORDINALS = 128;    // scores of a group block take GROUP_QUERIES * BLOCK_ORDINALS Scores
+    const size_t BLOCK_WORDS = BLOCK_ORDINALS / 64;
+    // a term with at least this many postings in a block adds its dense row to the queries with AddScaled,
+    // sparser ones are scattered one posting at a time
+    const size_t DENSE_BLOCK_POSTINGS = 16;
+
+    // One query of a group using a term
+    struct TermUse {
+        std::string_view word;
+        bool is_minus;
+        uint32_t query;    // in the group
+    };
+
+    struct Term {
+        bool is_minus;
+        Score inverse_document_freq;    // plus terms
+        std::map<uint32_t, TermFreq>::const_iterator next;    // first posting not scattered yet
+        std::map<uint32_t, TermFreq>::const_iterator end;
+        size_t queries_begin;    // range of the queries of the term in term_queries
+        size_t queries_end;
+    };
+
+    // Scans the set bits of word in ascending order
+    template <typename Callback>
+    void ForEachBit(uint64_t word, Callback callback) {
+        while (word != 0) {
+            size_t bit = 0;
+            while (((word >> bit) & 1) == 0) {
+                ++bit;
+            }
+            callback(bit);
+            word &= word - 1;
+        }
+    }
+
+    // Keeps the MAX_RESULT_DOCUMENT_COUNT most relevant documents in the heap top
+    void PushTopDocument(std::vector<Document>& top, const Document& document) {
+        if (top.size() < MAX_RESULT_DOCUMENT_COUNT) {
+            top.push_back(document);
+            std::push_heap(top.begin(), top.end(), IsMoreRelevant);
+        }
+        else if (IsMoreRelevant(document, top.front())) {
+            std::pop_heap(top.begin(), top.end(), IsMoreRelevant);
+            top.back() = document;
+            std::push_heap(top.begin(), top.end(), IsMoreRelevant);
+        }
+    }
+
+}  // namespace
+
+BatchQueryEvaluator::BatchQueryEvaluator(const SearchServer& search_server)
+    : search_server_(search_server) {
+}
+
+std::vector<std::vector<Document>> BatchQueryEvaluator::FindTopDocuments(const std::vector<std::string_view>& raw_queries,
+    DocumentStatus status) const {
+    // parsed in place: the words may point into Query::normalized_text
+    std::vector<SearchServer::Query> queries(raw_queries.size());
+    std::vector<std::exception_ptr> errors(raw_queries.size());
+    std::vector<size_t> indexes(raw_queries.size());
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        indexes[i] = i;
+    }
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [this, &raw_queries, &queries, &errors](size_t i) {
+        try {
+            search_server_.ParseQuery(raw_queries[i], queries[i]);
+        }
+        catch (...) {
+            errors[i] = std::current_exception();
+        }
+        });
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // prefix plus terms and fuzzy expansions are summed after the plus words, per query
+    std::vector<size_t> shared;
+    std::vector<size_t> separate;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const SearchServer::Query& query = queries[i];
+        const bool fuzzy = search_server_.fuzzy_index_ && std::any_of(query.plus_words.begin(), query.plus_words.end(),
+            [this](const std::string_view word) { return search_server_.GetCorpusWordDocumentCount(word) == 0; });
+        (fuzzy || !query.plus_prefixes.empty() ? separate : shared).push_back(i);
+    }
+    counters_.queries.Add(queries.size());
+    counters_.shared_queries.Add(shared.size());
+
+    std::vector<std::vector<Document>> results(queries.size());
+    std::vector<std::vector<size_t>> groups;
+    for (size_t begin = 0; begin < shared.size(); begin += GROUP_QUERIES) {
+        groups.emplace_back(shared.begin() + begin, shared.begin() + std::min(begin + GROUP_QUERIES, shared.size()));
+    }
+    std::for_each(std::execution::par, groups.begin(), groups.end(), [this, &queries, status, &results](const std::vector<size_t>& group) {
+        EvaluateGroup(queries, group, status, results);
+        });
+    std::for_each(std::execution::par, separate.begin(), separate.end(), [this, &raw_queries, status, &results](size_t i) {
+        results[i] = search_server_.FindTopDocuments(std::execution::seq, raw_queries[i], status);
+        });
+    return results;
+}
+
+void BatchQueryEvaluator::EvaluateGroup(const std::vector<SearchServer::Query>& queries, const std::vector<size_t>& query_indexes,
+    DocumentStatus status, std::vector<std::vector<Document>>& results) const {
+    const SearchServer& server = search_server_;
+    const DocumentStatusFilter filter{ status };
+
+    // terms of the group in lexicographic order, plus terms first; minus prefixes are expanded here
+    std::vector<TermUse> uses;
+    for (uint32_t query = 0; query < query_indexes.size(); ++query) {
+        const SearchServer::Query& parsed = queries[query_indexes[query]];
+        for (const std::string_view word : parsed.plus_words) {
+            uses.push_back({ word, false, query });
+        }
+        for (const std::string_view word : parsed.minus_words) {
+            uses.push_back({ word, true, query });
+        }
+        for (const std::string_view prefix : parsed.minus_prefixes) {
+            server.ForEachPrefixWord(prefix, [&uses, query](const std::string_view word) {
+                uses.push_back({ word, true, query });
+                });
+        }
+    }
+    std::sort(uses.begin(), uses.end(), [](const TermUse& lhs, const TermUse& rhs) {
+        return std::tie(lhs.is_minus, lhs.word, lhs.query) < std::tie(rhs.is_minus, rhs.word, rhs.query);
+        });
+    uses.erase(std::unique(uses.begin(), uses.end(), [](const TermUse& lhs, const TermUse& rhs) {
+        return lhs.is_minus == rhs.is_minus && lhs.word == rhs.word && lhs.query == rhs.query;
+        }), uses.end());
+
+    std::vector<Term> terms;
+    std::vector<uint32_t> term_queries;
+    for (size_t begin = 0; begin < uses.size();) {
+        size_t end = begin;
+        while (end < uses.size() && uses[end].is_minus == uses[begin].is_minus && uses[end].word == uses[begin].word) {
+            ++end;
+        }
+        const auto it = server.word_to_document_freqs_.find(uses[begin].word);
+        if (it != server.word_to_document_freqs_.end()) {
+            const bool is_minus = uses[begin].is_minus;
+            terms.push_back({ is_minus, is_minus ? Score{ 0 } : static_cast<Score>(server.ComputeWordInverseDocumentFreq(it->first)),
+                it->second.begin(), it->second.end(), term_queries.size(), term_queries.size() + (end - begin) });
+            for (size_t i = begin; i < end; ++i) {
+                term_queries.push_back(uses[i].query);
+            }
+        }
+        begin = end;
+    }
+    counters_.term_references.Add(uses.size());
+    counters_.posting_scans.Add(terms.size());
+
+    const size_t query_count = query_indexes.size();
+    std::vector<Score> scores(query_count * BLOCK_ORDINALS, Score{ 0 });
+    std::vector<Score> term_row(BLOCK_ORDINALS, Score{ 0 });    // relevance factors of a term in the block
+    uint64_t term_bits[BLOCK_WORDS] = {};
+    std::vector<uint64_t> scored(query_count * BLOCK_WORDS, 0);
+    std::vector<uint64_t> excluded(query_count * BLOCK_WORDS, 0);
+    std::vector<std::vector<Document>> tops(query_count);    // heaps with the least relevant document on top
+
+    // blocks without postings of the group are skipped
+    const auto next_block = [&terms](size_t ordinal) {
+        size_t next_ordinal = std::numeric_limits<size_t>::max();
+        for (const Term& term : terms) {
+            if (term.next != term.end) {
+                next_ordinal = std::min<size_t>(next_ordinal, term.next->first);
+            }
+        }
+        return std::max(ordinal, next_ordinal / BLOCK_ORDINALS * BLOCK_ORDINALS);
+    };
+    const size_t ordinal_bound = server.document_columns_.GetOrdinalBound();
+    for (size_t block_begin = next_block(0); block_begin < ordinal_bound; block_begin = next_block(block_begin + BLOCK_ORDINALS)) {
+        const size_t block_end = block_begin + BLOCK_ORDINALS;
+        // the same products and summation order as FindAllDocuments, so relevance is bit-identical:
+        // a dense row adds zero where the term has no posting
+        for (Term& term : terms) {
+            if (term.is_minus) {
+                for (; term.next != term.end && term.next->first < block_end; ++term.next) {
+                    const size_t offset = term.next->first - block_begin;
+                    for (size_t i = term.queries_begin; i < term.queries_end; ++i) {
+                        excluded[term_queries[i] * BLOCK_WORDS + offset / 64] |= uint64_t{ 1 } << (offset % 64);
+                    }
+                }
+                continue;
+            }
+            size_t row_begin = BLOCK_ORDINALS;
+            size_t row_end = 0;
+            size_t row_postings = 0;
+            for (; term.next != term.end && term.next->first < block_end; ++term.next) {
+                const uint32_t ordinal = term.next->first;
+                if (!server.IsAccepted(filter, ordinal)) {
+                    continue;
+                }
+                const size_t offset = ordinal - block_begin;
+                term_row[offset] = DecodeTermFreq(term.next->second);
+                term_bits[offset / 64] |= uint64_t{ 1 } << (offset % 64);
+                row_begin = std::min(row_begin, offset);
+                row_end = offset + 1;
+                ++row_postings;
+            }
+            if (row_postings == 0) {
+                continue;
+            }
+            for (size_t i = term.queries_begin; i < term.queries_end; ++i) {
+                const uint32_t query = term_queries[i];
+                Score* const query_scores = &scores[query * BLOCK_ORDINALS];
+                if (row_postings >= DENSE_BLOCK_POSTINGS) {
+                    AddScaled(query_scores + row_begin, term_row.data() + row_begin, term.inverse_document_freq, row_end - row_begin);
+                }
+                else {
+                    for (size_t word = 0; word < BLOCK_WORDS; ++word) {
+                        ForEachBit(term_bits[word], [&](size_t bit) {
+                            const size_t offset = word * 64 + bit;
+                            query_scores[offset] += term_row[offset] * term.inverse_document_freq;
+                            });
+                    }
+                }
+                for (size_t word = 0; word < BLOCK_WORDS; ++word) {
+                    scored[query * BLOCK_WORDS + word] |= term_bits[word];
+                }
+            }
+            std::fill(term_row.begin() + row_begin, term_row.begin() + row_end, Score{ 0 });
+            std::fill(std::begin(term_bits), std::end(term_bits), 0);
+        }
+        for (size_t query = 0; query < query_count; ++query) {
+            for (size_t word = 0; word < BLOCK_WORDS; ++word) {
+                uint64_t& scored_word = scored[query * BLOCK_WORDS + word];
+                uint64_t& excluded_word = excluded[query * BLOCK_WORDS + word];
+                ForEachBit(scored_word, [&](size_t bit) {
+                    const size_t offset = word * 64 + bit;
+                    Score& score = scores[query * BLOCK_ORDINALS + offset];
+                    if (((excluded_word >> bit) & 1) == 0) {
+                        const uint32_t ordinal = static_cast<uint32_t>(block_begin + offset);
+                        PushTopDocument(tops[query], Document(server.document_columns_.GetId(ordinal), score,
+                            server.document_columns_.GetRating(ordinal)));
+                    }
+                    score = 0;
+                    });
+                scored_word = 0;
+                excluded_word = 0;
+            }
+        }
+    }
+
+    for (size_t query = 0; query < query_count; ++query) {
+        std::sort_heap(tops[query].begin(), tops[query].end(), IsMoreRelevant);
+        results[query_indexes[query]] = std::move(tops[query]);
+    }
+}
+
+BatchQueryStats BatchQueryEvaluator::GetStats() const {
+    return {
+        counters_.queries.Get(),
+        counters_.shared_queries.Get(),
+        counters_.term_references.Get(),
+        counters_.posting_scans.Get()
+    };
+}
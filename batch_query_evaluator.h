@@ -0,0 +1,47 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+struct BatchQueryStats {
+    uint64_t queries = 0;
+    uint64_t shared_queries = 0;    // evaluated by the shared scan, the rest per query
+    uint64_t term_references = 0;    // plus and minus terms of the shared queries
+    uint64_t posting_scans = 0;    // posting lists walked for them, once per term and query group
+};
+
+// Shared-scan evaluation of a batch of queries. Queries are split into groups; the terms of a
+// group are walked once in ordinal blocks, in lexicographic order (the order of the plus words
+// of a parsed query), and every posting is scattered into block accumulators of the queries
+// containing the term. Relevance is summed in the order of FindAllDocuments, so it is bit-identical
+// to the per-query path, and every query keeps its top documents in a bounded heap as QueryContext does.
+// Queries with prefix plus terms or fuzzy expansions take the per-query path.
+class BatchQueryEvaluator {
+public:
+    explicit BatchQueryEvaluator(const SearchServer& search_server);
+
+    // As search_server.FindTopDocuments(std::execution::seq, query, status) for every query.
+    // Groups run in parallel; throws std::invalid_argument for invalid queries.
+    std::vector<std::vector<Document>> FindTopDocuments(const std::vector<std::string_view>& raw_queries,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    BatchQueryStats GetStats() const;
+
+private:
+    const SearchServer& search_server_;
+
+    struct Counters {
+        AtomicCounter queries;
+        AtomicCounter shared_queries;
+        AtomicCounter term_references;
+        AtomicCounter posting_scans;
+    };
+    mutable Counters counters_;
+
+    void EvaluateGroup(const std::vector<SearchServer::Query>& queries, const std::vector<size_t>& query_indexes,
+        DocumentStatus status, std::vector<std::vector<Document>>& results) const;
+};
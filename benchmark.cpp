@@ -0,0 +1,955 @@
+#include "benchmark.h"
+#include "allocation_counter.h"
+#include "batch_query_evaluator.h"
+#include "concurrent_map.h"
+#include "document_store.h"
+#include "huge_page_allocator.h"
+#include "index_statistics.h"
+#include "numa_replicas.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "score_kernels.h"
+#include "score_precision.h"
+#include "search_server.h"
+#include "stop_word_set.h"
+#include "text_normalizer.h"
+#include "write_ahead_log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    const size_t PROCESS_QUERIES_BATCH = 64;
+    const size_t MAP_UPDATE_BATCH = 1024;    // updates per latency sample
+
+    // Collects per-operation latencies of one benchmark
+    class LatencyRecorder {
+    public:
+        LatencyRecorder(std::string name, int documents)
+            : name_(std::move(name))
+            , documents_(documents) {
+            ResetPeakRss();
+        }
+
+        template <typename Operation>
+        void Measure(Operation operation, uint64_t operation_count = 1) {
+            const uint64_t start_allocations = GetThreadAllocationCount();
+            const auto start_time = Clock::now();
+            operation();
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time).count();
+            allocations_ += GetThreadAllocationCount() - start_allocations;
+            latencies_ns_.push_back(elapsed / static_cast<double>(operation_count));
+            total_ns_ += elapsed;
+            operations_ += operation_count;
+        }
+
+        BenchmarkResult Finish() {
+            std::sort(latencies_ns_.begin(), latencies_ns_.end());
+            const auto percentile = [this](double p) {
+                return latencies_ns_.empty() ? 0.0
+                    : latencies_ns_[std::min(latencies_ns_.size() - 1, static_cast<size_t>(p * latencies_ns_.size()))];
+            };
+            BenchmarkResult result;
+            result.name = name_;
+            result.documents = documents_;
+            result.operations = operations_;
+            result.seconds = total_ns_ / 1e9;
+            result.ops_per_second = total_ns_ > 0 ? operations_ * 1e9 / total_ns_ : 0.0;
+            result.p50_ns = percentile(0.5);
+            result.p99_ns = percentile(0.99);
+            result.p999_ns = percentile(0.999);
+            result.peak_rss_kb = GetPeakRssKb();
+            result.allocations_per_op = operations_ > 0 ? static_cast<double>(allocations_) / operations_ : 0.0;
+            return result;
+        }
+
+    private:
+        std::string name_;
+        int documents_;
+        std::vector<double> latencies_ns_;
+        int64_t total_ns_ = 0;
+        uint64_t operations_ = 0;
+        uint64_t allocations_ = 0;
+    };
+
+    std::string GenerateZipfText(std::mt19937& generator, const ZipfDistribution& zipf, const std::vector<std::string>& dictionary,
+        int word_count, double minus_word_probability) {
+        std::string text;
+        for (int i = 0; i < word_count; ++i) {
+            if (!text.empty()) {
+                text.push_back(' ');
+            }
+            if (minus_word_probability > 0 && std::uniform_real_distribution<>(0, 1)(generator) < minus_word_probability) {
+                text.push_back('-');
+            }
+            text += dictionary[zipf(generator)];
+        }
+        return text;
+    }
+
+    // Normalization with every option on and stop word lookups of the document words,
+    // the perfect hash set against the ordered set it replaced
+    void RunTextProcessing(const BenchmarkCorpus& corpus, int document_count, std::vector<BenchmarkResult>& results) {
+        size_t text_bytes = 0;
+        for (const std::string& document : corpus.documents) {
+            text_bytes += document.size();
+        }
+        const TextNormalizer normalizer({ true, true, true });
+        std::string buffer;
+        LatencyRecorder normalize("normalize"s, document_count);
+        for (const std::string& document : corpus.documents) {
+            normalize.Measure([&]() { normalizer.Normalize(document, buffer); });
+        }
+        results.push_back(normalize.Finish());
+        results.back().bytes_per_second = results.back().seconds > 0 ? text_bytes / results.back().seconds : 0.0;
+
+        const std::vector<std::string_view> stop_word_list = SplitIntoWords(std::string_view(corpus.stop_words));
+        const StopWordSet perfect_hash_set(std::vector<std::string>(stop_word_list.begin(), stop_word_list.end()));
+        const std::set<std::string, std::less<>> tree_set(stop_word_list.begin(), stop_word_list.end());
+        std::vector<std::string_view> words;
+        size_t stop_word_count[2] = { 0, 0 };
+        LatencyRecorder perfect_hash("stop_words_perfect_hash"s, document_count);
+        LatencyRecorder tree("stop_words_tree"s, document_count);
+        for (const std::string& document : corpus.documents) {
+            SplitIntoWords(document, words);
+            perfect_hash.Measure([&]() {
+                for (const std::string_view word : words) {
+                    stop_word_count[0] += perfect_hash_set.Contains(word) ? 1 : 0;
+                }
+                }, words.size());
+            tree.Measure([&]() {
+                for (const std::string_view word : words) {
+                    stop_word_count[1] += tree_set.count(word);
+                }
+                }, words.size());
+        }
+        if (stop_word_count[0] != stop_word_count[1]) {
+            std::cerr << "stop word sets disagree: "s << stop_word_count[0] << " and "s << stop_word_count[1] << std::endl;
+        }
+        for (LatencyRecorder* recorder : { &perfect_hash, &tree }) {
+            results.push_back(recorder->Finish());
+            results.back().bytes_per_second = results.back().seconds > 0 ? text_bytes / results.back().seconds : 0.0;
+        }
+    }
+
+    // Reads of random document texts from the compressed store, every read decompressing a block
+    // (no cache) and every read served by the block cache, and the memory saved against plain strings
+    void RunDocumentStore(const BenchmarkCorpus& corpus, int document_count, std::mt19937& generator,
+        std::vector<BenchmarkResult>& results) {
+        DocumentStore uncached(16 * 1024, 0);
+        size_t string_bytes = 0;
+        std::vector<DocumentStore::Location> locations;
+        for (const std::string& document : corpus.documents) {
+            locations.push_back(uncached.Add(document));
+            string_bytes += EstimateAllocationBytes(document.size() + 1);
+        }
+        const DocumentStoreStats stats = uncached.GetStats();
+        std::cerr << "document_store: "s << stats.text_bytes << " text bytes stored in "s << stats.stored_bytes << " bytes, "s
+            << (string_bytes - std::min(string_bytes, uncached.GetAllocatedBytes())) / 1024 << " KiB saved"s << std::endl;
+
+        std::uniform_int_distribution<size_t> random_document(0, locations.size() - 1);
+        LatencyRecorder miss("document_text_miss"s, document_count);
+        size_t text_bytes = 0;
+        for (size_t i = 0; i < corpus.queries.size(); ++i) {
+            const DocumentStore::Location location = locations[random_document(generator)];
+            miss.Measure([&]() { text_bytes += uncached.Get(location).size(); });
+        }
+        results.push_back(miss.Finish());
+        results.back().bytes_per_second = results.back().seconds > 0 ? text_bytes / results.back().seconds : 0.0;
+
+        DocumentStore cached(16 * 1024, stats.blocks + 1);
+        for (const std::string& document : corpus.documents) {
+            cached.Add(document);
+        }
+        for (const DocumentStore::Location location : locations) {
+            cached.Get(location);
+        }
+        LatencyRecorder hit("document_text_hit"s, document_count);
+        text_bytes = 0;
+        for (size_t i = 0; i < corpus.queries.size(); ++i) {
+            const DocumentStore::Location location = locations[random_document(generator)];
+            hit.Measure([&]() { text_bytes += cached.Get(location).size(); });
+        }
+        results.push_back(hit.Finish());
+        results.back().bytes_per_second = results.back().seconds > 0 ? text_bytes / results.back().seconds : 0.0;
+    }
+
+    // Top documents of the compiled-in score precision against relevance recomputed in double from the
+    // corpus texts for a sample of the queries: the ranks must agree up to ties within EPSILON
+    void CheckScorePrecision(const SearchServer& search_server, const BenchmarkCorpus& corpus) {
+        const size_t sample_count = std::min<size_t>(corpus.queries.size(), 50);
+        // the forward index keeps quantized frequencies, so they are counted again like AddDocument does
+        const std::vector<std::string_view> stop_word_list = SplitIntoWords(std::string_view(corpus.stop_words));
+        const std::set<std::string_view> stop_words(stop_word_list.begin(), stop_word_list.end());
+        const auto count_word_freqs = [&corpus, &stop_words](int id) {
+            std::vector<std::string_view> words;
+            for (const std::string_view word : SplitIntoWords(std::string_view(corpus.documents[id]))) {
+                if (stop_words.count(word) == 0) {
+                    words.push_back(word);
+                }
+            }
+            std::map<std::string_view, double> word_freqs;
+            for (const std::string_view word : words) {
+                word_freqs[word] += 1.0 / words.size();
+            }
+            return word_freqs;
+        };
+        size_t mismatches = 0;
+        double max_error = 0.0;
+        for (size_t i = 0; i < sample_count; ++i) {
+            std::set<std::string_view> plus_words;
+            std::set<std::string_view> minus_words;
+            for (const std::string_view word : SplitIntoWords(std::string_view(corpus.queries[i]))) {
+                if (word[0] == '-') {
+                    minus_words.insert(word.substr(1));
+                }
+                else if (search_server.GetWordDocumentCount(word) > 0) {
+                    plus_words.insert(word);
+                }
+            }
+            std::map<int, double> reference;
+            for (const int id : search_server) {
+                if (search_server.GetDocumentStatus(id) != DocumentStatus::ACTUAL) {
+                    continue;
+                }
+                const std::map<std::string_view, double> word_freqs = count_word_freqs(id);
+                if (std::any_of(minus_words.begin(), minus_words.end(), [&word_freqs](const std::string_view word) { return word_freqs.count(word) > 0; })) {
+                    continue;
+                }
+                double relevance = 0.0;
+                bool matched = false;
+                for (const std::string_view word : plus_words) {
+                    const auto it = word_freqs.find(word);
+                    if (it != word_freqs.end()) {
+                        relevance += it->second * std::log(search_server.GetDocumentCount() * 1.0 / search_server.GetWordDocumentCount(word));
+                        matched = true;
+                    }
+                }
+                if (matched) {
+                    reference[id] = relevance;
+                }
+            }
+            std::vector<Document> expected;
+            for (const auto [id, relevance] : reference) {
+                expected.push_back(Document(id, relevance, search_server.GetDocumentRating(id)));
+            }
+            std::sort(expected.begin(), expected.end(), IsMoreRelevant);
+            const std::vector<Document> found = search_server.FindTopDocuments(corpus.queries[i]);
+            bool mismatch = found.size() != std::min<size_t>(expected.size(), MAX_RESULT_DOCUMENT_COUNT);
+            for (size_t rank = 0; rank < found.size() && !mismatch; ++rank) {
+                const auto it = reference.find(found[rank].id);
+                if (it == reference.end()) {
+                    mismatch = true;
+                    break;
+                }
+                max_error = std::max(max_error, std::abs(found[rank].relevance - it->second));
+                mismatch = std::abs(found[rank].relevance - it->second) >= EPSILON
+                    || std::abs(it->second - expected[rank].relevance) >= EPSILON;
+            }
+            mismatches += mismatch ? 1 : 0;
+        }
+        std::cerr << "score precision "s << SCORE_PRECISION_NAME << " ("s << GetScoreKernelName() << " kernels): "s << mismatches
+            << " of "s << sample_count << " queries differ from double beyond EPSILON, max relevance error "s << max_error << std::endl;
+    }
+
+    // The planned evaluation (auto_execution) and DAAT forced sequential and into 4 parallel ranges,
+    // each checked against search_seq (TAAT) first
+    void RunQueryPlanner(SearchServer& search_server, const BenchmarkCorpus& corpus, int document_count,
+        std::vector<BenchmarkResult>& results) {
+        const QueryPlannerOptions default_options = search_server.GetQueryPlannerOptions();
+        QueryPlannerOptions daat_seq = default_options;
+        daat_seq.strategy = EvaluationStrategy::DOCUMENT_AT_A_TIME;
+        daat_seq.max_threads = 1;
+        QueryPlannerOptions daat_par = daat_seq;
+        daat_par.max_threads = 4;
+        daat_par.parallel_min_postings = 0;
+        const std::vector<std::pair<std::string, QueryPlannerOptions>> variants = {
+            { "search_auto"s, default_options }, { "search_daat"s, daat_seq }, { "search_daat_par"s, daat_par } };
+        for (const auto& [name, options] : variants) {
+            search_server.SetQueryPlannerOptions(options);
+            const QueryPlannerStats stats_before = search_server.GetQueryPlannerStats();
+            for (const std::string& query : corpus.queries) {
+                const auto expected = search_server.FindTopDocuments(std::execution::seq, query);
+                const auto found = search_server.FindTopDocuments(auto_execution, query);
+                if (!std::equal(expected.begin(), expected.end(), found.begin(), found.end(),
+                    [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; })) {
+                    std::cerr << name << " differs from search_seq for "s << query << std::endl;
+                }
+            }
+            LatencyRecorder search(name, document_count);
+            for (const std::string& query : corpus.queries) {
+                search.Measure([&]() { return search_server.FindTopDocuments(auto_execution, query); });
+            }
+            results.push_back(search.Finish());
+            const QueryPlannerStats stats = search_server.GetQueryPlannerStats();
+            std::cerr << name << ": plans taat_seq "s << stats.taat_seq - stats_before.taat_seq << ", taat_par "s
+                << stats.taat_par - stats_before.taat_par << ", daat_seq "s << stats.daat_seq - stats_before.daat_seq
+                << ", daat_par "s << stats.daat_par - stats_before.daat_par << std::endl;
+        }
+        search_server.SetQueryPlannerOptions(default_options);
+    }
+
+    // Data TLB misses of the scopes of stage over every thread, nullopt where not counted
+    std::optional<uint64_t> SumStageDtlbMisses(const std::vector<ThreadStageProfile>& profiles, ProfileStage stage) {
+        uint64_t misses = 0;
+        bool available = false;
+        for (const ThreadStageProfile& profile : profiles) {
+            available = available || profile.available[static_cast<size_t>(ProfileCounter::DTLB_MISSES)];
+            misses += profile.stages[static_cast<size_t>(stage)].counters[static_cast<size_t>(ProfileCounter::DTLB_MISSES)];
+        }
+        return available ? std::optional<uint64_t>(misses) : std::nullopt;
+    }
+
+    // search_context with the document columns and query buffers in huge pages or not and with
+    // posting prefetching or not: latency, then data TLB misses per query in a profiled pass
+    void RunMemoryLayout(SearchServer& search_server, const BenchmarkCorpus& corpus, int document_count,
+        std::vector<BenchmarkResult>& results) {
+        const HugePageMode default_mode = GetHugePageMode();
+        const size_t default_distance = search_server.GetPrefetchDistance();
+        const bool profiling = IsStageProfilingEnabled();
+        for (const HugePageMode mode : { HugePageMode::OFF, HugePageMode::TRANSPARENT }) {
+            if (!SetHugePageMode(mode)) {
+                std::cerr << "memory_layout: huge pages "s << GetHugePageModeName(mode) << " not supported"s << std::endl;
+                continue;
+            }
+            search_server.ReallocateIndexMemory();
+            for (const size_t distance : { size_t{ 0 }, DEFAULT_PREFETCH_DISTANCE }) {
+                search_server.SetPrefetchDistance(distance);
+                QueryContext context;
+                std::vector<Document> context_result;
+                const std::string name = "search_context_"s + GetHugePageModeName(mode) + "_pages_prefetch_"s + std::to_string(distance);
+                LatencyRecorder search(name, document_count);
+                for (const std::string& query : corpus.queries) {
+                    search.Measure([&]() { search_server.FindTopDocuments(context, query, context_result); });
+                }
+                results.push_back(search.Finish());
+
+                EnableStageProfiling(true);
+                const auto before = SumStageDtlbMisses(GetStageProfiles(), ProfileStage::SCORE_CONTEXT);
+                for (const std::string& query : corpus.queries) {
+                    search_server.FindTopDocuments(context, query, context_result);
+                }
+                const auto after = SumStageDtlbMisses(GetStageProfiles(), ProfileStage::SCORE_CONTEXT);
+                EnableStageProfiling(profiling);
+                std::cerr << name << ": dTLB misses per query "s;
+                if (before && after) {
+                    std::cerr << static_cast<double>(*after - *before) / corpus.queries.size() << std::endl;
+                }
+                else {
+                    std::cerr << "n/a"s << std::endl;
+                }
+            }
+        }
+        const HugePageStats stats = GetHugePageStats();
+        std::cerr << "memory_layout: "s << stats.mapped_bytes / 1024 << " KiB in huge page mappings, "s << stats.transparent_mappings
+            << " transparent and "s << stats.explicit_mappings << " explicit mappings made"s << std::endl;
+        SetHugePageMode(default_mode);
+        search_server.ReallocateIndexMemory();
+        search_server.SetPrefetchDistance(default_distance);
+    }
+
+    // Hit counts with facets: exact sequential and parallel, estimated from a quarter of the
+    // ordinal space, and with the top documents in the same pass (checked against search_seq)
+    void RunFacets(const SearchServer& search_server, const BenchmarkCorpus& corpus, int document_count,
+        std::vector<BenchmarkResult>& results) {
+        FacetOptions estimated_options;
+        estimated_options.sample_fraction = 0.25;
+        double estimate_error = 0.0;
+        size_t counted_queries = 0;
+        for (const std::string& query : corpus.queries) {
+            const FacetCounts exact = search_server.CountDocuments(query);
+            const FacetCounts parallel = search_server.CountDocuments(std::execution::par, query);
+            if (exact.total_hits != parallel.total_hits || exact.by_status != parallel.by_status || exact.by_rating != parallel.by_rating) {
+                std::cerr << "facets_par differs from facets for "s << query << std::endl;
+            }
+            const auto expected = search_server.FindTopDocuments(std::execution::seq, query);
+            const FacetedSearchResult found = search_server.FindTopDocumentsWithFacets(std::execution::seq, query);
+            if (found.facets.total_hits != exact.total_hits || !std::equal(expected.begin(), expected.end(), found.documents.begin(), found.documents.end(),
+                [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; })) {
+                std::cerr << "search_with_facets differs from search_seq for "s << query << std::endl;
+            }
+            if (exact.total_hits > 0) {
+                const FacetCounts estimate = search_server.CountDocuments(query, estimated_options);
+                estimate_error += std::abs(static_cast<double>(estimate.total_hits) - exact.total_hits) / exact.total_hits;
+                ++counted_queries;
+            }
+        }
+        std::cerr << "facets_estimated: mean relative hit count error "s << (counted_queries > 0 ? estimate_error / counted_queries : 0.0) << std::endl;
+
+        LatencyRecorder facets("facets"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            facets.Measure([&]() { return search_server.CountDocuments(query); });
+        }
+        results.push_back(facets.Finish());
+        LatencyRecorder facets_par("facets_par"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            facets_par.Measure([&]() { return search_server.CountDocuments(std::execution::par, query); });
+        }
+        results.push_back(facets_par.Finish());
+        LatencyRecorder facets_estimated("facets_estimated"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            facets_estimated.Measure([&]() { return search_server.CountDocuments(query, estimated_options); });
+        }
+        results.push_back(facets_estimated.Finish());
+        LatencyRecorder search_with_facets("search_with_facets"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            search_with_facets.Measure([&]() { return search_server.FindTopDocumentsWithFacets(std::execution::seq, query); });
+        }
+        results.push_back(search_with_facets.Finish());
+    }
+
+    void RunScale(const BenchmarkConfig& config, int document_count, std::vector<BenchmarkResult>& results) {
+        const BenchmarkCorpus corpus = GenerateZipfCorpus(config, document_count);
+        std::mt19937 generator(config.seed + document_count);
+        SearchServer search_server(corpus.stop_words);
+
+        LatencyRecorder add("add"s, document_count);
+        for (int id = 0; id < document_count; ++id) {
+            add.Measure([&]() { search_server.AddDocument(id, corpus.documents[id], DocumentStatus::ACTUAL, { id % 10, 5 }); });
+        }
+        results.push_back(add.Finish());
+
+        RunTextProcessing(corpus, document_count, results);
+
+        LatencyRecorder search_seq("search_seq"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            search_seq.Measure([&]() { return search_server.FindTopDocuments(std::execution::seq, query); });
+        }
+        results.push_back(search_seq.Finish());
+        CheckScorePrecision(search_server, corpus);
+
+        // steady state: the context buffers have grown during a first pass, which also checks the results
+        QueryContext context;
+        std::vector<Document> context_result;
+        for (const std::string& query : corpus.queries) {
+            search_server.FindTopDocuments(context, query, context_result);
+            const auto expected = search_server.FindTopDocuments(std::execution::seq, query);
+            if (!std::equal(expected.begin(), expected.end(), context_result.begin(), context_result.end(),
+                [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; })) {
+                std::cerr << "search_context differs from search_seq for "s << query << std::endl;
+            }
+        }
+        LatencyRecorder search_context("search_context"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            search_context.Measure([&]() { search_server.FindTopDocuments(context, query, context_result); });
+        }
+        results.push_back(search_context.Finish());
+        RunMemoryLayout(search_server, corpus, document_count, results);
+
+        // the same queries with a work budget: pathological ones stop early with partial results
+        const QueryBudget budget{ std::chrono::steady_clock::time_point::max(),
+            static_cast<uint64_t>(config.budget_postings_per_document * document_count) };
+        const QueryBudgetStats budget_stats_before = search_server.GetQueryBudgetStats();
+        LatencyRecorder search_budget("search_budget"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            search_budget.Measure([&]() { search_server.FindTopDocuments(context, budget, query, context_result); });
+        }
+        results.push_back(search_budget.Finish());
+        const QueryBudgetStats budget_stats = search_server.GetQueryBudgetStats();
+        std::cerr << "search_budget: "s << budget_stats.postings_exhausted - budget_stats_before.postings_exhausted << " of "s
+            << corpus.queries.size() << " queries partial"s << std::endl;
+
+        LatencyRecorder search_par("search_par"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            search_par.Measure([&]() { return search_server.FindTopDocuments(std::execution::par, query); });
+        }
+        results.push_back(search_par.Finish());
+
+        RunQueryPlanner(search_server, corpus, document_count, results);
+        RunFacets(search_server, corpus, document_count, results);
+
+        LatencyRecorder match("match"s, document_count);
+        std::uniform_int_distribution<int> random_id(0, document_count - 1);
+        for (const std::string& query : corpus.queries) {
+            const int id = random_id(generator);
+            match.Measure([&]() { return search_server.MatchDocument(query, id); });
+        }
+        results.push_back(match.Finish());
+
+        // the term lists rebuilt from the document texts instead of the forward index
+        const size_t forward_index_bytes = search_server.GetIndexStatistics(0).memory.forward_index;
+        search_server.DisableForwardIndex();
+        std::cerr << "forward_index: "s << (forward_index_bytes - search_server.GetIndexStatistics(0).memory.forward_index) / 1024
+            << " KiB of term arrays dropped"s << std::endl;
+        LatencyRecorder match_rebuilt("match_no_forward_index"s, document_count);
+        for (const std::string& query : corpus.queries) {
+            const int id = random_id(generator);
+            match_rebuilt.Measure([&]() { return search_server.MatchDocument(query, id); });
+        }
+        results.push_back(match_rebuilt.Finish());
+        search_server.EnableForwardIndex();
+
+        RunDocumentStore(corpus, document_count, generator, results);
+
+        // in-place metadata updates, every document is banned and then restored
+        LatencyRecorder set_status("set_status"s, document_count);
+        for (size_t i = 0; i < corpus.queries.size(); ++i) {
+            const int id = random_id(generator);
+            set_status.Measure([&]() { search_server.SetDocumentStatus(id, DocumentStatus::BANNED); });
+            set_status.Measure([&]() { search_server.SetDocumentStatus(id, DocumentStatus::ACTUAL); });
+        }
+        results.push_back(set_status.Finish());
+
+        // one sample per batch, in per-query nanoseconds
+        LatencyRecorder process_queries("process_queries"s, document_count);
+        for (size_t begin = 0; begin < corpus.queries.size(); begin += PROCESS_QUERIES_BATCH) {
+            const size_t end = std::min(begin + PROCESS_QUERIES_BATCH, corpus.queries.size());
+            const std::vector<std::string> batch(corpus.queries.begin() + begin, corpus.queries.begin() + end);
+            process_queries.Measure([&]() { return ProcessQueries(search_server, batch); }, batch.size());
+        }
+        results.push_back(process_queries.Finish());
+
+        // the same batches with one shared posting list scan per term, checked against the per-query path
+        const BatchQueryEvaluator batch_evaluator(search_server);
+        LatencyRecorder process_queries_shared("process_queries_shared"s, document_count);
+        for (size_t begin = 0; begin < corpus.queries.size(); begin += PROCESS_QUERIES_BATCH) {
+            const size_t end = std::min(begin + PROCESS_QUERIES_BATCH, corpus.queries.size());
+            const std::vector<std::string_view> batch(corpus.queries.begin() + begin, corpus.queries.begin() + end);
+            std::vector<std::vector<Document>> shared_results;
+            process_queries_shared.Measure([&]() { shared_results = batch_evaluator.FindTopDocuments(batch); }, batch.size());
+            const auto expected = ProcessQueries(search_server, batch);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (!std::equal(expected[i].begin(), expected[i].end(), shared_results[i].begin(), shared_results[i].end(),
+                    [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; })) {
+                    std::cerr << "process_queries_shared differs from process_queries for "s << batch[i] << std::endl;
+                }
+            }
+        }
+        results.push_back(process_queries_shared.Finish());
+        const BatchQueryStats batch_stats = batch_evaluator.GetStats();
+        std::cerr << "process_queries_shared: "s << batch_stats.term_references << " query terms scanned as "s
+            << batch_stats.posting_scans << " posting lists"s << std::endl;
+
+        // the same batches on pinned workers over per-node replicas, replicated even on one node
+        NumaReplicaOptions replica_options;
+        replica_options.replicate_single_node = true;
+        const auto replicas_start = std::chrono::steady_clock::now();
+        const NumaReplicatedIndex replicated_index(search_server,
+            [&corpus]() { return std::make_unique<SearchServer>(corpus.stop_words); }, replica_options);
+        std::cerr << "numa_replicas: "s << replicated_index.GetNodes().size() << " nodes, replicas built in "s
+            << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - replicas_start).count()
+            << " ms"s << std::endl;
+        LatencyRecorder process_queries_numa("process_queries_numa"s, document_count);
+        for (size_t begin = 0; begin < corpus.queries.size(); begin += PROCESS_QUERIES_BATCH) {
+            const size_t end = std::min(begin + PROCESS_QUERIES_BATCH, corpus.queries.size());
+            const std::vector<std::string> batch(corpus.queries.begin() + begin, corpus.queries.begin() + end);
+            std::vector<std::vector<Document>> replica_results;
+            process_queries_numa.Measure([&]() { replica_results = replicated_index.ProcessQueries(batch); }, batch.size());
+            const auto expected = ProcessQueries(search_server, batch);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (!std::equal(expected[i].begin(), expected[i].end(), replica_results[i].begin(), replica_results[i].end(),
+                    [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; })) {
+                    std::cerr << "process_queries_numa differs from process_queries for "s << batch[i] << std::endl;
+                }
+            }
+        }
+        results.push_back(process_queries_numa.Finish());
+        const NumaReplicaStats replica_stats = replicated_index.GetStats();
+        std::cerr << "process_queries_numa: queries by node"s;
+        for (const uint64_t queries : replica_stats.queries_by_node) {
+            std::cerr << ' ' << queries;
+        }
+        std::cerr << ", "s << replica_stats.pinned_workers << " workers pinned, "s << replica_stats.unpinned_workers << " not"s << std::endl;
+
+        const int duplicate_count = static_cast<int>(document_count * config.duplicate_share);
+        for (int i = 0; i < duplicate_count; ++i) {
+            search_server.AddDocument(document_count + i, corpus.documents[random_id(generator)], DocumentStatus::ACTUAL, { 1 });
+        }
+        LatencyRecorder dedup("dedup"s, document_count);
+        {
+            // RemoveDuplicates reports every removed document
+            std::ostringstream sink;
+            std::streambuf* const old_buffer = std::cout.rdbuf(sink.rdbuf());
+            dedup.Measure([&]() { RemoveDuplicates(search_server); }, document_count + duplicate_count);
+            std::cout.rdbuf(old_buffer);
+        }
+        results.push_back(dedup.Finish());
+
+        LatencyRecorder remove("remove"s, document_count);
+        const std::vector<int> ids(search_server.begin(), search_server.end());
+        for (const int id : ids) {
+            remove.Measure([&]() { search_server.RemoveDocument(id); });
+        }
+        results.push_back(remove.Finish());
+    }
+
+    void AppendJsonNumber(std::ostringstream& out, const char* key, double value, bool last = false) {
+        out << "\""s << key << "\": "s << value << (last ? ""s : ", "s);
+    }
+
+    // Value of "key": in a flat object, empty if missing
+    std::string FindJsonValue(const std::string& object, const std::string& key) {
+        const size_t key_pos = object.find("\""s + key + "\""s);
+        if (key_pos == std::string::npos) {
+            return {};
+        }
+        size_t pos = object.find(':', key_pos);
+        if (pos == std::string::npos) {
+            throw std::invalid_argument("Error: malformed benchmark JSON."s);
+        }
+        pos = object.find_first_not_of(" \t\r\n"s, pos + 1);
+        if (pos != std::string::npos && object[pos] == '"') {
+            const size_t end = object.find('"', pos + 1);
+            return object.substr(pos + 1, end - pos - 1);
+        }
+        const size_t end = object.find_first_of(",}\r\n"s, pos);
+        return object.substr(pos, end - pos);
+    }
+
+    double ParseJsonNumber(const std::string& object, const std::string& key) {
+        const std::string value = FindJsonValue(object, key);
+        return value.empty() ? 0.0 : std::stod(value);
+    }
+
+}  // namespace
+
+ZipfDistribution::ZipfDistribution(size_t n, double exponent) {
+    if (n == 0) {
+        throw std::invalid_argument("Error: Zipf distribution needs at least one rank."s);
+    }
+    cdf_.reserve(n);
+    double sum = 0.0;
+    for (size_t rank = 1; rank <= n; ++rank) {
+        sum += 1.0 / std::pow(static_cast<double>(rank), exponent);
+        cdf_.push_back(sum);
+    }
+}
+
+BenchmarkCorpus GenerateZipfCorpus(const BenchmarkConfig& config, int document_count) {
+    std::mt19937 generator(config.seed);
+    BenchmarkCorpus corpus;
+
+    std::set<std::string> used;
+    while (static_cast<int>(corpus.dictionary.size()) < config.dictionary_size) {
+        // short words are frequent, as in natural languages
+        const int max_length = 3 + static_cast<int>(corpus.dictionary.size() * 9 / config.dictionary_size);
+        std::string word(std::uniform_int_distribution(2, max_length)(generator), 'a');
+        for (char& c : word) {
+            c = static_cast<char>(std::uniform_int_distribution('a' + 0, 'z' + 0)(generator));
+        }
+        if (used.insert(word).second) {
+            corpus.dictionary.push_back(std::move(word));
+        }
+    }
+    for (int i = 0; i < std::min(config.stop_word_count, config.dictionary_size); ++i) {
+        corpus.stop_words += (i > 0 ? " "s : ""s) + corpus.dictionary[i];
+    }
+
+    const ZipfDistribution zipf(corpus.dictionary.size(), config.zipf_exponent);
+    std::uniform_int_distribution<int> document_length(std::max(1, config.words_per_document / 2),
+        std::max(1, config.words_per_document * 3 / 2));
+    corpus.documents.reserve(document_count);
+    for (int i = 0; i < document_count; ++i) {
+        corpus.documents.push_back(GenerateZipfText(generator, zipf, corpus.dictionary, document_length(generator), 0.0));
+    }
+    corpus.queries.reserve(config.query_count);
+    for (int i = 0; i < config.query_count; ++i) {
+        corpus.queries.push_back(GenerateZipfText(generator, zipf, corpus.dictionary, config.words_per_query,
+            config.minus_word_probability));
+    }
+    return corpus;
+}
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config) {
+    std::vector<BenchmarkResult> results;
+    for (const int document_count : config.scales) {
+        if (document_count <= 0) {
+            throw std::invalid_argument("Error: benchmark scale must be positive."s);
+        }
+        RunScale(config, document_count, results);
+    }
+    const auto map_results = RunConcurrentMapScaling(config);
+    results.insert(results.end(), map_results.begin(), map_results.end());
+    const auto wal_results = RunWalBenchmarks(config);
+    results.insert(results.end(), wal_results.begin(), wal_results.end());
+    return results;
+}
+
+std::vector<BenchmarkResult> RunConcurrentMapScaling(const BenchmarkConfig& config) {
+    std::mt19937 generator(config.seed);
+    std::vector<std::string> keys;
+    keys.reserve(config.map_key_count);
+    for (int i = 0; i < config.map_key_count; ++i) {
+        keys.push_back("term"s + std::to_string(i));
+    }
+    const ZipfDistribution zipf(keys.size(), config.zipf_exponent);
+    std::vector<uint32_t> key_sequence(config.map_operations);
+    for (uint32_t& key : key_sequence) {
+        key = static_cast<uint32_t>(zipf(generator));
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const int thread_count : config.map_thread_counts) {
+        if (thread_count <= 0) {
+            throw std::invalid_argument("Error: thread count must be positive."s);
+        }
+        ResetPeakRss();
+        ConcurrentMap<std::string, uint64_t> counts(keys.size());
+        std::vector<std::vector<double>> thread_latencies(thread_count);
+        const auto start_time = Clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t]() {
+                const size_t begin = key_sequence.size() * t / thread_count;
+                const size_t end = key_sequence.size() * (t + 1) / thread_count;
+                for (size_t batch = begin; batch < end; batch += MAP_UPDATE_BATCH) {
+                    const auto batch_start = Clock::now();
+                    const size_t batch_end = std::min(batch + MAP_UPDATE_BATCH, end);
+                    for (size_t i = batch; i < batch_end; ++i) {
+                        counts.Update(std::string_view(keys[key_sequence[i]]), [](uint64_t& count) { ++count; });
+                    }
+                    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - batch_start).count();
+                    thread_latencies[t].push_back(elapsed / static_cast<double>(batch_end - batch));
+                }
+                });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+        std::vector<double> latencies;
+        for (const auto& thread_latency : thread_latencies) {
+            latencies.insert(latencies.end(), thread_latency.begin(), thread_latency.end());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&latencies](double p) {
+            return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+        };
+        BenchmarkResult result;
+        result.name = "concurrent_map_t"s + std::to_string(thread_count);
+        result.documents = config.map_key_count;
+        result.operations = key_sequence.size();
+        result.seconds = seconds;
+        result.ops_per_second = seconds > 0 ? key_sequence.size() / seconds : 0.0;
+        result.p50_ns = percentile(0.5);
+        result.p99_ns = percentile(0.99);
+        result.p999_ns = percentile(0.999);
+        result.peak_rss_kb = GetPeakRssKb();
+        results.push_back(result);
+    }
+    return results;
+}
+
+std::vector<BenchmarkResult> RunWalBenchmarks(const BenchmarkConfig& config) {
+    std::vector<BenchmarkResult> results;
+    if (config.wal_writer_counts.empty() || config.wal_operations <= 0) {
+        return results;
+    }
+    const BenchmarkCorpus corpus = GenerateZipfCorpus(config, config.wal_operations);
+    const std::filesystem::path directory = config.wal_directory.empty()
+        ? std::filesystem::temp_directory_path() : std::filesystem::path(config.wal_directory);
+    std::filesystem::create_directories(directory);
+    const std::string log_path = (directory / ("y_cpp_my_bench_"s + std::to_string(config.seed) + ".wal"s)).string();
+
+    for (const int writer_count : config.wal_writer_counts) {
+        if (writer_count <= 0) {
+            throw std::invalid_argument("Error: thread count must be positive."s);
+        }
+        std::filesystem::remove(log_path);
+        ResetPeakRss();
+        SearchServer search_server(corpus.stop_words);
+        std::shared_mutex index_mutex;
+        WriteAheadLog log(log_path);
+        // the QueryServer update path: apply and log under the index lock, wait for the sync without it
+        std::vector<std::vector<double>> thread_latencies(writer_count);
+        const auto start_time = Clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < writer_count; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int id = t; id < config.wal_operations; id += writer_count) {
+                    const auto update_start = Clock::now();
+                    std::unique_lock lock(index_mutex);
+                    search_server.AddDocument(id, corpus.documents[id], DocumentStatus::ACTUAL, { id % 10, 5 });
+                    const uint64_t sequence = log.AppendAdd(id, corpus.documents[id], DocumentStatus::ACTUAL, { id % 10, 5 });
+                    lock.unlock();
+                    log.WaitDurable(sequence);
+                    thread_latencies[t].push_back(static_cast<double>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - update_start).count()));
+                }
+                });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+        std::vector<double> latencies;
+        for (const auto& thread_latency : thread_latencies) {
+            latencies.insert(latencies.end(), thread_latency.begin(), thread_latency.end());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&latencies](double p) {
+            return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+        };
+        BenchmarkResult result;
+        result.name = "wal_add_t"s + std::to_string(writer_count);
+        result.documents = config.wal_operations;
+        result.operations = config.wal_operations;
+        result.seconds = seconds;
+        result.ops_per_second = seconds > 0 ? config.wal_operations / seconds : 0.0;
+        result.p50_ns = percentile(0.5);
+        result.p99_ns = percentile(0.99);
+        result.p999_ns = percentile(0.999);
+        result.peak_rss_kb = GetPeakRssKb();
+        results.push_back(result);
+        const WalStats stats = log.GetStats();
+        std::cerr << result.name << ": "s << stats.records << " records in "s << stats.commits << " syncs"s << std::endl;
+    }
+
+    // the log of the last run holds every document
+    LatencyRecorder replay("wal_replay"s, config.wal_operations);
+    {
+        SearchServer search_server(corpus.stop_words);
+        replay.Measure([&]() { RecoverSearchServer(search_server, log_path + ".snapshot"s, log_path); }, config.wal_operations);
+        if (search_server.GetDocumentCount() != config.wal_operations) {
+            std::cerr << "wal_replay recovered "s << search_server.GetDocumentCount() << " documents"s << std::endl;
+        }
+    }
+    results.push_back(replay.Finish());
+    std::filesystem::remove(log_path);
+    return results;
+}
+
+std::string BenchmarksToJson(const std::vector<BenchmarkResult>& results) {
+    std::ostringstream out;
+    out.precision(10);
+    out << "{\n  \"benchmarks\": [\n"s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        out << "    {\"name\": \""s << result.name << "\", "s;
+        AppendJsonNumber(out, "documents", result.documents);
+        AppendJsonNumber(out, "operations", static_cast<double>(result.operations));
+        AppendJsonNumber(out, "seconds", result.seconds);
+        AppendJsonNumber(out, "ops_per_second", result.ops_per_second);
+        AppendJsonNumber(out, "p50_ns", result.p50_ns);
+        AppendJsonNumber(out, "p99_ns", result.p99_ns);
+        AppendJsonNumber(out, "p999_ns", result.p999_ns);
+        AppendJsonNumber(out, "peak_rss_kb", static_cast<double>(result.peak_rss_kb));
+        AppendJsonNumber(out, "allocations_per_op", result.allocations_per_op);
+        AppendJsonNumber(out, "bytes_per_second", result.bytes_per_second, true);
+        out << "}"s << (i + 1 < results.size() ? ","s : ""s) << "\n"s;
+    }
+    out << "  ]\n}\n"s;
+    return out.str();
+}
+
+std::vector<BenchmarkResult> BenchmarksFromJson(const std::string& json) {
+    const size_t array_pos = json.find("\"benchmarks\""s);
+    if (array_pos == std::string::npos) {
+        throw std::invalid_argument("Error: no benchmarks in JSON."s);
+    }
+    std::vector<BenchmarkResult> results;
+    for (size_t begin = json.find('{', array_pos); begin != std::string::npos; begin = json.find('{', begin + 1)) {
+        const size_t end = json.find('}', begin);
+        if (end == std::string::npos) {
+            throw std::invalid_argument("Error: malformed benchmark JSON."s);
+        }
+        const std::string object = json.substr(begin, end - begin + 1);
+        BenchmarkResult result;
+        result.name = FindJsonValue(object, "name"s);
+        result.documents = static_cast<int>(ParseJsonNumber(object, "documents"s));
+        result.operations = static_cast<uint64_t>(ParseJsonNumber(object, "operations"s));
+        result.seconds = ParseJsonNumber(object, "seconds"s);
+        result.ops_per_second = ParseJsonNumber(object, "ops_per_second"s);
+        result.p50_ns = ParseJsonNumber(object, "p50_ns"s);
+        result.p99_ns = ParseJsonNumber(object, "p99_ns"s);
+        result.p999_ns = ParseJsonNumber(object, "p999_ns"s);
+        result.peak_rss_kb = static_cast<uint64_t>(ParseJsonNumber(object, "peak_rss_kb"s));
+        result.allocations_per_op = ParseJsonNumber(object, "allocations_per_op"s);
+        result.bytes_per_second = ParseJsonNumber(object, "bytes_per_second"s);
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+std::vector<BenchmarkRegression> FindRegressions(const std::vector<BenchmarkResult>& baseline,
+    const std::vector<BenchmarkResult>& current, double tolerance) {
+    std::map<std::pair<std::string, int>, const BenchmarkResult*> baseline_by_key;
+    for (const BenchmarkResult& result : baseline) {
+        baseline_by_key[{ result.name, result.documents }] = &result;
+    }
+    std::vector<BenchmarkRegression> regressions;
+    for (const BenchmarkResult& result : current) {
+        const auto it = baseline_by_key.find({ result.name, result.documents });
+        if (it == baseline_by_key.end()) {
+            continue;
+        }
+        const BenchmarkResult& old = *it->second;
+        if (result.ops_per_second < old.ops_per_second * (1.0 - tolerance)) {
+            regressions.push_back({ result.name, result.documents, "ops_per_second"s, old.ops_per_second, result.ops_per_second });
+        }
+        if (result.p99_ns > old.p99_ns * (1.0 + tolerance)) {
+            regressions.push_back({ result.name, result.documents, "p99_ns"s, old.p99_ns, result.p99_ns });
+        }
+        // zero stays zero
+        if (result.allocations_per_op > old.allocations_per_op * (1.0 + tolerance) + 0.01) {
+            regressions.push_back({ result.name, result.documents, "allocations_per_op"s, old.allocations_per_op, result.allocations_per_op });
+        }
+    }
+    return regressions;
+}
+
+uint64_t GetPeakRssKb() {
+#if defined(__linux__)
+    // VmHWM follows clear_refs resets, ru_maxrss does not
+    std::ifstream status("/proc/self/status"s);
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:"s) == 0) {
+            return std::stoull(line.substr(6));
+        }
+    }
+#endif
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize / 1024;
+    }
+    return 0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+bool ResetPeakRss() {
+#if defined(__linux__)
+    std::ofstream clear_refs("/proc/self/clear_refs"s);
+    clear_refs << "5"s;
+    clear_refs.flush();
+    return static_cast<bool>(clear_refs);
+#else
+    return false;
+#endif
+}
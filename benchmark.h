@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Reproducible benchmark suite: Zipf-distributed corpora and queries at several scales,
+// per-operation latencies, throughput and peak RSS, JSON output and baseline comparison.
+
+struct BenchmarkConfig {
+    std::vector<int> scales = { 10'000, 100'000 };    // document counts
+    int query_count = 1'000;
+    int dictionary_size = 50'000;
+    int words_per_document = 70;    // mean, lengths vary by +-50%
+    int words_per_query = 5;
+    int stop_word_count = 8;    // the most frequent words
+    double minus_word_probability = 0.1;
+    double duplicate_share = 0.01;    // documents re-added under new ids for the dedup run
+    double zipf_exponent = 1.0;
+    uint32_t seed = 42;
+    // search_budget: posting entries a query may scan, per indexed document
+    double budget_postings_per_document = 1.0;
+    // ConcurrentMap scaling: Zipf-distributed term updates split over every thread count
+    std::vector<int> map_thread_counts = { 1, 2, 4, 8, 16, 32, 64 };
+    int map_operations = 2'000'000;
+    int map_key_count = 100'000;
+    // Durable updates: writer threads add documents through a WriteAheadLog in wal_directory
+    // (the temporary directory if empty), then the log is replayed
+    std::vector<int> wal_writer_counts = { 1, 8, 32 };
+    int wal_operations = 20'000;
+    std::string wal_directory;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    int documents = 0;
+    uint64_t operations = 0;
+    double seconds = 0.0;
+    double ops_per_second = 0.0;
+    double p50_ns = 0.0;
+    double p99_ns = 0.0;
+    double p999_ns = 0.0;
+    uint64_t peak_rss_kb = 0;    // process RSS peak during the benchmark (since the start where ResetPeakRss fails)
+    double allocations_per_op = 0.0;    // operator new calls of the measured thread, 0 without COUNT_ALLOCATIONS
+    double bytes_per_second = 0.0;    // input text throughput of the text processing benchmarks
+};
+
+struct BenchmarkRegression {
+    std::string name;
+    int documents = 0;
+    std::string metric;
+    double baseline = 0.0;
+    double current = 0.0;
+};
+
+// Samples ranks 0..n-1 with probability proportional to 1 / (rank + 1)^exponent
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t n, double exponent);
+
+    template <typename Generator>
+    size_t operator()(Generator& generator) const;
+
+private:
+    std::vector<double> cdf_;
+};
+
+struct BenchmarkCorpus {
+    std::vector<std::string> dictionary;    // by rank, the first one is the most frequent
+    std::string stop_words;
+    std::vector<std::string> documents;
+    std::vector<std::string> queries;
+};
+
+BenchmarkCorpus GenerateZipfCorpus(const BenchmarkConfig& config, int document_count);
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config);
+// Results are named concurrent_map_t<threads>, documents holds the key count
+std::vector<BenchmarkResult> RunConcurrentMapScaling(const BenchmarkConfig& config);
+// Results are named wal_add_t<writers> and wal_replay, documents holds the update count
+std::vector<BenchmarkResult> RunWalBenchmarks(const BenchmarkConfig& config);
+
+std::string BenchmarksToJson(const std::vector<BenchmarkResult>& results);
+// Reads the output of BenchmarksToJson, throws std::invalid_argument on malformed input
+std::vector<BenchmarkResult> BenchmarksFromJson(const std::string& json);
+
+// Throughput drops, p99 and allocation growth beyond tolerance (0.1 is 10%) of the baseline
+std::vector<BenchmarkRegression> FindRegressions(const std::vector<BenchmarkResult>& baseline,
+    const std::vector<BenchmarkResult>& current, double tolerance);
+
+// Peak RSS of the process since the last successful ResetPeakRss, or since the start
+uint64_t GetPeakRssKb();
+// Resets the peak to the current RSS (Linux /proc/self/clear_refs); false where it cannot
+bool ResetPeakRss();
+
+template <typename Generator>
+size_t ZipfDistribution::operator()(Generator& generator) const {
+    const double value = std::uniform_real_distribution<double>(0.0, cdf_.back())(generator);
+    const auto it = std::upper_bound(cdf_.begin(), cdf_.end(), value);
+    return std::min(static_cast<size_t>(it - cdf_.begin()), cdf_.size() - 1);
+}
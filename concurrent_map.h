@@ -1,48 +1,280 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <functional>
 #include <mutex>
-#include <map>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
-template <typename Key, typename Value>
+// Hash of ConcurrentMap keys; strings hash as string_view, so terms are looked up without a copy
+template <typename Key>
+struct ConcurrentMapHash {
+    size_t operator()(const Key& key) const {
+        return std::hash<Key>{}(key);
+    }
+};
+
+template <>
+struct ConcurrentMapHash<std::string> {
+    size_t operator()(const std::string_view key) const {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+// Concurrent hash map. Keys are spread over stripes by hash; a stripe is an open-addressing
+// table with linear probing under its own lock and grows independently, so operations on
+// different stripes never contend and there is no global rehash. Erase leaves a tombstone.
+template <typename Key, typename Value, typename Hash = ConcurrentMapHash<Key>>
 class ConcurrentMap {
 private:
-    struct Bucket {
+    enum class SlotState : uint8_t {
+        EMPTY,
+        FULL,
+        DELETED,
+    };
+
+    struct Slot {
+        uint64_t hash = 0;
+        SlotState state = SlotState::EMPTY;
+        Key key{};
+        Value value{};
+    };
+
+    struct alignas(64) Stripe {
         std::mutex mutex;
-        std::map<Key, Value> map;
+        std::vector<Slot> slots;    // power of two size or empty
+        size_t size = 0;    // full slots
+        size_t used = 0;    // full and deleted slots
     };
-    std::vector<Bucket> buckets_;
 
-public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+    mutable std::vector<Stripe> stripes_;
+    unsigned stripe_shift_;
+    Hash hasher_;
 
+    static const size_t MIN_STRIPE_CAPACITY = 16;
+
+public:
     struct Access {
         std::lock_guard<std::mutex> guard;
         Value& ref_to_value;
 
-        Access(const Key& key, Bucket& bucket)
-            : guard(bucket.mutex)
-            , ref_to_value(bucket.map[key]) {
+        template <typename K>
+        Access(const K& key, uint64_t hash, Stripe& stripe)
+            : guard(stripe.mutex)
+            , ref_to_value(FindOrInsert(stripe, key, hash)) {
         }
     };
 
-    explicit ConcurrentMap(size_t bucket_count)
-        : buckets_(bucket_count) {
+    // expected_size sizes the stripes up front, stripe_count 0 picks one from the hardware concurrency
+    explicit ConcurrentMap(size_t expected_size = 0, size_t stripe_count = 0)
+        : stripes_(RoundUpToPowerOfTwo(stripe_count > 0 ? stripe_count : std::max<size_t>(16, 8 * std::thread::hardware_concurrency())))
+        , stripe_shift_(64 - Log2(stripes_.size())) {
+        Reserve(expected_size);
+    }
+
+    ConcurrentMap(const ConcurrentMap&) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap&) = delete;
+
+    // Locks the stripe of the key while the Access lives, inserts a default value if absent
+    template <typename K>
+    Access operator[](const K& key) {
+        const uint64_t hash = HashOf(key);
+        return { key, hash, GetStripe(hash) };
+    }
+
+    // Calls update(value&) under the stripe lock, inserts a default value if absent
+    template <typename K, typename Updater>
+    void Update(const K& key, Updater update) {
+        const uint64_t hash = HashOf(key);
+        Stripe& stripe = GetStripe(hash);
+        std::lock_guard guard(stripe.mutex);
+        update(FindOrInsert(stripe, key, hash));
+    }
+
+    template <typename K>
+    std::optional<Value> Find(const K& key) const {
+        const uint64_t hash = HashOf(key);
+        Stripe& stripe = GetStripe(hash);
+        std::lock_guard guard(stripe.mutex);
+        const Slot* slot = FindSlot(stripe, key, hash);
+        return slot ? std::optional<Value>(slot->value) : std::nullopt;
+    }
+
+    // Returns whether the key was present
+    template <typename K>
+    bool erase(const K& key) {
+        const uint64_t hash = HashOf(key);
+        Stripe& stripe = GetStripe(hash);
+        std::lock_guard guard(stripe.mutex);
+        Slot* slot = const_cast<Slot*>(FindSlot(stripe, key, hash));
+        if (!slot) {
+            return false;
+        }
+        slot->state = SlotState::DELETED;
+        slot->key = Key{};
+        --stripe.size;
+        return true;
+    }
+
+    size_t size() const {
+        size_t result = 0;
+        for (Stripe& stripe : stripes_) {
+            std::lock_guard guard(stripe.mutex);
+            result += stripe.size;
+        }
+        return result;
+    }
+
+    // Grows the stripes to hold expected_size entries in total without rehashing
+    void Reserve(size_t expected_size) {
+        const size_t per_stripe = expected_size / stripes_.size() + 1;
+        for (Stripe& stripe : stripes_) {
+            std::lock_guard guard(stripe.mutex);
+            if (expected_size > 0 && CapacityFor(per_stripe) > stripe.slots.size()) {
+                Rehash(stripe, CapacityFor(per_stripe));
+            }
+        }
+    }
+
+    // Calls callback(key, value) for every entry, stripes are visited in parallel under their locks
+    template <typename Policy, typename Callback>
+    void ForEach(const Policy& policy, Callback callback) {
+        std::for_each(policy, stripes_.begin(), stripes_.end(), [&callback](Stripe& stripe) {
+            std::lock_guard guard(stripe.mutex);
+            for (Slot& slot : stripe.slots) {
+                if (slot.state == SlotState::FULL) {
+                    callback(static_cast<const Key&>(slot.key), slot.value);
+                }
+            }
+            });
+    }
+
+    // Moves all entries out in stripe order, stripes are drained in parallel.
+    // Must not run concurrently with other writers.
+    std::vector<std::pair<Key, Value>> DrainToVector() {
+        std::vector<size_t> offsets(stripes_.size() + 1, 0);
+        for (size_t i = 0; i < stripes_.size(); ++i) {
+            offsets[i + 1] = offsets[i] + stripes_[i].size;
+        }
+        std::vector<std::pair<Key, Value>> result(offsets.back());
+        std::vector<size_t> indexes(stripes_.size());
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::for_each(std::execution::par, indexes.begin(), indexes.end(), [this, &offsets, &result](size_t index) {
+            Stripe& stripe = stripes_[index];
+            std::lock_guard guard(stripe.mutex);
+            auto out = result.begin() + offsets[index];
+            for (Slot& slot : stripe.slots) {
+                if (slot.state == SlotState::FULL) {
+                    *out++ = { std::move(slot.key), std::move(slot.value) };
+                }
+            }
+            stripe.slots.clear();
+            stripe.size = 0;
+            stripe.used = 0;
+            });
+        return result;
     }
 
-    Access operator[](const Key& key) {
-        auto& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
-        return { key, bucket };
+private:
+    template <typename K>
+    uint64_t HashOf(const K& key) const {
+        // splitmix64 finalizer: the high bits pick the stripe, the low bits the slot
+        uint64_t x = static_cast<uint64_t>(hasher_(key));
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    Stripe& GetStripe(uint64_t hash) const {
+        return stripes_[stripes_.size() == 1 ? 0 : hash >> stripe_shift_];
+    }
+
+    template <typename K>
+    static const Slot* FindSlot(const Stripe& stripe, const K& key, uint64_t hash) {
+        if (stripe.slots.empty()) {
+            return nullptr;
+        }
+        const size_t mask = stripe.slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& slot = stripe.slots[i];
+            if (slot.state == SlotState::EMPTY) {
+                return nullptr;
+            }
+            if (slot.state == SlotState::FULL && slot.hash == hash && slot.key == key) {
+                return &slot;
+            }
+        }
     }
-    void erase(const Key& key) {
-        buckets_[static_cast<uint64_t>(key) % buckets_.size()].map.erase(key);
+
+    template <typename K>
+    static Value& FindOrInsert(Stripe& stripe, const K& key, uint64_t hash) {
+        if (Slot* slot = const_cast<Slot*>(FindSlot(stripe, key, hash))) {
+            return slot->value;
+        }
+        // keep at most 3/4 of the slots used so probe sequences stay short
+        if ((stripe.used + 1) * 4 > stripe.slots.size() * 3) {
+            Rehash(stripe, CapacityFor(stripe.size + 1));
+        }
+        const size_t mask = stripe.slots.size() - 1;
+        size_t i = hash & mask;
+        while (stripe.slots[i].state == SlotState::FULL) {
+            i = (i + 1) & mask;
+        }
+        Slot& slot = stripe.slots[i];
+        stripe.used += slot.state == SlotState::EMPTY ? 1 : 0;
+        ++stripe.size;
+        slot.hash = hash;
+        slot.state = SlotState::FULL;
+        slot.key = Key(key);
+        slot.value = Value{};
+        return slot.value;
+    }
+
+    static size_t CapacityFor(size_t size) {
+        return RoundUpToPowerOfTwo(std::max(MIN_STRIPE_CAPACITY, size * 2));
+    }
+
+    // Rebuilds the stripe with the capacity, dropping tombstones
+    static void Rehash(Stripe& stripe, size_t capacity) {
+        std::vector<Slot> old_slots(capacity);
+        old_slots.swap(stripe.slots);
+        const size_t mask = capacity - 1;
+        for (Slot& old_slot : old_slots) {
+            if (old_slot.state != SlotState::FULL) {
+                continue;
+            }
+            size_t i = old_slot.hash & mask;
+            while (stripe.slots[i].state == SlotState::FULL) {
+                i = (i + 1) & mask;
+            }
+            stripe.slots[i] = std::move(old_slot);
+        }
+        stripe.used = stripe.size;
+    }
+
+    static size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
     }
 
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> result;
-        for (auto& [mutex, map] : buckets_) {
-            std::lock_guard g(mutex);
-            result.insert(map.begin(), map.end());
+    static unsigned Log2(size_t power_of_two) {
+        unsigned result = 0;
+        while ((size_t{ 1 } << result) < power_of_two) {
+            ++result;
         }
         return result;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "fuzzy_index.h"
+
+#include <functional>
+#include <string_view>
+
+// Corpus-wide counts used to compute inverse document frequency.
+// A SearchServer holding a part of a corpus takes them from its owner to rank like a single index.
+class CorpusStatistics {
+public:
+    virtual ~CorpusStatistics() = default;
+
+    virtual int GetDocumentCount() const = 0;
+    // Number of documents containing the word
+    virtual int GetWordDocumentCount(const std::string_view word) const = 0;
+
+    // Calls callback(word) for the corpus words starting with prefix in lexicographic order while
+    // it returns true. Returns false if the words are not listed here; the index then expands
+    // prefixes over its own terms.
+    virtual bool ForEachWordWithPrefix(const std::string_view /*prefix*/, const std::function<bool(std::string_view)>& /*callback*/) const {
+        return false;
+    }
+    // FuzzyIndex::FindCandidates over the corpus words. Returns false if there is no corpus-wide
+    // fuzzy index; the index then looks up its own terms.
+    virtual bool FindFuzzyCandidates(const std::string_view /*word*/, size_t /*max_count*/, size_t /*max_checked*/,
+        FuzzyIndex::Lookup& /*lookup*/) const {
+        return false;
+    }
+};
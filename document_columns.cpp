@@ -0,0 +1,74 @@
+#include "document_columns.h"
+#include "index_statistics.h"
+
+#include <type_traits>
+
+uint32_t DocumentColumns::Add(int document_id, DocumentStatus status, int rating) {
+    uint32_t ordinal;
+    if (!free_ordinals_.empty()) {
+        ordinal = free_ordinals_.back();
+        free_ordinals_.pop_back();
+        ids_[ordinal] = document_id;
+        ratings_[ordinal].Store(rating);
+        statuses_[ordinal].Store(status);
+    }
+    else {
+        ordinal = static_cast<uint32_t>(ids_.size());
+        ids_.push_back(document_id);
+        ratings_.push_back(rating);
+        statuses_.push_back(status);
+        if (ordinal % 64 == 0) {
+            for (auto& bitmap : status_bitmaps_) {
+                bitmap.push_back(0);
+            }
+        }
+    }
+    status_bitmaps_[static_cast<size_t>(status)][ordinal / 64].SetBits(uint64_t{ 1 } << (ordinal % 64));
+    return ordinal;
+}
+
+void DocumentColumns::Remove(uint32_t ordinal) {
+    status_bitmaps_[static_cast<size_t>(statuses_[ordinal].Load())][ordinal / 64].ClearBits(uint64_t{ 1 } << (ordinal % 64));
+    free_ordinals_.push_back(ordinal);
+}
+
+void DocumentColumns::SetStatus(uint32_t ordinal, DocumentStatus status) {
+    const DocumentStatus old_status = statuses_[ordinal].Load();
+    if (old_status == status) {
+        return;
+    }
+    // the new bit is set first, so a concurrent query sees the document under one of the statuses
+    const uint64_t bit = uint64_t{ 1 } << (ordinal % 64);
+    status_bitmaps_[static_cast<size_t>(status)][ordinal / 64].SetBits(bit);
+    statuses_[ordinal].Store(status);
+    status_bitmaps_[static_cast<size_t>(old_status)][ordinal / 64].ClearBits(bit);
+}
+
+void DocumentColumns::SetRating(uint32_t ordinal, int rating) {
+    ratings_[ordinal].Store(rating);
+}
+
+void DocumentColumns::Reallocate() {
+    const auto reallocate = [](auto& column) {
+        std::remove_reference_t<decltype(column)>(column.begin(), column.end()).swap(column);
+    };
+    reallocate(ids_);
+    reallocate(ratings_);
+    reallocate(statuses_);
+    for (auto& bitmap : status_bitmaps_) {
+        reallocate(bitmap);
+    }
+}
+
+size_t DocumentColumns::GetOrdinalBound() const {
+    return ids_.size();
+}
+
+size_t DocumentColumns::GetAllocatedBytes() const {
+    size_t bytes = EstimateVectorBytes(ids_) + EstimateVectorBytes(ratings_) + EstimateVectorBytes(statuses_)
+        + EstimateVectorBytes(free_ordinals_);
+    for (const auto& bitmap : status_bitmaps_) {
+        bytes += EstimateVectorBytes(bitmap);
+    }
+    return bytes;
+}
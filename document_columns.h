@@ -0,0 +1,97 @@
+#pragma once
+
+#include "document.h"
+#include "huge_page_allocator.h"
+#include "prefetch.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Document metadata in dense columns indexed by an internal ordinal, plus a bitmap of the
+// ordinals of every DocumentStatus. Ordinals of removed documents are reused.
+// Status and rating cells are relaxed atomics: SetStatus and SetRating may run while queries
+// read the columns, Add and Remove may not. The columns are allocated with IndexAllocator.
+class DocumentColumns {
+public:
+    static const size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    // Returns the ordinal of the new document
+    uint32_t Add(int document_id, DocumentStatus status, int rating);
+    void Remove(uint32_t ordinal);
+
+    // Updates of one ordinal must not run concurrently with each other
+    void SetStatus(uint32_t ordinal, DocumentStatus status);
+    void SetRating(uint32_t ordinal, int rating);
+
+    int GetId(uint32_t ordinal) const {
+        return ids_[ordinal];
+    }
+    DocumentStatus GetStatus(uint32_t ordinal) const {
+        return statuses_[ordinal].Load();
+    }
+    int GetRating(uint32_t ordinal) const {
+        return ratings_[ordinal].Load();
+    }
+    bool HasStatus(uint32_t ordinal, DocumentStatus status) const {
+        return (status_bitmaps_[static_cast<size_t>(status)][ordinal / 64].Load() >> (ordinal % 64)) & 1;
+    }
+
+    // Cache hints for an upcoming HasStatus, or GetId, GetStatus and GetRating, of the ordinal
+    void PrefetchStatus(uint32_t ordinal, DocumentStatus status) const {
+        PrefetchRead(&status_bitmaps_[static_cast<size_t>(status)][ordinal / 64]);
+    }
+    void PrefetchRow(uint32_t ordinal) const {
+        PrefetchRead(&ids_[ordinal]);
+        PrefetchRead(&statuses_[ordinal]);
+        PrefetchRead(&ratings_[ordinal]);
+    }
+
+    // Copies the columns to new allocations of the current HugePageMode, not concurrently with queries
+    void Reallocate();
+
+    // Ordinals are below this bound
+    size_t GetOrdinalBound() const;
+    // Estimated heap bytes, see index_statistics.h
+    size_t GetAllocatedBytes() const;
+
+private:
+    // Relaxed atomic value that can be stored in a vector; copying is not atomic
+    template <typename T>
+    class Cell {
+    public:
+        Cell(T value = T{})
+            : value_(value) {
+        }
+        Cell(const Cell& other)
+            : value_(other.Load()) {
+        }
+        Cell& operator=(const Cell& other) {
+            Store(other.Load());
+            return *this;
+        }
+
+        T Load() const {
+            return value_.load(std::memory_order_relaxed);
+        }
+        void Store(T value) {
+            value_.store(value, std::memory_order_relaxed);
+        }
+        void SetBits(T mask) {
+            value_.fetch_or(mask, std::memory_order_relaxed);
+        }
+        void ClearBits(T mask) {
+            value_.fetch_and(~mask, std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<T> value_;
+    };
+
+    IndexVector<int> ids_;
+    IndexVector<Cell<int>> ratings_;
+    IndexVector<Cell<DocumentStatus>> statuses_;
+    std::array<IndexVector<Cell<uint64_t>>, STATUS_COUNT> status_bitmaps_;
+    std::vector<uint32_t> free_ordinals_;
+};
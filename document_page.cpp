@@ -0,0 +1,84 @@
+#include "document_page.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+
+    const size_t CURSOR_BYTES = sizeof(double) + 2 * sizeof(int32_t);
+    const char HEX_DIGITS[] = "0123456789abcdef";
+
+    int HexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+
+}  // namespace
+
+std::string EncodePageCursor(const Document& document) {
+    unsigned char bytes[CURSOR_BYTES];
+    const int32_t rating = document.rating;
+    const int32_t id = document.id;
+    std::memcpy(bytes, &document.relevance, sizeof(double));
+    std::memcpy(bytes + sizeof(double), &rating, sizeof(int32_t));
+    std::memcpy(bytes + sizeof(double) + sizeof(int32_t), &id, sizeof(int32_t));
+    std::string cursor;
+    cursor.reserve(2 * CURSOR_BYTES);
+    for (const unsigned char byte : bytes) {
+        cursor.push_back(HEX_DIGITS[byte >> 4]);
+        cursor.push_back(HEX_DIGITS[byte & 0xF]);
+    }
+    return cursor;
+}
+
+std::optional<Document> DecodePageCursor(const std::string_view cursor) {
+    if (cursor.empty()) {
+        return std::nullopt;
+    }
+    if (cursor.size() != 2 * CURSOR_BYTES) {
+        throw std::invalid_argument("Error: malformed page cursor."s);
+    }
+    unsigned char bytes[CURSOR_BYTES];
+    for (size_t i = 0; i < CURSOR_BYTES; ++i) {
+        const int high = HexValue(cursor[2 * i]);
+        const int low = HexValue(cursor[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            throw std::invalid_argument("Error: malformed page cursor."s);
+        }
+        bytes[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    Document document;
+    int32_t rating;
+    int32_t id;
+    std::memcpy(&document.relevance, bytes, sizeof(double));
+    std::memcpy(&rating, bytes + sizeof(double), sizeof(int32_t));
+    std::memcpy(&id, bytes + sizeof(double) + sizeof(int32_t), sizeof(int32_t));
+    document.rating = rating;
+    document.id = id;
+    return document;
+}
+
+bool SelectTopDocuments(std::vector<Document>& documents, const std::optional<Document>& after, size_t count) {
+    if (after) {
+        documents.erase(std::remove_if(documents.begin(), documents.end(),
+            [&after](const Document& document) { return !IsMoreRelevant(*after, document); }), documents.end());
+    }
+    const bool has_more = documents.size() > count;
+    if (has_more) {
+        std::partial_sort(documents.begin(), documents.begin() + count, documents.end(), IsMoreRelevant);
+        documents.resize(count);
+    }
+    else {
+        std::sort(documents.begin(), documents.end(), IsMoreRelevant);
+    }
+    return has_more;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "document.h"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One page of search results. next_cursor continues after its last document and is empty after the last page.
+struct DocumentPage {
+    std::vector<Document> documents;
+    std::string next_cursor;
+};
+
+// Opaque position in the result order (relevance, rating, id of the last document of a page)
+std::string EncodePageCursor(const Document& document);
+// Empty cursor is the start, throws std::invalid_argument on malformed cursors
+std::optional<Document> DecodePageCursor(const std::string_view cursor);
+
+// Keeps the count most relevant documents ordered after `after` (all if not set), sorted by IsMoreRelevant.
+// Selection is a bounded partial sort. Returns whether more documents followed the kept ones.
+bool SelectTopDocuments(std::vector<Document>& documents, const std::optional<Document>& after, size_t count);
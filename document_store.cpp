@@ -0,0 +1,148 @@
+#include "document_store.h"
+#include "index_statistics.h"
+#include "lz_codec.h"
+
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+DocumentStore::BlockCache::BlockCache(size_t capacity)
+    : capacity_(capacity) {
+}
+
+DocumentStore::BlockCache::BlockCache(const BlockCache& other)
+    : capacity_(other.capacity_) {
+}
+
+DocumentStore::BlockCache& DocumentStore::BlockCache::operator=(const BlockCache& other) {
+    if (this != &other) {
+        std::lock_guard guard(mutex_);
+        capacity_ = other.capacity_;
+        order_.clear();
+        entries_.clear();
+    }
+    return *this;
+}
+
+std::shared_ptr<const std::string> DocumentStore::BlockCache::Find(uint32_t block) {
+    std::lock_guard guard(mutex_);
+    const auto it = entries_.find(block);
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+    order_.splice(order_.begin(), order_, it->second.position);
+    return it->second.text;
+}
+
+void DocumentStore::BlockCache::Insert(uint32_t block, std::shared_ptr<const std::string> text) {
+    std::lock_guard guard(mutex_);
+    if (capacity_ == 0 || entries_.count(block) > 0) {
+        return;
+    }
+    if (entries_.size() == capacity_) {
+        entries_.erase(order_.back());
+        order_.pop_back();
+    }
+    order_.push_front(block);
+    entries_.emplace(block, Entry{ std::move(text), order_.begin() });
+}
+
+void DocumentStore::BlockCache::Erase(uint32_t block) {
+    std::lock_guard guard(mutex_);
+    const auto it = entries_.find(block);
+    if (it != entries_.end()) {
+        order_.erase(it->second.position);
+        entries_.erase(it);
+    }
+}
+
+size_t DocumentStore::BlockCache::Size() const {
+    std::lock_guard guard(mutex_);
+    return entries_.size();
+}
+
+DocumentStore::DocumentStore(size_t block_bytes, size_t cache_blocks)
+    : block_bytes_(block_bytes)
+    , blocks_(1)
+    , cache_(cache_blocks) {
+    if (block_bytes_ == 0) {
+        throw std::invalid_argument("Error: document store block size must be positive."s);
+    }
+}
+
+DocumentStore::Location DocumentStore::Add(const std::string_view text) {
+    const Location location{ static_cast<uint32_t>(blocks_.size() - 1), static_cast<uint32_t>(open_block_.size()),
+        static_cast<uint32_t>(text.size()) };
+    open_block_ += text;
+    blocks_.back().text_bytes += location.size;
+    ++document_count_;
+    text_bytes_ += text.size();
+    if (open_block_.size() >= block_bytes_) {
+        SealOpenBlock();
+    }
+    return location;
+}
+
+void DocumentStore::Remove(Location location) {
+    Block& block = blocks_.at(location.block);
+    block.text_bytes -= location.size;
+    --document_count_;
+    text_bytes_ -= location.size;
+    // the open block is reused as it is
+    if (block.text_bytes == 0 && location.block + 1 < blocks_.size()) {
+        stored_bytes_ -= block.compressed.size();
+        std::string().swap(block.compressed);
+        cache_.Erase(location.block);
+    }
+}
+
+std::string DocumentStore::Get(Location location) const {
+    if (location.block + 1 == blocks_.size()) {
+        return open_block_.substr(location.offset, location.size);
+    }
+    std::shared_ptr<const std::string> text = cache_.Find(location.block);
+    if (text) {
+        cache_hits_.Add();
+    }
+    else {
+        cache_misses_.Add();
+        auto decompressed = std::make_shared<std::string>();
+        LzDecompress(blocks_.at(location.block).compressed, *decompressed);
+        text = decompressed;
+        cache_.Insert(location.block, text);
+    }
+    return text->substr(location.offset, location.size);
+}
+
+DocumentStoreStats DocumentStore::GetStats() const {
+    DocumentStoreStats stats;
+    stats.documents = document_count_;
+    for (size_t i = 0; i + 1 < blocks_.size(); ++i) {
+        stats.blocks += blocks_[i].text_bytes > 0 ? 1 : 0;
+    }
+    stats.text_bytes = text_bytes_;
+    stats.stored_bytes = stored_bytes_ + open_block_.size();
+    stats.cached_blocks = cache_.Size();
+    stats.cache_hits = cache_hits_.Get();
+    stats.cache_misses = cache_misses_.Get();
+    return stats;
+}
+
+size_t DocumentStore::GetAllocatedBytes() const {
+    size_t bytes = EstimateVectorBytes(blocks_) + EstimateStringBytes(open_block_);
+    for (const Block& block : blocks_) {
+        bytes += EstimateStringBytes(block.compressed);
+    }
+    // cached blocks in their shared_ptr control blocks, the list and hash nodes
+    return bytes + cache_.Size() * (EstimateAllocationBytes(sizeof(std::string) + 16) + EstimateAllocationBytes(block_bytes_ + 1)
+        + EstimateAllocationBytes(3 * sizeof(void*)) + EstimateHashNodeBytes<std::pair<const uint32_t, BlockCache::Entry>>());
+}
+
+void DocumentStore::SealOpenBlock() {
+    Block& block = blocks_.back();
+    LzCompress(open_block_, block.compressed);
+    block.compressed.shrink_to_fit();
+    stored_bytes_ += block.compressed.size();
+    open_block_.clear();
+    blocks_.emplace_back();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "atomic_counter.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct DocumentStoreStats {
+    size_t documents = 0;
+    size_t blocks = 0;    // compressed blocks holding documents
+    uint64_t text_bytes = 0;    // of the stored documents
+    uint64_t stored_bytes = 0;    // compressed blocks and the open block
+    size_t cached_blocks = 0;
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+};
+
+// Document texts packed into blocks of about block_bytes compressed with LzCompress, with an
+// LRU cache of cache_blocks decompressed blocks. New documents go to an uncompressed open
+// block, which is compressed once full. The bytes of removed documents stay in their block
+// until every document of the block is removed.
+// Get may run concurrently with other Get calls, Add and Remove may not.
+class DocumentStore {
+public:
+    struct Location {
+        uint32_t block = 0;
+        uint32_t offset = 0;
+        uint32_t size = 0;
+    };
+
+    explicit DocumentStore(size_t block_bytes = 16 * 1024, size_t cache_blocks = 256);
+
+    Location Add(const std::string_view text);
+    void Remove(Location location);
+    std::string Get(Location location) const;
+
+    DocumentStoreStats GetStats() const;
+    // Estimated heap bytes, see index_statistics.h
+    size_t GetAllocatedBytes() const;
+
+private:
+    struct Block {
+        std::string compressed;
+        uint32_t text_bytes = 0;    // of the documents not removed yet
+    };
+
+    // Copies start empty, so the store stays copyable and movable
+    class BlockCache {
+    public:
+        explicit BlockCache(size_t capacity);
+        BlockCache(const BlockCache& other);
+        BlockCache& operator=(const BlockCache& other);
+
+        // nullptr if the block is not cached
+        std::shared_ptr<const std::string> Find(uint32_t block);
+        void Insert(uint32_t block, std::shared_ptr<const std::string> text);
+        void Erase(uint32_t block);
+        size_t Size() const;
+
+        struct Entry {
+            std::shared_ptr<const std::string> text;
+            std::list<uint32_t>::iterator position;
+        };
+
+    private:
+        size_t capacity_;
+        mutable std::mutex mutex_;
+        std::list<uint32_t> order_;    // most recently used first
+        std::unordered_map<uint32_t, Entry> entries_;
+    };
+
+    size_t block_bytes_;
+    std::vector<Block> blocks_;    // the last one is the open block
+    std::string open_block_;
+    size_t document_count_ = 0;
+    uint64_t text_bytes_ = 0;
+    uint64_t stored_bytes_ = 0;
+    mutable BlockCache cache_;
+    mutable AtomicCounter cache_hits_;
+    mutable AtomicCounter cache_misses_;
+
+    void SealOpenBlock();
+};
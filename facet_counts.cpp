@@ -0,0 +1,52 @@
+#include "facet_counts.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+void ValidateFacetOptions(const FacetOptions& options) {
+    if (!std::is_sorted(options.rating_bounds.begin(), options.rating_bounds.end())) {
+        throw std::invalid_argument("Error: facet rating bounds must be ascending."s);
+    }
+    if (!(options.sample_fraction > 0.0 && options.sample_fraction <= 1.0)) {
+        throw std::invalid_argument("Error: facet sample fraction must be in (0, 1]."s);
+    }
+}
+
+FacetCounts MakeFacetCounts(const FacetOptions& options) {
+    FacetCounts counts;
+    counts.by_rating.assign(options.rating_bounds.size() + 1, 0);
+    return counts;
+}
+
+size_t GetRatingBucket(const std::vector<int>& rating_bounds, int rating) {
+    return std::upper_bound(rating_bounds.begin(), rating_bounds.end(), rating) - rating_bounds.begin();
+}
+
+void AddFacetCounts(const FacetCounts& counts, FacetCounts& total) {
+    total.total_hits += counts.total_hits;
+    for (size_t i = 0; i < DOCUMENT_STATUS_COUNT; ++i) {
+        total.by_status[i] += counts.by_status[i];
+    }
+    for (size_t i = 0; i < counts.by_rating.size(); ++i) {
+        total.by_rating[i] += counts.by_rating[i];
+    }
+    total.estimated = total.estimated || counts.estimated;
+}
+
+void ScaleFacetCounts(double scale, FacetCounts& counts) {
+    const auto scaled = [scale](uint64_t count) {
+        return static_cast<uint64_t>(std::llround(count * scale));
+    };
+    counts.total_hits = scaled(counts.total_hits);
+    for (uint64_t& count : counts.by_status) {
+        count = scaled(count);
+    }
+    for (uint64_t& count : counts.by_rating) {
+        count = scaled(count);
+    }
+    counts.estimated = true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "document.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+const size_t DOCUMENT_STATUS_COUNT = 4;
+const size_t FACET_SAMPLE_STRIPES = 64;    // ordinal stripes of estimated counts
+
+// Facets of the documents matched by a query, whatever their status
+struct FacetOptions {
+    // Ascending bounds of the rating buckets: bucket 0 holds ratings below rating_bounds[0],
+    // bucket i ratings in [rating_bounds[i - 1], rating_bounds[i]), the last one the rest
+    std::vector<int> rating_bounds = { 1, 2, 3, 4, 5 };
+    // Below 1 the counts are estimated from this fraction of the ordinal space (at least one of
+    // FACET_SAMPLE_STRIPES stripes) scaled up; only for SearchServer::CountDocuments
+    double sample_fraction = 1.0;
+};
+
+struct FacetCounts {
+    uint64_t total_hits = 0;
+    std::array<uint64_t, DOCUMENT_STATUS_COUNT> by_status{};    // by DocumentStatus
+    std::vector<uint64_t> by_rating;    // rating_bounds.size() + 1 buckets
+    bool estimated = false;
+
+    uint64_t GetStatusCount(DocumentStatus status) const {
+        return by_status[static_cast<size_t>(status)];
+    }
+};
+
+// Top documents of a query with the facets of all its matches
+struct FacetedSearchResult {
+    std::vector<Document> documents;
+    FacetCounts facets;
+};
+
+// Throws std::invalid_argument for unsorted bounds or a sample fraction outside (0, 1]
+void ValidateFacetOptions(const FacetOptions& options);
+// Zero counts with the buckets of options
+FacetCounts MakeFacetCounts(const FacetOptions& options);
+size_t GetRatingBucket(const std::vector<int>& rating_bounds, int rating);
+void AddFacetCounts(const FacetCounts& counts, FacetCounts& total);
+// Multiplies the counts by scale, rounded, and marks them estimated
+void ScaleFacetCounts(double scale, FacetCounts& counts);
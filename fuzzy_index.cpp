@@ -0,0 +1,155 @@
+#include "fuzzy_index.h"
+#include "index_statistics.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std::string_literals;
+
+FuzzyIndex::FuzzyIndex(int max_distance)
+    : max_distance_(max_distance) {
+    if (max_distance < 1 || max_distance > 2) {
+        throw std::invalid_argument("Error: fuzzy edit distance must be 1 or 2."s);
+    }
+}
+
+int FuzzyIndex::GetMaxDistance() const {
+    return max_distance_;
+}
+
+size_t FuzzyIndex::Size() const {
+    return terms_.size() - free_ids_.size();
+}
+
+void FuzzyIndex::Insert(const std::string_view term) {
+    if (term_ids_.count(term) > 0) {
+        return;
+    }
+    uint32_t id;
+    if (free_ids_.empty()) {
+        id = static_cast<uint32_t>(terms_.size());
+        terms_.emplace_back(term);
+    }
+    else {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+        terms_[id] = term;
+    }
+    const std::string_view stored = terms_[id];
+    term_ids_.emplace(stored, id);
+    for (std::string& deletion : GenerateDeletes(stored)) {
+        deletes_[std::move(deletion)].push_back(id);
+    }
+}
+
+void FuzzyIndex::Erase(const std::string_view term) {
+    const auto id_it = term_ids_.find(term);
+    if (id_it == term_ids_.end()) {
+        return;
+    }
+    const uint32_t id = id_it->second;
+    term_ids_.erase(id_it);
+    for (const std::string& deletion : GenerateDeletes(terms_[id])) {
+        const auto it = deletes_.find(deletion);
+        std::vector<uint32_t>& term_ids = it->second;
+        term_ids.erase(std::find(term_ids.begin(), term_ids.end(), id));
+        if (term_ids.empty()) {
+            deletes_.erase(it);
+        }
+    }
+    std::string().swap(terms_[id]);
+    free_ids_.push_back(id);
+}
+
+FuzzyIndex::Lookup FuzzyIndex::FindCandidates(const std::string_view word, size_t max_count, size_t max_checked) const {
+    Lookup result;
+    std::unordered_set<uint32_t> seen;
+    for (const std::string& deletion : GenerateDeletes(word)) {
+        const auto it = deletes_.find(deletion);
+        if (it == deletes_.end()) {
+            continue;
+        }
+        for (const uint32_t id : it->second) {
+            if (result.checked >= max_checked) {
+                break;
+            }
+            if (!seen.insert(id).second) {
+                continue;
+            }
+            ++result.checked;
+            const int distance = BoundedDistance(word, terms_[id]);
+            if (distance > 0 && distance <= max_distance_) {
+                result.candidates.push_back({ terms_[id], distance });
+            }
+        }
+    }
+    std::sort(result.candidates.begin(), result.candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.distance < rhs.distance || (lhs.distance == rhs.distance && lhs.term < rhs.term);
+        });
+    if (result.candidates.size() > max_count) {
+        result.candidates.resize(max_count);
+    }
+    return result;
+}
+
+std::vector<std::string> FuzzyIndex::GenerateDeletes(const std::string_view word) const {
+    std::vector<std::string> result{ std::string(word) };
+    size_t level_begin = 0;
+    for (int distance = 1; distance <= max_distance_; ++distance) {
+        const size_t level_end = result.size();
+        for (size_t i = level_begin; i < level_end; ++i) {
+            // copy: push_back below may reallocate result
+            const std::string source = result[i];
+            for (size_t pos = 0; pos < source.size(); ++pos) {
+                std::string deletion = source.substr(0, pos) + source.substr(pos + 1);
+                result.push_back(std::move(deletion));
+            }
+        }
+        level_begin = level_end;
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+int FuzzyIndex::BoundedDistance(const std::string_view lhs, const std::string_view rhs) const {
+    const int too_far = max_distance_ + 1;
+    if (static_cast<int>(std::max(lhs.size(), rhs.size()) - std::min(lhs.size(), rhs.size())) > max_distance_) {
+        return too_far;
+    }
+    std::vector<int> prev(rhs.size() + 1);
+    std::vector<int> curr(rhs.size() + 1);
+    std::iota(prev.begin(), prev.end(), 0);
+    for (size_t i = 1; i <= lhs.size(); ++i) {
+        curr[0] = static_cast<int>(i);
+        int row_min = curr[0];
+        for (size_t j = 1; j <= rhs.size(); ++j) {
+            const int substitution = prev[j - 1] + (lhs[i - 1] == rhs[j - 1] ? 0 : 1);
+            curr[j] = std::min({ prev[j] + 1, curr[j - 1] + 1, substitution });
+            row_min = std::min(row_min, curr[j]);
+        }
+        if (row_min > max_distance_) {
+            return too_far;
+        }
+        std::swap(prev, curr);
+    }
+    return std::min(prev[rhs.size()], too_far);
+}
+
+size_t FuzzyIndex::GetAllocatedBytes() const {
+    size_t bytes = EstimateAllocationBytes(terms_.size() * sizeof(std::string));
+    for (const std::string& term : terms_) {
+        bytes += EstimateStringBytes(term);
+    }
+    bytes += term_ids_.size() * EstimateHashNodeBytes<std::pair<const std::string_view, uint32_t>>()
+        + EstimateAllocationBytes(term_ids_.bucket_count() * sizeof(void*));
+    bytes += EstimateVectorBytes(free_ids_);
+    bytes += deletes_.size() * EstimateHashNodeBytes<std::pair<const std::string, std::vector<uint32_t>>>()
+        + EstimateAllocationBytes(deletes_.bucket_count() * sizeof(void*));
+    for (const auto& [deletion, term_ids] : deletes_) {
+        bytes += EstimateStringBytes(deletion) + EstimateVectorBytes(term_ids);
+    }
+    return bytes;
+}
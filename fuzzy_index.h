@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// SymSpell-style deletion index: every term is registered under all strings obtained from it
+// by deleting up to max_distance characters. Terms within max_distance edits of a word share
+// at least one such deletion with it, so candidates come from a few hash lookups.
+class FuzzyIndex {
+public:
+    struct Candidate {
+        std::string_view term;
+        int distance;
+    };
+    struct Lookup {
+        std::vector<Candidate> candidates;    // ordered by distance, then by term
+        size_t checked = 0;    // terms verified with edit distance
+    };
+
+    explicit FuzzyIndex(int max_distance);
+
+    int GetMaxDistance() const;
+    size_t Size() const;
+    // Estimated heap bytes, see index_statistics.h
+    size_t GetAllocatedBytes() const;
+
+    void Insert(const std::string_view term);
+    // Removes the term and its deletions, ids of erased terms are reused by Insert
+    void Erase(const std::string_view term);
+
+    // Terms within GetMaxDistance() edits of word except word itself. At most max_checked
+    // terms are verified and at most max_count closest ones are returned.
+    Lookup FindCandidates(const std::string_view word, size_t max_count, size_t max_checked) const;
+
+private:
+    int max_distance_;
+    std::deque<std::string> terms_;
+    std::unordered_map<std::string_view, uint32_t> term_ids_;
+    std::unordered_map<std::string, std::vector<uint32_t>> deletes_;    // deletion: term ids
+    std::vector<uint32_t> free_ids_;    // of erased terms, whose strings are empty
+
+    std::vector<std::string> GenerateDeletes(const std::string_view word) const;
+    // Levenshtein distance or max_distance_ + 1 if it is greater than max_distance_
+    int BoundedDistance(const std::string_view lhs, const std::string_view rhs) const;
+};
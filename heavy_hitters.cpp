@@ -0,0 +1,198 @@
+#include "heavy_hitters.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace {
+
+    size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // splitmix64 finalizer
+    uint64_t Mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+}  // namespace
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : width_(RoundUpToPowerOfTwo(std::max<size_t>(width, 1)))
+    , depth_(depth)
+    , counters_(width_ * depth_) {
+    if (depth_ == 0) {
+        throw std::invalid_argument("Error: sketch depth must be positive."s);
+    }
+}
+
+uint64_t CountMinSketch::Add(uint64_t hash, uint64_t count) {
+    uint64_t estimate = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < depth_; ++row) {
+        AtomicCounter& counter = counters_[row * width_ + GetPosition(hash, row)];
+        counter.Add(count);
+        estimate = std::min(estimate, counter.Get());
+    }
+    return estimate;
+}
+
+uint64_t CountMinSketch::Estimate(uint64_t hash) const {
+    uint64_t estimate = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < depth_; ++row) {
+        estimate = std::min(estimate, counters_[row * width_ + GetPosition(hash, row)].Get());
+    }
+    return estimate;
+}
+
+void CountMinSketch::Clear() {
+    for (AtomicCounter& counter : counters_) {
+        counter.Reset();
+    }
+}
+
+size_t CountMinSketch::GetWidth() const {
+    return width_;
+}
+
+size_t CountMinSketch::GetDepth() const {
+    return depth_;
+}
+
+// an independent hash per row from one key hash
+size_t CountMinSketch::GetPosition(uint64_t hash, size_t row) const {
+    return Mix(hash + (row + 1) * 0x9e3779b97f4a7c15ULL) & (width_ - 1);
+}
+
+HeavyHitterTracker::HeavyHitterTracker(size_t capacity, std::chrono::nanoseconds window, size_t sketch_width, size_t sketch_depth)
+    : capacity_(capacity)
+    , window_ns_(window.count())
+    , sketches_{ CountMinSketch(sketch_width, sketch_depth), CountMinSketch(sketch_width, sketch_depth) }
+    , top_hashes_(capacity) {
+    if (capacity_ == 0 || window_ns_ <= 0) {
+        throw std::invalid_argument("Error: heavy hitter capacity and window must be positive."s);
+    }
+    for (auto& hash : top_hashes_) {
+        hash.store(0, std::memory_order_relaxed);
+    }
+}
+
+void HeavyHitterTracker::Add(std::string_view key, std::chrono::steady_clock::time_point now) {
+    const int64_t window_index = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count() / window_ns_;
+    if (window_index > window_index_.load(std::memory_order_acquire)) {
+        Rotate(window_index);
+    }
+    const uint64_t hash = HashKey(key);
+    const int64_t current = window_index_.load(std::memory_order_acquire);
+    const uint64_t estimate = sketches_[current % 2].Add(hash) + sketches_[(current + 1) % 2].Estimate(hash);
+    if (estimate <= top_threshold_.load(std::memory_order_relaxed) || IsInTop(hash)) {
+        return;
+    }
+    Insert(key, hash);
+}
+
+uint64_t HeavyHitterTracker::Estimate(std::string_view key) const {
+    return EstimateHash(HashKey(key));
+}
+
+std::vector<HeavyHitter> HeavyHitterTracker::GetTop(size_t count) const {
+    std::vector<HeavyHitter> top;
+    {
+        std::lock_guard guard(top_mutex_);
+        for (size_t i = 0; i < top_keys_.size(); ++i) {
+            top.push_back({ top_keys_[i], EstimateHash(top_hashes_[i].load(std::memory_order_relaxed)) });
+        }
+    }
+    std::sort(top.begin(), top.end(), [](const HeavyHitter& lhs, const HeavyHitter& rhs) {
+        return lhs.count > rhs.count || (lhs.count == rhs.count && lhs.key < rhs.key);
+        });
+    if (top.size() > count) {
+        top.resize(count);
+    }
+    return top;
+}
+
+// FNV-1a, never 0 (free entries of the top)
+uint64_t HeavyHitterTracker::HashKey(std::string_view key) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+uint64_t HeavyHitterTracker::EstimateHash(uint64_t hash) const {
+    const int64_t current = window_index_.load(std::memory_order_acquire);
+    return sketches_[current % 2].Estimate(hash) + sketches_[(current + 1) % 2].Estimate(hash);
+}
+
+bool HeavyHitterTracker::IsInTop(uint64_t hash) const {
+    for (const auto& top_hash : top_hashes_) {
+        if (top_hash.load(std::memory_order_relaxed) == hash) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The sketch two windows back becomes the current one; adds racing with the rotation may land in
+// either window
+void HeavyHitterTracker::Rotate(int64_t window_index) {
+    std::lock_guard guard(top_mutex_);
+    const int64_t current = window_index_.load(std::memory_order_relaxed);
+    if (window_index <= current) {
+        return;
+    }
+    sketches_[window_index % 2].Clear();
+    if (window_index > current + 1) {
+        sketches_[(window_index + 1) % 2].Clear();
+    }
+    window_index_.store(window_index, std::memory_order_release);
+    // counts of the top dropped with the window
+    top_threshold_.store(0, std::memory_order_relaxed);
+}
+
+void HeavyHitterTracker::Insert(std::string_view key, uint64_t hash) {
+    std::lock_guard guard(top_mutex_);
+    if (IsInTop(hash)) {
+        return;
+    }
+    const uint64_t estimate = EstimateHash(hash);
+    if (top_keys_.size() < capacity_) {
+        top_hashes_[top_keys_.size()].store(hash, std::memory_order_relaxed);
+        top_keys_.emplace_back(key);
+        if (top_keys_.size() < capacity_) {
+            return;
+        }
+    }
+    else {
+        size_t smallest = 0;
+        uint64_t smallest_count = std::numeric_limits<uint64_t>::max();
+        for (size_t i = 0; i < top_keys_.size(); ++i) {
+            const uint64_t count = EstimateHash(top_hashes_[i].load(std::memory_order_relaxed));
+            if (count < smallest_count) {
+                smallest = i;
+                smallest_count = count;
+            }
+        }
+        if (estimate > smallest_count) {
+            top_hashes_[smallest].store(hash, std::memory_order_relaxed);
+            top_keys_[smallest] = std::string(key);
+        }
+    }
+    uint64_t threshold = std::numeric_limits<uint64_t>::max();
+    for (const auto& top_hash : top_hashes_) {
+        threshold = std::min(threshold, EstimateHash(top_hash.load(std::memory_order_relaxed)));
+    }
+    top_threshold_.store(threshold, std::memory_order_relaxed);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "atomic_counter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Count-Min sketch: depth rows of width relaxed atomic counters, a key adds to one counter per row
+// and its estimate is the smallest of them (never below the true count).
+class CountMinSketch {
+public:
+    // width is rounded up to a power of two
+    CountMinSketch(size_t width, size_t depth);
+
+    // Returns the estimate of the key after adding count
+    uint64_t Add(uint64_t hash, uint64_t count = 1);
+    uint64_t Estimate(uint64_t hash) const;
+    void Clear();
+
+    size_t GetWidth() const;
+    size_t GetDepth() const;
+
+private:
+    size_t width_;
+    size_t depth_;
+    std::vector<AtomicCounter> counters_;    // row by row
+
+    size_t GetPosition(uint64_t hash, size_t row) const;
+};
+
+struct HeavyHitter {
+    std::string key;
+    uint64_t count = 0;    // estimated, in the current and the previous window
+};
+
+// Top-K most frequent keys over a sliding time window. Counts go to the sketch of the current
+// window; estimates add the previous window, so keys age out after two windows.
+// Add is lock-free unless the key enters the top: a key is looked up among the top hashes only
+// when its estimate reaches the smallest count of the top.
+class HeavyHitterTracker {
+public:
+    HeavyHitterTracker(size_t capacity, std::chrono::nanoseconds window, size_t sketch_width = 4096, size_t sketch_depth = 4);
+    HeavyHitterTracker(const HeavyHitterTracker&) = delete;
+    HeavyHitterTracker& operator=(const HeavyHitterTracker&) = delete;
+
+    void Add(std::string_view key, std::chrono::steady_clock::time_point now);
+    uint64_t Estimate(std::string_view key) const;
+    // Most frequent keys first, at most count of them
+    std::vector<HeavyHitter> GetTop(size_t count) const;
+
+    static uint64_t HashKey(std::string_view key);
+
+private:
+    size_t capacity_;
+    int64_t window_ns_;
+    CountMinSketch sketches_[2];
+    std::atomic<int64_t> window_index_{ 0 };    // the sketch of window w is sketches_[w % 2]
+    std::atomic<uint64_t> top_threshold_{ 0 };    // smallest count of a full top, 0 while not full
+    std::vector<std::atomic<uint64_t>> top_hashes_;    // 0 for free entries
+    mutable std::mutex top_mutex_;    // top_keys_, writes of top_hashes_ and window rotation
+    std::vector<std::string> top_keys_;
+
+    uint64_t EstimateHash(uint64_t hash) const;
+    bool IsInTop(uint64_t hash) const;
+    void Rotate(int64_t window_index);
+    void Insert(std::string_view key, uint64_t hash);
+};
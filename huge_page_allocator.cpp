@@ -0,0 +1,147 @@
+#include "huge_page_allocator.h"
+#include "atomic_counter.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+    std::atomic<HugePageMode> huge_page_mode{ HugePageMode::OFF };
+
+    // Mappings by address with their mapped size; only arrays of HUGE_PAGE_MIN_BYTES or more are looked up
+    std::mutex mappings_mutex;
+    std::unordered_map<void*, size_t> mappings;
+    uint64_t mapped_bytes = 0;
+    AtomicCounter transparent_mappings;
+    AtomicCounter explicit_mappings;
+    AtomicCounter explicit_fallbacks;
+
+    size_t RoundUpToHugePages(size_t bytes) {
+        return (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    }
+
+#if defined(__linux__)
+
+    // nullptr if the kernel refuses
+    void* MapHugePages(size_t bytes, HugePageMode mode) {
+        if (mode == HugePageMode::EXPLICIT) {
+            void* pointer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (pointer != MAP_FAILED) {
+                explicit_mappings.Add();
+                return pointer;
+            }
+            explicit_fallbacks.Add();
+        }
+        // over-map by a huge page to cut a 2 MiB aligned range, the kernel backs only aligned ranges with huge pages
+        const size_t mapped = bytes + HUGE_PAGE_BYTES;
+        void* pointer = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pointer == MAP_FAILED) {
+            return nullptr;
+        }
+        const uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+        const uintptr_t aligned = (address + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+        if (aligned > address) {
+            munmap(pointer, aligned - address);
+        }
+        if (address + mapped > aligned + bytes) {
+            munmap(reinterpret_cast<void*>(aligned + bytes), address + mapped - aligned - bytes);
+        }
+        madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+        transparent_mappings.Add();
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void UnmapHugePages(void* pointer, size_t bytes) {
+        munmap(pointer, bytes);
+    }
+
+#else
+
+    void* MapHugePages(size_t bytes, HugePageMode mode) {
+        return nullptr;
+    }
+
+    void UnmapHugePages(void* pointer, size_t bytes) {
+    }
+
+#endif
+
+}  // namespace
+
+bool SetHugePageMode(HugePageMode mode) {
+#if !defined(__linux__)
+    if (mode != HugePageMode::OFF) {
+        return false;
+    }
+#endif
+    huge_page_mode.store(mode, std::memory_order_relaxed);
+    return true;
+}
+
+HugePageMode GetHugePageMode() {
+    return huge_page_mode.load(std::memory_order_relaxed);
+}
+
+HugePageStats GetHugePageStats() {
+    HugePageStats stats;
+    {
+        std::lock_guard guard(mappings_mutex);
+        stats.mapped_bytes = mapped_bytes;
+    }
+    stats.transparent_mappings = transparent_mappings.Get();
+    stats.explicit_mappings = explicit_mappings.Get();
+    stats.explicit_fallbacks = explicit_fallbacks.Get();
+    return stats;
+}
+
+const char* GetHugePageModeName(HugePageMode mode) {
+    switch (mode) {
+    case HugePageMode::OFF:
+        return "off";
+    case HugePageMode::TRANSPARENT:
+        return "transparent";
+    case HugePageMode::EXPLICIT:
+        return "explicit";
+    default:
+        return "unknown";
+    }
+}
+
+void* AllocateIndexMemory(size_t bytes) {
+    const HugePageMode mode = GetHugePageMode();
+    if (mode != HugePageMode::OFF && bytes >= HUGE_PAGE_MIN_BYTES) {
+        const size_t mapped = RoundUpToHugePages(bytes);
+        void* pointer = MapHugePages(mapped, mode);
+        if (pointer != nullptr) {
+            std::lock_guard guard(mappings_mutex);
+            mappings.emplace(pointer, mapped);
+            mapped_bytes += mapped;
+            return pointer;
+        }
+    }
+    return ::operator new(bytes);
+}
+
+void FreeIndexMemory(void* pointer, size_t bytes) {
+    if (pointer == nullptr) {
+        return;
+    }
+    if (bytes >= HUGE_PAGE_MIN_BYTES) {
+        std::unique_lock guard(mappings_mutex);
+        const auto it = mappings.find(pointer);
+        if (it != mappings.end()) {
+            const size_t mapped = it->second;
+            mappings.erase(it);
+            mapped_bytes -= mapped;
+            guard.unlock();
+            UnmapHugePages(pointer, mapped);
+            return;
+        }
+    }
+    ::operator delete(pointer);
+}
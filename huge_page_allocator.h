@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <vector>
+
+// Memory of the large index arrays (document columns, per-ordinal query buffers). Arrays of at
+// least HUGE_PAGE_MIN_BYTES are mapped in whole 2 MiB pages, so a random access by ordinal
+// costs one TLB entry per 2 MiB instead of per 4 KiB page; smaller ones use operator new.
+// The mode applies to new allocations, existing arrays move when reallocated (see
+// SearchServer::ReallocateIndexMemory). Elsewhere than Linux the mode is always OFF.
+enum class HugePageMode : uint8_t {
+    OFF,
+    TRANSPARENT,    // 2 MiB aligned anonymous mappings advised with MADV_HUGEPAGE
+    EXPLICIT,    // MAP_HUGETLB pages reserved in vm.nr_hugepages, TRANSPARENT when none are left
+};
+
+const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+const size_t HUGE_PAGE_MIN_BYTES = HUGE_PAGE_BYTES / 2;
+
+struct HugePageStats {
+    uint64_t mapped_bytes = 0;    // currently mapped, in whole huge pages
+    uint64_t transparent_mappings = 0;    // since the start
+    uint64_t explicit_mappings = 0;
+    uint64_t explicit_fallbacks = 0;    // EXPLICIT mappings refused, mapped as TRANSPARENT
+};
+
+// Returns false (and keeps the mode) if the mode is not supported on this system
+bool SetHugePageMode(HugePageMode mode);
+HugePageMode GetHugePageMode();
+HugePageStats GetHugePageStats();
+const char* GetHugePageModeName(HugePageMode mode);
+
+// Throw std::bad_alloc; FreeIndexMemory takes the size passed to AllocateIndexMemory
+void* AllocateIndexMemory(size_t bytes);
+void FreeIndexMemory(void* pointer, size_t bytes);
+
+template <typename T>
+class IndexAllocator {
+public:
+    using value_type = T;
+
+    IndexAllocator() = default;
+    template <typename U>
+    IndexAllocator(const IndexAllocator<U>&) {
+    }
+
+    T* allocate(size_t count) {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(AllocateIndexMemory(count * sizeof(T)));
+    }
+    void deallocate(T* pointer, size_t count) {
+        FreeIndexMemory(pointer, count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const IndexAllocator<U>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const IndexAllocator<U>&) const {
+        return false;
+    }
+};
+
+template <typename T>
+using IndexVector = std::vector<T, IndexAllocator<T>>;
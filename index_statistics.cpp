@@ -0,0 +1,36 @@
+#include "index_statistics.h"
+
+using namespace std::string_literals;
+
+size_t IndexMemoryUsage::GetTotal() const {
+    // document_contents is a part of documents
+    return word_to_document_freqs + forward_index + documents + stop_words + added_doc_ids
+        + document_columns + term_dictionary + fuzzy_index;
+}
+
+void PrintIndexStatistics(std::ostream& out, const IndexStatistics& statistics) {
+    const IndexMemoryUsage& memory = statistics.memory;
+    out << "documents: "s << statistics.document_count << ", terms: "s << statistics.term_count
+        << ", postings: "s << statistics.posting_count << std::endl;
+    out << "average document: "s << statistics.average_document_terms << " terms, "s
+        << statistics.average_document_bytes << " bytes"s << std::endl;
+    out << "memory, bytes: total "s << memory.GetTotal()
+        << ", word_to_document_freqs "s << memory.word_to_document_freqs
+        << ", forward_index "s << memory.forward_index
+        << ", documents "s << memory.documents << " (contents "s << memory.document_contents << ")"s
+        << ", stop_words "s << memory.stop_words
+        << ", added_doc_ids "s << memory.added_doc_ids
+        << ", document_columns "s << memory.document_columns
+        << ", term_dictionary "s << memory.term_dictionary
+        << ", fuzzy_index "s << memory.fuzzy_index << std::endl;
+    out << "posting list lengths:"s;
+    for (size_t bucket = 0; bucket < statistics.posting_length_histogram.size(); ++bucket) {
+        out << ' ' << (size_t{ 1 } << bucket) << "+: "s << statistics.posting_length_histogram[bucket];
+    }
+    out << std::endl;
+    out << "longest posting lists:"s;
+    for (const PostingListLength& list : statistics.longest_posting_lists) {
+        out << ' ' << list.word << ' ' << list.length;
+    }
+    out << std::endl;
+}
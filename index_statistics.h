@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Heap bytes of the index structures. Containers do not report their allocations, so node and
+// buffer sizes are estimated from the element types with the allocator model below.
+struct IndexMemoryUsage {
+    size_t word_to_document_freqs = 0;    // terms and posting lists
+    size_t forward_index = 0;    // document term arrays and the term ids
+    size_t documents = 0;    // document nodes and contents
+    size_t document_contents = 0;    // of which the compressed contents and the block cache
+    size_t stop_words = 0;
+    size_t added_doc_ids = 0;
+    size_t document_columns = 0;
+    size_t term_dictionary = 0;
+    size_t fuzzy_index = 0;
+
+    size_t GetTotal() const;
+};
+
+struct PostingListLength {
+    std::string word;
+    size_t length = 0;
+};
+
+struct IndexStatistics {
+    IndexMemoryUsage memory;
+    size_t document_count = 0;
+    size_t term_count = 0;
+    size_t posting_count = 0;    // (term, document) pairs
+    double average_document_terms = 0.0;    // distinct indexed words
+    double average_document_bytes = 0.0;
+    // [i]: number of posting lists with length in [2^i, 2^(i+1))
+    std::vector<size_t> posting_length_histogram;
+    // Longest first
+    std::vector<PostingListLength> longest_posting_lists;
+};
+
+void PrintIndexStatistics(std::ostream& out, const IndexStatistics& statistics);
+
+// Bucket of posting_length_histogram for a list length, length > 0
+inline size_t GetPostingLengthBucket(size_t length) {
+    size_t bucket = 0;
+    while (length > 1) {
+        length >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+// Allocator model: a malloc chunk carries an 8-byte header and is rounded up to 16 bytes, 32 at least
+inline size_t EstimateAllocationBytes(size_t size) {
+    return size == 0 ? 0 : std::max<size_t>(32, (size + 8 + 15) & ~size_t{ 15 });
+}
+
+// Red-black tree node of std::map/std::set: color, parent, left, right, value
+template <typename Value>
+size_t EstimateTreeNodeBytes() {
+    return EstimateAllocationBytes(4 * sizeof(void*) + sizeof(Value));
+}
+
+// Hash table node of std::unordered_map/std::unordered_set: next, value, cached hash
+template <typename Value>
+size_t EstimateHashNodeBytes() {
+    return EstimateAllocationBytes(2 * sizeof(void*) + sizeof(Value));
+}
+
+// Heap buffer of a string, 0 if the characters fit in the object (small string optimization)
+inline size_t EstimateStringBytes(const std::string& value) {
+    const char* const object = reinterpret_cast<const char*>(&value);
+    if (value.data() >= object && value.data() < object + sizeof(value)) {
+        return 0;
+    }
+    return EstimateAllocationBytes(value.capacity() + 1);
+}
+
+template <typename T, typename Allocator>
+size_t EstimateVectorBytes(const std::vector<T, Allocator>& value) {
+    return EstimateAllocationBytes(value.capacity() * sizeof(T));
+}
@@ -0,0 +1,134 @@
+#include "lz_codec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace std::string_literals;
+
+namespace {
+
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_OFFSET = 65535;
+    const size_t HASH_BITS = 12;
+
+    uint32_t Read32(const std::string_view input, size_t pos) {
+        uint32_t value;
+        std::memcpy(&value, input.data() + pos, sizeof(value));
+        return value;
+    }
+
+    size_t HashSequence(uint32_t sequence) {
+        return (sequence * 2654435761U) >> (32 - HASH_BITS);
+    }
+
+    void WriteLength(std::string& output, size_t length) {
+        for (; length >= 255; length -= 255) {
+            output.push_back(static_cast<char>(255));
+        }
+        output.push_back(static_cast<char>(length));
+    }
+
+    // A sequence without a match ends the stream
+    void WriteSequence(std::string& output, const std::string_view literals, size_t offset, size_t match_length) {
+        const size_t literal_nibble = std::min<size_t>(literals.size(), 15);
+        const size_t match_nibble = match_length == 0 ? 0 : std::min<size_t>(match_length - MIN_MATCH, 15);
+        output.push_back(static_cast<char>(literal_nibble << 4 | match_nibble));
+        if (literal_nibble == 15) {
+            WriteLength(output, literals.size() - 15);
+        }
+        output += literals;
+        if (match_length == 0) {
+            return;
+        }
+        output.push_back(static_cast<char>(offset & 0xFF));
+        output.push_back(static_cast<char>(offset >> 8));
+        if (match_nibble == 15) {
+            WriteLength(output, match_length - MIN_MATCH - 15);
+        }
+    }
+
+    size_t ReadLength(const std::string_view input, size_t& pos, size_t nibble) {
+        size_t length = nibble;
+        if (nibble < 15) {
+            return length;
+        }
+        for (;;) {
+            if (pos == input.size()) {
+                throw std::invalid_argument("Error: truncated compressed block."s);
+            }
+            const unsigned char byte = static_cast<unsigned char>(input[pos++]);
+            length += byte;
+            if (byte < 255) {
+                return length;
+            }
+        }
+    }
+
+}  // namespace
+
+void LzCompress(const std::string_view input, std::string& output) {
+    output.clear();
+    output.reserve(input.size() / 2 + 16);
+    // positions + 1 of the last 4-byte sequences with each hash, 0 if none
+    std::vector<uint32_t> table(size_t{ 1 } << HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + MIN_MATCH <= input.size()) {
+        const uint32_t sequence = Read32(input, pos);
+        uint32_t& slot = table[HashSequence(sequence)];
+        const size_t candidate = slot;
+        slot = static_cast<uint32_t>(pos + 1);
+        if (candidate == 0 || pos + 1 - candidate > MAX_OFFSET || Read32(input, candidate - 1) != sequence) {
+            ++pos;
+            continue;
+        }
+        const size_t match = candidate - 1;
+        size_t length = MIN_MATCH;
+        while (pos + length < input.size() && input[match + length] == input[pos + length]) {
+            ++length;
+        }
+        WriteSequence(output, input.substr(anchor, pos - anchor), pos - match, length);
+        pos += length;
+        anchor = pos;
+    }
+    WriteSequence(output, input.substr(anchor), 0, 0);
+}
+
+void LzDecompress(const std::string_view input, std::string& output) {
+    output.clear();
+    size_t pos = 0;
+    while (pos < input.size()) {
+        const unsigned char token = static_cast<unsigned char>(input[pos++]);
+        const size_t literal_length = ReadLength(input, pos, token >> 4);
+        if (literal_length > input.size() - pos) {
+            throw std::invalid_argument("Error: truncated compressed block."s);
+        }
+        output.append(input.data() + pos, literal_length);
+        pos += literal_length;
+        if (pos == input.size()) {
+            break;
+        }
+        if (input.size() - pos < 2) {
+            throw std::invalid_argument("Error: truncated compressed block."s);
+        }
+        const size_t offset = static_cast<unsigned char>(input[pos]) | static_cast<size_t>(static_cast<unsigned char>(input[pos + 1])) << 8;
+        pos += 2;
+        if (offset == 0 || offset > output.size()) {
+            throw std::invalid_argument("Error: invalid match offset in compressed block."s);
+        }
+        const size_t match_length = ReadLength(input, pos, token & 15) + MIN_MATCH;
+        const size_t from = output.size() - offset;
+        if (offset >= match_length) {
+            output.append(output, from, match_length);
+        }
+        else {
+            // the match repeats the bytes it produces
+            for (size_t i = 0; i < match_length; ++i) {
+                output.push_back(output[from + i]);
+            }
+        }
+    }
+}
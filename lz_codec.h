@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Byte-oriented LZ77 codec in the spirit of LZ4, for blocks of document text.
+// A compressed stream is a sequence of
+//   token (literal length << 4 | match length - 4), literal length extension, literals,
+//   match offset (2 bytes, little endian), match length extension;
+// the last sequence has literals only. A length nibble of 15 continues in the following bytes,
+// each adding its value while it is 255. Matches are at least 4 bytes long and at most 65535
+// bytes back, they may overlap the bytes they produce.
+
+// Replaces the contents of output
+void LzCompress(const std::string_view input, std::string& output);
+// Replaces the contents of output, throws std::invalid_argument on a corrupt stream
+void LzDecompress(const std::string_view input, std::string& output);
@@ -0,0 +1,186 @@
+#include "numa_replicas.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::string_literals;
+
+struct NumaReplicatedIndex::WorkerPool {
+    std::mutex batch_mutex;    // held by ProcessQueries for the whole batch
+    std::mutex mutex;
+    std::condition_variable batch_ready;
+    std::condition_variable batch_done;
+    uint64_t batch = 0;    // number of the current batch
+    size_t busy_workers = 0;
+    bool stopping = false;
+    const std::vector<std::string>* queries = nullptr;
+    std::vector<std::vector<Document>>* results = nullptr;
+    std::vector<std::exception_ptr>* errors = nullptr;
+    std::atomic<size_t> next_query{ 0 };
+};
+
+NumaReplicatedIndex::NumaReplicatedIndex(const SearchServer& source, std::function<std::unique_ptr<SearchServer>()> make_empty,
+    NumaReplicaOptions options)
+    : source_(source)
+    , options_(std::move(options)) {
+    if (options_.nodes.empty()) {
+        options_.nodes = DetectNumaNodes();
+    }
+    for (size_t i = 0; i < options_.nodes.size(); ++i) {
+        if (options_.nodes[i].cpus.empty()) {
+            throw std::invalid_argument("Error: NUMA node without CPUs."s);
+        }
+        for (const int cpu : options_.nodes[i].cpus) {
+            if (cpu >= static_cast<int>(node_by_cpu_.size())) {
+                node_by_cpu_.resize(cpu + 1, -1);
+            }
+            node_by_cpu_[cpu] = static_cast<int>(i);
+        }
+    }
+    queries_by_node_.resize(options_.nodes.size());
+    if (options_.nodes.size() == 1 && !options_.replicate_single_node) {
+        StartWorkers();
+        return;
+    }
+
+    // the nodes build their replicas at the same time, the source is only read
+    replicas_.resize(options_.nodes.size());
+    std::vector<std::thread> builders;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    for (size_t i = 0; i < options_.nodes.size(); ++i) {
+        builders.emplace_back([this, i, &make_empty, &error, &error_mutex]() {
+            (PinCurrentThread(options_.nodes[i].cpus) ? pinned_workers_ : unpinned_workers_).Add();
+            try {
+                std::unique_ptr<SearchServer> replica = make_empty();
+                for (const int document_id : source_) {
+                    replica->AddDocument(document_id, source_.GetDocumentText(document_id), source_.GetDocumentStatus(document_id),
+                        { source_.GetDocumentRating(document_id) });
+                }
+                replica->SetQueryPlannerOptions(source_.GetQueryPlannerOptions());
+                replicas_[i] = std::move(replica);
+            }
+            catch (...) {
+                std::lock_guard guard(error_mutex);
+                error = std::current_exception();
+            }
+            });
+    }
+    for (std::thread& builder : builders) {
+        builder.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    StartWorkers();
+}
+
+NumaReplicatedIndex::~NumaReplicatedIndex() {
+    {
+        std::lock_guard lock(pool_->mutex);
+        pool_->stopping = true;
+    }
+    pool_->batch_ready.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void NumaReplicatedIndex::StartWorkers() {
+    pool_ = std::make_unique<WorkerPool>();
+    for (size_t node = 0; node < options_.nodes.size(); ++node) {
+        const std::vector<int>& cpus = options_.nodes[node].cpus;
+        const size_t worker_count = options_.workers_per_node > 0 ? options_.workers_per_node : cpus.size();
+        for (size_t worker = 0; worker < worker_count; ++worker) {
+            workers_.emplace_back([this, node, cpu = cpus[worker % cpus.size()]]() { RunWorker(node, cpu); });
+        }
+    }
+}
+
+void NumaReplicatedIndex::RunWorker(size_t node, int cpu) {
+    (PinCurrentThread({ cpu }) ? pinned_workers_ : unpinned_workers_).Add();
+    const SearchServer& replica = GetReplica(node);
+    WorkerPool& pool = *pool_;
+    uint64_t last_batch = 0;
+    std::unique_lock lock(pool.mutex);
+    while (true) {
+        pool.batch_ready.wait(lock, [&pool, last_batch]() { return pool.stopping || pool.batch != last_batch; });
+        if (pool.stopping) {
+            return;
+        }
+        last_batch = pool.batch;
+        const std::vector<std::string>& queries = *pool.queries;
+        lock.unlock();
+        uint64_t processed = 0;
+        for (size_t i = pool.next_query++; i < queries.size(); i = pool.next_query++) {
+            try {
+                (*pool.results)[i] = replica.FindTopDocuments(std::execution::seq, queries[i]);
+            }
+            catch (...) {
+                (*pool.errors)[i] = std::current_exception();
+            }
+            ++processed;
+        }
+        queries_by_node_[node].Add(processed);
+        lock.lock();
+        if (--pool.busy_workers == 0) {
+            pool.batch_done.notify_all();
+        }
+    }
+}
+
+const std::vector<NumaNode>& NumaReplicatedIndex::GetNodes() const {
+    return options_.nodes;
+}
+
+const SearchServer& NumaReplicatedIndex::GetReplica(size_t node_index) const {
+    if (node_index >= options_.nodes.size()) {
+        throw std::out_of_range("Error: no NUMA node with such index."s);
+    }
+    return replicas_.empty() ? source_ : *replicas_[node_index];
+}
+
+const SearchServer& NumaReplicatedIndex::GetLocalReplica() const {
+    const int cpu = GetCurrentCpu();
+    const int node = cpu >= 0 && cpu < static_cast<int>(node_by_cpu_.size()) ? node_by_cpu_[cpu] : -1;
+    return GetReplica(node >= 0 ? node : 0);
+}
+
+std::vector<std::vector<Document>> NumaReplicatedIndex::ProcessQueries(const std::vector<std::string>& queries) const {
+    std::vector<std::vector<Document>> results(queries.size());
+    std::vector<std::exception_ptr> errors(queries.size());
+    WorkerPool& pool = *pool_;
+    std::lock_guard batch_lock(pool.batch_mutex);
+    {
+        std::unique_lock lock(pool.mutex);
+        pool.queries = &queries;
+        pool.results = &results;
+        pool.errors = &errors;
+        pool.next_query = 0;
+        pool.busy_workers = workers_.size();
+        ++pool.batch;
+        pool.batch_ready.notify_all();
+        pool.batch_done.wait(lock, [&pool]() { return pool.busy_workers == 0; });
+    }
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    return results;
+}
+
+NumaReplicaStats NumaReplicatedIndex::GetStats() const {
+    NumaReplicaStats stats;
+    stats.replicas = replicas_.size();
+    for (const AtomicCounter& queries : queries_by_node_) {
+        stats.queries_by_node.push_back(queries.Get());
+    }
+    stats.pinned_workers = pinned_workers_.Get();
+    stats.unpinned_workers = unpinned_workers_.Get();
+    return stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "atomic_counter.h"
+#include "document.h"
+#include "numa_topology.h"
+#include "search_server.h"
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <string>
+#include <vector>
+
+struct NumaReplicaOptions {
+    std::vector<NumaNode> nodes;    // empty: DetectNumaNodes()
+    size_t workers_per_node = 0;    // query threads per node, 0: one per CPU of the node
+    bool replicate_single_node = false;    // one node queries the source index unless set
+};
+
+struct NumaReplicaStats {
+    size_t replicas = 0;    // 0 when the source index is queried
+    std::vector<uint64_t> queries_by_node;    // in the order of the nodes
+    uint64_t pinned_workers = 0;
+    uint64_t unpinned_workers = 0;    // pinning not supported or refused
+};
+
+// Read-only replicas of an index, one per NUMA node, for query batches from every socket.
+// A replica is rebuilt from the documents of the source on a thread pinned to the CPUs of its
+// node, so the default first-touch policy allocates it in node-local memory (no libnuma).
+// A persistent pool of query workers is started with the index: every worker is pinned to a
+// CPU of its node once and searches that node's replica only.
+// With a single node the source index is queried by pinned workers unless replicate_single_node.
+// Updates of the source after construction are not replicated.
+class NumaReplicatedIndex {
+public:
+    // make_empty returns an empty index set up like source (stop words, normalization, fuzzy and
+    // forward index modes); it is called on the pinned thread of each node.
+    NumaReplicatedIndex(const SearchServer& source, std::function<std::unique_ptr<SearchServer>()> make_empty,
+        NumaReplicaOptions options = {});
+    NumaReplicatedIndex(const NumaReplicatedIndex&) = delete;
+    NumaReplicatedIndex& operator=(const NumaReplicatedIndex&) = delete;
+    // Stops the workers
+    ~NumaReplicatedIndex();
+
+    const std::vector<NumaNode>& GetNodes() const;
+    // Index searched by the workers of the node with the index in GetNodes()
+    const SearchServer& GetReplica(size_t node_index) const;
+    // Replica of the node of the CPU the calling thread runs on (the first one if unknown)
+    const SearchServer& GetLocalReplica() const;
+
+    // Results identical to ProcessQueries, evaluated by the pinned workers of every node.
+    // Batches run one at a time; throws std::invalid_argument for invalid queries.
+    std::vector<std::vector<Document>> ProcessQueries(const std::vector<std::string>& queries) const;
+
+    NumaReplicaStats GetStats() const;
+
+private:
+    // Batch handed to the workers
+    struct WorkerPool;
+
+    const SearchServer& source_;
+    NumaReplicaOptions options_;
+    std::vector<std::unique_ptr<SearchServer>> replicas_;    // by node, empty when the source is queried
+    std::vector<int> node_by_cpu_;    // node index by CPU, -1 for unknown CPUs
+    mutable std::vector<AtomicCounter> queries_by_node_;
+    mutable AtomicCounter pinned_workers_;
+    mutable AtomicCounter unpinned_workers_;
+    std::unique_ptr<WorkerPool> pool_;
+    std::vector<std::thread> workers_;
+
+    void StartWorkers();
+    void RunWorker(size_t node, int cpu);
+};
@@ -0,0 +1,124 @@
+#include "numa_topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <filesystem>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+    std::vector<NumaNode> MakeSingleNode() {
+        NumaNode node;
+        const int cpu_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int cpu = 0; cpu < cpu_count; ++cpu) {
+            node.cpus.push_back(cpu);
+        }
+        return { node };
+    }
+
+    int ParseCpuNumber(const std::string_view text) {
+        if (text.empty() || text.size() > 6 || !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            throw std::invalid_argument("Error: malformed CPU list."s);
+        }
+        return std::stoi(std::string(text));
+    }
+
+}  // namespace
+
+std::vector<int> ParseCpuList(std::string_view text) {
+    while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) {
+        text.remove_suffix(1);
+    }
+    std::vector<int> cpus;
+    while (!text.empty()) {
+        const size_t comma = std::min(text.find(','), text.size());
+        const std::string_view range = text.substr(0, comma);
+        const size_t dash = range.find('-');
+        const int first = ParseCpuNumber(range.substr(0, dash));
+        const int last = dash == std::string_view::npos ? first : ParseCpuNumber(range.substr(dash + 1));
+        if (last < first) {
+            throw std::invalid_argument("Error: malformed CPU list."s);
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        text.remove_prefix(std::min(comma + 1, text.size()));
+    }
+    return cpus;
+}
+
+#if defined(__linux__)
+
+std::vector<NumaNode> DetectNumaNodes() {
+    std::vector<NumaNode> nodes;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        const std::string name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0
+            || !std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        std::ifstream input(entry.path() / "cpulist");
+        std::string cpu_list;
+        std::getline(input, cpu_list);
+        NumaNode node;
+        node.id = std::stoi(name.substr(4));
+        try {
+            node.cpus = ParseCpuList(cpu_list);
+        }
+        catch (const std::invalid_argument&) {
+            continue;
+        }
+        // memory-only nodes have no CPUs to run their queries
+        if (!node.cpus.empty()) {
+            nodes.push_back(std::move(node));
+        }
+    }
+    if (nodes.empty()) {
+        return MakeSingleNode();
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode& lhs, const NumaNode& rhs) {
+        return lhs.id < rhs.id;
+        });
+    return nodes;
+}
+
+bool PinCurrentThread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+int GetCurrentCpu() {
+    return sched_getcpu();
+}
+
+#else
+
+std::vector<NumaNode> DetectNumaNodes() {
+    return MakeSingleNode();
+}
+
+bool PinCurrentThread(const std::vector<int>& cpus) {
+    return false;
+}
+
+int GetCurrentCpu() {
+    return -1;
+}
+
+#endif
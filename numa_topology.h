@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;    // online CPUs of the node
+};
+
+// NUMA nodes with CPUs from /sys/devices/system/node (no libnuma). Without it (other systems,
+// no NUMA support) a single node 0 holding CPUs 0..hardware_concurrency-1.
+std::vector<NumaNode> DetectNumaNodes();
+// Linux CPU list format, e.g. "0-3,8,10-11"; throws std::invalid_argument when malformed
+std::vector<int> ParseCpuList(std::string_view text);
+
+// Restricts the calling thread to cpus, returns false where not supported or refused
+bool PinCurrentThread(const std::vector<int>& cpus);
+// CPU the calling thread runs on, -1 if unknown
+int GetCurrentCpu();
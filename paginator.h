@@ -1,45 +1,102 @@
 #pragma once
-#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 
+// Lazy view of a range as pages of page_size elements (the last one may be shorter).
+// Pages are computed while iterating: O(1) per page for random access iterators,
+// O(page_size) otherwise; nothing is stored.
 template <typename It>
 class Paginator {
 public:
-    explicit Paginator(It begin, It end, size_t page_size) {
-        auto iit = begin;
-        bool next = true;
-        while (distance(begin, end) > 0 && next) {
-            if (distance(begin, end) > page_size) {
-                advance(iit, page_size);
-                result_pages_.push_back(std::pair{ begin, iit });
-                advance(begin, page_size);
-            }
-            else if (distance(begin, end) == page_size) {
-                result_pages_.push_back(std::pair{ begin, end });
-                next = false;
-            }
-            else if (distance(begin, end) < page_size) {
-                result_pages_.push_back(std::pair{ begin, end });
-                next = false;
-            }
+    class PageIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<It, It>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        PageIterator(It begin, It end, size_t page_size)
+            : page_{ begin, PageEnd(begin, end, page_size) }
+            , end_(end)
+            , page_size_(page_size) {
+        }
+
+        reference operator*() const {
+            return page_;
+        }
+        pointer operator->() const {
+            return &page_;
+        }
+        PageIterator& operator++() {
+            page_.first = page_.second;
+            page_.second = PageEnd(page_.first, end_, page_size_);
+            return *this;
+        }
+        PageIterator operator++(int) {
+            PageIterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const PageIterator& other) const {
+            return page_.first == other.page_.first;
+        }
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        value_type page_;
+        It end_;
+        size_t page_size_;
+    };
+
+    explicit Paginator(It begin, It end, size_t page_size)
+        : begin_(begin)
+        , end_(end)
+        , page_size_(page_size) {
+        if (page_size == 0) {
+            throw std::invalid_argument("Error: page size must be positive.");
         }
     }
 
-    auto begin() const {
-        /*returns an iterator to the beginning */
-        return result_pages_.begin();
+    PageIterator begin() const {
+        return PageIterator(begin_, end_, page_size_);
     }
-    auto end() const {
-        /*returns an iterator to the end*/
-        return result_pages_.end();
+    PageIterator end() const {
+        return PageIterator(end_, end_, page_size_);
     }
-    auto size() const {
-        return distance(result_pages_.end(), result_pages_.begin());
+    // Number of pages, walks the range for non random access iterators
+    size_t size() const {
+        const auto element_count = static_cast<size_t>(std::distance(begin_, end_));
+        return (element_count + page_size_ - 1) / page_size_;
     }
+
 private:
-    std::vector<std::pair<It, It>> result_pages_;
+    It begin_;
+    It end_;
+    size_t page_size_;
+
+    static It PageEnd(It begin, It end, size_t page_size) {
+        if constexpr (std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>) {
+            return begin + static_cast<typename std::iterator_traits<It>::difference_type>(
+                std::min<size_t>(page_size, static_cast<size_t>(end - begin)));
+        }
+        else {
+            for (size_t i = 0; i < page_size && begin != end; ++i) {
+                ++begin;
+            }
+            return begin;
+        }
+    }
 };
 
 template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
+    using std::begin;
+    using std::end;
     return Paginator(begin(c), end(c), page_size);
 }
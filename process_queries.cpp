@@ -4,6 +4,7 @@
 
 #include "process_queries.h"
 #include "search_server.h"
+#include "batch_query_evaluator.h"
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
@@ -25,6 +26,36 @@ std::vector<std::vector<Document>> ProcessQueries(
     return ProcessQueries(search_server, sv_q);
 }
 
+std::vector<SearchResult> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    std::chrono::nanoseconds timeout,
+    uint64_t max_postings) {
+    std::vector<SearchResult> result(queries.size());
+    std::transform(std::execution::par, queries.begin(), queries.end(), result.begin(),
+        [&search_server, timeout, max_postings](const std::string& query) {
+            // the per-ordinal buffers are reused by every query of the thread
+            thread_local QueryContext context;
+            SearchResult query_result;
+            query_result.completion = search_server.FindTopDocuments(context, QueryBudget::FromTimeout(timeout, max_postings),
+                query, query_result.documents);
+            return query_result;
+        });
+    return result;
+}
+
+std::vector<std::vector<Document>> ProcessQueriesShared(
+    const SearchServer& search_server,
+    const std::vector<std::string_view>& queries) {
+    return BatchQueryEvaluator(search_server).FindTopDocuments(queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueriesShared(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueriesShared(search_server, std::vector<std::string_view>(queries.begin(), queries.end()));
+}
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string_view> queries) {
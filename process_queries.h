@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <vector>
 #include <list>
 
@@ -14,6 +17,23 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
+// Budgeted: every query may run for timeout from its own start and scan max_postings posting entries
+std::vector<SearchResult> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    std::chrono::nanoseconds timeout,
+    uint64_t max_postings = std::numeric_limits<uint64_t>::max());
+
+// Results identical to ProcessQueries, evaluated with one shared scan of the posting list of
+// every term per query group (see BatchQueryEvaluator)
+std::vector<std::vector<Document>> ProcessQueriesShared(
+    const SearchServer& search_server,
+    const std::vector<std::string_view>& queries);
+
+std::vector<std::vector<Document>> ProcessQueriesShared(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string_view> queries);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "document.h"
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Limits of one budgeted query. Plus terms are processed from the shortest posting list
+// (highest IDF) on; a term that would exceed max_postings, or passing the deadline (checked
+// every DEADLINE_CHECK_POSTINGS postings), ends the query with the results found so far.
+// Minus terms are not scanned and not counted: scored documents are looked up in them.
+struct QueryBudget {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    uint64_t max_postings = std::numeric_limits<uint64_t>::max();    // posting entries scanned
+
+    static QueryBudget FromTimeout(std::chrono::nanoseconds timeout,
+        uint64_t max_postings = std::numeric_limits<uint64_t>::max()) {
+        return { std::chrono::steady_clock::now() + timeout, max_postings };
+    }
+};
+
+enum class QueryCompletion : uint8_t {
+    COMPLETE,
+    DEADLINE_EXCEEDED,
+    POSTINGS_EXHAUSTED,
+};
+
+struct SearchResult {
+    std::vector<Document> documents;
+    QueryCompletion completion = QueryCompletion::COMPLETE;
+
+    // The budget ran out before every term was processed
+    bool IsPartial() const {
+        return completion != QueryCompletion::COMPLETE;
+    }
+};
+
+struct QueryBudgetStats {
+    uint64_t queries = 0;    // budgeted queries
+    uint64_t deadline_exceeded = 0;
+    uint64_t postings_exhausted = 0;
+    uint64_t skipped_terms = 0;    // plus terms not processed by partial queries
+};
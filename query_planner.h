@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Execution policy of FindTopDocuments and FindTopDocumentsPage: the query planner chooses
+// term-at-a-time or document-at-a-time scoring and sequential or parallel execution per query
+struct AutoExecutionPolicy {};
+inline constexpr AutoExecutionPolicy auto_execution{};
+
+enum class EvaluationStrategy : uint8_t {
+    AUTO,    // by the cost model
+    TERM_AT_A_TIME,    // posting lists one after another into a map of scores, parallel across terms
+    DOCUMENT_AT_A_TIME,    // posting cursors merged by ordinal, parallel across ordinal ranges
+};
+
+// Cost model of auto_execution. TAAT costs an ordered map update per posting entry, DAAT a pass
+// over the term cursors per matched document, so DAAT wins for short queries. A query goes
+// parallel from parallel_min_postings plus posting entries when more than one thread is available;
+// TAAT then runs a task per term, DAAT a task per ordinal range of about range_postings entries.
+struct QueryPlannerOptions {
+    EvaluationStrategy strategy = EvaluationStrategy::AUTO;
+    uint64_t parallel_min_postings = 1 << 16;
+    uint64_t range_postings = 1 << 14;
+    size_t max_threads = 0;    // 0: std::thread::hardware_concurrency()
+};
+
+struct QueryPlan {
+    EvaluationStrategy strategy = EvaluationStrategy::TERM_AT_A_TIME;    // never AUTO
+    bool parallel = false;
+    size_t terms = 0;    // plus posting lists, prefix expansions included
+    uint64_t postings = 0;    // entries of the plus posting lists
+    uint64_t longest_postings = 0;
+    size_t ranges = 1;    // ordinal ranges of a parallel DAAT query
+};
+
+struct QueryPlannerStats {
+    uint64_t taat_seq = 0;    // auto_execution queries by plan
+    uint64_t taat_par = 0;
+    uint64_t daat_seq = 0;
+    uint64_t daat_par = 0;
+};
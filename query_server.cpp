@@ -0,0 +1,723 @@
+#include "query_server.h"
+#include "shard_protocol.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+    const size_t READ_CHUNK_SIZE = 64 * 1024;
+    const size_t MAX_REQUEST_SIZE = 1024 * 1024;
+
+    // Next space-separated token of text, text keeps the rest
+    std::string_view TakeToken(std::string_view& text) {
+        const size_t start = std::min(text.find_first_not_of(' '), text.size());
+        text.remove_prefix(start);
+        const size_t end = std::min(text.find(' '), text.size());
+        const std::string_view token = text.substr(0, end);
+        text.remove_prefix(end);
+        const size_t rest = std::min(text.find_first_not_of(' '), text.size());
+        text.remove_prefix(rest);
+        return token;
+    }
+
+    int ParseInt(const std::string_view token) {
+        int value = 0;
+        const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (error != std::errc() || end != token.data() + token.size()) {
+            throw std::invalid_argument("Error: not a number: "s + std::string(token));
+        }
+        return value;
+    }
+
+    // Record of the type that restores what it changes of the document, throws std::invalid_argument
+    // for unknown ids. ADD_DOCUMENT copies the whole document to undo its removal, REMOVE_DOCUMENT
+    // undoes its addition.
+    WalRecord MakeUndoRecord(const SearchServer& search_server, WalRecordType type, int document_id) {
+        WalRecord record;
+        record.type = type;
+        record.document_id = document_id;
+        try {
+            if (type == WalRecordType::ADD_DOCUMENT) {
+                record.text = search_server.GetDocumentText(document_id);
+            }
+            if (type == WalRecordType::ADD_DOCUMENT || type == WalRecordType::SET_STATUS) {
+                record.status = search_server.GetDocumentStatus(document_id);
+            }
+            if (type == WalRecordType::ADD_DOCUMENT || type == WalRecordType::SET_RATING) {
+                record.ratings = { search_server.GetDocumentRating(document_id) };
+            }
+        }
+        catch (const std::out_of_range&) {
+            throw std::invalid_argument("Error: no document with such id "s + std::to_string(document_id));
+        }
+        return record;
+    }
+
+    DocumentStatus ParseStatus(const std::string_view token) {
+        const int status = ParseInt(token);
+        if (status < static_cast<int>(DocumentStatus::ACTUAL) || status > static_cast<int>(DocumentStatus::REMOVED)) {
+            throw std::invalid_argument("Error: unknown document status."s);
+        }
+        return static_cast<DocumentStatus>(status);
+    }
+
+    template <typename Number>
+    void AppendNumber(std::string& out, Number value) {
+        char buffer[32];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    double Percentile(const std::vector<int64_t>& sorted_ns, double p) {
+        if (sorted_ns.empty()) {
+            return 0.0;
+        }
+        return sorted_ns[std::min(sorted_ns.size() - 1, static_cast<size_t>(p * sorted_ns.size()))] / 1000.0;
+    }
+
+#if defined(__linux__)
+    // Sends request_count SEARCH requests from queries[first_query] on, pipeline_depth in flight,
+    // appends their latencies and counts ERR responses. Throws std::runtime_error on network errors.
+    void RunLoadConnection(int fd, const std::vector<std::string>& queries, size_t first_query, size_t request_count,
+        size_t pipeline_depth, std::vector<int64_t>& latencies_ns, uint64_t& errors) {
+        using Clock = std::chrono::steady_clock;
+        std::deque<Clock::time_point> in_flight;
+        std::string out;
+        std::string in;
+        size_t sent = 0;
+        size_t received = 0;
+        size_t query_index = first_query;
+        while (received < request_count) {
+            out.clear();
+            while (sent < request_count && in_flight.size() < pipeline_depth) {
+                out += "SEARCH "s;
+                out += queries[query_index++ % queries.size()];
+                out.push_back('\n');
+                in_flight.push_back(Clock::now());
+                ++sent;
+            }
+            for (size_t done = 0; done < out.size();) {
+                const ssize_t n = ::send(fd, out.data() + done, out.size() - done, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    throw std::runtime_error("Error: load generator send failed."s);
+                }
+                done += n;
+            }
+            char buffer[READ_CHUNK_SIZE];
+            const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                throw std::runtime_error("Error: server closed the connection."s);
+            }
+            in.append(buffer, n);
+            size_t pos = 0;
+            for (size_t end = in.find('\n'); end != std::string::npos; end = in.find('\n', pos)) {
+                const auto now = Clock::now();
+                latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - in_flight.front()).count());
+                in_flight.pop_front();
+                errors += in.compare(pos, 3, "ERR"s) == 0 ? 1 : 0;
+                ++received;
+                pos = end + 1;
+            }
+            in.erase(0, pos);
+        }
+    }
+#endif
+
+}  // namespace
+
+struct QueryServer::Connection {
+    int fd = -1;
+    int epoll_fd = -1;    // of the owning worker
+    std::string in;
+    std::string out;
+    size_t out_pos = 0;
+    bool waits_for_write = false;
+    bool closing = false;    // close after the output is sent
+};
+
+struct QueryServer::Worker {
+    int epoll_fd = -1;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    // scratch buffers reused by every request of this worker
+    std::vector<int> ratings;
+    std::vector<std::pair<int, DocumentStatus>> status_updates;
+    std::vector<std::pair<int, int>> rating_updates;
+    std::vector<WalRecord> undo_records;
+    QueryContext query_context;
+    std::vector<Document> documents;
+};
+
+QueryServer::QueryServer(SearchServer& search_server, const std::string& endpoint, size_t worker_count)
+    : search_server_(search_server)
+    , endpoint_(endpoint) {
+    if (worker_count == 0) {
+        throw std::invalid_argument("Error: worker count must be positive."s);
+    }
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+}
+
+QueryServer::~QueryServer() {
+    Stop();
+}
+
+void QueryServer::EnableDurability(WriteAheadLog& log, const std::string& snapshot_path, uint64_t checkpoint_interval) {
+    log_ = &log;
+    snapshot_path_ = snapshot_path;
+    checkpoint_interval_ = checkpoint_interval;
+    checkpoint_sequence_ = log.GetLastSequence();
+}
+
+void QueryServer::EnableRequestTracking(RequestQueue& request_queue) {
+    request_queue_ = &request_queue;
+}
+
+uint64_t QueryServer::LogUpdate(std::vector<WalRecord>& undo_records, const std::function<uint64_t(size_t)>& append) {
+    if (!log_ || undo_records.empty()) {
+        return 0;
+    }
+    try {
+        for (size_t i = 0; i < undo_records.size(); ++i) {
+            undo_records[i].sequence = append(i);
+        }
+    }
+    catch (...) {
+        for (auto it = undo_records.rbegin(); it != undo_records.rend(); ++it) {
+            ApplyUndoRecord(*it);
+        }
+        throw;
+    }
+    std::lock_guard lock(undo_mutex_);
+    const uint64_t durable_sequence = log_->GetDurableSequence();
+    while (!undo_records_.empty() && undo_records_.front().sequence <= durable_sequence) {
+        undo_records_.pop_front();
+    }
+    undo_records_.insert(undo_records_.end(), undo_records.begin(), undo_records.end());
+    return undo_records.back().sequence;
+}
+
+void QueryServer::CommitUpdate(uint64_t sequence) {
+    if (!log_) {
+        return;
+    }
+    try {
+        log_->WaitDurable(sequence);
+    }
+    catch (...) {
+        // the failed log takes no more records, so the newer updates of other workers fail as well
+        std::unique_lock lock(index_mutex_);
+        std::lock_guard undo_lock(undo_mutex_);
+        const uint64_t durable_sequence = log_->GetDurableSequence();
+        while (!undo_records_.empty() && undo_records_.back().sequence > durable_sequence) {
+            ApplyUndoRecord(undo_records_.back());
+            undo_records_.pop_back();
+        }
+        throw;
+    }
+    if (checkpoint_interval_ == 0 || sequence < checkpoint_sequence_.load() + checkpoint_interval_) {
+        return;
+    }
+    {
+        std::lock_guard lock(checkpoint_mutex_);
+        checkpoint_due_ = true;
+    }
+    checkpoint_wanted_.notify_one();
+}
+
+void QueryServer::ApplyUndoRecord(const WalRecord& record) {
+    switch (record.type) {
+    case WalRecordType::ADD_DOCUMENT:
+        search_server_.AddDocument(record.document_id, record.text, record.status, record.ratings);
+        break;
+    case WalRecordType::REMOVE_DOCUMENT:
+        search_server_.RemoveDocument(record.document_id);
+        break;
+    case WalRecordType::SET_STATUS:
+        search_server_.SetDocumentStatuses({ { record.document_id, record.status } });
+        break;
+    case WalRecordType::SET_RATING:
+        search_server_.SetDocumentRatings({ { record.document_id, record.ratings.at(0) } });
+        break;
+    }
+}
+
+void QueryServer::RunCheckpoints() {
+    std::unique_lock lock(checkpoint_mutex_);
+    while (true) {
+        checkpoint_wanted_.wait(lock, [this]() { return checkpoint_due_ || stop_checkpoints_; });
+        if (stop_checkpoints_) {
+            return;
+        }
+        checkpoint_due_ = false;
+        lock.unlock();
+        try {
+            // updates are logged under the exclusive lock or the metadata lock, so holding both pins
+            // the index to the log's last sequence while the documents are copied; queries go on
+            std::shared_lock index_lock(index_mutex_);
+            std::unique_lock metadata_lock(metadata_mutex_);
+            const uint64_t sequence = log_->GetLastSequence();
+            const std::string snapshot = MakeSnapshot(search_server_, sequence);
+            metadata_lock.unlock();
+            index_lock.unlock();
+            // records that are not durable may still be undone
+            log_->WaitDurable(sequence);
+            WriteSnapshot(snapshot, *log_, snapshot_path_);
+            checkpoint_sequence_ = sequence;
+        }
+        catch (const std::exception&) {
+            // the log keeps every record, the next due update retries
+        }
+        lock.lock();
+    }
+}
+
+uint64_t QueryServer::GetRequestCount() const {
+    return request_count_.load(std::memory_order_relaxed);
+}
+
+bool QueryServer::HandleLine(Worker& worker, const std::string_view line, std::string& out) {
+    std::string_view rest = line;
+    const std::string_view command = TakeToken(rest);
+    if (command.empty()) {
+        return true;
+    }
+    request_count_.fetch_add(1, std::memory_order_relaxed);
+    try {
+        if (command == "SEARCH"s) {
+            std::shared_lock lock(index_mutex_);
+            if (request_queue_) {
+                request_queue_->AddFindRequest(worker.query_context, rest, worker.documents);
+            }
+            else {
+                search_server_.FindTopDocuments(worker.query_context, rest, worker.documents);
+            }
+            lock.unlock();
+            out += "OK "s;
+            AppendNumber(out, worker.documents.size());
+            for (const Document& document : worker.documents) {
+                out.push_back(' ');
+                AppendNumber(out, document.id);
+                out.push_back(' ');
+                AppendNumber(out, document.relevance);
+                out.push_back(' ');
+                AppendNumber(out, document.rating);
+            }
+        }
+        else if (command == "MATCH"s) {
+            const int document_id = ParseInt(TakeToken(rest));
+            std::shared_lock lock(index_mutex_);
+            const auto [words, status] = search_server_.MatchDocument(std::execution::seq, rest, document_id);
+            out += "OK "s;
+            AppendNumber(out, static_cast<int>(status));
+            for (const std::string_view word : words) {
+                out.push_back(' ');
+                out.append(word);
+            }
+        }
+        else if (command == "ADD"s) {
+            const int document_id = ParseInt(TakeToken(rest));
+            const DocumentStatus status = ParseStatus(TakeToken(rest));
+            std::string_view ratings = TakeToken(rest);
+            worker.ratings.clear();
+            while (ratings != "-"s && !ratings.empty()) {
+                const size_t comma = std::min(ratings.find(','), ratings.size());
+                worker.ratings.push_back(ParseInt(ratings.substr(0, comma)));
+                ratings.remove_prefix(std::min(comma + 1, ratings.size()));
+            }
+            std::unique_lock lock(index_mutex_);
+            search_server_.AddDocument(document_id, rest, status, worker.ratings);
+            worker.undo_records.clear();
+            if (log_) {
+                worker.undo_records.push_back(MakeUndoRecord(search_server_, WalRecordType::REMOVE_DOCUMENT, document_id));
+            }
+            const uint64_t sequence = LogUpdate(worker.undo_records, [&](size_t) {
+                return log_->AppendAdd(document_id, rest, status, worker.ratings);
+                });
+            lock.unlock();
+            CommitUpdate(sequence);
+            out += "OK"s;
+        }
+        else if (command == "REMOVE"s) {
+            const int document_id = ParseInt(TakeToken(rest));
+            std::unique_lock lock(index_mutex_);
+            worker.undo_records.clear();
+            if (log_) {
+                worker.undo_records.push_back(MakeUndoRecord(search_server_, WalRecordType::ADD_DOCUMENT, document_id));
+            }
+            search_server_.RemoveDocument(document_id);
+            const uint64_t sequence = LogUpdate(worker.undo_records, [&](size_t) {
+                return log_->AppendRemove(document_id);
+                });
+            lock.unlock();
+            CommitUpdate(sequence);
+            out += "OK"s;
+        }
+        else if (command == "STATUS"s) {
+            worker.status_updates.clear();
+            while (!rest.empty()) {
+                const int document_id = ParseInt(TakeToken(rest));
+                worker.status_updates.emplace_back(document_id, ParseStatus(TakeToken(rest)));
+            }
+            // metadata updates share the index with queries and are serialized among themselves
+            std::shared_lock lock(index_mutex_);
+            std::unique_lock metadata_lock(metadata_mutex_);
+            worker.undo_records.clear();
+            if (log_) {
+                for (const auto& [document_id, _] : worker.status_updates) {
+                    worker.undo_records.push_back(MakeUndoRecord(search_server_, WalRecordType::SET_STATUS, document_id));
+                }
+            }
+            search_server_.SetDocumentStatuses(worker.status_updates);
+            const uint64_t sequence = LogUpdate(worker.undo_records, [&](size_t i) {
+                return log_->AppendSetStatus(worker.status_updates[i].first, worker.status_updates[i].second);
+                });
+            metadata_lock.unlock();
+            lock.unlock();
+            CommitUpdate(sequence);
+            out += "OK"s;
+        }
+        else if (command == "RATING"s) {
+            worker.rating_updates.clear();
+            while (!rest.empty()) {
+                const int document_id = ParseInt(TakeToken(rest));
+                worker.rating_updates.emplace_back(document_id, ParseInt(TakeToken(rest)));
+            }
+            std::shared_lock lock(index_mutex_);
+            std::unique_lock metadata_lock(metadata_mutex_);
+            worker.undo_records.clear();
+            if (log_) {
+                for (const auto& [document_id, _] : worker.rating_updates) {
+                    worker.undo_records.push_back(MakeUndoRecord(search_server_, WalRecordType::SET_RATING, document_id));
+                }
+            }
+            search_server_.SetDocumentRatings(worker.rating_updates);
+            const uint64_t sequence = LogUpdate(worker.undo_records, [&](size_t i) {
+                return log_->AppendSetRating(worker.rating_updates[i].first, worker.rating_updates[i].second);
+                });
+            metadata_lock.unlock();
+            lock.unlock();
+            CommitUpdate(sequence);
+            out += "OK"s;
+        }
+        else if (command == "STATS"s) {
+            std::shared_lock lock(index_mutex_);
+            const IndexStatistics statistics = search_server_.GetIndexStatistics(0);
+            lock.unlock();
+            out += "OK "s;
+            AppendNumber(out, statistics.document_count);
+            out.push_back(' ');
+            AppendNumber(out, statistics.term_count);
+            out.push_back(' ');
+            AppendNumber(out, statistics.posting_count);
+            out.push_back(' ');
+            AppendNumber(out, statistics.memory.GetTotal());
+        }
+        else if (command == "QUIT"s) {
+            return false;
+        }
+        else {
+            throw std::invalid_argument("Error: unknown command "s + std::string(command));
+        }
+    }
+    catch (const std::exception& e) {
+        out += "ERR "s;
+        out += e.what();
+    }
+    out.push_back('\n');
+    return true;
+}
+
+#if defined(__linux__)
+
+void QueryServer::Start() {
+    if (!threads_.empty()) {
+        return;
+    }
+    listen_fd_ = OpenListeningSocket(endpoint_);
+    fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK);
+    for (auto& worker : workers_) {
+        worker->epoll_fd = epoll_create1(0);
+        epoll_event event{};
+        // every worker waits for new connections, one of them is woken per connection
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.fd = listen_fd_;
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, listen_fd_, &event);
+        event.events = EPOLLIN;
+        event.data.fd = stop_fd_;
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, stop_fd_, &event);
+    }
+    for (auto& worker : workers_) {
+        threads_.emplace_back([this, &worker = *worker]() { RunWorker(worker); });
+    }
+    if (log_ && checkpoint_interval_ > 0) {
+        stop_checkpoints_ = false;
+        checkpoint_thread_ = std::thread([this]() { RunCheckpoints(); });
+    }
+}
+
+void QueryServer::Stop() {
+    if (threads_.empty()) {
+        return;
+    }
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t written = ::write(stop_fd_, &one, sizeof(one));
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+    if (checkpoint_thread_.joinable()) {
+        {
+            std::lock_guard lock(checkpoint_mutex_);
+            stop_checkpoints_ = true;
+        }
+        checkpoint_wanted_.notify_one();
+        checkpoint_thread_.join();
+    }
+    for (auto& worker : workers_) {
+        for (const auto& [fd, _] : worker->connections) {
+            ::close(fd);
+        }
+        worker->connections.clear();
+        ::close(worker->epoll_fd);
+    }
+    ::close(stop_fd_);
+    ::close(listen_fd_);
+    if (endpoint_.compare(0, 5, "unix:"s) == 0) {
+        ::unlink(endpoint_.c_str() + 5);
+    }
+}
+
+void QueryServer::RunWorker(Worker& worker) {
+    epoll_event events[64];
+    while (true) {
+        const int count = epoll_wait(worker.epoll_fd, events, 64, -1);
+        if (count < 0 && errno != EINTR) {
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == stop_fd_) {
+                return;
+            }
+            if (fd == listen_fd_) {
+                AcceptConnection(worker);
+                continue;
+            }
+            const auto it = worker.connections.find(fd);
+            if (it == worker.connections.end()) {
+                continue;
+            }
+            Connection& connection = *it->second;
+            bool keep = true;
+            if (events[i].events & EPOLLOUT) {
+                keep = WriteResponses(connection);
+            }
+            if (keep && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                keep = ReadRequests(worker, connection);
+            }
+            if (!keep) {
+                ::close(fd);
+                worker.connections.erase(it);
+            }
+        }
+    }
+}
+
+// One connection per wakeup: the listening socket stays readable while the backlog is not
+// empty, so a burst of connects wakes the workers in turn instead of landing on one of them
+void QueryServer::AcceptConnection(Worker& worker) {
+    const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    auto connection = std::make_unique<Connection>();
+    connection->fd = fd;
+    connection->epoll_fd = worker.epoll_fd;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    worker.connections.emplace(fd, std::move(connection));
+}
+
+bool QueryServer::ReadRequests(Worker& worker, Connection& connection) {
+    bool peer_closed = false;
+    while (true) {
+        const size_t old_size = connection.in.size();
+        connection.in.resize(old_size + READ_CHUNK_SIZE);
+        const ssize_t n = ::recv(connection.fd, connection.in.data() + old_size, READ_CHUNK_SIZE, 0);
+        connection.in.resize(old_size + std::max<ssize_t>(n, 0));
+        if (n > 0) {
+            continue;
+        }
+        if (n == 0) {
+            peer_closed = true;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        break;
+    }
+
+    size_t pos = 0;
+    while (!connection.closing) {
+        const size_t end = connection.in.find('\n', pos);
+        if (end == std::string::npos) {
+            break;
+        }
+        std::string_view line(connection.in.data() + pos, end - pos);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        connection.closing = !HandleLine(worker, line, connection.out);
+        pos = end + 1;
+    }
+    connection.in.erase(0, pos);
+    if (connection.in.size() > MAX_REQUEST_SIZE) {
+        connection.out += "ERR Error: request is too long.\n"s;
+        connection.closing = true;
+    }
+    connection.closing = connection.closing || peer_closed;
+    return WriteResponses(connection);
+}
+
+bool QueryServer::WriteResponses(Connection& connection) {
+    while (connection.out_pos < connection.out.size()) {
+        const ssize_t n = ::send(connection.fd, connection.out.data() + connection.out_pos,
+            connection.out.size() - connection.out_pos, MSG_NOSIGNAL);
+        if (n >= 0) {
+            connection.out_pos += n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        if (!connection.waits_for_write) {
+            connection.waits_for_write = true;
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+            event.data.fd = connection.fd;
+            epoll_ctl(connection.epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+        }
+        return true;
+    }
+    // everything is sent, buffers keep their capacity
+    connection.out.clear();
+    connection.out_pos = 0;
+    if (connection.waits_for_write) {
+        connection.waits_for_write = false;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = connection.fd;
+        epoll_ctl(connection.epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+    }
+    return !connection.closing;
+}
+
+LoadReport RunLoadGenerator(const std::string& endpoint, const std::vector<std::string>& queries,
+    size_t connection_count, size_t requests_per_connection, size_t pipeline_depth) {
+    using Clock = std::chrono::steady_clock;
+    if (queries.empty() || connection_count == 0 || pipeline_depth == 0) {
+        throw std::invalid_argument("Error: load needs queries, connections and a positive pipeline depth."s);
+    }
+    std::mutex report_mutex;
+    std::vector<int64_t> latencies_ns;
+    uint64_t errors = 0;
+    uint64_t failed_connections = 0;
+    std::exception_ptr first_failure;
+
+    // a network error ends its connection only, the requests answered before it still count
+    const auto run_connection = [&](size_t connection_index) {
+        int fd = -1;
+        std::vector<int64_t> local_latencies;
+        local_latencies.reserve(requests_per_connection);
+        uint64_t local_errors = 0;
+        std::exception_ptr failure;
+        try {
+            fd = OpenConnectedSocket(endpoint);
+            RunLoadConnection(fd, queries, connection_index * requests_per_connection, requests_per_connection, pipeline_depth,
+                local_latencies, local_errors);
+        }
+        catch (...) {
+            failure = std::current_exception();
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        std::lock_guard guard(report_mutex);
+        latencies_ns.insert(latencies_ns.end(), local_latencies.begin(), local_latencies.end());
+        errors += local_errors;
+        if (failure) {
+            ++failed_connections;
+            if (!first_failure) {
+                first_failure = failure;
+            }
+        }
+    };
+
+    const auto start_time = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < connection_count; ++i) {
+        threads.emplace_back(run_connection, i);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    if (failed_connections == connection_count) {
+        std::rethrow_exception(first_failure);
+    }
+
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    LoadReport report;
+    report.requests = latencies_ns.size();
+    report.seconds = seconds;
+    report.qps = seconds > 0 ? report.requests / seconds : 0.0;
+    report.p50_us = Percentile(latencies_ns, 0.5);
+    report.p99_us = Percentile(latencies_ns, 0.99);
+    report.p999_us = Percentile(latencies_ns, 0.999);
+    report.errors = errors;
+    report.failed_connections = failed_connections;
+    return report;
+}
+
+#else
+
+void QueryServer::Start() {
+    throw std::runtime_error("Error: QueryServer needs epoll (Linux)."s);
+}
+
+void QueryServer::Stop() {
+}
+
+LoadReport RunLoadGenerator(const std::string&, const std::vector<std::string>&, size_t, size_t, size_t) {
+    throw std::runtime_error("Error: the load generator needs POSIX sockets."s);
+}
+
+#endif
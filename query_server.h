@@ -0,0 +1,122 @@
+#pragma once
+
+#include "search_server.h"
+#include "write_ahead_log.h"
+#include "request_queue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Network front-end of a SearchServer with a line protocol, one request per line:
+//   SEARCH <query>                          -> OK <count>[ <id> <relevance> <rating>]...
+//   MATCH <id> <query>                      -> OK <status>[ <word>]...
+//   ADD <id> <status> <r1,r2,...|-> <text>  -> OK
+//   REMOVE <id>                             -> OK
+//   STATUS <id> <status>[ <id> <status>]... -> OK
+//   RATING <id> <rating>[ <id> <rating>]... -> OK
+//   STATS                                   -> OK <documents> <terms> <postings> <memory bytes>
+//   QUIT                                    -> closes the connection
+// Errors are answered with "ERR <message>". Connections are kept alive and requests may be
+// pipelined: responses come in request order.
+// A fixed pool of workers runs one epoll loop each; a worker owns its connections and scratch
+// buffers, searches with its own QueryContext and formats responses right into the connection
+// output buffer it writes from.
+// STATUS and RATING update document metadata in place: they run alongside queries and the whole
+// batch is rejected if an id is unknown.
+// With durability enabled updates are answered once their log records are synced; the
+// index lock is released before that, so queries never wait for the disk. An update whose record
+// cannot be logged or synced is undone, together with every later one not yet synced, so ERR
+// always leaves the index as it was. Checkpoints run on their own thread, which blocks updates
+// only while it copies the documents into memory, and cover only synced records.
+class QueryServer {
+public:
+    QueryServer(SearchServer& search_server, const std::string& endpoint, size_t worker_count);
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+    ~QueryServer();
+
+    // Starts the workers and returns
+    void Start();
+    // Stops the workers and closes all connections
+    void Stop();
+
+    // Logs successful update requests to log and checkpoints the index to snapshot_path
+    // every checkpoint_interval records (0 never). Call before Start.
+    void EnableDurability(WriteAheadLog& log, const std::string& snapshot_path, uint64_t checkpoint_interval);
+
+    // Runs SEARCH requests through request_queue (over the same SearchServer) to track hot
+    // queries and terms. Call before Start.
+    void EnableRequestTracking(RequestQueue& request_queue);
+
+    uint64_t GetRequestCount() const;
+
+private:
+    struct Connection;
+    struct Worker;
+
+    SearchServer& search_server_;
+    std::shared_mutex index_mutex_;    // queries share the index, updates are exclusive
+    std::mutex metadata_mutex_;    // STATUS and RATING, taken with a shared index lock
+    std::string endpoint_;
+    int listen_fd_ = -1;
+    int stop_fd_ = -1;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<uint64_t> request_count_{ 0 };
+    WriteAheadLog* log_ = nullptr;
+    RequestQueue* request_queue_ = nullptr;
+    std::string snapshot_path_;
+    uint64_t checkpoint_interval_ = 0;
+    std::atomic<uint64_t> checkpoint_sequence_{ 0 };
+    std::thread checkpoint_thread_;
+    std::mutex checkpoint_mutex_;
+    std::condition_variable checkpoint_wanted_;
+    bool checkpoint_due_ = false;
+    bool stop_checkpoints_ = false;
+    std::mutex undo_mutex_;
+    std::deque<WalRecord> undo_records_;    // revert the updates logged after the durable sequence, in log order
+
+    void RunWorker(Worker& worker);
+    void AcceptConnection(Worker& worker);
+    // Reads available data and answers complete requests; false if the connection is to be closed
+    bool ReadRequests(Worker& worker, Connection& connection);
+    bool WriteResponses(Connection& connection);
+    // Appends the response to out; false for QUIT
+    bool HandleLine(Worker& worker, const std::string_view line, std::string& out);
+    // Logs the update applied to the index with append(i) for every record of undo_records, which
+    // revert it in reverse order and receive the sequence numbers. If an append throws, the update is
+    // reverted. Call with the index locks of the update held; returns the last sequence number.
+    uint64_t LogUpdate(std::vector<WalRecord>& undo_records, const std::function<uint64_t(size_t)>& append);
+    // Waits for the update with the sequence number to be durable, requests a checkpoint when due.
+    // If the log fails, reverts every update that is not durable and rethrows.
+    void CommitUpdate(uint64_t sequence);
+    void ApplyUndoRecord(const WalRecord& record);
+    // Checkpoint thread: writes a checkpoint whenever one is requested, until Stop
+    void RunCheckpoints();
+};
+
+struct LoadReport {
+    uint64_t requests = 0;
+    double seconds = 0.0;
+    double qps = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double p999_us = 0.0;
+    uint64_t errors = 0;    // ERR responses
+    uint64_t failed_connections = 0;    // ended by a network error, their answered requests count
+};
+
+// Sends SEARCH requests for queries over connection_count connections, pipeline_depth requests
+// in flight per connection, and measures latency from send to response. Rethrows the network
+// error if every connection failed.
+LoadReport RunLoadGenerator(const std::string& endpoint, const std::vector<std::string>& queries,
+    size_t connection_count, size_t requests_per_connection, size_t pipeline_depth);
@@ -1,32 +1,134 @@
 #include "request_queue.h"
+#include "string_processing.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : search_server_(search_server) {
-    total_request_count_ = 0;
-    null_result_count_ = 0;
+#include <stdexcept>
+
+namespace {
+
+    int64_t GetTimeNs(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+}  // namespace
+
+RequestQueue::RequestQueue(const SearchServer& search_server, RequestQueueOptions options)
+    : search_server_(search_server)
+    , options_(options)
+    , requests_(options.ring_capacity)
+    , hot_queries_(options.hot_query_count, options.hot_window, options.sketch_width, options.sketch_depth)
+    , hot_terms_(options.hot_term_count, options.hot_window, options.sketch_width, options.sketch_depth) {
+    if (options.ring_capacity == 0) {
+        throw std::invalid_argument("Error: request ring capacity must be positive."s);
+    }
 }
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
+std::vector<Document> RequestQueue::AddFindRequest(const std::string_view raw_query, DocumentStatus status) {
     std::vector<Document> result = search_server_.FindTopDocuments(raw_query, status);
-    LogRequest(result.empty());
+    LogRequest(raw_query, result.empty());
     return result;
 }
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
+std::vector<Document> RequestQueue::AddFindRequest(const std::string_view raw_query) {
     std::vector<Document> result = search_server_.FindTopDocuments(raw_query);
-    LogRequest(result.empty());
+    LogRequest(raw_query, result.empty());
     return result;
 }
 
+void RequestQueue::AddFindRequest(QueryContext& context, const std::string_view raw_query, std::vector<Document>& result) {
+    search_server_.FindTopDocuments(context, raw_query, result);
+    LogRequest(raw_query, result.empty());
+}
+
 int RequestQueue::GetNoResultRequests() const {
-    return null_result_count_;
+    int null_result_count = 0;
+    ForEachRecord([&null_result_count](int64_t, bool null_result) {
+        null_result_count += null_result ? 1 : 0;
+        });
+    return null_result_count;
+}
+
+RequestWindowStats RequestQueue::GetWindowStats(std::chrono::nanoseconds window) const {
+    const int64_t since_ns = GetTimeNs(std::chrono::steady_clock::now()) - window.count();
+    RequestWindowStats stats;
+    ForEachRecord([since_ns, &stats](int64_t time_ns, bool null_result) {
+        if (time_ns >= since_ns) {
+            ++stats.requests;
+            stats.no_result_requests += null_result ? 1 : 0;
+        }
+        });
+    return stats;
+}
+
+std::vector<HeavyHitter> RequestQueue::GetHotQueries(size_t count) const {
+    return hot_queries_.GetTop(count);
+}
+
+std::vector<HeavyHitter> RequestQueue::GetHotTerms(size_t count) const {
+    return hot_terms_.GetTop(count);
 }
 
-void RequestQueue::LogRequest(bool is_null) {
-    ++total_request_count_;
-    if (is_null) { ++null_result_count_; };
-    requests_.push_back({ total_request_count_, is_null });
-    if (requests_.size() > min_in_day_) {
-        if (requests_.front().null_result) { --null_result_count_; };
-        requests_.pop_front();
+void RequestQueue::ExportHotSet(std::ostream& out) const {
+    for (const HeavyHitter& query : GetHotQueries(options_.hot_query_count)) {
+        out << "Q "s << query.count << ' ' << query.key << '\n';
+    }
+    for (const HeavyHitter& term : GetHotTerms(options_.hot_term_count)) {
+        out << "T "s << term.count << ' ' << term.key << '\n';
     }
-}
\ No newline at end of file
+}
+
+void RequestQueue::LogRequest(const std::string_view raw_query, bool is_null) {
+    const auto now = std::chrono::steady_clock::now();
+    // producers claim slots with one fetch_add; a slot is published by its sequence
+    const uint64_t number = total_request_count_.fetch_add(1, std::memory_order_relaxed);
+    RequestRecord& record = requests_[number % requests_.size()];
+    record.sequence.store(0, std::memory_order_release);
+    record.time_ns.store(GetTimeNs(now), std::memory_order_relaxed);
+    record.null_result.store(is_null, std::memory_order_relaxed);
+    record.sequence.store(number + 1, std::memory_order_release);
+
+    hot_queries_.Add(raw_query, now);
+    thread_local std::vector<std::string_view> words;
+    SplitIntoWords(raw_query, words);
+    for (const std::string_view word : words) {
+        if (!word.empty() && word[0] != '-') {
+            hot_terms_.Add(word, now);
+        }
+    }
+}
+
+// A record being rewritten while it is read is skipped
+template <typename Callback>
+void RequestQueue::ForEachRecord(Callback callback) const {
+    const uint64_t end = total_request_count_.load(std::memory_order_acquire);
+    const uint64_t begin = end > requests_.size() ? end - requests_.size() : 0;
+    for (uint64_t number = begin; number < end; ++number) {
+        const RequestRecord& record = requests_[number % requests_.size()];
+        if (record.sequence.load(std::memory_order_acquire) != number + 1) {
+            continue;
+        }
+        const int64_t time_ns = record.time_ns.load(std::memory_order_relaxed);
+        const bool null_result = record.null_result.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.sequence.load(std::memory_order_relaxed) == number + 1) {
+            callback(time_ns, null_result);
+        }
+    }
+}
+
+size_t WarmUpSearchServer(const SearchServer& search_server, std::istream& hot_set) {
+    size_t replayed = 0;
+    for (std::string line; std::getline(hot_set, line);) {
+        // "Q|T <count> <text>"
+        const size_t text_begin = line.find(' ', 2);
+        if (line.size() < 4 || (line[0] != 'Q' && line[0] != 'T') || line[1] != ' ' || text_begin == std::string::npos) {
+            continue;
+        }
+        try {
+            search_server.FindTopDocuments(std::string_view(line).substr(text_begin + 1));
+            ++replayed;
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+    return replayed;
+}
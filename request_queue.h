@@ -2,36 +2,82 @@
 
 #include "document.h"
 #include "search_server.h"
+#include "heavy_hitters.h"
+#include <atomic>
+#include <chrono>
+#include <istream>
+#include <ostream>
 #include <vector>
 #include <string>
-#include <deque>
+#include <string_view>
 
+struct RequestQueueOptions {
+    size_t ring_capacity = 1440;    // requests kept for GetNoResultRequests and GetWindowStats
+    std::chrono::nanoseconds hot_window = std::chrono::minutes(10);    // heavy hitters count over 1-2 windows
+    size_t hot_query_count = 64;
+    size_t hot_term_count = 256;
+    size_t sketch_width = 4096;
+    size_t sketch_depth = 4;
+};
+
+struct RequestWindowStats {
+    uint64_t requests = 0;
+    uint64_t no_result_requests = 0;
+};
+
+// Search requests with statistics: the last ring_capacity requests in a lock-free ring and the
+// most frequent queries and query words (minus words excluded) over a sliding time window.
+// AddFindRequest may be called from several threads at once.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    explicit RequestQueue(const SearchServer& search_server, RequestQueueOptions options = {});
 
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+    std::vector<Document> AddFindRequest(const std::string_view raw_query, DocumentPredicate document_predicate) {
         std::vector<Document> result = search_server_.FindTopDocuments(raw_query, document_predicate);
-        LogRequest(result.empty());
+        LogRequest(raw_query, result.empty());
         return result;
     }
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
+    std::vector<Document> AddFindRequest(const std::string_view raw_query, DocumentStatus status);
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
+    std::vector<Document> AddFindRequest(const std::string_view raw_query);
 
+    // Searches with the caller's scratch buffers into result
+    void AddFindRequest(QueryContext& context, const std::string_view raw_query, std::vector<Document>& result);
+
+    // Among the last ring_capacity requests
     int GetNoResultRequests() const;
+    // Requests of the last window, at most ring_capacity of them
+    RequestWindowStats GetWindowStats(std::chrono::nanoseconds window) const;
+
+    std::vector<HeavyHitter> GetHotQueries(size_t count) const;
+    std::vector<HeavyHitter> GetHotTerms(size_t count) const;
+
+    // Hot set for WarmUpSearchServer, one "Q|T <count> <text>" line per query or term
+    void ExportHotSet(std::ostream& out) const;
 
 private:
-    struct QueryResult {
-        int query_id = -1;
-        bool null_result = true;
+    // Ring slot, sequence is the request number + 1 once the fields are written
+    struct RequestRecord {
+        std::atomic<uint64_t> sequence{ 0 };
+        std::atomic<int64_t> time_ns{ 0 };
+        std::atomic<bool> null_result{ false };
     };
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
-    int total_request_count_;
-    int null_result_count_;
     const SearchServer& search_server_;
-    void LogRequest(bool is_null);
-};
\ No newline at end of file
+    RequestQueueOptions options_;
+    std::vector<RequestRecord> requests_;
+    std::atomic<uint64_t> total_request_count_{ 0 };
+    HeavyHitterTracker hot_queries_;
+    HeavyHitterTracker hot_terms_;
+
+    void LogRequest(const std::string_view raw_query, bool is_null);
+    // Calls callback(time_ns, null_result) for the complete records of the ring
+    template <typename Callback>
+    void ForEachRecord(Callback callback) const;
+};
+
+// Replays the hot queries and terms of an exported hot set against search_server, so the index
+// pages and caches they touch are warm before serving. Returns the number of replayed lines;
+// malformed lines and invalid queries are skipped.
+size_t WarmUpSearchServer(const SearchServer& search_server, std::istream& hot_set);
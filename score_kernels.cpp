@@ -0,0 +1,108 @@
+#include "score_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCORE_KERNELS_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles AVX2 intrinsics in any function, GCC and Clang only in functions targeting AVX2
+#if defined(SCORE_KERNELS_AVX2) && (defined(__GNUC__) || defined(__clang__))
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+namespace {
+
+    template <typename Value>
+    void AddScaledScalar(Value* scores, const Value* values, Value weight, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const Value product = values[i] * weight;
+            scores[i] += product;
+        }
+    }
+
+#if defined(SCORE_KERNELS_AVX2)
+
+    AVX2_FUNCTION void AddScaledAvx2(double* scores, const double* values, double weight, size_t count) {
+        const __m256d weights = _mm256_set1_pd(weight);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m256d products = _mm256_mul_pd(_mm256_loadu_pd(values + i), weights);
+            _mm256_storeu_pd(scores + i, _mm256_add_pd(_mm256_loadu_pd(scores + i), products));
+        }
+        AddScaledScalar(scores + i, values + i, weight, count - i);
+    }
+
+    AVX2_FUNCTION void AddScaledAvx2(float* scores, const float* values, float weight, size_t count) {
+        const __m256 weights = _mm256_set1_ps(weight);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256 products = _mm256_mul_ps(_mm256_loadu_ps(values + i), weights);
+            _mm256_storeu_ps(scores + i, _mm256_add_ps(_mm256_loadu_ps(scores + i), products));
+        }
+        AddScaledScalar(scores + i, values + i, weight, count - i);
+    }
+
+    bool DetectAvx2() {
+#if defined(__AVX2__)
+        return true;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        // the OS must save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    bool HasAvx2() {
+        static const bool has_avx2 = DetectAvx2();
+        return has_avx2;
+    }
+
+#else
+
+    bool HasAvx2() {
+        return false;
+    }
+
+#endif
+
+}  // namespace
+
+void AddScaled(double* scores, const double* values, double weight, size_t count) {
+#if defined(SCORE_KERNELS_AVX2)
+    if (HasAvx2()) {
+        AddScaledAvx2(scores, values, weight, count);
+        return;
+    }
+#endif
+    AddScaledScalar(scores, values, weight, count);
+}
+
+void AddScaled(float* scores, const float* values, float weight, size_t count) {
+#if defined(SCORE_KERNELS_AVX2)
+    if (HasAvx2()) {
+        AddScaledAvx2(scores, values, weight, count);
+        return;
+    }
+#endif
+    AddScaledScalar(scores, values, weight, count);
+}
+
+const char* GetScoreKernelName() {
+    return HasAvx2() ? "avx2" : "scalar";
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+// Dense kernels of the block scoring loops of BatchQueryEvaluator, the only path with dense
+// term rows (the per-query paths walk std::map posting lists and scatter one posting at a time).
+// On x86-64 they process 4 doubles or 8 floats per instruction if the CPU supports AVX2, detected
+// at run time, so the default build needs no /arch:AVX2 or -mavx2; elsewhere they are scalar loops.
+// Both multiply and then add, like the scalar loops of the search paths, so they give the same
+// results (no fused multiply-add intrinsics; GCC and Clang builds targeting FMA need
+// -ffp-contract=off for the scalar loops not to be fused either).
+
+// scores[i] += values[i] * weight for i < count
+void AddScaled(double* scores, const double* values, double weight, size_t count);
+void AddScaled(float* scores, const float* values, float weight, size_t count);
+
+// Name of the kernels in use, "avx2" or "scalar"
+const char* GetScoreKernelName();
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Precision of the term frequencies stored in the posting lists and of the relevance accumulators,
+// chosen at compile time:
+//   default                    double term frequencies and scores;
+//   SCORE_PRECISION_FLOAT      float term frequencies and scores, twice the postings per cache line;
+//   SCORE_PRECISION_QUANTIZED  term frequencies quantized to uint16_t steps of 1/65535, float scores;
+//                              relevance may be off by more than EPSILON, so near ties may reorder.
+// The sequential search paths sum ComputeTermRelevance of the query terms in the same order, so
+// they agree exactly within one precision; the benchmark checks the top documents against double.
+#if defined(SCORE_PRECISION_QUANTIZED)
+using TermFreq = uint16_t;
+using Score = float;
+const char* const SCORE_PRECISION_NAME = "quantized";
+#elif defined(SCORE_PRECISION_FLOAT)
+using TermFreq = float;
+using Score = float;
+const char* const SCORE_PRECISION_NAME = "float";
+#else
+using TermFreq = double;
+using Score = double;
+const char* const SCORE_PRECISION_NAME = "double";
+#endif
+
+// term_freq is in (0, 1]
+inline TermFreq EncodeTermFreq(double term_freq) {
+#if defined(SCORE_PRECISION_QUANTIZED)
+    // a word of a very long document keeps the smallest step
+    return static_cast<TermFreq>(std::max<long>(1, std::lround(term_freq * 65535.0)));
+#else
+    return static_cast<TermFreq>(term_freq);
+#endif
+}
+
+inline Score DecodeTermFreq(TermFreq term_freq) {
+#if defined(SCORE_PRECISION_QUANTIZED)
+    return term_freq * (Score{ 1 } / 65535);
+#else
+    return term_freq;
+#endif
+}
+
+// weight is the inverse document frequency of the term times its query weight
+inline Score ComputeTermRelevance(TermFreq term_freq, Score weight) {
+    return DecodeTermFreq(term_freq) * weight;
+}
@@ -1,102 +1,561 @@
 #include "search_server.h"
 
 #include <execution>
+#include <thread>
 
 using namespace std::string_literals;
 
-SearchServer::SearchServer(std::string sws) : SearchServer(std::string_view(sws)) {}
-SearchServer::SearchServer(std::string_view swsv) {
-    for (const auto word : SplitIntoWords(swsv)) {
+namespace {
+
+    uint16_t EncodeForwardFreq(double term_freq) {
+        return static_cast<uint16_t>(std::max<long>(1, std::lround(term_freq * 65535.0)));
+    }
+
+    double DecodeForwardFreq(uint16_t term_freq) {
+        return term_freq / 65535.0;
+    }
+
+}  // namespace
+
+SearchServer::SearchServer(std::string sws, NormalizationOptions normalization) : SearchServer(std::string_view(sws), normalization) {}
+SearchServer::SearchServer(std::string_view swsv, NormalizationOptions normalization)
+    : text_normalizer_(normalization) {
+    SetStopWords(SplitIntoWords(swsv));
+}
+
+void SearchServer::SetStopWords(const std::vector<std::string_view>& stop_words) {
+    std::vector<std::string> words;
+    std::string buffer;
+    for (const std::string_view word : stop_words) {
         if (!IsValidWord(word)) {
-            throw std::invalid_argument("Error: invalid word (string_view constructor)."s);
+            throw std::invalid_argument("Error: invalid stop word."s);
+        }
+        // normalization may split a stop word ("don't")
+        for (const std::string_view normalized_word : SplitIntoWords(text_normalizer_.Normalize(word, buffer))) {
+            words.emplace_back(normalized_word);
         }
-        stop_words_.insert(std::string(word));
     }
+    stop_words_ = StopWordSet(words);
 }
 
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    PROFILE_STAGE(ADD_DOCUMENT);
     if (document_id < 0 || documents_.count(document_id) > 0) { throw std::invalid_argument("Error: doc id is negative or duplicate already existing id."s); }
     else {
-        documents_.emplace(document_id,
+        const uint32_t ordinal = document_columns_.Add(document_id, status, ComputeAverageRating(ratings));
+        DocumentData& data = documents_.emplace(document_id,
             DocumentData{
-                ComputeAverageRating(ratings),
-                status,
-                std::string(document)
-            });
-        std::vector<std::string_view> words = SplitIntoWordsNoStop(std::string_view(documents_.at(document_id).content));
+                ordinal,
+                document_store_.Add(document),
+                {}
+            }).first->second;
+        std::string normalized_text;
+        std::map<std::string_view, double> word_freqs;
+        {
+            PROFILE_STAGE(TOKENIZE_DOCUMENT);
+            word_freqs = CountWordFrequencies(document, normalized_text);
+        }
         added_doc_ids_.insert(document_id);
-        const double inv_word_count = 1.0 / words.size();
-        for (const std::string_view word : words) {
-            word_to_document_freqs_[word][document_id] += inv_word_count;
-            docid_word_freqs_[document_id][word] += inv_word_count;
+        // postings take the final frequencies, a quantized one would not add up
+        for (const auto [word, term_freq] : word_freqs) {
+            auto word_it = word_to_document_freqs_.find(word);
+            if (word_it == word_to_document_freqs_.end()) {
+                word_it = word_to_document_freqs_.emplace(std::string(word), PostingList{}).first;
+                AddTermId(word_it->first);
+                term_dictionary_.Insert(word);
+                if (fuzzy_index_) {
+                    fuzzy_index_->Insert(word);
+                }
+            }
+            word_it->second[ordinal] = EncodeTermFreq(term_freq);
+        }
+        if (forward_index_enabled_) {
+            BuildDocumentTerms(word_freqs, data.terms);
         }
     }
 }
 
+std::map<std::string_view, double> SearchServer::CountWordFrequencies(const std::string_view text, std::string& normalized_text) const {
+    const std::vector<std::string_view> words = SplitIntoWordsNoStop(text_normalizer_.Normalize(text, normalized_text));
+    const double inv_word_count = 1.0 / words.size();
+    std::map<std::string_view, double> word_freqs;
+    for (const std::string_view word : words) {
+        word_freqs[word] += inv_word_count;
+    }
+    return word_freqs;
+}
+
+void SearchServer::BuildDocumentTerms(const std::map<std::string_view, double>& word_freqs, std::vector<ForwardTerm>& terms) const {
+    terms.clear();
+    terms.reserve(word_freqs.size());
+    for (const auto [word, term_freq] : word_freqs) {
+        terms.push_back({ term_ids_.find(word)->second, EncodeForwardFreq(term_freq) });
+    }
+    std::sort(terms.begin(), terms.end(), [](const ForwardTerm& lhs, const ForwardTerm& rhs) {
+        return lhs.term_id < rhs.term_id;
+        });
+}
+
+const std::vector<SearchServer::ForwardTerm>& SearchServer::GetDocumentTerms(const DocumentData& document,
+    std::vector<ForwardTerm>& buffer) const {
+    if (forward_index_enabled_) {
+        return document.terms;
+    }
+    std::string normalized_text;
+    const std::string text = document_store_.Get(document.content);
+    BuildDocumentTerms(CountWordFrequencies(text, normalized_text), buffer);
+    return buffer;
+}
+
+uint32_t SearchServer::AddTermId(const std::string_view word) {
+    uint32_t term_id;
+    if (free_term_ids_.empty()) {
+        term_id = static_cast<uint32_t>(term_words_.size());
+        term_words_.push_back(word);
+    }
+    else {
+        term_id = free_term_ids_.back();
+        free_term_ids_.pop_back();
+        term_words_[term_id] = word;
+    }
+    term_ids_.emplace(word, term_id);
+    return term_id;
+}
+
+void SearchServer::RemoveTerm(std::map<std::string, PostingList, std::less<>>::iterator word_it) {
+    term_dictionary_.Erase(word_it->first);
+    if (fuzzy_index_) {
+        fuzzy_index_->Erase(word_it->first);
+    }
+    const auto id_it = term_ids_.find(word_it->first);
+    term_words_[id_it->second] = {};
+    free_term_ids_.push_back(id_it->second);
+    term_ids_.erase(id_it);
+    word_to_document_freqs_.erase(word_it);
+}
+
+void SearchServer::EnableForwardIndex() {
+    if (forward_index_enabled_) {
+        return;
+    }
+    for (auto& [document_id, document] : documents_) {
+        GetDocumentTerms(document, document.terms);
+        document.terms.shrink_to_fit();
+    }
+    forward_index_enabled_ = true;
+}
+
+void SearchServer::DisableForwardIndex() {
+    for (auto& [document_id, document] : documents_) {
+        std::vector<ForwardTerm>().swap(document.terms);
+    }
+    forward_index_enabled_ = false;
+}
+
+void SearchServer::SetDocumentStatus(int document_id, DocumentStatus status) {
+    document_columns_.SetStatus(GetUpdatedDocumentOrdinal(document_id), status);
+}
+
+void SearchServer::SetDocumentRating(int document_id, int rating) {
+    document_columns_.SetRating(GetUpdatedDocumentOrdinal(document_id), rating);
+}
+
+void SearchServer::SetDocumentStatuses(const std::vector<std::pair<int, DocumentStatus>>& updates) {
+    std::vector<uint32_t> ordinals;
+    ordinals.reserve(updates.size());
+    for (const auto& [document_id, _] : updates) {
+        ordinals.push_back(GetUpdatedDocumentOrdinal(document_id));
+    }
+    for (size_t i = 0; i < updates.size(); ++i) {
+        document_columns_.SetStatus(ordinals[i], updates[i].second);
+    }
+}
+
+void SearchServer::SetDocumentRatings(const std::vector<std::pair<int, int>>& updates) {
+    std::vector<uint32_t> ordinals;
+    ordinals.reserve(updates.size());
+    for (const auto& [document_id, _] : updates) {
+        ordinals.push_back(GetUpdatedDocumentOrdinal(document_id));
+    }
+    for (size_t i = 0; i < updates.size(); ++i) {
+        document_columns_.SetRating(ordinals[i], updates[i].second);
+    }
+}
+
+uint32_t SearchServer::GetUpdatedDocumentOrdinal(int document_id) const {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        throw std::invalid_argument("Error: no document with such id (SetDocumentStatus/SetDocumentRating)."s);
+    }
+    return it->second.ordinal;
+}
+
+void SearchServer::EnableFuzzySearch(int max_edit_distance) {
+    auto fuzzy_index = std::make_unique<FuzzyIndex>(max_edit_distance);
+    for (const auto& [word, word_freqs] : word_to_document_freqs_) {
+        if (!word_freqs.empty()) {
+            fuzzy_index->Insert(word);
+        }
+    }
+    fuzzy_index_ = std::move(fuzzy_index);
+}
+
+void SearchServer::DisableFuzzySearch() {
+    fuzzy_index_.reset();
+}
+
+FuzzySearchStats SearchServer::GetFuzzySearchStats() const {
+    return {
+        fuzzy_counters_.expanded_words.Get(),
+        fuzzy_counters_.checked_terms.Get(),
+        fuzzy_counters_.expansion_terms.Get(),
+        fuzzy_counters_.expansion_ns.Get()
+    };
+}
+
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; });
+    return FindTopDocuments(std::execution::seq, raw_query, DocumentStatusFilter{ status });
 }
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+void SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query, DocumentStatus status, std::vector<Document>& result) const {
+    FindTopDocuments(context, raw_query, DocumentStatusFilter{ status }, result);
+}
+void SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query, std::vector<Document>& result) const {
+    FindTopDocuments(context, raw_query, DocumentStatusFilter{ DocumentStatus::ACTUAL }, result);
+}
 
-int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+QueryCompletion SearchServer::FindTopDocuments(QueryContext& context, const QueryBudget& budget, const std::string_view raw_query,
+    DocumentStatus status, std::vector<Document>& result) const {
+    return FindTopDocuments(context, budget, raw_query, DocumentStatusFilter{ status }, result);
+}
+QueryCompletion SearchServer::FindTopDocuments(QueryContext& context, const QueryBudget& budget, const std::string_view raw_query,
+    std::vector<Document>& result) const {
+    return FindTopDocuments(context, budget, raw_query, DocumentStatusFilter{ DocumentStatus::ACTUAL }, result);
 }
 
-SearchServer::MatchingDocs_sv SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
-    return MatchDocument(std::execution::seq, raw_query, document_id);
+void SearchServer::SetPrefetchDistance(size_t distance) {
+    prefetch_distance_ = distance;
 }
-SearchServer::MatchingDocs_sv SearchServer::MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const {
-    Query query = ParseQuery(raw_query);
-    std::vector<std::string_view> matched_words;
-    if (!docid_word_freqs_.count(document_id)) {
-        throw std::out_of_range("");
+
+size_t SearchServer::GetPrefetchDistance() const {
+    return prefetch_distance_;
+}
+
+void SearchServer::ReallocateIndexMemory() {
+    document_columns_.Reallocate();
+}
+
+void SearchServer::SetQueryPlannerOptions(const QueryPlannerOptions& options) {
+    if (options.range_postings == 0) {
+        throw std::invalid_argument("Error: query planner range postings must be positive."s);
     }
-    const auto& doc_to_word = docid_word_freqs_.at(document_id);
+    planner_options_ = options;
+}
+
+const QueryPlannerOptions& SearchServer::GetQueryPlannerOptions() const {
+    return planner_options_;
+}
 
+QueryPlan SearchServer::PlanQuery(const std::string_view raw_query) const {
+    Query query;
+    ParseQuery(raw_query, query);
+    ExpandFuzzyWords(query);
+    std::vector<DaatTerm> plus_terms;
+    std::vector<const PostingList*> minus_terms;
+    CollectDaatTerms(query, plus_terms, minus_terms);
+    return PlanQuery(plus_terms);
+}
+
+QueryPlannerStats SearchServer::GetQueryPlannerStats() const {
+    return {
+        planner_counters_.taat_seq.Get(),
+        planner_counters_.taat_par.Get(),
+        planner_counters_.daat_seq.Get(),
+        planner_counters_.daat_par.Get()
+    };
+}
+
+void SearchServer::CollectDaatTerms(const Query& query, std::vector<DaatTerm>& plus_terms, std::vector<const PostingList*>& minus_terms) const {
+    // the order of FindAllDocuments: plus words, fuzzy words, then prefixes
+    uint32_t group = 0;
+    for (const auto& word : query.plus_words) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end()) {
+            plus_terms.push_back({ &it->second, static_cast<Score>(ComputeWordInverseDocumentFreq(word)), group++ });
+        }
+    }
+    for (const auto& [word, weight] : query.fuzzy_words) {
+        plus_terms.push_back({ &GetWordPostings(word), static_cast<Score>(ComputeWordInverseDocumentFreq(word) * weight), group++ });
+    }
+    for (size_t i = 0; i < query.plus_prefixes.size(); ++i) {
+        for (size_t j = query.prefix_word_bounds[i]; j < query.prefix_word_bounds[i + 1]; ++j) {
+            const std::string_view word = query.prefix_words[j];
+            plus_terms.push_back({ &GetWordPostings(word), static_cast<Score>(ComputeWordInverseDocumentFreq(word)), group });
+        }
+        ++group;
+    }
     for (const auto& word : query.minus_words) {
-        if (doc_to_word.count(word) > 0) {
-            {
-                return { matched_words, documents_.at(document_id).status };
-            }
+        const auto it = word_to_document_freqs_.find(word);
+        if (it != word_to_document_freqs_.end()) {
+            minus_terms.push_back(&it->second);
         }
     }
-    for (const auto& word : query.plus_words) {
-        if (doc_to_word.count(word) > 0) {
-            matched_words.push_back(word);
+    for (const auto& prefix : query.minus_prefixes) {
+        ForEachPrefixWord(prefix, [this, &minus_terms](const std::string_view word) {
+            minus_terms.push_back(&GetWordPostings(word));
+            });
+    }
+}
+
+FacetCounts SearchServer::CountDocuments(const std::string_view raw_query, const FacetOptions& options) const {
+    return CountDocuments(std::execution::seq, raw_query, options);
+}
+
+size_t SearchServer::GetPlannerThreadCount() const {
+    return planner_options_.max_threads > 0 ? planner_options_.max_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+QueryPlan SearchServer::PlanQuery(const std::vector<DaatTerm>& plus_terms) const {
+    QueryPlan plan;
+    plan.terms = plus_terms.size();
+    for (const DaatTerm& term : plus_terms) {
+        plan.postings += term.postings->size();
+        plan.longest_postings = std::max<uint64_t>(plan.longest_postings, term.postings->size());
+    }
+    const size_t threads = GetPlannerThreadCount();
+    plan.parallel = threads > 1 && plan.postings >= planner_options_.parallel_min_postings;
+    if (planner_options_.strategy != EvaluationStrategy::AUTO) {
+        plan.strategy = planner_options_.strategy;
+    }
+    else {
+        // TAAT updates an ordered map of the matches per posting entry, DAAT passes over every
+        // cursor per match; parallel TAAT has no more tasks than terms
+        const double matches = static_cast<double>(std::min<uint64_t>(plan.postings, documents_.size()));
+        const double taat_cost = plan.postings * std::log2(2.0 + matches);
+        const double daat_cost = plan.postings + matches * plan.terms;
+        plan.strategy = daat_cost <= taat_cost || (plan.parallel && plan.terms < threads)
+            ? EvaluationStrategy::DOCUMENT_AT_A_TIME : EvaluationStrategy::TERM_AT_A_TIME;
+    }
+    if (plan.parallel && plan.strategy == EvaluationStrategy::DOCUMENT_AT_A_TIME) {
+        plan.ranges = static_cast<size_t>(std::clamp<uint64_t>(plan.postings / planner_options_.range_postings, 2, threads * 4));
+    }
+    return plan;
+}
+
+QueryBudgetStats SearchServer::GetQueryBudgetStats() const {
+    return {
+        budget_counters_.queries.Get(),
+        budget_counters_.deadline_exceeded.Get(),
+        budget_counters_.postings_exhausted.Get(),
+        budget_counters_.skipped_terms.Get()
+    };
+}
+
+void SearchServer::PushTopDocument(const Document& document, std::vector<Document>& top) {
+    if (top.size() < MAX_RESULT_DOCUMENT_COUNT) {
+        top.push_back(document);
+        std::push_heap(top.begin(), top.end(), IsMoreRelevant);
+    }
+    else if (IsMoreRelevant(document, top.front())) {
+        std::pop_heap(top.begin(), top.end(), IsMoreRelevant);
+        top.back() = document;
+        std::push_heap(top.begin(), top.end(), IsMoreRelevant);
+    }
+}
+
+void SearchServer::CollectTopDocuments(QueryContext& context, std::vector<Document>& result) const {
+    PROFILE_STAGE(SORT_RESULTS);
+    auto& top = context.top_;
+    top.clear();
+    for (const uint32_t ordinal : context.touched_) {
+        if (context.states_[ordinal] == QueryContext::SCORED) {
+            PushTopDocument(Document(document_columns_.GetId(ordinal), context.scores_[ordinal], document_columns_.GetRating(ordinal)), top);
         }
+        context.scores_[ordinal] = 0.0;
+        context.states_[ordinal] = 0;
     }
+    context.touched_.clear();
+    std::sort_heap(top.begin(), top.end(), IsMoreRelevant);
+    result.assign(top.begin(), top.end());
+}
 
-    return { matched_words, documents_.at(document_id).status };
+DocumentPage SearchServer::FindTopDocumentsPage(const std::string_view raw_query, size_t page_size, const std::string_view cursor) const {
+    return FindTopDocumentsPage(std::execution::seq, raw_query, DocumentStatus::ACTUAL, page_size, cursor);
 }
 
-/*Returns MatchingDocs_sv (that is words, doc status) that exists in both: the query and doc(id).*/
-SearchServer::MatchingDocs_sv SearchServer::MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const {
-    if (!docid_word_freqs_.count(document_id)) {
-        throw std::out_of_range("out_of_range in MatchDocument ");
+
+int SearchServer::GetDocumentCount() const {
+    return documents_.size();
+}
+
+const NormalizationOptions& SearchServer::GetNormalizationOptions() const {
+    return text_normalizer_.GetOptions();
+}
+
+std::string SearchServer::GetDocumentText(int document_id) const {
+    return document_store_.Get(documents_.at(document_id).content);
+}
+
+DocumentStatus SearchServer::GetDocumentStatus(int document_id) const {
+    return document_columns_.GetStatus(documents_.at(document_id).ordinal);
+}
+
+int SearchServer::GetDocumentRating(int document_id) const {
+    return document_columns_.GetRating(documents_.at(document_id).ordinal);
+}
+
+int SearchServer::GetWordDocumentCount(const std::string_view word) const {
+    const auto it = word_to_document_freqs_.find(word);
+    return it == word_to_document_freqs_.end() ? 0 : static_cast<int>(it->second.size());
+}
+
+DocumentStoreStats SearchServer::GetDocumentStoreStats() const {
+    return document_store_.GetStats();
+}
+
+IndexStatistics SearchServer::GetIndexStatistics(size_t top_count) const {
+    IndexStatistics statistics;
+    IndexMemoryUsage& memory = statistics.memory;
+    statistics.document_count = documents_.size();
+    statistics.term_count = word_to_document_freqs_.size();
+
+    // the shortest of the longest lists on top
+    const auto is_longer = [](const PostingListLength& lhs, const PostingListLength& rhs) {
+        return lhs.length > rhs.length;
+    };
+    std::vector<PostingListLength>& longest = statistics.longest_posting_lists;
+    for (const auto& [word, postings] : word_to_document_freqs_) {
+        statistics.posting_count += postings.size();
+        memory.word_to_document_freqs += EstimateTreeNodeBytes<std::pair<const std::string, PostingList>>()
+            + EstimateStringBytes(word) + postings.size() * EstimateTreeNodeBytes<std::pair<const uint32_t, TermFreq>>();
+        if (postings.empty()) {
+            continue;
+        }
+        const size_t bucket = GetPostingLengthBucket(postings.size());
+        if (statistics.posting_length_histogram.size() <= bucket) {
+            statistics.posting_length_histogram.resize(bucket + 1, 0);
+        }
+        ++statistics.posting_length_histogram[bucket];
+        if (top_count == 0 || (longest.size() == top_count && longest.front().length >= postings.size())) {
+            continue;
+        }
+        if (longest.size() == top_count) {
+            std::pop_heap(longest.begin(), longest.end(), is_longer);
+            longest.pop_back();
+        }
+        longest.push_back({ word, postings.size() });
+        std::push_heap(longest.begin(), longest.end(), is_longer);
     }
-    const auto& doc_word_freqs = docid_word_freqs_.at(document_id);
+    std::sort_heap(longest.begin(), longest.end(), is_longer);
 
-    std::vector<std::string_view> splited_query = SplitIntoWords(raw_query);
-    if (std::any_of(std::execution::par, splited_query.begin(), splited_query.end(),
-        [this, &doc_word_freqs](const auto& word) {const auto parsed_w = ParseQueryWord(word);
-    return parsed_w.is_minus
-        && doc_word_freqs.count(parsed_w.data) > 0
-        ; })) {
-        return { {}, documents_.at(document_id).status };
+    for (const auto& [document_id, document] : documents_) {
+        memory.forward_index += EstimateVectorBytes(document.terms);
+    }
+    memory.forward_index += term_ids_.size() * EstimateHashNodeBytes<std::pair<const std::string_view, uint32_t>>()
+        + term_ids_.bucket_count() * sizeof(void*) + EstimateVectorBytes(term_words_) + EstimateVectorBytes(free_term_ids_);
+    const size_t content_bytes = document_store_.GetStats().text_bytes;
+    memory.document_contents = document_store_.GetAllocatedBytes();
+    memory.documents = documents_.size() * EstimateTreeNodeBytes<std::pair<const int, DocumentData>>() + memory.document_contents;
+    memory.stop_words = stop_words_.GetAllocatedBytes();
+    memory.added_doc_ids = added_doc_ids_.size() * EstimateTreeNodeBytes<int>();
+    memory.document_columns = document_columns_.GetAllocatedBytes();
+    memory.term_dictionary = term_dictionary_.GetAllocatedBytes();
+    memory.fuzzy_index = fuzzy_index_ ? fuzzy_index_->GetAllocatedBytes() : 0;
+
+    if (statistics.document_count > 0) {
+        statistics.average_document_terms = static_cast<double>(statistics.posting_count) / statistics.document_count;
+        statistics.average_document_bytes = static_cast<double>(content_bytes) / statistics.document_count;
+    }
+    return statistics;
+}
+
+void SearchServer::SetCorpusStatistics(const CorpusStatistics* statistics) {
+    corpus_statistics_ = statistics;
+}
+
+SearchServer::MatchingDocs_sv SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
+    return MatchDocument(std::execution::seq, raw_query, document_id);
+}
+SearchServer::MatchingDocs_sv SearchServer::MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        throw std::out_of_range("out_of_range in MatchDocument "s);
     }
+    Query query;
+    ParseQuery(raw_query, query);
+    ExpandFuzzyWords(query);
+    std::vector<ForwardTerm> buffer;
+    return { MatchDocumentTerms(query, GetDocumentTerms(it->second, buffer)), document_columns_.GetStatus(it->second.ordinal) };
+}
+
+/*Returns MatchingDocs_sv (that is words, doc status) that exists in both: the query and doc(id).*/
+SearchServer::MatchingDocs_sv SearchServer::MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const {
+    // a document holds tens of terms, too few to split the intersection
+    return MatchDocument(std::execution::seq, raw_query, document_id);
+}
+
+std::vector<std::string_view> SearchServer::MatchDocumentTerms(const Query& query, const std::vector<ForwardTerm>& terms) const {
+    // query words as sorted term ids, intersected with the sorted terms of the document
+    const auto to_term_ids = [this](const auto& words, auto get_word) {
+        std::vector<uint32_t> term_ids;
+        for (const auto& word : words) {
+            const auto it = term_ids_.find(get_word(word));
+            if (it != term_ids_.end()) {
+                term_ids.push_back(it->second);
+            }
+        }
+        std::sort(term_ids.begin(), term_ids.end());
+        return term_ids;
+    };
+    const auto intersect = [&terms](const std::vector<uint32_t>& term_ids, auto callback) {
+        size_t i = 0;
+        size_t j = 0;
+        while (i < term_ids.size() && j < terms.size()) {
+            if (term_ids[i] < terms[j].term_id) {
+                ++i;
+            }
+            else if (terms[j].term_id < term_ids[i]) {
+                ++j;
+            }
+            else {
+                callback(terms[j].term_id);
+                ++i;
+                ++j;
+            }
+        }
+    };
+    const auto has_prefix = [this, &terms](const std::string_view prefix) {
+        return std::any_of(terms.begin(), terms.end(), [this, prefix](const ForwardTerm& term) {
+            return term_words_[term.term_id].substr(0, prefix.size()) == prefix;
+            });
+    };
+    const auto word_of = [](const std::string_view word) { return word; };
 
-    std::vector<std::string_view> plus_ws(splited_query.size());
-    const auto plus_end_it = std::copy_if(std::execution::par, splited_query.begin(), splited_query.end(),
-        plus_ws.begin(),
-        [this, &doc_word_freqs](const auto& word) {const auto pw = ParseQueryWord(word); return !pw.is_stop //
-        && doc_word_freqs.count(word) > 0; });
-    std::sort(std::execution::par, plus_ws.begin(), plus_end_it);
-    const auto plus_end = std::unique(std::execution::par, plus_ws.begin(), plus_end_it);
-    std::vector<std::string_view> res(std::make_move_iterator(plus_ws.begin()), std::make_move_iterator(plus_end));
-    return { res, documents_.at(document_id).status };
+    bool excluded = false;
+    intersect(to_term_ids(query.minus_words, word_of), [&excluded](uint32_t) { excluded = true; });
+    if (excluded || std::any_of(query.minus_prefixes.begin(), query.minus_prefixes.end(), has_prefix)) {
+        return {};
+    }
+    // views of the index words, the query text may be a temporary normalized copy
+    std::vector<std::string_view> matched_words;
+    std::vector<uint32_t> plus_term_ids = to_term_ids(query.plus_words, word_of);
+    const std::vector<uint32_t> fuzzy_term_ids = to_term_ids(query.fuzzy_words, [](const WeightedWord& word) { return word.data; });
+    plus_term_ids.insert(plus_term_ids.end(), fuzzy_term_ids.begin(), fuzzy_term_ids.end());
+    std::inplace_merge(plus_term_ids.begin(), plus_term_ids.end() - fuzzy_term_ids.size(), plus_term_ids.end());
+    intersect(plus_term_ids, [this, &matched_words](uint32_t term_id) { matched_words.push_back(term_words_[term_id]); });
+    for (const ForwardTerm& term : terms) {
+        const std::string_view word = term_words_[term.term_id];
+        if (std::any_of(query.plus_prefixes.begin(), query.plus_prefixes.end(),
+            [word](const std::string_view prefix) { return word.substr(0, prefix.size()) == prefix; })) {
+            matched_words.push_back(word);
+        }
+    }
+    std::sort(matched_words.begin(), matched_words.end());
+    matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+    return matched_words;
 }
 
 
@@ -108,49 +567,74 @@ std::set<int>::const_iterator SearchServer::end() const {
     return added_doc_ids_.end();
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static std::map<std::string_view, double> f{};
-    if (!docid_word_freqs_.count(document_id)) {
-        return f;
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> word_freqs;
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return word_freqs;
     }
-    return docid_word_freqs_.at(document_id);
+    std::vector<ForwardTerm> buffer;
+    for (const ForwardTerm& term : GetDocumentTerms(it->second, buffer)) {
+        word_freqs.emplace(term_words_[term.term_id], DecodeForwardFreq(term.term_freq));
+    }
+    return word_freqs;
 }
 
 void SearchServer::RemoveDocument(std::execution::parallel_policy ex, int document_id) {
-    if (!docid_word_freqs_.count(document_id)) {
+    PROFILE_STAGE(REMOVE_DOCUMENT);
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
         throw std::invalid_argument("Error: no document with such id (RemoveDocument)."s);
     }
-    std::vector<std::string_view> words_v(docid_word_freqs_.at(document_id).size());
+    std::vector<ForwardTerm> buffer;
+    const std::vector<ForwardTerm>& terms = GetDocumentTerms(document_it->second, buffer);
+    std::vector<std::string_view> words_v(terms.size());
     std::transform(std::execution::par,
-        docid_word_freqs_.at(document_id).begin(), docid_word_freqs_.at(document_id).end(),
+        terms.begin(), terms.end(),
         words_v.begin(),
-        [](const auto& p) {return std::get<0>(p); });    // get the right words
+        [this](const ForwardTerm& term) {return term_words_[term.term_id]; });    // get the right words
+    const uint32_t ordinal = document_it->second.ordinal;
     std::for_each(std::execution::par, words_v.begin(), words_v.end(),
-        [this, document_id](const auto& word) {word_to_document_freqs_.at(word).erase(document_id); });
-    docid_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
+        [this, ordinal](const auto& word) {word_to_document_freqs_.find(word)->second.erase(ordinal); });
+    for (const auto word : words_v) {
+        const auto it = word_to_document_freqs_.find(word);
+        if (it->second.empty()) {
+            RemoveTerm(it);
+        }
+    }
+    added_doc_ids_.erase(document_id);
+    document_columns_.Remove(ordinal);
+    document_store_.Remove(document_it->second.content);
+    documents_.erase(document_it);
 }
 
 void SearchServer::RemoveDocument(std::execution::sequenced_policy ex, int document_id) {
-    for (auto& wf : docid_word_freqs_.at(document_id)) {
-        word_to_document_freqs_.at(wf.first).erase(document_id);
+    PROFILE_STAGE(REMOVE_DOCUMENT);
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        throw std::invalid_argument("Error: no document with such id (RemoveDocument)."s);
+    }
+    const uint32_t ordinal = document_it->second.ordinal;
+    std::vector<ForwardTerm> buffer;
+    for (const ForwardTerm& term : GetDocumentTerms(document_it->second, buffer)) {
+        const auto it = word_to_document_freqs_.find(term_words_[term.term_id]);
+        it->second.erase(ordinal);
+        if (it->second.empty()) {
+            RemoveTerm(it);
+        }
     }
-    docid_word_freqs_.erase(document_id);
-    added_doc_ids_.erase(find(added_doc_ids_.begin(), added_doc_ids_.end(), document_id));
-    documents_.erase(document_id);
+    added_doc_ids_.erase(document_id);
+    document_columns_.Remove(ordinal);
+    document_store_.Remove(document_it->second.content);
+    documents_.erase(document_it);
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (docid_word_freqs_.count(document_id)) {
-        RemoveDocument(std::execution::seq, document_id);
-    }
-    else {
-        throw std::invalid_argument("Error: no document with such id (RemoveDocument)."s);
-    }
+    RemoveDocument(std::execution::seq, document_id);
 }
 
 bool SearchServer::IsStopWord(const std::string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(const std::string& word) {
@@ -227,6 +711,7 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
 SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
     QueryWord result;
     bool is_minus = false;
+    bool is_prefix = false;
 
     if (text.size() > 0) {
         if (text[0] == '-') {
@@ -238,29 +723,51 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
                 text = text.substr(1);
             }
         }
+        if (text.back() == '*') {
+            if (text.size() == 1) {
+                throw std::invalid_argument("Error: empty prefix (ParseQueryWord)."s);
+            }
+            is_prefix = true;
+            text.remove_suffix(1);
+        }
         result = {
             text,
             is_minus,
-            IsStopWord(text)
+            !is_prefix && IsStopWord(text),
+            is_prefix
         };
     }
     else {
         result = {
             text,
             is_minus,
+            false,
             false
         };
     }
     return result;
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const {
-    Query result;
-    auto words = SplitIntoWords(text);
+void SearchServer::ParseQuery(const std::string_view text, Query& result) const {
+    std::vector<std::string_view> words;
+    ParseQuery(text, words, result);
+}
+
+void SearchServer::ParseQuery(const std::string_view text, std::vector<std::string_view>& words, Query& result) const {
+    for (auto* word_list : { &result.plus_words, &result.minus_words, &result.plus_prefixes, &result.minus_prefixes }) {
+        word_list->clear();
+    }
+    result.fuzzy_words.clear();
+    SplitIntoWords(text_normalizer_.Normalize(text, result.normalized_text), words);
     std::for_each(words.begin(), words.end(), [this, &result](const auto& word) {QueryWord query_word = ParseQueryWord(word);
     if (!query_word.is_stop) {
         if (IsValidWord(query_word.data)) {
-            query_word.is_minus ? result.minus_words.push_back(query_word.data) : result.plus_words.push_back(query_word.data);
+            if (query_word.is_prefix) {
+                query_word.is_minus ? result.minus_prefixes.push_back(query_word.data) : result.plus_prefixes.push_back(query_word.data);
+            }
+            else {
+                query_word.is_minus ? result.minus_words.push_back(query_word.data) : result.plus_words.push_back(query_word.data);
+            }
         }
         else {
             throw std::invalid_argument("Error: invalid word (ParseQuery)."s);
@@ -273,13 +780,86 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const
     result.minus_words.resize(mw_end - result.minus_words.begin());
     const auto pw_end = std::unique(result.plus_words.begin(), result.plus_words.end());
     result.plus_words.resize(pw_end - result.plus_words.begin());
-    return result;
+    for (auto* prefixes : { &result.plus_prefixes, &result.minus_prefixes }) {
+        std::sort(prefixes->begin(), prefixes->end());
+        prefixes->erase(std::unique(prefixes->begin(), prefixes->end()), prefixes->end());
+    }
+    ExpandPrefixWords(result);
+}
+
+void SearchServer::ExpandPrefixWords(Query& query) const {
+    query.prefix_words.clear();
+    query.prefix_word_bounds.assign(1, 0);
+    // prefixes are sorted, so an earlier one matching a word is a prefix of the current one
+    for (size_t i = 0; i < query.plus_prefixes.size(); ++i) {
+        ForEachPrefixWord(query.plus_prefixes[i], [&query, i](const std::string_view word) {
+            if (std::binary_search(query.plus_words.begin(), query.plus_words.end(), word)) {
+                return;
+            }
+            for (size_t j = 0; j < i; ++j) {
+                const auto begin = query.prefix_words.begin() + query.prefix_word_bounds[j];
+                const auto end = query.prefix_words.begin() + query.prefix_word_bounds[j + 1];
+                if (word.substr(0, query.plus_prefixes[j].size()) == query.plus_prefixes[j] && std::binary_search(begin, end, word)) {
+                    return;
+                }
+            }
+            query.prefix_words.push_back(word);
+            });
+        query.prefix_word_bounds.push_back(query.prefix_words.size());
+    }
+}
+
+void SearchServer::ExpandFuzzyWords(Query& query) const {
+    if (!fuzzy_index_) {
+        return;
+    }
+    const auto start_time = std::chrono::steady_clock::now();
+    for (const auto word : query.plus_words) {
+        if (GetCorpusWordDocumentCount(word) > 0) {
+            continue;
+        }
+        fuzzy_counters_.expanded_words.Add();
+        FuzzyIndex::Lookup lookup;
+        if (!corpus_statistics_ || !corpus_statistics_->FindFuzzyCandidates(word, MAX_FUZZY_EXPANSION, MAX_FUZZY_CHECKED, lookup)) {
+            lookup = fuzzy_index_->FindCandidates(word, MAX_FUZZY_EXPANSION, MAX_FUZZY_CHECKED);
+        }
+        fuzzy_counters_.checked_terms.Add(lookup.checked);
+        for (const auto& [term, distance] : lookup.candidates) {
+            const auto it = word_to_document_freqs_.find(term);
+            if (it == word_to_document_freqs_.end() || it->second.empty()
+                || std::binary_search(query.plus_words.begin(), query.plus_words.end(), it->first)) {
+                continue;
+            }
+            query.fuzzy_words.push_back({ it->first, std::pow(FUZZY_WEIGHT, distance) });
+        }
+    }
+    // a term reachable from several query words counts once, with the best weight
+    std::sort(query.fuzzy_words.begin(), query.fuzzy_words.end(), [](const WeightedWord& lhs, const WeightedWord& rhs) {
+        return lhs.data < rhs.data || (lhs.data == rhs.data && lhs.weight > rhs.weight);
+        });
+    query.fuzzy_words.erase(std::unique(query.fuzzy_words.begin(), query.fuzzy_words.end(), [](const WeightedWord& lhs, const WeightedWord& rhs) {
+        return lhs.data == rhs.data;
+        }), query.fuzzy_words.end());
+    fuzzy_counters_.expansion_terms.Add(query.fuzzy_words.size());
+    fuzzy_counters_.expansion_ns.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count());
 }
 
+// Existence required
+const SearchServer::PostingList& SearchServer::GetWordPostings(const std::string_view word) const {
+    return word_to_document_freqs_.find(word)->second;
+}
+
+int SearchServer::GetCorpusDocumentCount() const {
+    return corpus_statistics_ ? corpus_statistics_->GetDocumentCount() : GetDocumentCount();
+}
+
+int SearchServer::GetCorpusWordDocumentCount(const std::string_view word) const {
+    return corpus_statistics_ ? corpus_statistics_->GetWordDocumentCount(word) : GetWordDocumentCount(word);
+}
 
 // Existence required
 double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+    return std::log(GetCorpusDocumentCount() * 1.0 / GetCorpusWordDocumentCount(word));
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view document, DocumentStatus status,
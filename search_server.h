@@ -3,6 +3,21 @@
 #include "string_processing.h"
 #include "document.h"
 #include "concurrent_map.h"
+#include "term_dictionary.h"
+#include "fuzzy_index.h"
+#include "atomic_counter.h"
+#include "corpus_statistics.h"
+#include "document_columns.h"
+#include "document_store.h"
+#include "document_page.h"
+#include "facet_counts.h"
+#include "query_budget.h"
+#include "query_planner.h"
+#include "index_statistics.h"
+#include "stop_word_set.h"
+#include "text_normalizer.h"
+#include "stage_profiler.h"
+#include "score_precision.h"
 
 
 #include <algorithm>
@@ -12,28 +27,115 @@
 #include <stdexcept>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <cmath>
 #include <execution>
+#include <memory>
+#include <chrono>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 using namespace std::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double EPSILON = 1e-6;
+const int MAX_PREFIX_EXPANSION = 64;    // max dictionary terms a "word*" query word expands to
+const int MAX_FUZZY_EXPANSION = 8;    // max dictionary terms an unmatched word expands to in fuzzy mode
+const int MAX_FUZZY_CHECKED = 256;    // max candidates verified with edit distance per word
+const double FUZZY_WEIGHT = 0.5;    // relevance multiplier per edit of a fuzzy expansion
+const size_t DEFAULT_PREFETCH_DISTANCE = 8;    // postings ahead in the scoring loops
+const uint64_t DEADLINE_CHECK_POSTINGS = 1024;    // postings a budgeted query scores between deadline checks
+
+struct FuzzySearchStats {
+    uint64_t expanded_words = 0;    // unmatched query words looked up in the fuzzy index
+    uint64_t checked_terms = 0;    // candidates verified with edit distance
+    uint64_t expansion_terms = 0;    // terms added to queries
+    uint64_t expansion_ns = 0;    // time spent on expansion
+};
+
+class QueryContext;
+class BatchQueryEvaluator;
+
+// Order of search results: by relevance, then by rating, then by id
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        return lhs.rating > rhs.rating || (lhs.rating == rhs.rating && lhs.id < rhs.id);
+    }
+    else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
+
+// Predicate of FindTopDocuments(status): tested against the status bitmap instead of being called per document
+struct DocumentStatusFilter {
+    DocumentStatus status;
+
+    bool operator()(int, DocumentStatus document_status, int) const {
+        return document_status == status;
+    }
+};
 
 class SearchServer {
 private:
+    friend class QueryContext;
+    friend class BatchQueryEvaluator;
+
+    // Forward index entry, the frequency is quantized to steps of 1/65535
+    struct ForwardTerm {
+        uint32_t term_id;
+        uint16_t term_freq;
+    };
     struct DocumentData {
-        int rating;
-        DocumentStatus status;
-        std::string content;
-    };
-    std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;   // INDEX word: {doc_id: word_frequency}
-    std::map<int, std::map<std::string_view, double>> docid_word_freqs_;    // INDEX doc_id: {word: frequency}
-    std::map<int, DocumentData> documents_;    // doc's id: {rating, status}
+        uint32_t ordinal;    // in document_columns_ and the posting lists
+        DocumentStore::Location content;    // in document_store_
+        std::vector<ForwardTerm> terms;    // sorted by term id, empty without the forward index
+    };
+    TextNormalizer text_normalizer_;
+    StopWordSet stop_words_;    // normalized
+    using PostingList = std::map<uint32_t, TermFreq>;    // doc ordinal: word_frequency
+    std::map<std::string, PostingList, std::less<>> word_to_document_freqs_;   // INDEX word: postings, owns the words
+    std::unordered_map<std::string_view, uint32_t> term_ids_;    // indexed words (the keys of word_to_document_freqs_)
+    std::vector<std::string_view> term_words_;    // by term id, empty for free ids
+    std::vector<uint32_t> free_term_ids_;
+    bool forward_index_enabled_ = true;
+    std::map<int, DocumentData> documents_;    // doc's id: {ordinal, content, terms}
+    DocumentColumns document_columns_;    // id, rating and status by ordinal
+    DocumentStore document_store_;    // compressed contents, read only by GetDocumentText
     std::set<int> added_doc_ids_;    // doc_ids
+    TermDictionary term_dictionary_;    // all indexed words, for prefix search
+    std::unique_ptr<FuzzyIndex> fuzzy_index_;    // set in fuzzy mode
+
+    struct FuzzyCounters {
+        AtomicCounter expanded_words;
+        AtomicCounter checked_terms;
+        AtomicCounter expansion_terms;
+        AtomicCounter expansion_ns;
+    };
+    mutable FuzzyCounters fuzzy_counters_;
+
+    struct BudgetCounters {
+        AtomicCounter queries;
+        AtomicCounter deadline_exceeded;
+        AtomicCounter postings_exhausted;
+        AtomicCounter skipped_terms;
+    };
+    mutable BudgetCounters budget_counters_;
+
+    QueryPlannerOptions planner_options_;
+    struct PlannerCounters {
+        AtomicCounter taat_seq;
+        AtomicCounter taat_par;
+        AtomicCounter daat_seq;
+        AtomicCounter daat_par;
+    };
+    mutable PlannerCounters planner_counters_;
+    size_t prefetch_distance_ = DEFAULT_PREFETCH_DISTANCE;    // postings, 0: off
+    const CorpusStatistics* corpus_statistics_ = nullptr;    // IDF source, this index if not set
 
     bool IsStopWord(const std::string_view word) const;
+    // Validates and normalizes the stop words
+    void SetStopWords(const std::vector<std::string_view>& stop_words);
 
     static bool IsValidWord(const std::string& word);
     static bool IsValidWord(const std::string_view word);
@@ -44,48 +146,179 @@ private:
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
+    // Frequencies of the indexed words of a text, the words point into text or normalized_text
+    std::map<std::string_view, double> CountWordFrequencies(const std::string_view text, std::string& normalized_text) const;
+    // Forward index entries of word_freqs sorted by term id, the words must be indexed
+    void BuildDocumentTerms(const std::map<std::string_view, double>& word_freqs, std::vector<ForwardTerm>& terms) const;
+    // The forward index entries of the document, or buffer rebuilt from its text without the forward index
+    const std::vector<ForwardTerm>& GetDocumentTerms(const DocumentData& document, std::vector<ForwardTerm>& buffer) const;
+    uint32_t AddTermId(const std::string_view word);
+    // Erases the word with an empty posting list from the index
+    void RemoveTerm(std::map<std::string, PostingList, std::less<>>::iterator word_it);
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
+        bool is_prefix;    // "word*"
     };
 
     QueryWord ParseQueryWord(std::string_view text) const;
 
+    struct WeightedWord {
+        std::string_view data;
+        double weight;
+    };
+
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        std::vector<std::string_view> plus_prefixes;
+        std::vector<std::string_view> minus_prefixes;
+        // Expansions of the plus prefixes without the words of plus_words or of an earlier prefix,
+        // those of plus_prefixes[i] are prefix_words[prefix_word_bounds[i], prefix_word_bounds[i + 1])
+        std::vector<std::string_view> prefix_words;
+        std::vector<size_t> prefix_word_bounds;
+        std::vector<WeightedWord> fuzzy_words;    // expansions of unmatched plus words
+        std::string normalized_text;    // the words point into it unless normalization is off
     };
 
-    Query ParseQuery(const std::string_view text) const;
+    void ParseQuery(const std::string_view text, Query& result) const;
+    // Fills result reusing its buffers, words receives the split text
+    void ParseQuery(const std::string_view text, std::vector<std::string_view>& words, Query& result) const;
+    // Fills query.prefix_words, so a term matched twice by the query is scored once
+    void ExpandPrefixWords(Query& query) const;
+    // Fills query.fuzzy_words in fuzzy mode
+    void ExpandFuzzyWords(Query& query) const;
+    // Words of the document (views of the index words) matched by the query, sorted
+    std::vector<std::string_view> MatchDocumentTerms(const Query& query, const std::vector<ForwardTerm>& terms) const;
+
+    // Throws std::invalid_argument for unknown ids
+    uint32_t GetUpdatedDocumentOrdinal(int document_id) const;
 
+    // Existence required
+    const PostingList& GetWordPostings(const std::string_view word) const;
+    int GetCorpusDocumentCount() const;
+    int GetCorpusWordDocumentCount(const std::string_view word) const;
     // Existence required
     double ComputeWordInverseDocumentFreq(const std::string_view word) const;
 
+    // Calls callback(word) for the indexed words among the first MAX_PREFIX_EXPANSION words starting
+    // with prefix, of the corpus statistics if they list words. Dictionary entries erased but not yet
+    // compacted away count towards the limit, so a scan never walks an unbounded run of them.
+    template <typename Callback>
+    void ForEachPrefixWord(const std::string_view prefix, Callback callback) const;
+    // Union of the posting lists of the expansions of query.plus_prefixes[prefix_index] merged with
+    // a heap, calls callback(ordinal, Score relevance) once per document in ordinal order, or until
+    // a callback returning bool returns false
+    template <typename Callback>
+    void ForEachPrefixDocument(const Query& query, size_t prefix_index, Callback callback) const;
+
+    // Keeps the MAX_RESULT_DOCUMENT_COUNT most relevant documents in top, a heap with the least relevant on top
+    static void PushTopDocument(const Document& document, std::vector<Document>& top);
+    // Moves the top scored documents of context to result and resets its per-ordinal buffers
+    void CollectTopDocuments(QueryContext& context, std::vector<Document>& result) const;
+
+    // Predicate check of the document with the ordinal, a bitmap test for DocumentStatusFilter
+    template <typename DocumentPredicate>
+    bool IsAccepted(const DocumentPredicate& document_predicate, uint32_t ordinal) const;
+    // Cache hint for an upcoming IsAccepted
+    template <typename DocumentPredicate>
+    void PrefetchAccepted(const DocumentPredicate& document_predicate, uint32_t ordinal) const;
+    // Calls callback(ordinal, term_freq) for every posting. With a prefetch distance the posting
+    // that many entries ahead is reached first and prefetch(its ordinal) hints the data it scores.
+    // A callback returning bool stops the walk with false.
+    template <typename Prefetch, typename Callback>
+    void ForEachPosting(const PostingList& postings, Prefetch prefetch, Callback callback) const;
+    // Calls callback(args...); false if it returned bool false
+    template <typename Callback, typename... Args>
+    static bool InvokeWalkCallback(Callback& callback, Args... args);
+
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const;
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const;
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    // Evaluation chosen by PlanQuery
+    template <typename DocumentPredicate>
+    std::vector<Document> FindAllDocuments(const AutoExecutionPolicy&, const Query& query, DocumentPredicate document_predicate) const;
+
+    // Plus posting list of a DAAT query. The terms of a group (the expansions of one prefix) are
+    // summed before they are added to the relevance, in the order TAAT adds them
+    struct DaatTerm {
+        const PostingList* postings;
+        Score weight;
+        uint32_t group;
+    };
+    void CollectDaatTerms(const Query& query, std::vector<DaatTerm>& plus_terms, std::vector<const PostingList*>& minus_terms) const;
+    QueryPlan PlanQuery(const std::vector<DaatTerm>& plus_terms) const;
+    size_t GetPlannerThreadCount() const;
+    // DAAT over the ordinals in [begin, end): calls callback(ordinal, Score relevance) for every
+    // matched document in ordinal order, whatever its status
+    template <typename Callback>
+    void ForEachDaatMatch(const std::vector<DaatTerm>& plus_terms, const std::vector<const PostingList*>& minus_terms,
+        uint32_t begin, uint32_t end, Callback callback) const;
+    // Appends the matches accepted by document_predicate to result in ordinal order
+    template <typename DocumentPredicate>
+    void FindDocumentsInRange(const std::vector<DaatTerm>& plus_terms, const std::vector<const PostingList*>& minus_terms,
+        DocumentPredicate document_predicate, uint32_t begin, uint32_t end, std::vector<Document>& result) const;
+    // Facets of all matches and, with keep_top, the top documents accepted by document_predicate
+    template <typename Policy, typename DocumentPredicate>
+    FacetedSearchResult AggregateDocuments(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate,
+        const FacetOptions& options, bool keep_top) const;
 
 public:
-    explicit SearchServer(std::string sws);
-    explicit SearchServer(std::string_view sws);
+    // Documents, queries and stop words go through the same normalization
+    explicit SearchServer(std::string sws, NormalizationOptions normalization = {});
+    explicit SearchServer(std::string_view sws, NormalizationOptions normalization = {});
 
     template <typename stringContainer>
-    explicit SearchServer(const stringContainer& stop_words) {
-        for (const std::string& sw : stop_words) {
-            if (!IsValidWord(sw)) {
-                throw std::invalid_argument("Error: invalid word."s);
-            }
-            stop_words_.insert(sw);
-        }
+    explicit SearchServer(const stringContainer& stop_words, NormalizationOptions normalization = {})
+        : text_normalizer_(normalization) {
+        const std::vector<std::string> words(stop_words.begin(), stop_words.end());
+        SetStopWords(std::vector<std::string_view>(words.begin(), words.end()));
     }
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
-    //par/seq
+    // Metadata updates in O(1) without reindexing, rating is the stored (average) rating.
+    // They may run while queries execute (a query sees the old or the new value) but must be
+    // serialized with other updates. Throw std::invalid_argument for unknown ids; the batched
+    // versions check every id before changing any document.
+    void SetDocumentStatus(int document_id, DocumentStatus status);
+    void SetDocumentRating(int document_id, int rating);
+    void SetDocumentStatuses(const std::vector<std::pair<int, DocumentStatus>>& updates);
+    void SetDocumentRatings(const std::vector<std::pair<int, int>>& updates);
+
+    // Fuzzy mode: plus words absent from the index are replaced with indexed words within
+    // max_edit_distance (1 or 2) edits, their relevance is multiplied by FUZZY_WEIGHT per edit.
+    void EnableFuzzySearch(int max_edit_distance);
+    void DisableFuzzySearch();
+    FuzzySearchStats GetFuzzySearchStats() const;
+
+    // Software prefetching in the posting loops of the TAAT search paths: distance postings ahead
+    // of the one scored, the tree node is reached and the document data prefetched; 0 disables it.
+    void SetPrefetchDistance(size_t distance);
+    size_t GetPrefetchDistance() const;
+    // Moves the document columns to allocations of the current HugePageMode (huge_page_allocator.h).
+    // Must not run concurrently with other calls.
+    void ReallocateIndexMemory();
+
+    // Forward index (on by default): the terms of every document as an array of term ids with
+    // quantized frequencies, for MatchDocument, GetWordFrequencies and RemoveDocument. Without it
+    // they tokenize the stored text of the document again, trading CPU for memory.
+    void EnableForwardIndex();
+    void DisableForwardIndex();
+
+    // Query planner of the auto_execution policy, see QueryPlannerOptions. PlanQuery shows the
+    // plan of a query, the counters count the executed plans.
+    void SetQueryPlannerOptions(const QueryPlannerOptions& options);
+    const QueryPlannerOptions& GetQueryPlannerOptions() const;
+    QueryPlan PlanQuery(const std::string_view raw_query) const;
+    QueryPlannerStats GetQueryPlannerStats() const;
+
+    //par/seq/auto_execution
     template <typename Policy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate) const;
     template <typename Policy>
@@ -99,7 +332,73 @@ public:
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
 
+    // Sequential search with the scratch buffers of context, results replace the contents of result.
+    // Scores are accumulated in a dense array and the top documents kept in a bounded heap; once the
+    // buffers have grown, queries of plain and minus words do not allocate (prefix and fuzzy terms may).
+    template <typename DocumentPredicate>
+    void FindTopDocuments(QueryContext& context, const std::string_view raw_query, DocumentPredicate document_predicate,
+        std::vector<Document>& result) const;
+    void FindTopDocuments(QueryContext& context, const std::string_view raw_query, DocumentStatus status, std::vector<Document>& result) const;
+    void FindTopDocuments(QueryContext& context, const std::string_view raw_query, std::vector<Document>& result) const;
+
+    // Budgeted search with the buffers of context, see QueryBudget. Returns COMPLETE or why the
+    // budget ran out; result then holds the best documents of the terms processed so far.
+    // Relevance may differ from the other overloads in the last bits as terms are summed by cost.
+    template <typename DocumentPredicate>
+    QueryCompletion FindTopDocuments(QueryContext& context, const QueryBudget& budget, const std::string_view raw_query,
+        DocumentPredicate document_predicate, std::vector<Document>& result) const;
+    QueryCompletion FindTopDocuments(QueryContext& context, const QueryBudget& budget, const std::string_view raw_query,
+        DocumentStatus status, std::vector<Document>& result) const;
+    QueryCompletion FindTopDocuments(QueryContext& context, const QueryBudget& budget, const std::string_view raw_query,
+        std::vector<Document>& result) const;
+    QueryBudgetStats GetQueryBudgetStats() const;
+
+    // Hit count of a query with its counts by DocumentStatus and rating bucket, over all matches
+    // whatever their status. Counted while the posting lists are merged (DAAT) without
+    // materializing the matches; the par policy splits the ordinal space into ranges counted in
+    // parallel. FacetOptions::sample_fraction below 1 estimates the counts from a sample.
+    template <typename Policy>
+    FacetCounts CountDocuments(const Policy& exPol, const std::string_view raw_query, const FacetOptions& options = {}) const;
+    FacetCounts CountDocuments(const std::string_view raw_query, const FacetOptions& options = {}) const;
+    // The top documents of FindTopDocuments with the exact facets of all matches, in the same pass
+    template <typename Policy, typename DocumentPredicate>
+    FacetedSearchResult FindTopDocumentsWithFacets(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate,
+        const FacetOptions& options = {}) const;
+    template <typename Policy>
+    FacetedSearchResult FindTopDocumentsWithFacets(const Policy& exPol, const std::string_view raw_query, DocumentStatus status,
+        const FacetOptions& options = {}) const;
+    template <typename Policy>
+    FacetedSearchResult FindTopDocumentsWithFacets(const Policy& exPol, const std::string_view raw_query, const FacetOptions& options = {}) const;
+
+    // Deep pagination: page_size documents after cursor (empty for the first page) in FindTopDocuments order.
+    // The page is selected from the matches with a bounded partial sort, pass next_cursor for the next one.
+    // Cursors are stateless, so every page scores all matches again: a page costs O(matches) at any depth,
+    // as a relevance is only final after the last term and no match can be skipped before that.
+    template <typename Policy, typename DocumentPredicate>
+    DocumentPage FindTopDocumentsPage(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t page_size, const std::string_view cursor) const;
+    template <typename Policy>
+    DocumentPage FindTopDocumentsPage(const Policy& exPol, const std::string_view raw_query, DocumentStatus status,
+        size_t page_size, const std::string_view cursor) const;
+    DocumentPage FindTopDocumentsPage(const std::string_view raw_query, size_t page_size, const std::string_view cursor = {}) const;
+
     int GetDocumentCount() const;
+    const NormalizationOptions& GetNormalizationOptions() const;
+    // Stored document fields, throw std::out_of_range for unknown ids
+    std::string GetDocumentText(int document_id) const;
+    DocumentStatus GetDocumentStatus(int document_id) const;
+    int GetDocumentRating(int document_id) const;
+    // Number of documents containing the word
+    int GetWordDocumentCount(const std::string_view word) const;
+    DocumentStoreStats GetDocumentStoreStats() const;
+
+    // Sizes and estimated memory of the index structures with the top_count longest posting lists.
+    // Linear in the number of terms and documents, posting lists are not traversed.
+    IndexStatistics GetIndexStatistics(size_t top_count = 10) const;
+
+    // Makes IDF, and prefix and fuzzy expansions where statistics list words, computed from statistics
+    // (not owned) instead of this index, nullptr resets it
+    void SetCorpusStatistics(const CorpusStatistics* statistics);
 
     using MatchingDocs_sv = std::tuple<std::vector<std::string_view>, DocumentStatus>;
     MatchingDocs_sv MatchDocument(const std::string_view raw_query, int document_id) const;
@@ -109,36 +408,276 @@ public:
     std::set<int>::const_iterator begin() const;
     std::set<int>::const_iterator end() const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Indexed words of the document with their frequencies (to 1/65535), empty for unknown ids
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
     void RemoveDocument(std::execution::parallel_policy ex, int document_id);
     void RemoveDocument(std::execution::sequenced_policy ex, int document_id);
     void RemoveDocument(int document_id);
 };
 
+// Reusable scratch buffers of the query path for one caller at a time (e.g. one per thread).
+// Can be used with any SearchServer.
+class QueryContext {
+private:
+    friend class SearchServer;
+
+    std::vector<std::string_view> words_;
+    SearchServer::Query query_;
+    IndexVector<Score> scores_;    // by ordinal
+    IndexVector<uint8_t> states_;    // by ordinal: SCORED, EXCLUDED or 0
+    std::vector<uint32_t> touched_;    // ordinals with a state
+    std::vector<Document> top_;    // heap with the least relevant document on top
+
+    static const uint8_t SCORED = 1;
+    static const uint8_t EXCLUDED = 2;
+
+    // Plus term of a budgeted query
+    struct Term {
+        uint64_t cost;    // posting entries
+        uint32_t index;    // in the query list of its kind
+        uint8_t kind;
+    };
+    std::vector<Term> terms_;
+    std::vector<const SearchServer::PostingList*> minus_postings_;    // of a budgeted query
+
+    static const uint8_t PLUS_WORD = 0;
+    static const uint8_t FUZZY_WORD = 1;
+    static const uint8_t PLUS_PREFIX = 2;
+
+    // Makes the per-ordinal buffers cover ordinal_bound ordinals
+    void Prepare(size_t ordinal_bound) {
+        if (scores_.size() < ordinal_bound) {
+            scores_.resize(ordinal_bound, Score{ 0 });
+            states_.resize(ordinal_bound, 0);
+        }
+    }
+};
+
+template <typename DocumentPredicate>
+void SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query, DocumentPredicate document_predicate,
+    std::vector<Document>& result) const {
+    {
+        PROFILE_STAGE(PARSE_QUERY);
+        ParseQuery(raw_query, context.words_, context.query_);
+        ExpandFuzzyWords(context.query_);
+    }
+    PROFILE_STAGE(SCORE_CONTEXT);
+    const Query& query = context.query_;
+    context.Prepare(document_columns_.GetOrdinalBound());
+
+    const auto add_relevance = [this, &context, &document_predicate](uint32_t ordinal, Score relevance) {
+        if (!IsAccepted(document_predicate, ordinal)) {
+            return;
+        }
+        if (context.states_[ordinal] == 0) {
+            context.states_[ordinal] = QueryContext::SCORED;
+            context.touched_.push_back(ordinal);
+        }
+        context.scores_[ordinal] += relevance;
+    };
+    const auto prefetch = [this, &context, &document_predicate](uint32_t ordinal) {
+        PrefetchAccepted(document_predicate, ordinal);
+        PrefetchRead(&context.states_[ordinal]);
+        PrefetchRead(&context.scores_[ordinal]);
+    };
+    // the same summation order as FindAllDocuments, so relevance is bit-identical
+    for (const auto& word : query.plus_words) {
+        if (word_to_document_freqs_.count(word) == 0) {
+            continue;
+        }
+        const Score inverse_document_freq = static_cast<Score>(ComputeWordInverseDocumentFreq(word));
+        ForEachPosting(GetWordPostings(word), prefetch, [&add_relevance, inverse_document_freq](uint32_t ordinal, TermFreq term_freq) {
+            add_relevance(ordinal, ComputeTermRelevance(term_freq, inverse_document_freq));
+            });
+    }
+    for (const auto& [word, weight] : query.fuzzy_words) {
+        const Score inverse_document_freq = static_cast<Score>(ComputeWordInverseDocumentFreq(word) * weight);
+        ForEachPosting(GetWordPostings(word), prefetch, [&add_relevance, inverse_document_freq](uint32_t ordinal, TermFreq term_freq) {
+            add_relevance(ordinal, ComputeTermRelevance(term_freq, inverse_document_freq));
+            });
+    }
+    for (size_t i = 0; i < query.plus_prefixes.size(); ++i) {
+        ForEachPrefixDocument(query, i, add_relevance);
+    }
+    const auto exclude = [&context](uint32_t ordinal) {
+        if (context.states_[ordinal] == QueryContext::SCORED) {
+            context.states_[ordinal] = QueryContext::EXCLUDED;
+        }
+    };
+    for (const auto& word : query.minus_words) {
+        if (word_to_document_freqs_.count(word) == 0) {
+            continue;
+        }
+        for (const auto [ordinal, _] : GetWordPostings(word)) {
+            exclude(ordinal);
+        }
+    }
+    for (const auto& prefix : query.minus_prefixes) {
+        ForEachPrefixWord(prefix, [this, &exclude](const std::string_view word) {
+            for (const auto [ordinal, _] : GetWordPostings(word)) {
+                exclude(ordinal);
+            }
+            });
+    }
+
+    CollectTopDocuments(context, result);
+}
+
+template <typename DocumentPredicate>
+QueryCompletion SearchServer::FindTopDocuments(QueryContext& context, const QueryBudget& budget, const std::string_view raw_query,
+    DocumentPredicate document_predicate, std::vector<Document>& result) const {
+    {
+        PROFILE_STAGE(PARSE_QUERY);
+        ParseQuery(raw_query, context.words_, context.query_);
+        ExpandFuzzyWords(context.query_);
+    }
+    PROFILE_STAGE(SCORE_CONTEXT);
+    const Query& query = context.query_;
+    context.Prepare(document_columns_.GetOrdinalBound());
+    budget_counters_.queries.Add();
+
+    // minus terms are not scanned: a document is looked up in their posting lists when it is first
+    // scored, so long minus terms cost neither time nor budget and partial results exclude them
+    auto& minus_postings = context.minus_postings_;
+    minus_postings.clear();
+    for (const auto& word : query.minus_words) {
+        if (word_to_document_freqs_.count(word) > 0) {
+            minus_postings.push_back(&GetWordPostings(word));
+        }
+    }
+    for (const auto& prefix : query.minus_prefixes) {
+        ForEachPrefixWord(prefix, [this, &minus_postings](const std::string_view word) {
+            minus_postings.push_back(&GetWordPostings(word));
+            });
+    }
+
+    auto& terms = context.terms_;
+    terms.clear();
+    for (uint32_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto it = word_to_document_freqs_.find(query.plus_words[i]);
+        if (it != word_to_document_freqs_.end() && !it->second.empty()) {
+            terms.push_back({ it->second.size(), i, QueryContext::PLUS_WORD });
+        }
+    }
+    for (uint32_t i = 0; i < query.fuzzy_words.size(); ++i) {
+        terms.push_back({ GetWordPostings(query.fuzzy_words[i].data).size(), i, QueryContext::FUZZY_WORD });
+    }
+    for (uint32_t i = 0; i < query.plus_prefixes.size(); ++i) {
+        uint64_t cost = 0;
+        for (size_t j = query.prefix_word_bounds[i]; j < query.prefix_word_bounds[i + 1]; ++j) {
+            cost += GetWordPostings(query.prefix_words[j]).size();
+        }
+        terms.push_back({ cost, i, QueryContext::PLUS_PREFIX });
+    }
+    std::sort(terms.begin(), terms.end(), [](const QueryContext::Term& lhs, const QueryContext::Term& rhs) {
+        return std::tie(lhs.cost, lhs.kind, lhs.index) < std::tie(rhs.cost, rhs.kind, rhs.index);
+        });
+
+    const auto add_relevance = [this, &context, &document_predicate, &minus_postings](uint32_t ordinal, Score relevance) {
+        uint8_t& state = context.states_[ordinal];
+        if (state == QueryContext::EXCLUDED || !IsAccepted(document_predicate, ordinal)) {
+            return;
+        }
+        if (state == 0) {
+            context.touched_.push_back(ordinal);
+            const bool excluded = std::any_of(minus_postings.begin(), minus_postings.end(), [ordinal](const PostingList* postings) {
+                return postings->count(ordinal) > 0;
+                });
+            state = excluded ? QueryContext::EXCLUDED : QueryContext::SCORED;
+            if (excluded) {
+                return;
+            }
+        }
+        context.scores_[ordinal] += relevance;
+    };
+    const auto prefetch = [this, &context, &document_predicate](uint32_t ordinal) {
+        PrefetchAccepted(document_predicate, ordinal);
+        PrefetchRead(&context.states_[ordinal]);
+        PrefetchRead(&context.scores_[ordinal]);
+    };
+    // the deadline is also checked within a term, so one long posting list cannot overrun it
+    const bool has_deadline = budget.deadline != std::chrono::steady_clock::time_point::max();
+    uint64_t postings_to_check = DEADLINE_CHECK_POSTINGS;
+    const auto before_deadline = [&budget, has_deadline, &postings_to_check]() {
+        if (!has_deadline || --postings_to_check > 0) {
+            return true;
+        }
+        postings_to_check = DEADLINE_CHECK_POSTINGS;
+        return std::chrono::steady_clock::now() < budget.deadline;
+    };
+    QueryCompletion completion = QueryCompletion::COMPLETE;
+    uint64_t postings = 0;
+    size_t processed = 0;
+    for (; processed < terms.size(); ++processed) {
+        const QueryContext::Term& term = terms[processed];
+        if (postings + term.cost > budget.max_postings) {
+            completion = QueryCompletion::POSTINGS_EXHAUSTED;
+            break;
+        }
+        if (has_deadline && std::chrono::steady_clock::now() >= budget.deadline) {
+            completion = QueryCompletion::DEADLINE_EXCEEDED;
+            break;
+        }
+        postings += term.cost;
+        bool in_time = true;
+        if (term.kind == QueryContext::PLUS_PREFIX) {
+            ForEachPrefixDocument(query, term.index, [&add_relevance, &before_deadline, &in_time](uint32_t ordinal, Score relevance) {
+                add_relevance(ordinal, relevance);
+                return in_time = before_deadline();
+                });
+        }
+        else {
+            const bool is_fuzzy = term.kind == QueryContext::FUZZY_WORD;
+            const std::string_view word = is_fuzzy ? query.fuzzy_words[term.index].data : query.plus_words[term.index];
+            const Score inverse_document_freq = static_cast<Score>(ComputeWordInverseDocumentFreq(word)
+                * (is_fuzzy ? query.fuzzy_words[term.index].weight : 1.0));
+            ForEachPosting(GetWordPostings(word), prefetch,
+                [&add_relevance, &before_deadline, &in_time, inverse_document_freq](uint32_t ordinal, TermFreq term_freq) {
+                    add_relevance(ordinal, ComputeTermRelevance(term_freq, inverse_document_freq));
+                    return in_time = before_deadline();
+                });
+        }
+        // a term cut short counts as skipped
+        if (!in_time) {
+            completion = QueryCompletion::DEADLINE_EXCEEDED;
+            break;
+        }
+    }
+    if (completion != QueryCompletion::COMPLETE) {
+        (completion == QueryCompletion::DEADLINE_EXCEEDED ? budget_counters_.deadline_exceeded : budget_counters_.postings_exhausted).Add();
+        budget_counters_.skipped_terms.Add(terms.size() - processed);
+    }
+    CollectTopDocuments(context, result);
+    return completion;
+}
+
 template <typename Policy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate) const {
     std::vector<Document> response;
-    std::string raw_query_s;
-    raw_query_s = raw_query;
-    Query query = ParseQuery(raw_query_s);
+    Query query;
+    {
+        PROFILE_STAGE(PARSE_QUERY);
+        ParseQuery(raw_query, query);
+        ExpandFuzzyWords(query);
+    }
     response = FindAllDocuments(exPol, query, document_predicate);
-    std::sort(exPol, response.begin(), response.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (response.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        response.resize(MAX_RESULT_DOCUMENT_COUNT);
+    {
+        PROFILE_STAGE(SORT_RESULTS);
+        if constexpr (std::is_same_v<Policy, AutoExecutionPolicy>) {
+            std::sort(response.begin(), response.end(), IsMoreRelevant);
+        }
+        else {
+            std::sort(exPol, response.begin(), response.end(), IsMoreRelevant);
+        }
+        if (response.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            response.resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
     }
     return response;
 }
 template <typename Policy>
 std::vector<Document> SearchServer::FindTopDocuments(const Policy& exPol, const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(exPol, raw_query, [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; });
+    return FindTopDocuments(exPol, raw_query, DocumentStatusFilter{ status });
 }
 template <typename Policy>
 std::vector<Document> SearchServer::FindTopDocuments(const Policy& exPol, const std::string_view raw_query) const {
@@ -150,38 +689,144 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_
     return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
 }
 
+template <typename Policy, typename DocumentPredicate>
+DocumentPage SearchServer::FindTopDocumentsPage(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t page_size, const std::string_view cursor) const {
+    if (page_size == 0) {
+        throw std::invalid_argument("Error: page size must be positive."s);
+    }
+    const std::optional<Document> after = DecodePageCursor(cursor);
+    Query query;
+    ParseQuery(raw_query, query);
+    ExpandFuzzyWords(query);
+    DocumentPage page;
+    page.documents = FindAllDocuments(exPol, query, document_predicate);
+    if (SelectTopDocuments(page.documents, after, page_size)) {
+        page.next_cursor = EncodePageCursor(page.documents.back());
+    }
+    return page;
+}
+template <typename Policy>
+DocumentPage SearchServer::FindTopDocumentsPage(const Policy& exPol, const std::string_view raw_query, DocumentStatus status,
+    size_t page_size, const std::string_view cursor) const {
+    return FindTopDocumentsPage(exPol, raw_query, DocumentStatusFilter{ status }, page_size, cursor);
+}
+
+
+template <typename DocumentPredicate>
+bool SearchServer::IsAccepted(const DocumentPredicate& document_predicate, uint32_t ordinal) const {
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentStatusFilter>) {
+        return document_columns_.HasStatus(ordinal, document_predicate.status);
+    }
+    else {
+        return document_predicate(document_columns_.GetId(ordinal), document_columns_.GetStatus(ordinal), document_columns_.GetRating(ordinal));
+    }
+}
+
+template <typename DocumentPredicate>
+void SearchServer::PrefetchAccepted(const DocumentPredicate& document_predicate, uint32_t ordinal) const {
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentStatusFilter>) {
+        document_columns_.PrefetchStatus(ordinal, document_predicate.status);
+    }
+    else {
+        document_columns_.PrefetchRow(ordinal);
+    }
+}
+
+template <typename Prefetch, typename Callback>
+void SearchServer::ForEachPosting(const PostingList& postings, Prefetch prefetch, Callback callback) const {
+    if (prefetch_distance_ == 0) {
+        for (const auto [ordinal, term_freq] : postings) {
+            if (!InvokeWalkCallback(callback, ordinal, term_freq)) {
+                return;
+            }
+        }
+        return;
+    }
+    // the misses of the tree nodes ahead overlap the scoring of the current posting
+    auto ahead = postings.begin();
+    for (size_t i = 0; i < prefetch_distance_ && ahead != postings.end(); ++i) {
+        ++ahead;
+    }
+    for (const auto [ordinal, term_freq] : postings) {
+        if (ahead != postings.end()) {
+            prefetch(ahead->first);
+            ++ahead;
+        }
+        if (!InvokeWalkCallback(callback, ordinal, term_freq)) {
+            return;
+        }
+    }
+}
+
+template <typename Callback, typename... Args>
+bool SearchServer::InvokeWalkCallback(Callback& callback, Args... args) {
+    if constexpr (std::is_same_v<std::invoke_result_t<Callback&, Args...>, bool>) {
+        return callback(args...);
+    }
+    else {
+        callback(args...);
+        return true;
+    }
+}
 
 // Find all docs
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
+    PROFILE_STAGE(SCORE_SEQ);
+    std::map<uint32_t, Score> document_to_relevance;
+    const auto prefetch = [this, &document_predicate](uint32_t ordinal) {
+        PrefetchAccepted(document_predicate, ordinal);
+    };
     for (const auto& word : query.plus_words) {
         if (word_to_document_freqs_.count(word) == 0) {
             continue;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        const Score inverse_document_freq = static_cast<Score>(ComputeWordInverseDocumentFreq(word));
+        ForEachPosting(GetWordPostings(word), prefetch, [&](uint32_t ordinal, TermFreq term_freq) {
+            if (IsAccepted(document_predicate, ordinal)) {
+                document_to_relevance[ordinal] += ComputeTermRelevance(term_freq, inverse_document_freq);
             }
-        }
+            });
+    }
+
+    for (const auto& [word, weight] : query.fuzzy_words) {
+        const Score inverse_document_freq = static_cast<Score>(ComputeWordInverseDocumentFreq(word) * weight);
+        ForEachPosting(GetWordPostings(word), prefetch, [&](uint32_t ordinal, TermFreq term_freq) {
+            if (IsAccepted(document_predicate, ordinal)) {
+                document_to_relevance[ordinal] += ComputeTermRelevance(term_freq, inverse_document_freq);
+            }
+            });
+    }
+    for (size_t i = 0; i < query.plus_prefixes.size(); ++i) {
+        ForEachPrefixDocument(query, i, [this, &document_to_relevance, &document_predicate](uint32_t ordinal, Score relevance) {
+            if (IsAccepted(document_predicate, ordinal)) {
+                document_to_relevance[ordinal] += relevance;
+            }
+            });
     }
 
     for (const auto& word : query.minus_words) {
         if (word_to_document_freqs_.count(word) == 0) {
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+        for (const auto [ordinal, _] : GetWordPostings(word)) {
+            document_to_relevance.erase(ordinal);
         }
     }
+    for (const auto& prefix : query.minus_prefixes) {
+        ForEachPrefixWord(prefix, [this, &document_to_relevance](const std::string_view word) {
+            for (const auto [ordinal, _] : GetWordPostings(word)) {
+                document_to_relevance.erase(ordinal);
+            }
+            });
+    }
     std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
+    for (const auto [ordinal, relevance] : document_to_relevance) {
         matched_documents.push_back(Document{
-            document_id,
+            document_columns_.GetId(ordinal),
             relevance,
-            documents_.at(document_id).rating
+            document_columns_.GetRating(ordinal)
             });
     }
     return matched_documents;
@@ -189,34 +834,70 @@ std::vector<Document> SearchServer::FindAllDocuments(const std::execution::seque
 //par
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(5000);
+    PROFILE_STAGE(SCORE_PAR);
+    // matches are at most the postings of the plus words, and at most all documents
+    size_t expected_matches = 0;
+    for (const auto& word : query.plus_words) {
+        expected_matches += GetWordDocumentCount(word);
+    }
+    ConcurrentMap<uint32_t, Score> document_to_relevance(std::min(expected_matches, documents_.size()));
     std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [this, &document_to_relevance, &document_predicate](const auto& word) {
+        PROFILE_STAGE(SCORE_PAR_TASK);
         if (word_to_document_freqs_.count(word)) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+            const Score inverse_document_freq = static_cast<Score>(ComputeWordInverseDocumentFreq(word));
+            ForEachPosting(GetWordPostings(word), [this, &document_predicate](uint32_t ordinal) { PrefetchAccepted(document_predicate, ordinal); },
+                [&](uint32_t ordinal, TermFreq term_freq) {
+                    if (IsAccepted(document_predicate, ordinal)) {
+                        document_to_relevance[ordinal].ref_to_value += ComputeTermRelevance(term_freq, inverse_document_freq);
+                    }
+                });
+        }
+        });
+    std::for_each(std::execution::par, query.fuzzy_words.begin(), query.fuzzy_words.end(), [this, &document_to_relevance, &document_predicate](const auto& fuzzy_word) {
+        PROFILE_STAGE(SCORE_PAR_TASK);
+        const Score inverse_document_freq = static_cast<Score>(ComputeWordInverseDocumentFreq(fuzzy_word.data) * fuzzy_word.weight);
+        ForEachPosting(GetWordPostings(fuzzy_word.data), [this, &document_predicate](uint32_t ordinal) { PrefetchAccepted(document_predicate, ordinal); },
+            [&](uint32_t ordinal, TermFreq term_freq) {
+                if (IsAccepted(document_predicate, ordinal)) {
+                    document_to_relevance[ordinal].ref_to_value += ComputeTermRelevance(term_freq, inverse_document_freq);
                 }
+            });
+        });
+    std::vector<size_t> prefix_indexes(query.plus_prefixes.size());
+    std::iota(prefix_indexes.begin(), prefix_indexes.end(), 0);
+    std::for_each(std::execution::par, prefix_indexes.begin(), prefix_indexes.end(), [this, &query, &document_to_relevance, &document_predicate](size_t i) {
+        PROFILE_STAGE(SCORE_PAR_TASK);
+        ForEachPrefixDocument(query, i, [this, &document_to_relevance, &document_predicate](uint32_t ordinal, Score relevance) {
+            if (IsAccepted(document_predicate, ordinal)) {
+                document_to_relevance[ordinal].ref_to_value += relevance;
             }
-        }
+            });
         });
     std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [this, &document_to_relevance](const auto& word) {
+        PROFILE_STAGE(SCORE_PAR_TASK);
         if (word_to_document_freqs_.count(word)) {
-            for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+            for (const auto& [ordinal, _] : GetWordPostings(word)) {
+                document_to_relevance.erase(ordinal);
             }
         }
         });
+    std::for_each(std::execution::par, query.minus_prefixes.begin(), query.minus_prefixes.end(), [this, &document_to_relevance](const auto& prefix) {
+        PROFILE_STAGE(SCORE_PAR_TASK);
+        ForEachPrefixWord(prefix, [this, &document_to_relevance](const std::string_view word) {
+            for (const auto& [ordinal, _] : GetWordPostings(word)) {
+                document_to_relevance.erase(ordinal);
+            }
+            });
+        });
 
-    std::vector<Document> matched_documents;
-    const auto res = document_to_relevance.BuildOrdinaryMap();
-    for_each(std::execution::seq, res.begin(), res.end(), [&matched_documents, this](const auto p) {
-        matched_documents.push_back(Document{
-        p.first,
+    const auto res = document_to_relevance.DrainToVector();
+    std::vector<Document> matched_documents(res.size());
+    std::transform(std::execution::par, res.begin(), res.end(), matched_documents.begin(), [this](const auto& p) {
+        return Document{
+        document_columns_.GetId(p.first),
         p.second,
-        documents_.at(p.first).rating
-            });
+        document_columns_.GetRating(p.first)
+        };
         });
     return matched_documents;
 }
@@ -225,6 +906,290 @@ std::vector<Document> SearchServer::FindAllDocuments(const Query& query, Documen
     return FindAllDocuments(std::execution::seq, query, document_predicate);
 }
 
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const AutoExecutionPolicy&, const Query& query, DocumentPredicate document_predicate) const {
+    std::vector<DaatTerm> plus_terms;
+    std::vector<const PostingList*> minus_terms;
+    CollectDaatTerms(query, plus_terms, minus_terms);
+    const QueryPlan plan = PlanQuery(plus_terms);
+    if (plan.strategy == EvaluationStrategy::TERM_AT_A_TIME) {
+        if (plan.parallel) {
+            planner_counters_.taat_par.Add();
+            return FindAllDocuments(std::execution::par, query, document_predicate);
+        }
+        planner_counters_.taat_seq.Add();
+        return FindAllDocuments(std::execution::seq, query, document_predicate);
+    }
+    PROFILE_STAGE(SCORE_DAAT);
+    const uint32_t ordinal_bound = static_cast<uint32_t>(document_columns_.GetOrdinalBound());
+    std::vector<Document> matched_documents;
+    if (!plan.parallel) {
+        planner_counters_.daat_seq.Add();
+        FindDocumentsInRange(plus_terms, minus_terms, document_predicate, 0, ordinal_bound, matched_documents);
+        return matched_documents;
+    }
+    planner_counters_.daat_par.Add();
+    // equal ordinal ranges, ordinals are assigned in insertion order so postings spread evenly
+    std::vector<std::vector<Document>> range_documents(plan.ranges);
+    std::vector<uint32_t> range_indexes(plan.ranges);
+    std::iota(range_indexes.begin(), range_indexes.end(), 0);
+    const uint64_t range_width = (uint64_t{ ordinal_bound } + plan.ranges - 1) / plan.ranges;
+    std::for_each(std::execution::par, range_indexes.begin(), range_indexes.end(),
+        [&](uint32_t range) {
+            PROFILE_STAGE(SCORE_DAAT_RANGE);
+            const uint64_t begin = std::min<uint64_t>(range * range_width, ordinal_bound);
+            const uint64_t end = std::min<uint64_t>(begin + range_width, ordinal_bound);
+            FindDocumentsInRange(plus_terms, minus_terms, document_predicate, static_cast<uint32_t>(begin), static_cast<uint32_t>(end),
+                range_documents[range]);
+        });
+    size_t match_count = 0;
+    for (const auto& documents : range_documents) {
+        match_count += documents.size();
+    }
+    matched_documents.reserve(match_count);
+    for (const auto& documents : range_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    return matched_documents;
+}
+
+template <typename Callback>
+void SearchServer::ForEachDaatMatch(const std::vector<DaatTerm>& plus_terms, const std::vector<const PostingList*>& minus_terms,
+    uint32_t begin, uint32_t end, Callback callback) const {
+    struct Cursor {
+        PostingList::const_iterator it;
+        PostingList::const_iterator end;
+    };
+    const auto make_cursor = [begin, end](const PostingList& postings) {
+        return Cursor{ postings.lower_bound(begin), postings.lower_bound(end) };
+    };
+    std::vector<Cursor> plus_cursors;
+    plus_cursors.reserve(plus_terms.size());
+    for (const DaatTerm& term : plus_terms) {
+        plus_cursors.push_back(make_cursor(*term.postings));
+    }
+    std::vector<Cursor> minus_cursors;
+    minus_cursors.reserve(minus_terms.size());
+    for (const PostingList* postings : minus_terms) {
+        minus_cursors.push_back(make_cursor(*postings));
+    }
+    while (true) {
+        uint32_t ordinal = end;
+        for (const Cursor& cursor : plus_cursors) {
+            if (cursor.it != cursor.end) {
+                ordinal = std::min(ordinal, cursor.it->first);
+            }
+        }
+        if (ordinal == end) {
+            break;
+        }
+        Score relevance = 0;
+        for (size_t i = 0; i < plus_cursors.size();) {
+            const uint32_t group = plus_terms[i].group;
+            Score group_relevance = 0;
+            bool matched = false;
+            for (; i < plus_cursors.size() && plus_terms[i].group == group; ++i) {
+                Cursor& cursor = plus_cursors[i];
+                if (cursor.it != cursor.end && cursor.it->first == ordinal) {
+                    group_relevance += ComputeTermRelevance(cursor.it->second, plus_terms[i].weight);
+                    matched = true;
+                    ++cursor.it;
+                }
+            }
+            if (matched) {
+                relevance += group_relevance;
+            }
+        }
+        bool excluded = false;
+        for (Cursor& cursor : minus_cursors) {
+            while (cursor.it != cursor.end && cursor.it->first < ordinal) {
+                ++cursor.it;
+            }
+            excluded = excluded || (cursor.it != cursor.end && cursor.it->first == ordinal);
+        }
+        if (!excluded) {
+            callback(ordinal, relevance);
+        }
+    }
+}
+
+template <typename DocumentPredicate>
+void SearchServer::FindDocumentsInRange(const std::vector<DaatTerm>& plus_terms, const std::vector<const PostingList*>& minus_terms,
+    DocumentPredicate document_predicate, uint32_t begin, uint32_t end, std::vector<Document>& result) const {
+    ForEachDaatMatch(plus_terms, minus_terms, begin, end, [this, &document_predicate, &result](uint32_t ordinal, Score relevance) {
+        if (IsAccepted(document_predicate, ordinal)) {
+            result.push_back(Document{
+                document_columns_.GetId(ordinal),
+                relevance,
+                document_columns_.GetRating(ordinal)
+                });
+        }
+        });
+}
+
+template <typename Policy, typename DocumentPredicate>
+FacetedSearchResult SearchServer::AggregateDocuments(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate,
+    const FacetOptions& options, bool keep_top) const {
+    ValidateFacetOptions(options);
+    if (keep_top && options.sample_fraction < 1.0) {
+        throw std::invalid_argument("Error: facets of top documents cannot be estimated."s);
+    }
+    Query query;
+    {
+        PROFILE_STAGE(PARSE_QUERY);
+        ParseQuery(raw_query, query);
+        ExpandFuzzyWords(query);
+    }
+    PROFILE_STAGE(SCORE_DAAT);
+    std::vector<DaatTerm> plus_terms;
+    std::vector<const PostingList*> minus_terms;
+    CollectDaatTerms(query, plus_terms, minus_terms);
+
+    // [begin, end) ordinal intervals: sampled stripes, parallel ranges or everything
+    const uint64_t ordinal_bound = document_columns_.GetOrdinalBound();
+    std::vector<std::pair<uint32_t, uint32_t>> intervals;
+    uint64_t interval_width = 0;
+    size_t stripes = 1;
+    size_t interval_count = 1;
+    if (options.sample_fraction < 1.0) {
+        stripes = static_cast<size_t>(std::clamp<uint64_t>(ordinal_bound, 1, FACET_SAMPLE_STRIPES));
+        interval_count = std::max<size_t>(1, static_cast<size_t>(std::ceil(options.sample_fraction * stripes)));
+    }
+    else if constexpr (std::is_same_v<Policy, std::execution::parallel_policy>) {
+        uint64_t postings = 0;
+        for (const DaatTerm& term : plus_terms) {
+            postings += term.postings->size();
+        }
+        stripes = static_cast<size_t>(std::clamp<uint64_t>(postings / planner_options_.range_postings, 1, GetPlannerThreadCount() * 4));
+        interval_count = stripes;
+    }
+    for (size_t i = 0; i < interval_count; ++i) {
+        const size_t stripe = i * stripes / interval_count;
+        const uint64_t begin = stripe * ordinal_bound / stripes;
+        const uint64_t end = (stripe + 1) * ordinal_bound / stripes;
+        intervals.push_back({ static_cast<uint32_t>(begin), static_cast<uint32_t>(end) });
+        interval_width += end - begin;
+    }
+
+    struct Partial {
+        FacetCounts facets;
+        std::vector<Document> top;
+    };
+    std::vector<Partial> partials(intervals.size(), Partial{ MakeFacetCounts(options), {} });
+    std::vector<size_t> interval_indexes(intervals.size());
+    std::iota(interval_indexes.begin(), interval_indexes.end(), 0);
+    std::for_each(exPol, interval_indexes.begin(), interval_indexes.end(), [&](size_t i) {
+        PROFILE_STAGE(SCORE_DAAT_RANGE);
+        Partial& partial = partials[i];
+        ForEachDaatMatch(plus_terms, minus_terms, intervals[i].first, intervals[i].second,
+            [this, &partial, &options, &document_predicate, keep_top](uint32_t ordinal, Score relevance) {
+                const int rating = document_columns_.GetRating(ordinal);
+                ++partial.facets.total_hits;
+                ++partial.facets.by_status[static_cast<size_t>(document_columns_.GetStatus(ordinal))];
+                ++partial.facets.by_rating[GetRatingBucket(options.rating_bounds, rating)];
+                if (keep_top && IsAccepted(document_predicate, ordinal)) {
+                    PushTopDocument(Document(document_columns_.GetId(ordinal), relevance, rating), partial.top);
+                }
+            });
+        });
+
+    FacetedSearchResult result;
+    result.facets = MakeFacetCounts(options);
+    for (const Partial& partial : partials) {
+        AddFacetCounts(partial.facets, result.facets);
+        result.documents.insert(result.documents.end(), partial.top.begin(), partial.top.end());
+    }
+    if (interval_count < stripes) {
+        ScaleFacetCounts(interval_width > 0 ? static_cast<double>(ordinal_bound) / interval_width : 0.0, result.facets);
+    }
+    PROFILE_STAGE(SORT_RESULTS);
+    std::sort(result.documents.begin(), result.documents.end(), IsMoreRelevant);
+    if (result.documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        result.documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return result;
+}
+
+template <typename Policy>
+FacetCounts SearchServer::CountDocuments(const Policy& exPol, const std::string_view raw_query, const FacetOptions& options) const {
+    return AggregateDocuments(exPol, raw_query, DocumentStatusFilter{ DocumentStatus::ACTUAL }, options, false).facets;
+}
+
+template <typename Policy, typename DocumentPredicate>
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(const Policy& exPol, const std::string_view raw_query,
+    DocumentPredicate document_predicate, const FacetOptions& options) const {
+    return AggregateDocuments(exPol, raw_query, document_predicate, options, true);
+}
+template <typename Policy>
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(const Policy& exPol, const std::string_view raw_query, DocumentStatus status,
+    const FacetOptions& options) const {
+    return FindTopDocumentsWithFacets(exPol, raw_query, DocumentStatusFilter{ status }, options);
+}
+template <typename Policy>
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(const Policy& exPol, const std::string_view raw_query,
+    const FacetOptions& options) const {
+    return FindTopDocumentsWithFacets(exPol, raw_query, DocumentStatus::ACTUAL, options);
+}
+
+template <typename Callback>
+void SearchServer::ForEachPrefixWord(const std::string_view prefix, Callback callback) const {
+    int expanded = 0;
+    // a part of a corpus expands over the corpus words, so every part scores the same terms
+    if (corpus_statistics_ && corpus_statistics_->ForEachWordWithPrefix(prefix, [this, &expanded, &callback](const std::string_view term) {
+        const auto it = word_to_document_freqs_.find(term);
+        if (it != word_to_document_freqs_.end() && !it->second.empty()) {
+            callback(it->first);
+        }
+        return ++expanded < MAX_PREFIX_EXPANSION;
+        })) {
+        return;
+    }
+    // removed terms are erased from the dictionary; the ones not yet compacted away count as well
+    term_dictionary_.ForEachWithPrefix(prefix, MAX_PREFIX_EXPANSION, [this, &callback](const std::string_view term) {
+        callback(word_to_document_freqs_.find(term)->first);
+        return true;
+        });
+}
+
+template <typename Callback>
+void SearchServer::ForEachPrefixDocument(const Query& query, size_t prefix_index, Callback callback) const {
+    struct Cursor {
+        PostingList::const_iterator it;
+        PostingList::const_iterator end;
+        Score inverse_document_freq;
+        size_t word_index;
+    };
+    std::vector<Cursor> heap;
+    for (size_t i = query.prefix_word_bounds[prefix_index]; i < query.prefix_word_bounds[prefix_index + 1]; ++i) {
+        const std::string_view word = query.prefix_words[i];
+        const auto& postings = GetWordPostings(word);
+        heap.push_back({ postings.begin(), postings.end(), static_cast<Score>(ComputeWordInverseDocumentFreq(word)), heap.size() });
+    }
+    // equal ordinals pop in word order, so the sum does not depend on the heap layout
+    const auto greater_id = [](const Cursor& lhs, const Cursor& rhs) {
+        return lhs.it->first > rhs.it->first || (lhs.it->first == rhs.it->first && lhs.word_index > rhs.word_index);
+    };
+    std::make_heap(heap.begin(), heap.end(), greater_id);
+    while (!heap.empty()) {
+        const uint32_t ordinal = heap.front().it->first;
+        Score relevance = 0;
+        while (!heap.empty() && heap.front().it->first == ordinal) {
+            std::pop_heap(heap.begin(), heap.end(), greater_id);
+            Cursor& cursor = heap.back();
+            relevance += ComputeTermRelevance(cursor.it->second, cursor.inverse_document_freq);
+            if (++cursor.it == cursor.end) {
+                heap.pop_back();
+            }
+            else {
+                std::push_heap(heap.begin(), heap.end(), greater_id);
+            }
+        }
+        if (!InvokeWalkCallback(callback, ordinal, relevance)) {
+            return;
+        }
+    }
+}
+
 void RemoveDuplicates(SearchServer& search_server);
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view document, DocumentStatus status,
@@ -0,0 +1,261 @@
+#include "shard_broker.h"
+#include "search_server.h"
+#include "sharded_search_server.h"
+#include "string_processing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+ShardBroker::ShardBroker(const std::vector<std::string>& endpoints)
+    : endpoints_(endpoints) {
+    if (endpoints.empty()) {
+        throw std::invalid_argument("Error: shard count must be positive."s);
+    }
+    for (const std::string& endpoint : endpoints) {
+        shards_.push_back(ConnectToEndpoint(endpoint));
+    }
+    response_buffers_.resize(shards_.size());
+}
+
+void ShardBroker::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    if (document_id < 0 || document_ids_.count(document_id) > 0) {
+        throw std::invalid_argument("Error: doc id is negative or duplicate already existing id."s);
+    }
+    MessageWriter request;
+    request.WriteU8(static_cast<uint8_t>(ShardRequestType::ADD_DOCUMENT));
+    request.WriteI32(document_id);
+    request.WriteU8(static_cast<uint8_t>(status));
+    request.WriteU32(static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        request.WriteI32(rating);
+    }
+    request.WriteString(document);
+    MessageReader reader = Call(GetDocumentShard(document_id, shards_.size()), request.GetData());
+    document_ids_.insert(document_id);
+    AddWordCounts(reader, 1);
+}
+
+void ShardBroker::RemoveDocument(int document_id) {
+    if (document_ids_.count(document_id) == 0) {
+        throw std::invalid_argument("Error: no document with such id (RemoveDocument)."s);
+    }
+    MessageWriter request;
+    request.WriteU8(static_cast<uint8_t>(ShardRequestType::REMOVE_DOCUMENT));
+    request.WriteI32(document_id);
+    MessageReader reader = Call(GetDocumentShard(document_id, shards_.size()), request.GetData());
+    document_ids_.erase(document_id);
+    AddWordCounts(reader, -1);
+}
+
+std::vector<Document> ShardBroker::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) {
+    using Clock = std::chrono::steady_clock;
+    const auto start_time = Clock::now();
+
+    MessageWriter request;
+    request.WriteU8(static_cast<uint8_t>(ShardRequestType::FIND_TOP_DOCUMENTS));
+    request.WriteString(raw_query);
+    request.WriteU8(static_cast<uint8_t>(status));
+    WriteQueryStatistics(raw_query, request);
+    auto serialization = Clock::now() - start_time;
+
+    // scatter to all shards first, then gather: shards work in parallel
+    try {
+        for (SocketConnection& shard : shards_) {
+            shard.SendMessage(request.GetData());
+        }
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            if (!shards_[i].ReceiveMessage(response_buffers_[i])) {
+                throw std::runtime_error("Error: shard closed the connection."s);
+            }
+        }
+    }
+    catch (...) {
+        // the other shards' replies are still on their sockets
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            Reconnect(i);
+        }
+        throw;
+    }
+
+    const auto decode_start = Clock::now();
+    std::vector<Document> response;
+    for (const std::string& buffer : response_buffers_) {
+        MessageReader reader(buffer);
+        CheckStatus(reader);
+        const uint32_t count = reader.ReadU32();
+        for (uint32_t i = 0; i < count; ++i) {
+            const int id = reader.ReadI32();
+            const double relevance = reader.ReadDouble();
+            const int rating = reader.ReadI32();
+            response.emplace_back(id, relevance, rating);
+        }
+    }
+    const auto decode_end = Clock::now();
+    serialization += decode_end - decode_start;
+
+    std::sort(response.begin(), response.end(), IsMoreRelevant);
+    if (response.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        response.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    serialization_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(serialization).count();
+    query_ns_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time).count());
+    return response;
+}
+
+ShardBroker::MatchingDocs ShardBroker::MatchDocument(const std::string_view raw_query, int document_id) {
+    if (document_ids_.count(document_id) == 0) {
+        throw std::out_of_range("out_of_range in MatchDocument ");
+    }
+    MessageWriter request;
+    request.WriteU8(static_cast<uint8_t>(ShardRequestType::MATCH_DOCUMENT));
+    request.WriteI32(document_id);
+    request.WriteString(raw_query);
+    MessageReader reader = Call(GetDocumentShard(document_id, shards_.size()), request.GetData());
+    const auto status = reader.ReadStatus();
+    std::vector<std::string> words(reader.ReadU32());
+    for (std::string& word : words) {
+        word = reader.ReadString();
+    }
+    return { words, status };
+}
+
+int ShardBroker::GetDocumentCount() const {
+    return static_cast<int>(document_ids_.size());
+}
+
+int ShardBroker::GetWordDocumentCount(const std::string_view word) const {
+    const auto it = word_document_counts_.find(word);
+    return it == word_document_counts_.end() ? 0 : it->second;
+}
+
+ScatterGatherReport ShardBroker::GetScatterGatherReport() const {
+    ScatterGatherReport report;
+    report.query_count = query_ns_.size();
+    for (const SocketConnection& shard : shards_) {
+        report.bytes_sent += shard.GetBytesSent();
+        report.bytes_received += shard.GetBytesReceived();
+    }
+    if (query_ns_.empty()) {
+        return report;
+    }
+    std::vector<int64_t> sorted = query_ns_;
+    std::sort(sorted.begin(), sorted.end());
+    const auto percentile = [&sorted](double p) {
+        const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+        return sorted[index] / 1000.0;
+    };
+    report.p50_us = percentile(0.5);
+    report.p99_us = percentile(0.99);
+    report.p999_us = percentile(0.999);
+    report.max_us = sorted.back() / 1000.0;
+    int64_t total_ns = 0;
+    for (const int64_t ns : sorted) {
+        total_ns += ns;
+    }
+    report.serialization_share = total_ns > 0 ? static_cast<double>(serialization_ns_) / total_ns : 0.0;
+    return report;
+}
+
+void ShardBroker::ResetScatterGatherStats() {
+    query_ns_.clear();
+    serialization_ns_ = 0;
+}
+
+void ShardBroker::Shutdown() {
+    MessageWriter request;
+    request.WriteU8(static_cast<uint8_t>(ShardRequestType::SHUTDOWN));
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        Call(i, request.GetData());
+    }
+}
+
+MessageReader ShardBroker::Call(size_t shard, const std::string& request) {
+    try {
+        shards_[shard].SendMessage(request);
+        if (!shards_[shard].ReceiveMessage(response_buffers_[shard])) {
+            throw std::runtime_error("Error: shard closed the connection."s);
+        }
+    }
+    catch (...) {
+        Reconnect(shard);
+        throw;
+    }
+    MessageReader reader(response_buffers_[shard]);
+    CheckStatus(reader);
+    return reader;
+}
+
+void ShardBroker::Reconnect(size_t shard) {
+    try {
+        shards_[shard] = ConnectToEndpoint(endpoints_[shard]);
+    }
+    catch (const std::runtime_error&) {
+        shards_[shard] = SocketConnection(-1);
+    }
+}
+
+void ShardBroker::CheckStatus(MessageReader& reader) {
+    const auto status = static_cast<ShardResponseStatus>(reader.ReadU8());
+    if (status == ShardResponseStatus::OK) {
+        return;
+    }
+    const std::string message(reader.ReadString());
+    switch (status) {
+    case ShardResponseStatus::INVALID_ARGUMENT:
+        throw std::invalid_argument(message);
+    case ShardResponseStatus::OUT_OF_RANGE:
+        throw std::out_of_range(message);
+    default:
+        throw std::runtime_error(message);
+    }
+}
+
+void ShardBroker::AddWordCounts(MessageReader& reader, int delta) {
+    const uint32_t word_count = reader.ReadU32();
+    for (uint32_t i = 0; i < word_count; ++i) {
+        const std::string_view word = reader.ReadString();
+        auto it = word_document_counts_.find(word);
+        if (it == word_document_counts_.end()) {
+            it = word_document_counts_.emplace(std::string(word), 0).first;
+        }
+        it->second += delta;
+        if (it->second <= 0) {
+            word_document_counts_.erase(it);
+        }
+    }
+}
+
+// Corpus document count and counts of the query words. Prefix words send their first
+// MAX_PREFIX_EXPANSION corpus words, the shards expand them to exactly these.
+void ShardBroker::WriteQueryStatistics(const std::string_view raw_query, MessageWriter& request) const {
+    std::map<std::string_view, int> statistics;
+    for (std::string_view word : SplitIntoWords(raw_query)) {
+        if (!word.empty() && word.front() == '-') {
+            word.remove_prefix(1);
+        }
+        if (word.size() > 1 && word.back() == '*') {
+            word.remove_suffix(1);
+            int expanded = 0;
+            for (auto it = word_document_counts_.lower_bound(word);
+                it != word_document_counts_.end() && expanded < MAX_PREFIX_EXPANSION && it->first.compare(0, word.size(), word) == 0;
+                ++it, ++expanded) {
+                statistics.emplace(it->first, it->second);
+            }
+        }
+        else {
+            const auto it = word_document_counts_.find(word);
+            if (it != word_document_counts_.end()) {
+                statistics.emplace(it->first, it->second);
+            }
+        }
+    }
+    request.WriteI32(GetDocumentCount());
+    request.WriteU32(static_cast<uint32_t>(statistics.size()));
+    for (const auto& [word, count] : statistics) {
+        request.WriteString(word);
+        request.WriteI32(count);
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "document.h"
+#include "shard_protocol.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+struct ScatterGatherReport {
+    size_t query_count = 0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double p999_us = 0.0;
+    double max_us = 0.0;
+    double serialization_share = 0.0;    // part of query time spent encoding and decoding messages
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_received = 0;
+};
+
+// Front of ShardNode processes: routes updates to the owning shard, sends queries to all shards
+// with corpus-wide word counts and merges their top documents. A request that fails on the
+// connection reconnects the shards it was sent to, so no reply is left for the next request.
+class ShardBroker {
+public:
+    // endpoints as in ConnectToEndpoint, one per shard
+    explicit ShardBroker(const std::vector<std::string>& endpoints);
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+    using MatchingDocs = std::tuple<std::vector<std::string>, DocumentStatus>;
+    MatchingDocs MatchDocument(const std::string_view raw_query, int document_id);
+
+    int GetDocumentCount() const;
+    int GetWordDocumentCount(const std::string_view word) const;
+
+    // Latency of FindTopDocuments calls since the last reset
+    ScatterGatherReport GetScatterGatherReport() const;
+    void ResetScatterGatherStats();
+
+    // Stops the shard processes
+    void Shutdown();
+
+private:
+    std::vector<std::string> endpoints_;
+    std::vector<SocketConnection> shards_;
+    std::map<std::string, int, std::less<>> word_document_counts_;
+    std::set<int> document_ids_;
+
+    std::vector<int64_t> query_ns_;
+    int64_t serialization_ns_ = 0;
+    std::string request_buffer_;
+    std::vector<std::string> response_buffers_;
+
+    // Sends request to the shard and returns a reader over the response fields after an OK status
+    MessageReader Call(size_t shard, const std::string& request);
+    // Replaces the connection, whose state is unknown after a failed exchange. If the shard cannot
+    // be reached, the connection is left closed and the next request to it fails.
+    void Reconnect(size_t shard);
+    static void CheckStatus(MessageReader& reader);
+    void AddWordCounts(MessageReader& reader, int delta);
+    void WriteQueryStatistics(const std::string_view raw_query, MessageWriter& request) const;
+};
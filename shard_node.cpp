@@ -0,0 +1,176 @@
+#include "shard_node.h"
+
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+ShardNode::ShardNode(const std::string_view stop_words)
+    : search_server_(stop_words) {
+}
+
+void ShardNode::Serve(SocketListener& listener) {
+    std::string request;
+    MessageWriter response;
+    while (true) {
+        SocketConnection connection = listener.Accept();
+        // a broken or oversized frame closes only its connection
+        try {
+            while (connection.ReceiveMessage(request)) {
+                response.Clear();
+                const bool keep_serving = HandleRequest(request, response);
+                connection.SendMessage(response.GetData());
+                if (!keep_serving) {
+                    return;
+                }
+            }
+        }
+        catch (const std::runtime_error&) {
+        }
+    }
+}
+
+bool ShardNode::HandleRequest(const std::string_view request, MessageWriter& response) {
+    MessageReader reader(request);
+    ShardRequestType type = ShardRequestType::SHUTDOWN;
+    try {
+        type = static_cast<ShardRequestType>(reader.ReadU8());
+        switch (type) {
+        case ShardRequestType::ADD_DOCUMENT:
+            HandleAddDocument(reader, response);
+            break;
+        case ShardRequestType::REMOVE_DOCUMENT:
+            HandleRemoveDocument(reader, response);
+            break;
+        case ShardRequestType::FIND_TOP_DOCUMENTS:
+            HandleFindTopDocuments(reader, response);
+            break;
+        case ShardRequestType::MATCH_DOCUMENT:
+            HandleMatchDocument(reader, response);
+            break;
+        case ShardRequestType::SHUTDOWN:
+            response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::OK));
+            break;
+        default:
+            throw std::runtime_error("Error: unknown request type."s);
+        }
+    }
+    catch (const std::invalid_argument& e) {
+        response.Clear();
+        response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::INVALID_ARGUMENT));
+        response.WriteString(e.what());
+    }
+    catch (const std::out_of_range& e) {
+        response.Clear();
+        response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::OUT_OF_RANGE));
+        response.WriteString(e.what());
+    }
+    catch (const std::exception& e) {
+        response.Clear();
+        response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::ERROR));
+        response.WriteString(e.what());
+    }
+    return type != ShardRequestType::SHUTDOWN;
+}
+
+const SearchServer& ShardNode::GetSearchServer() const {
+    return search_server_;
+}
+
+// id, status, ratings, text -> words of the document
+void ShardNode::HandleAddDocument(MessageReader& reader, MessageWriter& response) {
+    const int document_id = reader.ReadI32();
+    const auto status = reader.ReadStatus();
+    std::vector<int> ratings(reader.ReadU32());
+    for (int& rating : ratings) {
+        rating = reader.ReadI32();
+    }
+    const std::string_view text = reader.ReadString();
+    search_server_.AddDocument(document_id, text, status, ratings);
+    response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::OK));
+    WriteDocumentWords(document_id, response);
+}
+
+// id -> words of the removed document
+void ShardNode::HandleRemoveDocument(MessageReader& reader, MessageWriter& response) {
+    const int document_id = reader.ReadI32();
+    // words are copied to the response before the index drops them
+    response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::OK));
+    WriteDocumentWords(document_id, response);
+    search_server_.RemoveDocument(document_id);
+}
+
+// query, status, corpus document count, (word, count)... -> documents
+void ShardNode::HandleFindTopDocuments(MessageReader& reader, MessageWriter& response) {
+    const std::string_view raw_query = reader.ReadString();
+    const auto status = reader.ReadStatus();
+    QueryStatistics statistics(search_server_, reader.ReadI32());
+    const uint32_t word_count = reader.ReadU32();
+    for (uint32_t i = 0; i < word_count; ++i) {
+        const std::string_view word = reader.ReadString();
+        statistics.AddWord(word, reader.ReadI32());
+    }
+    search_server_.SetCorpusStatistics(&statistics);
+    std::vector<Document> documents;
+    try {
+        documents = search_server_.FindTopDocuments(raw_query, status);
+    }
+    catch (...) {
+        search_server_.SetCorpusStatistics(nullptr);
+        throw;
+    }
+    search_server_.SetCorpusStatistics(nullptr);
+    response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::OK));
+    response.WriteU32(static_cast<uint32_t>(documents.size()));
+    for (const Document& document : documents) {
+        response.WriteI32(document.id);
+        response.WriteDouble(document.relevance);
+        response.WriteI32(document.rating);
+    }
+}
+
+// id, query -> status, words
+void ShardNode::HandleMatchDocument(MessageReader& reader, MessageWriter& response) {
+    const int document_id = reader.ReadI32();
+    const std::string_view raw_query = reader.ReadString();
+    const auto [words, status] = search_server_.MatchDocument(raw_query, document_id);
+    response.WriteU8(static_cast<uint8_t>(ShardResponseStatus::OK));
+    response.WriteU8(static_cast<uint8_t>(status));
+    response.WriteU32(static_cast<uint32_t>(words.size()));
+    for (const std::string_view word : words) {
+        response.WriteString(word);
+    }
+}
+
+void ShardNode::WriteDocumentWords(int document_id, MessageWriter& response) const {
+    const auto& word_freqs = search_server_.GetWordFrequencies(document_id);
+    response.WriteU32(static_cast<uint32_t>(word_freqs.size()));
+    for (const auto& [word, _] : word_freqs) {
+        response.WriteString(word);
+    }
+}
+
+ShardNode::QueryStatistics::QueryStatistics(const SearchServer& local, int document_count)
+    : local_(local)
+    , document_count_(document_count) {
+}
+
+void ShardNode::QueryStatistics::AddWord(const std::string_view word, int count) {
+    word_document_counts_[word] = count;
+}
+
+int ShardNode::QueryStatistics::GetDocumentCount() const {
+    return document_count_;
+}
+
+int ShardNode::QueryStatistics::GetWordDocumentCount(const std::string_view word) const {
+    const auto it = word_document_counts_.find(word);
+    return it == word_document_counts_.end() ? local_.GetWordDocumentCount(word) : it->second;
+}
+
+bool ShardNode::QueryStatistics::ForEachWordWithPrefix(const std::string_view prefix,
+    const std::function<bool(std::string_view)>& callback) const {
+    for (auto it = word_document_counts_.lower_bound(prefix);
+        it != word_document_counts_.end() && it->first.substr(0, prefix.size()) == prefix && callback(it->first); ++it) {
+    }
+    return true;
+}
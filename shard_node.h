@@ -0,0 +1,49 @@
+#pragma once
+
+#include "search_server.h"
+#include "shard_protocol.h"
+#include "corpus_statistics.h"
+
+#include <map>
+#include <string>
+#include <string_view>
+
+// Index shard process: holds a part of the corpus and answers ShardBroker requests.
+// Queries carry corpus-wide word counts from the broker, so shards rank like a single index.
+class ShardNode {
+public:
+    explicit ShardNode(const std::string_view stop_words);
+
+    // Serves connections one by one until a SHUTDOWN request
+    void Serve(SocketListener& listener);
+    // Writes the response to request; returns false for SHUTDOWN
+    bool HandleRequest(const std::string_view request, MessageWriter& response);
+
+    const SearchServer& GetSearchServer() const;
+
+private:
+    // Counts sent with a query; words missing there are counted in the local index. The words
+    // include the broker's expansion of every query prefix, which is the start of the words
+    // listed here with the prefix, so prefixes expand to the same terms on every shard.
+    class QueryStatistics : public CorpusStatistics {
+    public:
+        QueryStatistics(const SearchServer& local, int document_count);
+        void AddWord(const std::string_view word, int count);
+        int GetDocumentCount() const override;
+        int GetWordDocumentCount(const std::string_view word) const override;
+        bool ForEachWordWithPrefix(const std::string_view prefix, const std::function<bool(std::string_view)>& callback) const override;
+
+    private:
+        const SearchServer& local_;
+        int document_count_;
+        std::map<std::string_view, int> word_document_counts_;
+    };
+
+    SearchServer search_server_;
+
+    void HandleAddDocument(MessageReader& reader, MessageWriter& response);
+    void HandleRemoveDocument(MessageReader& reader, MessageWriter& response);
+    void HandleFindTopDocuments(MessageReader& reader, MessageWriter& response);
+    void HandleMatchDocument(MessageReader& reader, MessageWriter& response);
+    void WriteDocumentWords(int document_id, MessageWriter& response) const;
+};
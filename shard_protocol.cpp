@@ -0,0 +1,436 @@
+#include "shard_protocol.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+void MessageWriter::WriteU8(uint8_t value) {
+    data_.push_back(static_cast<char>(value));
+}
+
+void MessageWriter::WriteI32(int32_t value) {
+    WriteU32(static_cast<uint32_t>(value));
+}
+
+void MessageWriter::WriteU32(uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        data_.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void MessageWriter::WriteU64(uint64_t value) {
+    WriteU32(static_cast<uint32_t>(value));
+    WriteU32(static_cast<uint32_t>(value >> 32));
+}
+
+void MessageWriter::WriteDouble(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    WriteU64(bits);
+}
+
+void MessageWriter::WriteString(const std::string_view value) {
+    WriteU32(static_cast<uint32_t>(value.size()));
+    data_.append(value);
+}
+
+const std::string& MessageWriter::GetData() const {
+    return data_;
+}
+
+void MessageWriter::Clear() {
+    data_.clear();
+}
+
+MessageReader::MessageReader(const std::string_view data)
+    : data_(data) {
+}
+
+uint8_t MessageReader::ReadU8() {
+    return static_cast<uint8_t>(*Take(1));
+}
+
+int32_t MessageReader::ReadI32() {
+    return static_cast<int32_t>(ReadU32());
+}
+
+uint32_t MessageReader::ReadU32() {
+    const char* bytes = Take(4);
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t MessageReader::ReadU64() {
+    const uint64_t low = ReadU32();
+    const uint64_t high = ReadU32();
+    return low | (high << 32);
+}
+
+double MessageReader::ReadDouble() {
+    const uint64_t bits = ReadU64();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+DocumentStatus MessageReader::ReadStatus() {
+    const uint8_t status = ReadU8();
+    if (status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+        throw std::runtime_error("Error: unknown document status."s);
+    }
+    return static_cast<DocumentStatus>(status);
+}
+
+std::string_view MessageReader::ReadString() {
+    const uint32_t size = ReadU32();
+    return std::string_view(Take(size), size);
+}
+
+bool MessageReader::AtEnd() const {
+    return pos_ == data_.size();
+}
+
+const char* MessageReader::Take(size_t size) {
+    if (data_.size() - pos_ < size) {
+        throw std::runtime_error("Error: truncated message."s);
+    }
+    const char* result = data_.data() + pos_;
+    pos_ += size;
+    return result;
+}
+
+uint64_t SocketConnection::GetBytesSent() const {
+    return bytes_sent_;
+}
+
+uint64_t SocketConnection::GetBytesReceived() const {
+    return bytes_received_;
+}
+
+#if defined(_WIN32)
+
+SocketConnection::SocketConnection(int fd)
+    : fd_(fd) {
+}
+SocketConnection::SocketConnection(SocketConnection&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)) {
+}
+SocketConnection& SocketConnection::operator=(SocketConnection&& other) noexcept {
+    fd_ = std::exchange(other.fd_, -1);
+    return *this;
+}
+SocketConnection::~SocketConnection() = default;
+void SocketConnection::SendMessage(const std::string_view) {
+    throw std::runtime_error("Error: shard sockets are supported on POSIX systems only."s);
+}
+bool SocketConnection::ReceiveMessage(std::string&) {
+    throw std::runtime_error("Error: shard sockets are supported on POSIX systems only."s);
+}
+void SocketConnection::Close() {
+}
+int OpenConnectedSocket(const std::string&) {
+    throw std::runtime_error("Error: sockets are supported on POSIX systems only."s);
+}
+int OpenListeningSocket(const std::string&) {
+    throw std::runtime_error("Error: sockets are supported on POSIX systems only."s);
+}
+SocketConnection ConnectToEndpoint(const std::string&) {
+    throw std::runtime_error("Error: shard sockets are supported on POSIX systems only."s);
+}
+SocketListener::SocketListener(const std::string&) {
+    throw std::runtime_error("Error: shard sockets are supported on POSIX systems only."s);
+}
+SocketListener::~SocketListener() = default;
+SocketConnection SocketListener::Accept() {
+    throw std::runtime_error("Error: shard sockets are supported on POSIX systems only."s);
+}
+
+#else
+
+namespace {
+
+    [[noreturn]] void ThrowSystemError(const std::string& what) {
+        throw std::runtime_error("Error: "s + what + ": "s + std::strerror(errno));
+    }
+
+    struct Endpoint {
+        bool is_unix;
+        std::string host_or_path;
+        std::string port;
+    };
+
+    Endpoint ParseEndpoint(const std::string& endpoint) {
+        if (endpoint.compare(0, 5, "unix:"s) == 0) {
+            return { true, endpoint.substr(5), {} };
+        }
+        if (endpoint.compare(0, 4, "tcp:"s) == 0) {
+            const size_t colon = endpoint.rfind(':');
+            if (colon > 4) {
+                return { false, endpoint.substr(4, colon - 4), endpoint.substr(colon + 1) };
+            }
+        }
+        throw std::invalid_argument("Error: endpoint must be tcp:host:port or unix:path, got "s + endpoint);
+    }
+
+    sockaddr_un MakeUnixAddress(const std::string& path) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Error: unix socket path is too long."s);
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    addrinfo* ResolveTcp(const Endpoint& endpoint, bool passive) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo* result = nullptr;
+        const int error = getaddrinfo(endpoint.host_or_path.empty() ? nullptr : endpoint.host_or_path.c_str(),
+            endpoint.port.c_str(), &hints, &result);
+        if (error != 0) {
+            throw std::runtime_error("Error: cannot resolve "s + endpoint.host_or_path + ": "s + gai_strerror(error));
+        }
+        return result;
+    }
+
+    void SetNoDelay(int fd) {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+}  // namespace
+
+SocketConnection::SocketConnection(int fd)
+    : fd_(fd) {
+}
+
+SocketConnection::SocketConnection(SocketConnection&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1))
+    , bytes_sent_(other.bytes_sent_)
+    , bytes_received_(other.bytes_received_) {
+}
+
+SocketConnection& SocketConnection::operator=(SocketConnection&& other) noexcept {
+    if (this != &other) {
+        Close();
+        fd_ = std::exchange(other.fd_, -1);
+        bytes_sent_ = other.bytes_sent_;
+        bytes_received_ = other.bytes_received_;
+    }
+    return *this;
+}
+
+SocketConnection::~SocketConnection() {
+    Close();
+}
+
+void SocketConnection::Close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void SocketConnection::SendMessage(const std::string_view payload) {
+    if (payload.size() > MAX_MESSAGE_BYTES) {
+        throw std::runtime_error("Error: message of "s + std::to_string(payload.size()) + " bytes exceeds the size limit."s);
+    }
+    char header[4];
+    const auto size = static_cast<uint32_t>(payload.size());
+    for (int i = 0; i < 4; ++i) {
+        header[i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+    }
+    iovec parts[2] = { { header, sizeof(header) }, { const_cast<char*>(payload.data()), payload.size() } };
+    msghdr message{};
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+    size_t left = sizeof(header) + payload.size();
+    while (left > 0) {
+        const ssize_t sent = ::sendmsg(fd_, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("send"s);
+        }
+        left -= sent;
+        bytes_sent_ += sent;
+        // skip what is sent
+        size_t done = static_cast<size_t>(sent);
+        while (done > 0 && message.msg_iovlen > 0) {
+            if (done >= message.msg_iov->iov_len) {
+                done -= message.msg_iov->iov_len;
+                ++message.msg_iov;
+                --message.msg_iovlen;
+            }
+            else {
+                message.msg_iov->iov_base = static_cast<char*>(message.msg_iov->iov_base) + done;
+                message.msg_iov->iov_len -= done;
+                done = 0;
+            }
+        }
+    }
+}
+
+bool SocketConnection::ReceiveMessage(std::string& payload) {
+    const auto receive_exactly = [this](char* data, size_t size, bool allow_eof) {
+        size_t received = 0;
+        while (received < size) {
+            const ssize_t n = ::recv(fd_, data + received, size - received, 0);
+            if (n == 0) {
+                if (allow_eof && received == 0) {
+                    return false;
+                }
+                throw std::runtime_error("Error: connection closed in the middle of a message."s);
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ThrowSystemError("recv"s);
+            }
+            received += n;
+        }
+        bytes_received_ += size;
+        return true;
+    };
+    char header[4];
+    if (!receive_exactly(header, sizeof(header), true)) {
+        return false;
+    }
+    uint32_t size = 0;
+    for (int i = 0; i < 4; ++i) {
+        size |= static_cast<uint32_t>(static_cast<unsigned char>(header[i])) << (8 * i);
+    }
+    if (size > MAX_MESSAGE_BYTES) {
+        throw std::runtime_error("Error: message of "s + std::to_string(size) + " bytes exceeds the size limit."s);
+    }
+    payload.resize(size);
+    receive_exactly(payload.data(), size, false);
+    return true;
+}
+
+int OpenConnectedSocket(const std::string& endpoint) {
+    const Endpoint parsed = ParseEndpoint(endpoint);
+    if (parsed.is_unix) {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            ThrowSystemError("socket"s);
+        }
+        const sockaddr_un address = MakeUnixAddress(parsed.host_or_path);
+        if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            const int error = errno;
+            ::close(fd);
+            errno = error;
+            ThrowSystemError("connect to "s + endpoint);
+        }
+        return fd;
+    }
+    addrinfo* addresses = ResolveTcp(parsed, false);
+    for (addrinfo* it = addresses; it != nullptr; it = it->ai_next) {
+        const int fd = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, it->ai_addr, it->ai_addrlen) == 0) {
+            freeaddrinfo(addresses);
+            SetNoDelay(fd);
+            return fd;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(addresses);
+    ThrowSystemError("connect to "s + endpoint);
+}
+
+int OpenListeningSocket(const std::string& endpoint) {
+    const Endpoint parsed = ParseEndpoint(endpoint);
+    int fd = -1;
+    if (parsed.is_unix) {
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            ThrowSystemError("socket"s);
+        }
+        const sockaddr_un address = MakeUnixAddress(parsed.host_or_path);
+        ::unlink(parsed.host_or_path.c_str());
+        if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            ::close(fd);
+            ThrowSystemError("bind "s + endpoint);
+        }
+    }
+    else {
+        addrinfo* addresses = ResolveTcp(parsed, true);
+        fd = ::socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+        if (fd < 0) {
+            freeaddrinfo(addresses);
+            ThrowSystemError("socket"s);
+        }
+        const int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        const int bind_result = ::bind(fd, addresses->ai_addr, addresses->ai_addrlen);
+        freeaddrinfo(addresses);
+        if (bind_result < 0) {
+            ::close(fd);
+            ThrowSystemError("bind "s + endpoint);
+        }
+    }
+    if (::listen(fd, SOMAXCONN) < 0) {
+        ::close(fd);
+        ThrowSystemError("listen "s + endpoint);
+    }
+    return fd;
+}
+
+SocketConnection ConnectToEndpoint(const std::string& endpoint) {
+    return SocketConnection(OpenConnectedSocket(endpoint));
+}
+
+SocketListener::SocketListener(const std::string& endpoint)
+    : fd_(OpenListeningSocket(endpoint)) {
+    const Endpoint parsed = ParseEndpoint(endpoint);
+    if (parsed.is_unix) {
+        unix_path_ = parsed.host_or_path;
+    }
+}
+
+SocketListener::~SocketListener() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    if (!unix_path_.empty()) {
+        ::unlink(unix_path_.c_str());
+    }
+}
+
+SocketConnection SocketListener::Accept() {
+    while (true) {
+        const int fd = ::accept(fd_, nullptr, nullptr);
+        if (fd >= 0) {
+            SetNoDelay(fd);
+            return SocketConnection(fd);
+        }
+        if (errno != EINTR) {
+            ThrowSystemError("accept"s);
+        }
+    }
+}
+
+#endif
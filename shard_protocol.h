@@ -0,0 +1,117 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Binary protocol between ShardBroker and ShardNode processes.
+// Every message is a little-endian uint32 payload size followed by the payload.
+// Request payload: ShardRequestType, then the fields written by the broker.
+// Response payload: ShardResponseStatus, then the fields or an error text.
+
+// Larger payloads are neither sent nor accepted, so a peer cannot make the receiver allocate 4 GiB
+const uint32_t MAX_MESSAGE_BYTES = 64 * 1024 * 1024;
+
+enum class ShardRequestType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT,
+    FIND_TOP_DOCUMENTS,
+    MATCH_DOCUMENT,
+    SHUTDOWN,
+};
+
+enum class ShardResponseStatus : uint8_t {
+    OK,
+    INVALID_ARGUMENT,
+    OUT_OF_RANGE,
+    ERROR,
+};
+
+class MessageWriter {
+public:
+    void WriteU8(uint8_t value);
+    void WriteI32(int32_t value);
+    void WriteU32(uint32_t value);
+    void WriteU64(uint64_t value);
+    void WriteDouble(double value);
+    void WriteString(const std::string_view value);
+
+    const std::string& GetData() const;
+    void Clear();
+
+private:
+    std::string data_;
+};
+
+// Reads fields from a payload, throws std::runtime_error on truncated data
+class MessageReader {
+public:
+    explicit MessageReader(const std::string_view data);
+
+    uint8_t ReadU8();
+    int32_t ReadI32();
+    uint32_t ReadU32();
+    uint64_t ReadU64();
+    double ReadDouble();
+    // Also throws for bytes outside DocumentStatus
+    DocumentStatus ReadStatus();
+    // The view points into the payload
+    std::string_view ReadString();
+
+    bool AtEnd() const;
+
+private:
+    std::string_view data_;
+    size_t pos_ = 0;
+
+    const char* Take(size_t size);
+};
+
+// Stream socket exchanging size-prefixed messages
+class SocketConnection {
+public:
+    explicit SocketConnection(int fd);
+    SocketConnection(SocketConnection&& other) noexcept;
+    SocketConnection& operator=(SocketConnection&& other) noexcept;
+    SocketConnection(const SocketConnection&) = delete;
+    SocketConnection& operator=(const SocketConnection&) = delete;
+    ~SocketConnection();
+
+    // Throw std::runtime_error for payloads over MAX_MESSAGE_BYTES
+    void SendMessage(const std::string_view payload);
+    // Returns false if the peer closed the connection before a new message
+    bool ReceiveMessage(std::string& payload);
+
+    uint64_t GetBytesSent() const;
+    uint64_t GetBytesReceived() const;
+
+private:
+    int fd_;
+    uint64_t bytes_sent_ = 0;
+    uint64_t bytes_received_ = 0;
+
+    void Close();
+};
+
+// Endpoints are "tcp:host:port" or "unix:path"
+SocketConnection ConnectToEndpoint(const std::string& endpoint);
+
+// Socket descriptors for protocols with their own framing, closed by the caller
+int OpenConnectedSocket(const std::string& endpoint);
+int OpenListeningSocket(const std::string& endpoint);
+
+class SocketListener {
+public:
+    explicit SocketListener(const std::string& endpoint);
+    SocketListener(const SocketListener&) = delete;
+    SocketListener& operator=(const SocketListener&) = delete;
+    ~SocketListener();
+
+    SocketConnection Accept();
+
+private:
+    int fd_ = -1;
+    std::string unix_path_;    // removed on destruction
+};
@@ -0,0 +1,176 @@
+#include "sharded_search_server.h"
+
+using namespace std::string_literals;
+
+ShardedSearchServer::ShardedSearchServer(const std::string_view stop_words, size_t shard_count, NormalizationOptions normalization) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Error: shard count must be positive."s);
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words, normalization);
+    }
+    AttachShards();
+}
+
+void ShardedSearchServer::AttachShards() {
+    for (SearchServer& shard : shards_) {
+        shard.SetCorpusStatistics(this);
+    }
+}
+
+void ShardedSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    if (document_id < 0 || document_ids_.count(document_id) > 0) {
+        throw std::invalid_argument("Error: doc id is negative or duplicate already existing id."s);
+    }
+    SearchServer& shard = shards_[GetShardIndex(document_id)];
+    shard.AddDocument(document_id, document, status, ratings);
+    document_ids_.insert(document_id);
+    for (const auto& [word, _] : shard.GetWordFrequencies(document_id)) {
+        const auto it = word_document_counts_.find(word);
+        if (it == word_document_counts_.end()) {
+            word_document_counts_.emplace(std::string(word), 1);
+            if (fuzzy_index_) {
+                fuzzy_index_->Insert(word);
+            }
+        }
+        else {
+            ++it->second;
+        }
+    }
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_ids_.count(document_id) == 0) {
+        throw std::invalid_argument("Error: no document with such id (RemoveDocument)."s);
+    }
+    SearchServer& shard = shards_[GetShardIndex(document_id)];
+    for (const auto& [word, _] : shard.GetWordFrequencies(document_id)) {
+        const auto it = word_document_counts_.find(word);
+        if (--it->second == 0) {
+            if (fuzzy_index_) {
+                fuzzy_index_->Erase(word);
+            }
+            word_document_counts_.erase(it);
+        }
+    }
+    shard.RemoveDocument(document_id);
+    document_ids_.erase(document_id);
+}
+
+// the shard throws for unknown ids
+void ShardedSearchServer::SetDocumentStatus(int document_id, DocumentStatus status) {
+    shards_[GetShardIndex(document_id)].SetDocumentStatus(document_id, status);
+}
+
+void ShardedSearchServer::SetDocumentRating(int document_id, int rating) {
+    shards_[GetShardIndex(document_id)].SetDocumentRating(document_id, rating);
+}
+
+void ShardedSearchServer::SetDocumentStatuses(const std::vector<std::pair<int, DocumentStatus>>& updates) {
+    const auto shard_updates = SplitUpdates(updates);
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        if (!shard_updates[i].empty()) {
+            shards_[i].SetDocumentStatuses(shard_updates[i]);
+        }
+    }
+}
+
+void ShardedSearchServer::SetDocumentRatings(const std::vector<std::pair<int, int>>& updates) {
+    const auto shard_updates = SplitUpdates(updates);
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        if (!shard_updates[i].empty()) {
+            shards_[i].SetDocumentRatings(shard_updates[i]);
+        }
+    }
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(std::execution::par, raw_query, status);
+}
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query) const {
+    return FindTopDocuments(std::execution::par, raw_query, DocumentStatus::ACTUAL);
+}
+
+DocumentPage ShardedSearchServer::FindTopDocumentsPage(const std::string_view raw_query, size_t page_size, const std::string_view cursor) const {
+    return FindTopDocumentsPage(std::execution::par, raw_query, DocumentStatusFilter{ DocumentStatus::ACTUAL }, page_size, cursor);
+}
+
+SearchServer::MatchingDocs_sv ShardedSearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
+    if (document_ids_.count(document_id) == 0) {
+        throw std::out_of_range("out_of_range in MatchDocument ");
+    }
+    return shards_[GetShardIndex(document_id)].MatchDocument(raw_query, document_id);
+}
+
+std::map<std::string_view, double> ShardedSearchServer::GetWordFrequencies(int document_id) const {
+    return shards_[GetShardIndex(document_id)].GetWordFrequencies(document_id);
+}
+
+void ShardedSearchServer::EnableFuzzySearch(int max_edit_distance) {
+    auto fuzzy_index = std::make_unique<FuzzyIndex>(max_edit_distance);
+    for (const auto& [word, _] : word_document_counts_) {
+        fuzzy_index->Insert(word);
+    }
+    for (SearchServer& shard : shards_) {
+        shard.EnableFuzzySearch(max_edit_distance);
+    }
+    fuzzy_index_ = std::move(fuzzy_index);
+}
+
+void ShardedSearchServer::DisableFuzzySearch() {
+    for (SearchServer& shard : shards_) {
+        shard.DisableFuzzySearch();
+    }
+    fuzzy_index_.reset();
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    return static_cast<int>(document_ids_.size());
+}
+
+int ShardedSearchServer::GetWordDocumentCount(const std::string_view word) const {
+    const auto it = word_document_counts_.find(word);
+    return it == word_document_counts_.end() ? 0 : it->second;
+}
+
+bool ShardedSearchServer::ForEachWordWithPrefix(const std::string_view prefix, const std::function<bool(std::string_view)>& callback) const {
+    for (auto it = word_document_counts_.lower_bound(prefix);
+        it != word_document_counts_.end() && it->first.compare(0, prefix.size(), prefix) == 0 && callback(it->first); ++it) {
+    }
+    return true;
+}
+
+bool ShardedSearchServer::FindFuzzyCandidates(const std::string_view word, size_t max_count, size_t max_checked,
+    FuzzyIndex::Lookup& lookup) const {
+    if (!fuzzy_index_) {
+        return false;
+    }
+    lookup = fuzzy_index_->FindCandidates(word, max_count, max_checked);
+    return true;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t GetDocumentShard(int document_id, size_t shard_count) {
+    // Fibonacci hashing spreads sequential ids evenly
+    return static_cast<size_t>((static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 11400714819323198485ull) >> 32) % shard_count;
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    return GetDocumentShard(document_id, shards_.size());
+}
+
+const SearchServer& ShardedSearchServer::GetShard(size_t index) const {
+    return shards_.at(index);
+}
+
+std::set<int>::const_iterator ShardedSearchServer::begin() const {
+    return document_ids_.begin();
+}
+
+std::set<int>::const_iterator ShardedSearchServer::end() const {
+    return document_ids_.end();
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "search_server.h"
+#include "corpus_statistics.h"
+
+#include <execution>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Shard of a document among shard_count shards
+size_t GetDocumentShard(int document_id, size_t shard_count);
+
+// Documents hash-partitioned over independent SearchServer shards. Queries run on all shards
+// and their top documents are merged. Shards take IDF, prefix expansions and fuzzy candidates
+// from the corpus-wide words kept here, so results are the same as of a single SearchServer
+// with all documents.
+class ShardedSearchServer : public CorpusStatistics {
+public:
+    ShardedSearchServer(const std::string_view stop_words, size_t shard_count, NormalizationOptions normalization = {});
+
+    template <typename stringContainer>
+    ShardedSearchServer(const stringContainer& stop_words, size_t shard_count, NormalizationOptions normalization = {});
+
+    ShardedSearchServer(const ShardedSearchServer&) = delete;    // shards point to this
+    ShardedSearchServer& operator=(const ShardedSearchServer&) = delete;
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+    // As of SearchServer, routed to the owning shards
+    void SetDocumentStatus(int document_id, DocumentStatus status);
+    void SetDocumentRating(int document_id, int rating);
+    void SetDocumentStatuses(const std::vector<std::pair<int, DocumentStatus>>& updates);
+    void SetDocumentRatings(const std::vector<std::pair<int, int>>& updates);
+
+    // policy selects how shards are queried, each shard runs sequentially
+    template <typename Policy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    template <typename Policy>
+    std::vector<Document> FindTopDocuments(const Policy& exPol, const std::string_view raw_query, DocumentStatus status) const;
+    template <typename Policy>
+    std::vector<Document> FindTopDocuments(const Policy& exPol, const std::string_view raw_query) const;
+
+    //not specified policy: shards are queried in parallel
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+
+    // Pages as of SearchServer::FindTopDocumentsPage: every shard selects its page after the cursor, pages are merged
+    template <typename Policy, typename DocumentPredicate>
+    DocumentPage FindTopDocumentsPage(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t page_size, const std::string_view cursor) const;
+    DocumentPage FindTopDocumentsPage(const std::string_view raw_query, size_t page_size, const std::string_view cursor = {}) const;
+
+    SearchServer::MatchingDocs_sv MatchDocument(const std::string_view raw_query, int document_id) const;
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    void EnableFuzzySearch(int max_edit_distance);
+    void DisableFuzzySearch();
+
+    int GetDocumentCount() const override;
+    int GetWordDocumentCount(const std::string_view word) const override;
+    bool ForEachWordWithPrefix(const std::string_view prefix, const std::function<bool(std::string_view)>& callback) const override;
+    bool FindFuzzyCandidates(const std::string_view word, size_t max_count, size_t max_checked, FuzzyIndex::Lookup& lookup) const override;
+
+    size_t GetShardCount() const;
+    size_t GetShardIndex(int document_id) const;
+    const SearchServer& GetShard(size_t index) const;
+
+    std::set<int>::const_iterator begin() const;
+    std::set<int>::const_iterator end() const;
+
+private:
+    std::vector<SearchServer> shards_;
+    std::map<std::string, int, std::less<>> word_document_counts_;    // word: number of documents in all shards
+    std::unique_ptr<FuzzyIndex> fuzzy_index_;    // of all shards in fuzzy mode
+    std::set<int> document_ids_;
+
+    void AttachShards();
+    // Updates grouped by shard; throws std::invalid_argument for unknown ids
+    template <typename Value>
+    std::vector<std::vector<std::pair<int, Value>>> SplitUpdates(const std::vector<std::pair<int, Value>>& updates) const;
+};
+
+template <typename stringContainer>
+ShardedSearchServer::ShardedSearchServer(const stringContainer& stop_words, size_t shard_count, NormalizationOptions normalization) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Error: shard count must be positive."s);
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words, normalization);
+    }
+    AttachShards();
+}
+
+template <typename Value>
+std::vector<std::vector<std::pair<int, Value>>> ShardedSearchServer::SplitUpdates(const std::vector<std::pair<int, Value>>& updates) const {
+    std::vector<std::vector<std::pair<int, Value>>> shard_updates(shards_.size());
+    for (const auto& update : updates) {
+        if (document_ids_.count(update.first) == 0) {
+            throw std::invalid_argument("Error: no document with such id (SetDocumentStatus/SetDocumentRating)."s);
+        }
+        shard_updates[GetShardIndex(update.first)].push_back(update);
+    }
+    return shard_updates;
+}
+
+template <typename Policy, typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    std::vector<std::vector<Document>> shard_results(shards_.size());
+    std::transform(exPol, shards_.begin(), shards_.end(), shard_results.begin(),
+        [raw_query, &document_predicate](const SearchServer& shard) {
+            return shard.FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+        });
+    std::vector<Document> response;
+    for (auto& documents : shard_results) {
+        response.insert(response.end(), documents.begin(), documents.end());
+    }
+    // every shard result is already cut to MAX_RESULT_DOCUMENT_COUNT
+    std::sort(response.begin(), response.end(), IsMoreRelevant);
+    if (response.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        response.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return response;
+}
+template <typename Policy, typename DocumentPredicate>
+DocumentPage ShardedSearchServer::FindTopDocumentsPage(const Policy& exPol, const std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t page_size, const std::string_view cursor) const {
+    std::vector<DocumentPage> shard_pages(shards_.size());
+    std::transform(exPol, shards_.begin(), shards_.end(), shard_pages.begin(),
+        [raw_query, &document_predicate, page_size, cursor](const SearchServer& shard) {
+            return shard.FindTopDocumentsPage(std::execution::seq, raw_query, document_predicate, page_size, cursor);
+        });
+    DocumentPage page;
+    bool shard_has_more = false;
+    for (auto& shard_page : shard_pages) {
+        page.documents.insert(page.documents.end(), shard_page.documents.begin(), shard_page.documents.end());
+        shard_has_more = shard_has_more || !shard_page.next_cursor.empty();
+    }
+    // shard pages already follow the cursor
+    if (SelectTopDocuments(page.documents, std::nullopt, page_size) || (shard_has_more && !page.documents.empty())) {
+        page.next_cursor = EncodePageCursor(page.documents.back());
+    }
+    return page;
+}
+
+template <typename Policy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const Policy& exPol, const std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(exPol, raw_query, DocumentStatusFilter{ status });
+}
+template <typename Policy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const Policy& exPol, const std::string_view raw_query) const {
+    return FindTopDocuments(exPol, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocuments(std::execution::par, raw_query, document_predicate);
+}
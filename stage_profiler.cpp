@@ -0,0 +1,373 @@
+#include "stage_profiler.h"
+#include "atomic_counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+    std::atomic<bool> profiling_enabled{ false };
+
+    // Totals of one thread, written by the thread and read by GetStageProfiles
+    struct ThreadRecord {
+        size_t thread_index = 0;
+        std::array<bool, PROFILE_COUNTER_COUNT> available{};
+        struct Stage {
+            AtomicCounter calls;
+            AtomicCounter wall_ns;
+            std::array<AtomicCounter, PROFILE_COUNTER_COUNT> counters;
+        };
+        std::array<Stage, PROFILE_STAGE_COUNT> stages;
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::shared_ptr<ThreadRecord>> registry;
+
+    // Counter file descriptors of the calling thread, opened on its first profiled stage
+    class ThreadCounters {
+    public:
+        ThreadCounters();
+        ThreadCounters(const ThreadCounters&) = delete;
+        ThreadCounters& operator=(const ThreadCounters&) = delete;
+        ~ThreadCounters();
+
+        void Read(std::array<uint64_t, PROFILE_COUNTER_COUNT>& values) const;
+        ThreadRecord& GetRecord() {
+            return *record_;
+        }
+
+    private:
+        // Counters of a group are read together with one read() of the leader
+        struct Group {
+            int leader = -1;
+            std::vector<int> fds;
+            std::vector<ProfileCounter> counters;
+        };
+        std::array<Group, 3> groups_;    // hardware, software, data TLB
+        std::shared_ptr<ThreadRecord> record_;
+
+        void Open();
+    };
+
+    ThreadCounters::ThreadCounters()
+        : record_(std::make_shared<ThreadRecord>()) {
+        Open();
+        for (const Group& group : groups_) {
+            for (const ProfileCounter counter : group.counters) {
+                record_->available[static_cast<size_t>(counter)] = true;
+            }
+        }
+        std::lock_guard guard(registry_mutex);
+        record_->thread_index = registry.size();
+        registry.push_back(record_);
+    }
+
+#if defined(__linux__)
+
+    struct CounterEvent {
+        ProfileCounter counter;
+        uint32_t type;
+        uint64_t config;
+        size_t group;
+    };
+
+    const std::array<CounterEvent, PROFILE_COUNTER_COUNT> COUNTER_EVENTS = { {
+        { ProfileCounter::CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0 },
+        { ProfileCounter::INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0 },
+        { ProfileCounter::LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 0 },
+        { ProfileCounter::BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0 },
+        { ProfileCounter::TASK_CLOCK_NS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 1 },
+        { ProfileCounter::CONTEXT_SWITCHES, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 1 },
+        // a group of its own, the hardware group may already use every programmable counter
+        { ProfileCounter::DTLB_MISSES, PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 2 },
+    } };
+
+    // Counts the calling thread on any CPU
+    int OpenEvent(const CounterEvent& event, int group_fd, bool exclude_kernel) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event.type;
+        attr.config = event.config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = exclude_kernel ? 1 : 0;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    void ThreadCounters::Open() {
+        for (const CounterEvent& event : COUNTER_EVENTS) {
+            Group& group = groups_[event.group];
+            // context switches happen in the kernel, user-only counting is the fallback
+            int fd = event.type == PERF_TYPE_SOFTWARE ? OpenEvent(event, group.leader, false) : -1;
+            if (fd < 0) {
+                fd = OpenEvent(event, group.leader, true);
+            }
+            if (fd < 0) {
+                continue;
+            }
+            if (group.leader < 0) {
+                group.leader = fd;
+            }
+            group.fds.push_back(fd);
+            group.counters.push_back(event.counter);
+        }
+    }
+
+    ThreadCounters::~ThreadCounters() {
+        for (const Group& group : groups_) {
+            for (const int fd : group.fds) {
+                close(fd);
+            }
+        }
+    }
+
+    void ThreadCounters::Read(std::array<uint64_t, PROFILE_COUNTER_COUNT>& values) const {
+        values.fill(0);
+        uint64_t buffer[1 + PROFILE_COUNTER_COUNT];
+        for (const Group& group : groups_) {
+            if (group.leader < 0) {
+                continue;
+            }
+            // PERF_FORMAT_GROUP: the number of counters, then their values in opening order
+            const ssize_t size = read(group.leader, buffer, sizeof(buffer));
+            if (size < static_cast<ssize_t>(sizeof(uint64_t) * (1 + group.counters.size()))) {
+                continue;
+            }
+            for (size_t i = 0; i < group.counters.size(); ++i) {
+                values[static_cast<size_t>(group.counters[i])] = buffer[1 + i];
+            }
+        }
+    }
+
+#else
+
+    void ThreadCounters::Open() {
+    }
+
+    ThreadCounters::~ThreadCounters() {
+    }
+
+    void ThreadCounters::Read(std::array<uint64_t, PROFILE_COUNTER_COUNT>& values) const {
+        values.fill(0);
+    }
+
+#endif
+
+    ThreadCounters& GetThreadCounters() {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    double Ratio(uint64_t numerator, uint64_t denominator, double scale = 1.0) {
+        return denominator > 0 ? scale * numerator / denominator : 0.0;
+    }
+
+    void PrintProfile(std::ostream& out, const ThreadStageProfile& profile) {
+        const auto has = [&profile](ProfileCounter counter) {
+            return profile.available[static_cast<size_t>(counter)];
+        };
+        const auto get = [](const StageTotals& totals, ProfileCounter counter) {
+            return totals.counters[static_cast<size_t>(counter)];
+        };
+        const std::ios_base::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(3);
+        out << std::left << std::setw(20) << "stage"s << std::right << std::setw(10) << "calls"s << std::setw(12) << "wall ms"s
+            << std::setw(12) << "cpu ms"s << std::setw(16) << "instructions"s << std::setw(8) << "IPC"s
+            << std::setw(12) << "LLC/kinstr"s << std::setw(12) << "br/kinstr"s << std::setw(14) << "dTLB/kinstr"s
+            << std::setw(10) << "ctx sw"s << std::endl;
+        for (size_t stage = 0; stage < PROFILE_STAGE_COUNT; ++stage) {
+            const StageTotals& totals = profile.stages[stage];
+            if (totals.calls == 0) {
+                continue;
+            }
+            const uint64_t instructions = get(totals, ProfileCounter::INSTRUCTIONS);
+            out << std::left << std::setw(20) << GetProfileStageName(static_cast<ProfileStage>(stage)) << std::right
+                << std::setw(10) << totals.calls << std::setw(12) << totals.wall_ns / 1e6;
+            out << std::setw(12);
+            has(ProfileCounter::TASK_CLOCK_NS) ? out << get(totals, ProfileCounter::TASK_CLOCK_NS) / 1e6 : out << "-"s;
+            out << std::setw(16);
+            has(ProfileCounter::INSTRUCTIONS) ? out << instructions : out << "-"s;
+            out << std::setw(8);
+            has(ProfileCounter::CYCLES) && has(ProfileCounter::INSTRUCTIONS)
+                ? out << Ratio(instructions, get(totals, ProfileCounter::CYCLES)) : out << "-"s;
+            out << std::setw(12);
+            has(ProfileCounter::LLC_MISSES) && has(ProfileCounter::INSTRUCTIONS)
+                ? out << Ratio(get(totals, ProfileCounter::LLC_MISSES), instructions, 1000.0) : out << "-"s;
+            out << std::setw(12);
+            has(ProfileCounter::BRANCH_MISSES) && has(ProfileCounter::INSTRUCTIONS)
+                ? out << Ratio(get(totals, ProfileCounter::BRANCH_MISSES), instructions, 1000.0) : out << "-"s;
+            out << std::setw(14);
+            has(ProfileCounter::DTLB_MISSES) && has(ProfileCounter::INSTRUCTIONS)
+                ? out << Ratio(get(totals, ProfileCounter::DTLB_MISSES), instructions, 1000.0) : out << "-"s;
+            out << std::setw(10);
+            has(ProfileCounter::CONTEXT_SWITCHES) ? out << get(totals, ProfileCounter::CONTEXT_SWITCHES) : out << "-"s;
+            out << std::endl;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+}  // namespace
+
+const char* GetProfileStageName(ProfileStage stage) {
+    switch (stage) {
+    case ProfileStage::PARSE_QUERY:
+        return "parse_query";
+    case ProfileStage::SCORE_SEQ:
+        return "score_seq";
+    case ProfileStage::SCORE_PAR:
+        return "score_par";
+    case ProfileStage::SCORE_PAR_TASK:
+        return "score_par_task";
+    case ProfileStage::SCORE_DAAT:
+        return "score_daat";
+    case ProfileStage::SCORE_DAAT_RANGE:
+        return "score_daat_range";
+    case ProfileStage::SCORE_CONTEXT:
+        return "score_context";
+    case ProfileStage::SORT_RESULTS:
+        return "sort_results";
+    case ProfileStage::ADD_DOCUMENT:
+        return "add_document";
+    case ProfileStage::TOKENIZE_DOCUMENT:
+        return "tokenize_document";
+    case ProfileStage::REMOVE_DOCUMENT:
+        return "remove_document";
+    default:
+        return "unknown";
+    }
+}
+
+const char* GetProfileCounterName(ProfileCounter counter) {
+    switch (counter) {
+    case ProfileCounter::CYCLES:
+        return "cycles";
+    case ProfileCounter::INSTRUCTIONS:
+        return "instructions";
+    case ProfileCounter::LLC_MISSES:
+        return "llc_misses";
+    case ProfileCounter::BRANCH_MISSES:
+        return "branch_misses";
+    case ProfileCounter::TASK_CLOCK_NS:
+        return "task_clock_ns";
+    case ProfileCounter::CONTEXT_SWITCHES:
+        return "context_switches";
+    case ProfileCounter::DTLB_MISSES:
+        return "dtlb_misses";
+    default:
+        return "unknown";
+    }
+}
+
+void EnableStageProfiling(bool enabled) {
+    profiling_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool IsStageProfilingEnabled() {
+    return profiling_enabled.load(std::memory_order_relaxed);
+}
+
+std::vector<ThreadStageProfile> GetStageProfiles() {
+    std::lock_guard guard(registry_mutex);
+    std::vector<ThreadStageProfile> profiles;
+    for (const auto& record : registry) {
+        ThreadStageProfile profile;
+        profile.thread_index = record->thread_index;
+        profile.available = record->available;
+        for (size_t stage = 0; stage < PROFILE_STAGE_COUNT; ++stage) {
+            const ThreadRecord::Stage& source = record->stages[stage];
+            StageTotals& totals = profile.stages[stage];
+            totals.calls = source.calls.Get();
+            totals.wall_ns = source.wall_ns.Get();
+            for (size_t counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+                totals.counters[counter] = source.counters[counter].Get();
+            }
+        }
+        profiles.push_back(profile);
+    }
+    return profiles;
+}
+
+void ResetStageProfiles() {
+    std::lock_guard guard(registry_mutex);
+    for (const auto& record : registry) {
+        for (ThreadRecord::Stage& stage : record->stages) {
+            stage.calls.Reset();
+            stage.wall_ns.Reset();
+            for (AtomicCounter& counter : stage.counters) {
+                counter.Reset();
+            }
+        }
+    }
+}
+
+void PrintStageProfiles(std::ostream& out, const std::vector<ThreadStageProfile>& profiles) {
+    ThreadStageProfile total;
+    for (const ThreadStageProfile& profile : profiles) {
+        bool used = false;
+        for (size_t stage = 0; stage < PROFILE_STAGE_COUNT; ++stage) {
+            const StageTotals& totals = profile.stages[stage];
+            used = used || totals.calls > 0;
+            total.stages[stage].calls += totals.calls;
+            total.stages[stage].wall_ns += totals.wall_ns;
+            for (size_t counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+                total.stages[stage].counters[counter] += totals.counters[counter];
+            }
+        }
+        for (size_t counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+            total.available[counter] = total.available[counter] || profile.available[counter];
+        }
+        if (used) {
+            out << "thread "s << profile.thread_index << std::endl;
+            PrintProfile(out, profile);
+        }
+    }
+    out << "all threads"s << std::endl;
+    PrintProfile(out, total);
+    out << "counters:"s;
+    for (size_t counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+        out << ' ' << GetProfileCounterName(static_cast<ProfileCounter>(counter)) << (total.available[counter] ? ""s : " (n/a)"s);
+    }
+    out << std::endl;
+}
+
+StageScope::StageScope(ProfileStage stage)
+    : stage_(stage)
+    , active_(IsStageProfilingEnabled()) {
+    if (active_) {
+        GetThreadCounters().Read(start_counters_);
+        start_time_ = std::chrono::steady_clock::now();
+    }
+}
+
+StageScope::~StageScope() {
+    if (!active_) {
+        return;
+    }
+    const auto end_time = std::chrono::steady_clock::now();
+    ThreadCounters& thread_counters = GetThreadCounters();
+    std::array<uint64_t, PROFILE_COUNTER_COUNT> end_counters;
+    thread_counters.Read(end_counters);
+    ThreadRecord::Stage& stage = thread_counters.GetRecord().stages[static_cast<size_t>(stage_)];
+    stage.calls.Add();
+    stage.wall_ns.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time_).count());
+    for (size_t counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+        stage.counters[counter].Add(end_counters[counter] - start_counters_[counter]);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Opt-in profiling of query and update stages. While enabled, every PROFILE_STAGE scope reads
+// the wall clock and the hardware and software counters of its thread (Linux perf_event_open:
+// cycles, instructions, last level cache misses, branch misses, task clock, context switches,
+// data TLB misses)
+// at entry and exit and adds the differences to the totals of the thread. Counters the kernel
+// or the machine does not provide are left out; elsewhere only wall time is measured.
+// Disabled scopes cost one relaxed load; define NO_STAGE_PROFILING to compile them out.
+
+enum class ProfileStage : uint8_t {
+    PARSE_QUERY,
+    SCORE_SEQ,
+    SCORE_PAR,
+    SCORE_PAR_TASK,    // one query term on a worker thread of SCORE_PAR
+    SCORE_DAAT,    // document-at-a-time scoring of auto_execution
+    SCORE_DAAT_RANGE,    // one ordinal range of SCORE_DAAT
+    SCORE_CONTEXT,    // includes its SORT_RESULTS
+    SORT_RESULTS,
+    ADD_DOCUMENT,
+    TOKENIZE_DOCUMENT,    // part of ADD_DOCUMENT
+    REMOVE_DOCUMENT,
+    COUNT,
+};
+
+enum class ProfileCounter : uint8_t {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    TASK_CLOCK_NS,    // time on CPU, wall time minus task clock is time blocked or preempted
+    CONTEXT_SWITCHES,
+    DTLB_MISSES,    // data TLB load misses
+    COUNT,
+};
+
+const size_t PROFILE_STAGE_COUNT = static_cast<size_t>(ProfileStage::COUNT);
+const size_t PROFILE_COUNTER_COUNT = static_cast<size_t>(ProfileCounter::COUNT);
+
+const char* GetProfileStageName(ProfileStage stage);
+const char* GetProfileCounterName(ProfileCounter counter);
+
+struct StageTotals {
+    uint64_t calls = 0;
+    uint64_t wall_ns = 0;
+    std::array<uint64_t, PROFILE_COUNTER_COUNT> counters{};
+};
+
+struct ThreadStageProfile {
+    size_t thread_index = 0;    // in the order threads first entered a stage
+    std::array<bool, PROFILE_COUNTER_COUNT> available{};    // counters opened on the thread
+    std::array<StageTotals, PROFILE_STAGE_COUNT> stages{};
+};
+
+void EnableStageProfiling(bool enabled);
+bool IsStageProfilingEnabled();
+
+// Snapshot of every thread that has entered a stage, exited threads included
+std::vector<ThreadStageProfile> GetStageProfiles();
+void ResetStageProfiles();
+
+// Per thread and total tables with instructions per cycle and misses per thousand instructions
+void PrintStageProfiles(std::ostream& out, const std::vector<ThreadStageProfile>& profiles);
+
+class StageScope {
+public:
+    explicit StageScope(ProfileStage stage);
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+    ~StageScope();
+
+private:
+    ProfileStage stage_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::array<uint64_t, PROFILE_COUNTER_COUNT> start_counters_;
+};
+
+#if defined(NO_STAGE_PROFILING)
+#define PROFILE_STAGE(stage)
+#else
+#define PROFILE_STAGE_CONCAT_INTERNAL(X, Y) X##Y
+#define PROFILE_STAGE_CONCAT(X, Y) PROFILE_STAGE_CONCAT_INTERNAL(X, Y)
+#define PROFILE_STAGE(stage) StageScope PROFILE_STAGE_CONCAT(stageScope, __LINE__)(ProfileStage::stage)
+#endif
@@ -0,0 +1,135 @@
+#include "stop_word_set.h"
+#include "index_statistics.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+    const size_t WORDS_PER_BUCKET = 4;
+    const uint32_t MAX_BUCKET_SEED = 1 << 16;    // a larger table is tried beyond it
+
+    size_t RoundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    size_t LengthBit(size_t length) {
+        return std::min<size_t>(length, 63);
+    }
+
+}  // namespace
+
+StopWordSet::StopWordSet(const std::vector<std::string>& words) {
+    std::vector<std::string> unique_words;
+    std::copy_if(words.begin(), words.end(), std::back_inserter(unique_words), [](const std::string& word) { return !word.empty(); });
+    std::sort(unique_words.begin(), unique_words.end());
+    unique_words.erase(std::unique(unique_words.begin(), unique_words.end()), unique_words.end());
+    size_ = unique_words.size();
+    if (size_ == 0) {
+        return;
+    }
+    std::vector<uint64_t> hashes;
+    for (const std::string& word : unique_words) {
+        hashes.push_back(HashWord(word));
+        length_mask_ |= uint64_t{ 1 } << LengthBit(word.size());
+    }
+
+    const size_t bucket_count = (size_ + WORDS_PER_BUCKET - 1) / WORDS_PER_BUCKET;
+    std::vector<std::vector<size_t>> buckets(bucket_count);
+    for (size_t i = 0; i < size_; ++i) {
+        buckets[Mix(hashes[i], 0) % bucket_count].push_back(i);
+    }
+    // the largest buckets are placed first, while most slots are free
+    std::vector<size_t> order(bucket_count);
+    for (size_t i = 0; i < bucket_count; ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&buckets](size_t lhs, size_t rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
+
+    for (size_t slot_count = RoundUpToPowerOfTwo(size_ * 2);; slot_count *= 2) {
+        const size_t mask = slot_count - 1;
+        std::vector<int> slot_words(slot_count, -1);
+        bucket_seeds_.assign(bucket_count, 0);
+        bool placed_all = true;
+        std::vector<size_t> positions;
+        for (const size_t bucket : order) {
+            bool placed = buckets[bucket].empty();
+            for (uint32_t seed = 1; !placed && seed <= MAX_BUCKET_SEED; ++seed) {
+                positions.clear();
+                placed = true;
+                for (const size_t word : buckets[bucket]) {
+                    const size_t position = Mix(hashes[word], seed) & mask;
+                    if (slot_words[position] != -1 || std::find(positions.begin(), positions.end(), position) != positions.end()) {
+                        placed = false;
+                        break;
+                    }
+                    positions.push_back(position);
+                }
+                if (placed) {
+                    for (size_t i = 0; i < positions.size(); ++i) {
+                        slot_words[positions[i]] = static_cast<int>(buckets[bucket][i]);
+                    }
+                    bucket_seeds_[bucket] = seed;
+                }
+            }
+            if (!placed) {
+                placed_all = false;
+                break;
+            }
+        }
+        if (placed_all) {
+            slots_.assign(slot_count, std::string());
+            for (size_t slot = 0; slot < slot_count; ++slot) {
+                if (slot_words[slot] != -1) {
+                    slots_[slot] = std::move(unique_words[slot_words[slot]]);
+                }
+            }
+            return;
+        }
+    }
+}
+
+bool StopWordSet::Contains(const std::string_view word) const {
+    if (((length_mask_ >> LengthBit(word.size())) & 1) == 0) {
+        return false;
+    }
+    const uint64_t hash = HashWord(word);
+    const uint32_t seed = bucket_seeds_[Mix(hash, 0) % bucket_seeds_.size()];
+    return slots_[Mix(hash, seed) & (slots_.size() - 1)] == word;
+}
+
+size_t StopWordSet::Size() const {
+    return size_;
+}
+
+size_t StopWordSet::GetAllocatedBytes() const {
+    size_t bytes = EstimateVectorBytes(slots_) + EstimateVectorBytes(bucket_seeds_);
+    for (const std::string& word : slots_) {
+        bytes += EstimateStringBytes(word);
+    }
+    return bytes;
+}
+
+// FNV-1a
+uint64_t StopWordSet::HashWord(const std::string_view word) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// splitmix64 finalizer of the hash displaced by the seed
+uint64_t StopWordSet::Mix(uint64_t hash, uint64_t seed) {
+    uint64_t x = hash + seed * 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Static set of stop words with a minimal-probe perfect hash (hash and displace): a word is
+// assigned to a bucket by one hash, and every bucket has a seed that sends its words to free
+// slots. A lookup costs one pass over the word, two mixes and at most one comparison, and words
+// of a length no stop word has are rejected before hashing.
+class StopWordSet {
+public:
+    StopWordSet() = default;
+    // Duplicates are ignored
+    explicit StopWordSet(const std::vector<std::string>& words);
+
+    bool Contains(const std::string_view word) const;
+    size_t Size() const;
+    // Estimated heap bytes, see index_statistics.h
+    size_t GetAllocatedBytes() const;
+
+private:
+    std::vector<std::string> slots_;    // power of two size, empty strings are free slots
+    std::vector<uint32_t> bucket_seeds_;
+    uint64_t length_mask_ = 0;    // bit min(length, 63) is set for every stop word length
+    size_t size_ = 0;
+
+    static uint64_t HashWord(const std::string_view word);
+    static uint64_t Mix(uint64_t hash, uint64_t seed);
+};
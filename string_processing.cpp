@@ -29,16 +29,16 @@ std::vector<std::string> SplitIntoWords(const std::string& text) {
 
 std::vector<std::string_view> SplitIntoWords(const std::string_view text) {
     std::vector<std::string_view> res;
-    const std::string_view separator(" ");
-    size_t start_pos = 0;
-    size_t stop_pos = 0;
-    size_t length = 0;
-    while (start_pos < text.size()) {
-        start_pos = text.find_first_not_of(separator, start_pos);
-        stop_pos = text.find_first_of(separator, start_pos);
-        stop_pos == std::string_view::npos ? length = text.size() - start_pos : length = stop_pos - start_pos;
-        res.push_back(text.substr(start_pos, length));
-        start_pos = stop_pos;
-    }
+    SplitIntoWords(text, res);
     return res;
+}
+
+void SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    size_t start_pos = text.find_first_not_of(' ');
+    while (start_pos != std::string_view::npos) {
+        const size_t stop_pos = text.find(' ', start_pos);
+        words.push_back(text.substr(start_pos, stop_pos == std::string_view::npos ? std::string_view::npos : stop_pos - start_pos));
+        start_pos = text.find_first_not_of(' ', stop_pos);
+    }
 }
\ No newline at end of file
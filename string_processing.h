@@ -8,3 +8,5 @@
 int ReadLineWithNumber();
 std::vector<std::string> SplitIntoWords(const std::string& text);
 std::vector<std::string_view> SplitIntoWords(const std::string_view text);
+// Replaces the contents of words, keeping their capacity
+void SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words);
@@ -0,0 +1,181 @@
+#include "term_dictionary.h"
+#include "index_statistics.h"
+
+#include <algorithm>
+
+void TermDictionary::Insert(const std::string_view term) {
+    const auto erased_it = erased_.find(term);
+    if (erased_it != erased_.end()) {
+        erased_.erase(erased_it);
+        return;
+    }
+    if (Contains(term)) {
+        return;
+    }
+    pending_.emplace(term);
+    if (pending_.size() >= std::max(MIN_PENDING_TO_COMPACT, packed_count_ / 8)) {
+        Compact();
+    }
+}
+
+void TermDictionary::Erase(const std::string_view term) {
+    const auto pending_it = pending_.find(term);
+    if (pending_it != pending_.end()) {
+        pending_.erase(pending_it);
+        return;
+    }
+    if (!Contains(term)) {
+        return;
+    }
+    erased_.emplace(term);
+    if (erased_.size() >= std::max(MIN_ERASED_TO_COMPACT, packed_count_ / 8)) {
+        Compact();
+    }
+}
+
+bool TermDictionary::Contains(const std::string_view term) const {
+    if (pending_.count(term) > 0) {
+        return true;
+    }
+    const Cursor it(*this, term);
+    return it.IsValid() && it.Term() == term && erased_.count(term) == 0;
+}
+
+size_t TermDictionary::Size() const {
+    return packed_count_ - erased_.size() + pending_.size();
+}
+
+void TermDictionary::Compact() {
+    if (pending_.empty() && erased_.empty()) {
+        return;
+    }
+    std::vector<std::string> terms;
+    terms.reserve(packed_count_ - erased_.size());
+    for (Cursor it(*this, {}); it.IsValid(); it.Next()) {
+        if (erased_.count(it.Term()) == 0) {
+            terms.push_back(it.Term());
+        }
+    }
+    std::vector<std::string> merged;
+    merged.reserve(terms.size() + pending_.size());
+    std::merge(std::make_move_iterator(terms.begin()), std::make_move_iterator(terms.end()),
+        pending_.begin(), pending_.end(), std::back_inserter(merged));
+
+    std::string data;
+    std::vector<uint32_t> block_offsets;
+    for (size_t i = 0; i < merged.size(); ++i) {
+        size_t shared = 0;
+        if (i % BLOCK_SIZE == 0) {
+            block_offsets.push_back(static_cast<uint32_t>(data.size()));
+        }
+        else {
+            const std::string& prev = merged[i - 1];
+            const size_t max_shared = std::min(prev.size(), merged[i].size());
+            while (shared < max_shared && prev[shared] == merged[i][shared]) {
+                ++shared;
+            }
+        }
+        WriteVarint(data, static_cast<uint32_t>(shared));
+        WriteVarint(data, static_cast<uint32_t>(merged[i].size() - shared));
+        data.append(merged[i], shared, std::string::npos);
+    }
+    data.shrink_to_fit();
+    data_ = std::move(data);
+    block_offsets_ = std::move(block_offsets);
+    packed_count_ = merged.size();
+    pending_.clear();
+    erased_.clear();
+}
+
+TermDictionary::Cursor::Cursor(const TermDictionary& dictionary, const std::string_view from)
+    : dictionary_(dictionary) {
+    if (dictionary_.block_offsets_.empty()) {
+        return;
+    }
+    pos_ = dictionary_.block_offsets_[dictionary_.FindStartBlock(from)];
+    valid_ = true;
+    Next();
+    while (valid_ && term_ < from) {
+        Next();
+    }
+}
+
+bool TermDictionary::Cursor::IsValid() const {
+    return valid_;
+}
+
+const std::string& TermDictionary::Cursor::Term() const {
+    return term_;
+}
+
+void TermDictionary::Cursor::Next() {
+    if (pos_ >= dictionary_.data_.size()) {
+        valid_ = false;
+        return;
+    }
+    dictionary_.ReadEntry(pos_, term_);
+}
+
+void TermDictionary::WriteVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint32_t TermDictionary::ReadVarint(const std::string& data, size_t& pos) {
+    uint32_t value = 0;
+    int shift = 0;
+    while (true) {
+        const auto byte = static_cast<unsigned char>(data[pos++]);
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+void TermDictionary::ReadEntry(size_t& pos, std::string& term) const {
+    const uint32_t shared = ReadVarint(data_, pos);
+    const uint32_t suffix_size = ReadVarint(data_, pos);
+    term.resize(shared);
+    term.append(data_, pos, suffix_size);
+    pos += suffix_size;
+}
+
+size_t TermDictionary::FindStartBlock(const std::string_view value) const {
+    // the last block whose head is < value, the first term >= value is in it or at the next block start
+    size_t lo = 0;
+    size_t hi = block_offsets_.size();
+    std::string head;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        size_t pos = block_offsets_[mid];
+        head.clear();
+        ReadEntry(pos, head);
+        if (head < value) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool TermDictionary::HasPrefix(const std::string_view term, const std::string_view prefix) {
+    return term.size() >= prefix.size() && term.compare(0, prefix.size(), prefix) == 0;
+}
+
+size_t TermDictionary::GetAllocatedBytes() const {
+    size_t bytes = EstimateStringBytes(data_) + EstimateVectorBytes(block_offsets_);
+    for (const std::string& term : pending_) {
+        bytes += EstimateTreeNodeBytes<std::string>() + EstimateStringBytes(term);
+    }
+    for (const std::string& term : erased_) {
+        bytes += EstimateTreeNodeBytes<std::string>() + EstimateStringBytes(term);
+    }
+    return bytes;
+}
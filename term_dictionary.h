@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Sorted dictionary of index terms stored with front coding: terms are packed in blocks,
+// the first term of a block is kept in full, the others as (shared prefix length, suffix).
+// New terms go to a small pending set which is merged into the packed part from time to time.
+// Erased packed terms are kept as tombstones until they are an eighth of the packed terms, then
+// the blocks are rebuilt without them.
+class TermDictionary {
+public:
+    void Insert(const std::string_view term);
+    void Erase(const std::string_view term);
+    bool Contains(const std::string_view term) const;
+    size_t Size() const;
+    // Estimated heap bytes, see index_statistics.h
+    size_t GetAllocatedBytes() const;
+
+    // Merges pending terms into the front-coded blocks and drops the erased ones.
+    void Compact();
+
+    // Calls callback(std::string_view term) for terms starting with prefix in lexicographic order
+    // while it returns true, visiting at most max_scanned of them, erased ones included.
+    // The view is valid only during the call.
+    template <typename Callback>
+    void ForEachWithPrefix(const std::string_view prefix, size_t max_scanned, Callback callback) const;
+
+private:
+    static const size_t BLOCK_SIZE = 16;
+    static const size_t MIN_PENDING_TO_COMPACT = 1024;
+    static const size_t MIN_ERASED_TO_COMPACT = 64;
+
+    std::string data_;    // front-coded blocks
+    std::vector<uint32_t> block_offsets_;
+    size_t packed_count_ = 0;
+    std::set<std::string, std::less<>> pending_;
+    std::set<std::string, std::less<>> erased_;    // packed terms to skip
+
+    // Sequential reader of the packed terms
+    class Cursor {
+    public:
+        Cursor(const TermDictionary& dictionary, const std::string_view from);
+        bool IsValid() const;
+        const std::string& Term() const;
+        void Next();
+
+    private:
+        const TermDictionary& dictionary_;
+        size_t pos_ = 0;
+        bool valid_ = false;
+        std::string term_;
+    };
+
+    static void WriteVarint(std::string& out, uint32_t value);
+    static uint32_t ReadVarint(const std::string& data, size_t& pos);
+
+    // Decodes the entry at pos into term (which holds the previous term of the block), advances pos.
+    void ReadEntry(size_t& pos, std::string& term) const;
+    // Index of the block which may hold the first term >= value
+    size_t FindStartBlock(const std::string_view value) const;
+
+    static bool HasPrefix(const std::string_view term, const std::string_view prefix);
+};
+
+template <typename Callback>
+void TermDictionary::ForEachWithPrefix(const std::string_view prefix, size_t max_scanned, Callback callback) const {
+    Cursor packed_it(*this, prefix);
+    auto pending_it = pending_.lower_bound(prefix);
+    for (size_t scanned = 0; scanned < max_scanned; ++scanned) {
+        const bool packed_left = packed_it.IsValid() && HasPrefix(packed_it.Term(), prefix);
+        const bool pending_left = pending_it != pending_.end() && HasPrefix(*pending_it, prefix);
+        if (!packed_left && !pending_left) {
+            return;
+        }
+        if (!pending_left || (packed_left && packed_it.Term() < *pending_it)) {
+            if (erased_.count(packed_it.Term()) == 0 && !callback(std::string_view(packed_it.Term()))) {
+                return;
+            }
+            packed_it.Next();
+        }
+        else {
+            if (!callback(std::string_view(*pending_it))) {
+                return;
+            }
+            ++pending_it;
+        }
+    }
+}
@@ -0,0 +1,277 @@
+#include "text_normalizer.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+    // Decodes the code point at pos, invalid sequences decode as their first byte
+    char32_t DecodeCodePoint(const std::string_view text, size_t pos, size_t& length) {
+        const unsigned char lead = static_cast<unsigned char>(text[pos]);
+        size_t size = 1;
+        char32_t code_point = lead;
+        if (lead >= 0xC2 && lead < 0xE0) {
+            size = 2;
+            code_point = lead & 0x1F;
+        }
+        else if (lead >= 0xE0 && lead < 0xF0) {
+            size = 3;
+            code_point = lead & 0x0F;
+        }
+        else if (lead >= 0xF0 && lead < 0xF5) {
+            size = 4;
+            code_point = lead & 0x07;
+        }
+        if (size == 1 || pos + size > text.size()) {
+            length = 1;
+            return lead;
+        }
+        for (size_t i = 1; i < size; ++i) {
+            const unsigned char next = static_cast<unsigned char>(text[pos + i]);
+            if ((next & 0xC0) != 0x80) {
+                length = 1;
+                return lead;
+            }
+            code_point = (code_point << 6) | (next & 0x3F);
+        }
+        length = size;
+        return code_point;
+    }
+
+    void AppendCodePoint(char32_t code_point, std::string& out) {
+        if (code_point < 0x80) {
+            out.push_back(static_cast<char>(code_point));
+        }
+        else if (code_point < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+        else if (code_point < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+        else {
+            out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+    }
+
+    // Simple (one to one) case folding of the Unicode tables for Latin-1, Latin Extended-A, Greek and Cyrillic
+    char32_t FoldCodePoint(char32_t c) {
+        if (c < 0x80) {
+            return c >= 'A' && c <= 'Z' ? c + 32 : c;
+        }
+        if (c < 0x100) {
+            return c >= 0xC0 && c <= 0xDE && c != 0xD7 ? c + 32 : c == 0xB5 ? 0x3BC : c;
+        }
+        if (c < 0x180) {
+            if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149) {
+                return c;
+            }
+            if (c == 0x178) {
+                return 0xFF;
+            }
+            if (c == 0x17F) {
+                return 's';
+            }
+            const bool odd_is_upper = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+            return (c % 2 == 1) == odd_is_upper ? c + 1 : c;
+        }
+        if (c >= 0x386 && c <= 0x3AB) {
+            if (c == 0x386) {
+                return 0x3AC;
+            }
+            if (c >= 0x388 && c <= 0x38A) {
+                return c + 37;
+            }
+            if (c == 0x38C) {
+                return 0x3CC;
+            }
+            if (c == 0x38E || c == 0x38F) {
+                return c + 63;
+            }
+            return c >= 0x391 && c != 0x3A2 ? c + 32 : c;
+        }
+        if (c == 0x3C2) {
+            return 0x3C3;    // final sigma
+        }
+        if (c >= 0x400 && c < 0x530) {
+            if (c < 0x410) {
+                return c + 80;
+            }
+            if (c < 0x430) {
+                return c + 32;
+            }
+            if (c == 0x4C0) {
+                return 0x4CF;
+            }
+            if (c >= 0x4C1 && c <= 0x4CE) {
+                return c % 2 == 1 ? c + 1 : c;
+            }
+            if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || c >= 0x4D0) {
+                return c % 2 == 0 ? c + 1 : c;
+            }
+        }
+        return c;
+    }
+
+    // Punctuation other than '-' and '*', which are query operators
+    bool IsPunctuation(char32_t c) {
+        if (c < 0x80) {
+            return (c >= '!' && c <= '/' && c != '-' && c != '*') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`')
+                || (c >= '{' && c <= '~');
+        }
+        return c == 0xA0 || c == 0xA1 || c == 0xA7 || c == 0xAB || c == 0xB6 || c == 0xB7 || c == 0xBB || c == 0xBF
+            || (c >= 0x2000 && c <= 0x206F) || (c >= 0x3000 && c <= 0x303F);
+    }
+
+    bool EndsWith(const std::string_view word, const std::string_view suffix) {
+        return word.size() >= suffix.size() && word.substr(word.size() - suffix.size()) == suffix;
+    }
+
+    size_t CountCodePoints(const std::string_view text) {
+        return std::count_if(text.begin(), text.end(), [](char c) { return (static_cast<unsigned char>(c) & 0xC0) != 0x80; });
+    }
+
+    // Russian inflection endings, longest first
+    const std::array<std::string_view, 47> RUSSIAN_ENDINGS = {
+        "иями", "ями", "ами", "ией", "ием", "иях", "ого", "его", "ому", "ему", "ыми", "ими",
+        "ая", "яя", "ое", "ее", "ой", "ей", "ий", "ый", "ом", "ем", "ам", "ям", "ах", "ях", "ов", "ев",
+        "ую", "юю", "ых", "их", "ию", "ия", "ье", "ья", "ью",
+        "а", "я", "о", "е", "и", "ы", "у", "ю", "ь", "й",
+    };
+    const size_t MIN_STEM_CODE_POINTS = 3;
+
+    // Length of the stem of word: English plurals (Harman's S-stemmer), Russian endings
+    size_t StemLength(const std::string_view word) {
+        if (word.empty()) {
+            return 0;
+        }
+        if (static_cast<unsigned char>(word.back()) < 0x80) {
+            if (word.size() > 4 && EndsWith(word, "ies") && !EndsWith(word, "eies") && !EndsWith(word, "aies")) {
+                return word.size() - 2;    // the caller turns "ies" into "y"
+            }
+            if (word.size() > 3 && EndsWith(word, "es") && !EndsWith(word, "aes") && !EndsWith(word, "ees") && !EndsWith(word, "oes")) {
+                return word.size() - 1;
+            }
+            if (word.size() > 3 && word.back() == 's' && !EndsWith(word, "us") && !EndsWith(word, "ss")) {
+                return word.size() - 1;
+            }
+            return word.size();
+        }
+        for (const std::string_view ending : RUSSIAN_ENDINGS) {
+            if (EndsWith(word, ending)) {
+                const std::string_view stem = word.substr(0, word.size() - ending.size());
+                if (CountCodePoints(stem) >= MIN_STEM_CODE_POINTS) {
+                    return stem.size();
+                }
+            }
+        }
+        return word.size();
+    }
+
+}  // namespace
+
+TextNormalizer::TextNormalizer(NormalizationOptions options)
+    : options_(options) {
+}
+
+const NormalizationOptions& TextNormalizer::GetOptions() const {
+    return options_;
+}
+
+bool TextNormalizer::IsIdentity() const {
+    return !options_.fold_case && !options_.split_punctuation && !options_.stem;
+}
+
+std::string_view TextNormalizer::Normalize(const std::string_view text, std::string& buffer) const {
+    if (IsIdentity()) {
+        return text;
+    }
+    buffer.clear();
+    buffer.reserve(text.size());
+    size_t word_begin = 0;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t length = 1;
+        const char32_t code_point = DecodeCodePoint(text, pos, length);
+        if (code_point == ' ' || (options_.split_punctuation && IsPunctuation(code_point))) {
+            if (pos > word_begin) {
+                AppendWord(text.substr(word_begin, pos - word_begin), buffer);
+            }
+            word_begin = pos + length;
+        }
+        pos += length;
+    }
+    if (word_begin < text.size()) {
+        AppendWord(text.substr(word_begin), buffer);
+    }
+    if (!buffer.empty() && buffer.back() == ' ') {
+        buffer.pop_back();
+    }
+    return buffer;
+}
+
+void TextNormalizer::AppendWord(std::string_view word, std::string& out) const {
+    // split further at operators out of place: '-' not before a word character, '*' not at the end
+    if (options_.split_punctuation) {
+        for (size_t i = 0; i < word.size(); ++i) {
+            const bool misplaced_minus = word[i] == '-' && (i + 1 == word.size() || word[i + 1] == '-' || word[i + 1] == '*');
+            const bool misplaced_star = word[i] == '*' && (i + 1 < word.size() || i == 0 || word[i - 1] == '-');
+            if (misplaced_minus || misplaced_star) {
+                if (i > 0) {
+                    AppendWord(word.substr(0, i), out);
+                }
+                AppendWord(word.substr(i + 1), out);
+                return;
+            }
+        }
+    }
+    if (word.empty()) {
+        return;
+    }
+
+    const size_t begin = out.size();
+    if (options_.fold_case) {
+        FoldCase(word, out);
+    }
+    else {
+        out.append(word);
+    }
+    const std::string_view written = std::string_view(out).substr(begin);
+    if (options_.stem && written.back() != '*') {
+        const size_t operator_size = written.front() == '-' ? 1 : 0;
+        const std::string_view body = written.substr(operator_size);
+        const size_t stem_length = StemLength(body);
+        if (stem_length < body.size()) {
+            const bool ies = EndsWith(body, "ies") && stem_length == body.size() - 2;
+            out.resize(begin + operator_size + stem_length);
+            if (ies) {
+                out.back() = 'y';
+            }
+        }
+    }
+    out.push_back(' ');
+}
+
+void FoldCase(const std::string_view text, std::string& out) {
+    for (size_t pos = 0; pos < text.size();) {
+        const unsigned char byte = static_cast<unsigned char>(text[pos]);
+        if (byte < 0x80) {
+            out.push_back(byte >= 'A' && byte <= 'Z' ? static_cast<char>(byte + 32) : static_cast<char>(byte));
+            ++pos;
+            continue;
+        }
+        size_t length = 1;
+        const char32_t code_point = DecodeCodePoint(text, pos, length);
+        if (length == 1) {
+            out.push_back(static_cast<char>(byte));
+        }
+        else {
+            AppendCodePoint(FoldCodePoint(code_point), out);
+        }
+        pos += length;
+    }
+}
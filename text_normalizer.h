@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+struct NormalizationOptions {
+    // UTF-8 simple case folding of Latin, Greek and Cyrillic letters
+    bool fold_case = false;
+    // ASCII and Unicode punctuation separates words. '-' is kept before a letter or digit
+    // (minus words, "e-mail") and '*' after one (prefix words).
+    bool split_punctuation = false;
+    // Strips common English plural and Russian inflection endings, prefix words ("word*") are kept
+    bool stem = false;
+};
+
+// Normalization shared by documents, queries and stop words. The output is the words of the
+// text separated by single spaces; with no option set the text is used as is.
+class TextNormalizer {
+public:
+    explicit TextNormalizer(NormalizationOptions options = {});
+
+    const NormalizationOptions& GetOptions() const;
+    bool IsIdentity() const;
+
+    // Returns text itself for the identity normalizer, otherwise the normalized text written to buffer
+    std::string_view Normalize(const std::string_view text, std::string& buffer) const;
+
+private:
+    NormalizationOptions options_;
+
+    void AppendWord(std::string_view word, std::string& out) const;
+};
+
+// Appends text to out with the letters case folded; other bytes, invalid UTF-8 included, are copied
+void FoldCase(const std::string_view text, std::string& out);
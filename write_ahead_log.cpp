@@ -0,0 +1,561 @@
+#include "write_ahead_log.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+    const std::string_view LOG_MAGIC = "YCMWAL01";
+    const std::string_view SNAPSHOT_MAGIC = "YCMSNP01";
+    const size_t FRAME_HEADER_SIZE = 8;    // payload size, CRC-32
+
+    std::array<uint32_t, 256> MakeCrcTable() {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320u : 0u);
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    // CRC-32 (IEEE)
+    uint32_t ComputeCrc32(const std::string_view data) {
+        static const std::array<uint32_t, 256> table = MakeCrcTable();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (const char c : data) {
+            crc = table[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    void AppendU32(std::string& out, uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            out.push_back(static_cast<char>((value >> shift) & 0xFF));
+        }
+    }
+
+    void AppendFrame(std::string& out, const std::string_view payload) {
+        AppendU32(out, static_cast<uint32_t>(payload.size()));
+        AppendU32(out, ComputeCrc32(payload));
+        out.append(payload);
+    }
+
+    void WriteRecordPayload(MessageWriter& writer, const WalRecord& record) {
+        writer.WriteU64(record.sequence);
+        writer.WriteU8(static_cast<uint8_t>(record.type));
+        writer.WriteI32(record.document_id);
+        if (record.type == WalRecordType::ADD_DOCUMENT) {
+            writer.WriteU8(static_cast<uint8_t>(record.status));
+            writer.WriteU32(static_cast<uint32_t>(record.ratings.size()));
+            for (const int rating : record.ratings) {
+                writer.WriteI32(rating);
+            }
+            writer.WriteString(record.text);
+        }
+        else if (record.type == WalRecordType::SET_STATUS) {
+            writer.WriteU8(static_cast<uint8_t>(record.status));
+        }
+        else if (record.type == WalRecordType::SET_RATING) {
+            writer.WriteI32(record.ratings.at(0));
+        }
+    }
+
+    // Throws std::runtime_error on malformed payloads
+    WalRecord ReadRecordPayload(const std::string_view payload) {
+        MessageReader reader(payload);
+        WalRecord record;
+        record.sequence = reader.ReadU64();
+        record.type = static_cast<WalRecordType>(reader.ReadU8());
+        record.document_id = reader.ReadI32();
+        if (record.type == WalRecordType::ADD_DOCUMENT) {
+            record.status = reader.ReadStatus();
+            record.ratings.resize(reader.ReadU32());
+            for (int& rating : record.ratings) {
+                rating = reader.ReadI32();
+            }
+            record.text = std::string(reader.ReadString());
+        }
+        else if (record.type == WalRecordType::SET_STATUS) {
+            record.status = reader.ReadStatus();
+        }
+        else if (record.type == WalRecordType::SET_RATING) {
+            record.ratings = { reader.ReadI32() };
+        }
+        else if (record.type != WalRecordType::REMOVE_DOCUMENT) {
+            throw std::runtime_error("Error: unknown WAL record type."s);
+        }
+        if (!reader.AtEnd()) {
+            throw std::runtime_error("Error: trailing bytes in WAL record."s);
+        }
+        return record;
+    }
+
+    struct LoadedFile {
+        bool exists = false;
+        uint64_t snapshot_sequence = 0;
+        std::vector<WalRecord> records;
+        size_t valid_size = 0;    // bytes up to the end of the last complete record
+    };
+
+    // Frames are located sequentially, then verified and decoded in parallel;
+    // everything from the first damaged frame on is dropped
+    LoadedFile LoadFile(const std::string& path, const std::string_view magic) {
+        LoadedFile result;
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            return result;
+        }
+        const std::string data{ std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>() };
+        result.exists = true;
+        if (data.compare(0, magic.size(), magic) != 0) {
+            if (data.size() >= magic.size()) {
+                throw std::runtime_error("Error: "s + path + " is not a "s + std::string(magic) + " file."s);
+            }
+            return result;
+        }
+        size_t pos = magic.size();
+        if (magic == SNAPSHOT_MAGIC) {
+            if (data.size() < pos + 8) {
+                throw std::runtime_error("Error: truncated snapshot "s + path);
+            }
+            result.snapshot_sequence = MessageReader(std::string_view(data).substr(pos, 8)).ReadU64();
+            pos += 8;
+        }
+        result.valid_size = pos;
+
+        std::vector<std::string_view> payloads;
+        std::vector<uint32_t> checksums;
+        while (data.size() - pos >= FRAME_HEADER_SIZE) {
+            MessageReader header(std::string_view(data).substr(pos, FRAME_HEADER_SIZE));
+            const uint32_t size = header.ReadU32();
+            const uint32_t checksum = header.ReadU32();
+            if (data.size() - pos - FRAME_HEADER_SIZE < size) {
+                break;
+            }
+            payloads.push_back(std::string_view(data).substr(pos + FRAME_HEADER_SIZE, size));
+            checksums.push_back(checksum);
+            pos += FRAME_HEADER_SIZE + size;
+        }
+
+        std::vector<uint8_t> valid(payloads.size());
+        result.records.resize(payloads.size());
+        std::vector<size_t> indexes(payloads.size());
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+            if (ComputeCrc32(payloads[i]) != checksums[i]) {
+                return;
+            }
+            try {
+                result.records[i] = ReadRecordPayload(payloads[i]);
+                valid[i] = 1;
+            }
+            catch (const std::runtime_error&) {
+            }
+            });
+        const size_t valid_count = std::find(valid.begin(), valid.end(), 0) - valid.begin();
+        result.records.resize(valid_count);
+        if (valid_count > 0) {
+            const std::string_view& last = payloads[valid_count - 1];
+            result.valid_size = static_cast<size_t>(last.data() - data.data()) + last.size();
+        }
+        return result;
+    }
+
+#if defined(_WIN32)
+    int OpenFile(const std::string& path, bool append) {
+        int fd = -1;
+        _sopen_s(&fd, path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC), _SH_DENYNO, _S_IREAD | _S_IWRITE);
+        return fd;
+    }
+    void WriteAll(int fd, const std::string_view data) {
+        for (size_t done = 0; done < data.size();) {
+            const int n = _write(fd, data.data() + done, static_cast<unsigned>(std::min<size_t>(data.size() - done, 1 << 30)));
+            if (n <= 0) {
+                throw std::runtime_error("Error: WAL write failed."s);
+            }
+            done += n;
+        }
+    }
+    void SyncFile(int fd) {
+        if (_commit(fd) != 0) {
+            throw std::runtime_error("Error: WAL sync failed."s);
+        }
+    }
+    void TruncateFile(int fd, size_t size) {
+        if (_chsize_s(fd, static_cast<__int64>(size)) != 0) {
+            throw std::runtime_error("Error: WAL truncate failed."s);
+        }
+    }
+    void CloseFile(int fd) {
+        _close(fd);
+    }
+    void SyncDirectory(const std::string&) {
+    }
+#else
+    int OpenFile(const std::string& path, bool append) {
+        return ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+    }
+    void WriteAll(int fd, const std::string_view data) {
+        for (size_t done = 0; done < data.size();) {
+            const ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw std::runtime_error("Error: WAL write failed."s);
+            }
+            done += n;
+        }
+    }
+    void SyncFile(int fd) {
+#if defined(__linux__)
+        const int result = ::fdatasync(fd);
+#else
+        const int result = ::fsync(fd);
+#endif
+        if (result != 0) {
+            throw std::runtime_error("Error: WAL sync failed."s);
+        }
+    }
+    void TruncateFile(int fd, size_t size) {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            throw std::runtime_error("Error: WAL truncate failed."s);
+        }
+    }
+    void CloseFile(int fd) {
+        ::close(fd);
+    }
+    // makes a rename in the directory durable
+    void SyncDirectory(const std::string& path) {
+        const std::string directory = std::filesystem::path(path).parent_path().string();
+        const int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+#endif
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, uint64_t last_sequence)
+    : path_(path) {
+    const LoadedFile existing = LoadFile(path, LOG_MAGIC);
+    fd_ = OpenFile(path, true);
+    if (fd_ < 0) {
+        throw std::runtime_error("Error: cannot open WAL "s + path);
+    }
+    if (existing.valid_size == 0) {
+        TruncateFile(fd_, 0);
+        WriteAll(fd_, LOG_MAGIC);
+    }
+    else {
+        TruncateFile(fd_, existing.valid_size);
+    }
+    SyncFile(fd_);
+    if (!existing.records.empty()) {
+        last_sequence = std::max(last_sequence, existing.records.back().sequence);
+    }
+    next_sequence_ = last_sequence + 1;
+    durable_sequence_ = last_sequence;
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    try {
+        WaitDurable(GetLastSequence());
+    }
+    catch (const std::exception&) {
+    }
+    CloseFile(fd_);
+}
+
+uint64_t WriteAheadLog::AppendAdd(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    std::lock_guard lock(mutex_);
+    const uint64_t sequence = next_sequence_;
+    record_writer_.Clear();
+    record_writer_.WriteU64(sequence);
+    record_writer_.WriteU8(static_cast<uint8_t>(WalRecordType::ADD_DOCUMENT));
+    record_writer_.WriteI32(document_id);
+    record_writer_.WriteU8(static_cast<uint8_t>(status));
+    record_writer_.WriteU32(static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        record_writer_.WriteI32(rating);
+    }
+    record_writer_.WriteString(document);
+    FramePendingRecord();
+    return sequence;
+}
+
+uint64_t WriteAheadLog::AppendRemove(int document_id) {
+    std::lock_guard lock(mutex_);
+    const uint64_t sequence = next_sequence_;
+    record_writer_.Clear();
+    record_writer_.WriteU64(sequence);
+    record_writer_.WriteU8(static_cast<uint8_t>(WalRecordType::REMOVE_DOCUMENT));
+    record_writer_.WriteI32(document_id);
+    FramePendingRecord();
+    return sequence;
+}
+
+uint64_t WriteAheadLog::AppendSetStatus(int document_id, DocumentStatus status) {
+    std::lock_guard lock(mutex_);
+    const uint64_t sequence = next_sequence_;
+    record_writer_.Clear();
+    record_writer_.WriteU64(sequence);
+    record_writer_.WriteU8(static_cast<uint8_t>(WalRecordType::SET_STATUS));
+    record_writer_.WriteI32(document_id);
+    record_writer_.WriteU8(static_cast<uint8_t>(status));
+    FramePendingRecord();
+    return sequence;
+}
+
+uint64_t WriteAheadLog::AppendSetRating(int document_id, int rating) {
+    std::lock_guard lock(mutex_);
+    const uint64_t sequence = next_sequence_;
+    record_writer_.Clear();
+    record_writer_.WriteU64(sequence);
+    record_writer_.WriteU8(static_cast<uint8_t>(WalRecordType::SET_RATING));
+    record_writer_.WriteI32(document_id);
+    record_writer_.WriteI32(rating);
+    FramePendingRecord();
+    return sequence;
+}
+
+void WriteAheadLog::FramePendingRecord() {
+    CheckNotFailed();
+    AppendFrame(pending_, record_writer_.GetData());
+    ++next_sequence_;
+    ++stats_.records;
+    stats_.bytes += FRAME_HEADER_SIZE + record_writer_.GetData().size();
+}
+
+void WriteAheadLog::WaitDurable(uint64_t sequence) {
+    std::unique_lock lock(mutex_);
+    while (durable_sequence_ < sequence) {
+        CheckNotFailed();
+        if (commit_in_progress_) {
+            committed_.wait(lock);
+            continue;
+        }
+        // this caller commits everything appended so far for all waiters
+        commit_in_progress_ = true;
+        writing_.clear();
+        writing_.swap(pending_);
+        const uint64_t batch_sequence = next_sequence_ - 1;
+        lock.unlock();
+        try {
+            WriteAll(fd_, writing_);
+            SyncFile(fd_);
+        }
+        catch (...) {
+            // the batch may be partly written, so no later record may follow it in the file
+            lock.lock();
+            failed_ = true;
+            commit_in_progress_ = false;
+            committed_.notify_all();
+            throw;
+        }
+        lock.lock();
+        commit_in_progress_ = false;
+        durable_sequence_ = batch_sequence;
+        ++stats_.commits;
+        committed_.notify_all();
+    }
+}
+
+uint64_t WriteAheadLog::GetLastSequence() const {
+    std::lock_guard lock(mutex_);
+    return next_sequence_ - 1;
+}
+
+uint64_t WriteAheadLog::GetDurableSequence() const {
+    std::lock_guard lock(mutex_);
+    return durable_sequence_;
+}
+
+void WriteAheadLog::DropRecordsUpTo(uint64_t sequence) {
+    WaitDurable(sequence);
+    std::unique_lock lock(mutex_);
+    committed_.wait(lock, [this]() { return !commit_in_progress_; });
+    CheckNotFailed();
+    // no commit touches the file until the new one is in place
+    commit_in_progress_ = true;
+    lock.unlock();
+
+    const auto finish = [&](bool failed) {
+        lock.lock();
+        failed_ = failed_ || failed;
+        commit_in_progress_ = false;
+        committed_.notify_all();
+    };
+    std::string data(LOG_MAGIC);
+    const std::string temporary_path = path_ + ".tmp"s;
+    try {
+        MessageWriter writer;
+        for (const WalRecord& record : LoadFile(path_, LOG_MAGIC).records) {
+            if (record.sequence > sequence) {
+                writer.Clear();
+                WriteRecordPayload(writer, record);
+                AppendFrame(data, writer.GetData());
+            }
+        }
+        const int fd = OpenFile(temporary_path, false);
+        if (fd < 0) {
+            throw std::runtime_error("Error: cannot write WAL "s + temporary_path);
+        }
+        try {
+            WriteAll(fd, data);
+            SyncFile(fd);
+        }
+        catch (...) {
+            CloseFile(fd);
+            throw;
+        }
+        CloseFile(fd);
+    }
+    catch (...) {
+        finish(false);
+        throw;
+    }
+    // the file is replaced while closed, so renaming works where open files cannot be replaced
+    CloseFile(fd_);
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path_, error);
+    SyncDirectory(path_);
+    fd_ = OpenFile(path_, true);
+    finish(fd_ < 0);
+    if (error || fd_ < 0) {
+        throw std::runtime_error("Error: cannot replace WAL "s + path_);
+    }
+}
+
+void WriteAheadLog::CheckNotFailed() const {
+    if (failed_) {
+        throw std::runtime_error("Error: WAL "s + path_ + " failed, records after "s + std::to_string(durable_sequence_)
+            + " are not durable."s);
+    }
+}
+
+WalStats WriteAheadLog::GetStats() const {
+    std::lock_guard lock(mutex_);
+    return stats_;
+}
+
+std::vector<WalRecord> ReadWalRecords(const std::string& path) {
+    return LoadFile(path, LOG_MAGIC).records;
+}
+
+std::string MakeSnapshot(const SearchServer& search_server, uint64_t sequence) {
+    std::string data(SNAPSHOT_MAGIC);
+    MessageWriter writer;
+    writer.WriteU64(sequence);
+    data += writer.GetData();
+    WalRecord record;
+    record.sequence = sequence;
+    for (const int document_id : search_server) {
+        record.document_id = document_id;
+        record.status = search_server.GetDocumentStatus(document_id);
+        record.ratings = { search_server.GetDocumentRating(document_id) };
+        record.text = search_server.GetDocumentText(document_id);
+        writer.Clear();
+        WriteRecordPayload(writer, record);
+        AppendFrame(data, writer.GetData());
+    }
+    return data;
+}
+
+void WriteSnapshot(const std::string& snapshot, WriteAheadLog& log, const std::string& snapshot_path) {
+    const uint64_t sequence = MessageReader(std::string_view(snapshot).substr(SNAPSHOT_MAGIC.size(), 8)).ReadU64();
+    const std::string temporary_path = snapshot_path + ".tmp"s;
+    const int fd = OpenFile(temporary_path, false);
+    if (fd < 0) {
+        throw std::runtime_error("Error: cannot write snapshot "s + temporary_path);
+    }
+    try {
+        WriteAll(fd, snapshot);
+        SyncFile(fd);
+    }
+    catch (...) {
+        CloseFile(fd);
+        throw;
+    }
+    CloseFile(fd);
+    std::filesystem::rename(temporary_path, snapshot_path);
+    SyncDirectory(snapshot_path);
+    // the records are in the snapshot now
+    log.DropRecordsUpTo(sequence);
+}
+
+void WriteCheckpoint(const SearchServer& search_server, WriteAheadLog& log, const std::string& snapshot_path) {
+    WriteSnapshot(MakeSnapshot(search_server, log.GetLastSequence()), log, snapshot_path);
+}
+
+uint64_t RecoverSearchServer(SearchServer& search_server, const std::string& snapshot_path, const std::string& log_path) {
+    if (search_server.GetDocumentCount() > 0) {
+        throw std::invalid_argument("Error: recovery needs an empty SearchServer."s);
+    }
+    LoadedFile snapshot = LoadFile(snapshot_path, SNAPSHOT_MAGIC);
+    LoadedFile log = LoadFile(log_path, LOG_MAGIC);
+    uint64_t last_sequence = snapshot.snapshot_sequence;
+
+    // snapshot then newer log records; the last add or remove of an id decides whether the document exists
+    std::vector<WalRecord>& records = snapshot.records;
+    for (WalRecord& record : log.records) {
+        if (record.sequence > snapshot.snapshot_sequence) {
+            last_sequence = std::max(last_sequence, record.sequence);
+            records.push_back(std::move(record));
+        }
+    }
+    std::unordered_map<int, size_t> last_record;
+    last_record.reserve(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        WalRecord& record = records[i];
+        if (record.type == WalRecordType::ADD_DOCUMENT || record.type == WalRecordType::REMOVE_DOCUMENT) {
+            last_record[record.document_id] = i;
+            continue;
+        }
+        // updates of a document apply to its latest add, updates of removed ids are dropped
+        const auto it = last_record.find(record.document_id);
+        if (it == last_record.end() || records[it->second].type != WalRecordType::ADD_DOCUMENT) {
+            continue;
+        }
+        WalRecord& added = records[it->second];
+        if (record.type == WalRecordType::SET_STATUS) {
+            added.status = record.status;
+        }
+        else {
+            added.ratings = std::move(record.ratings);
+        }
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        const WalRecord& record = records[i];
+        if (record.type == WalRecordType::ADD_DOCUMENT && last_record.at(record.document_id) == i) {
+            search_server.AddDocument(record.document_id, record.text, record.status, record.ratings);
+        }
+    }
+    return last_sequence;
+}
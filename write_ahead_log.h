@@ -0,0 +1,111 @@
+#pragma once
+
+#include "document.h"
+#include "shard_protocol.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class SearchServer;
+
+// Append-only log of index updates. Every record is framed as
+// uint32 payload size, uint32 CRC-32 of the payload, payload (see WalRecord);
+// a torn or corrupt tail is dropped when the log is read or reopened.
+// Appends only buffer records; WaitDurable writes and syncs them. Callers waiting at the same time
+// share one write and one fsync (group commit), and the file lock is not held while syncing.
+// A failed write or sync leaves the log failed: the file may end with a torn frame and the state
+// of its cached pages is unknown, so later appends and waits for newer records throw
+// std::runtime_error. Reopening the log drops the torn tail.
+
+enum class WalRecordType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT,
+    SET_STATUS,
+    SET_RATING,
+};
+
+struct WalRecord {
+    uint64_t sequence = 0;
+    WalRecordType type = WalRecordType::ADD_DOCUMENT;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;    // ADD_DOCUMENT and SET_STATUS
+    std::vector<int> ratings;    // ADD_DOCUMENT, the single rating of SET_RATING
+    std::string text;
+};
+
+struct WalStats {
+    uint64_t records = 0;
+    uint64_t commits = 0;    // writes followed by fsync
+    uint64_t bytes = 0;
+};
+
+class WriteAheadLog {
+public:
+    // Opens or creates the log, dropping a torn tail. Sequence numbers continue after the last
+    // record and after last_sequence (the sequence covered by a checkpoint).
+    explicit WriteAheadLog(const std::string& path, uint64_t last_sequence = 0);
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    // Syncs buffered records
+    ~WriteAheadLog();
+
+    // Buffer a record and return its sequence number
+    uint64_t AppendAdd(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    uint64_t AppendRemove(int document_id);
+    uint64_t AppendSetStatus(int document_id, DocumentStatus status);
+    uint64_t AppendSetRating(int document_id, int rating);
+
+    // Returns when the record with the sequence number is on stable storage
+    void WaitDurable(uint64_t sequence);
+    uint64_t GetLastSequence() const;
+    // Sequence number of the last record on stable storage
+    uint64_t GetDurableSequence() const;
+
+    // Removes the records up to sequence, which must be covered by a durable checkpoint, by
+    // rewriting the newer ones to a new file. Appends go on meanwhile, commits wait.
+    void DropRecordsUpTo(uint64_t sequence);
+
+    WalStats GetStats() const;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    mutable std::mutex mutex_;
+    std::condition_variable committed_;
+    MessageWriter record_writer_;
+    std::string pending_;    // framed records not yet written
+    std::string writing_;    // batch of the commit in flight, keeps its capacity
+    uint64_t next_sequence_ = 1;
+    uint64_t durable_sequence_ = 0;
+    bool commit_in_progress_ = false;
+    bool failed_ = false;
+    WalStats stats_;
+
+    // Frames the record in record_writer_ into pending_, mutex_ held
+    void FramePendingRecord();
+    // Throws if an earlier commit failed, mutex_ held
+    void CheckNotFailed() const;
+};
+
+// Complete records of a log or snapshot file in order, empty if the file does not exist
+std::vector<WalRecord> ReadWalRecords(const std::string& path);
+
+// Every document of search_server serialized as a snapshot covering the log records up to sequence.
+// Writers must be stopped for the duration; readers may continue.
+std::string MakeSnapshot(const SearchServer& search_server, uint64_t sequence);
+// Writes the snapshot to snapshot_path (atomically replaced), then drops the log records it covers.
+// Writers may go on.
+void WriteSnapshot(const std::string& snapshot, WriteAheadLog& log, const std::string& snapshot_path);
+// Both for the records of log up to its last sequence; writers must be stopped for the duration
+void WriteCheckpoint(const SearchServer& search_server, WriteAheadLog& log, const std::string& snapshot_path);
+
+// Loads the snapshot and replays the newer log records into an empty search_server.
+// Records are decoded and verified in parallel and superseded ones are skipped; status and
+// rating updates are folded into the add record of their document. The remaining documents
+// are indexed one by one, since SearchServer::AddDocument is not thread-safe.
+// Returns the last recovered sequence number for the WriteAheadLog constructor.
+uint64_t RecoverSearchServer(SearchServer& search_server, const std::string& snapshot_path, const std::string& log_path);
@@ -1,11 +1,29 @@
 ﻿#include "search_server.h"
 #include "log_duration.h"
+#include "shard_node.h"
+#include "shard_broker.h"
+#include "query_server.h"
+#include "benchmark.h"
+#include "write_ahead_log.h"
+#include "stage_profiler.h"
+#include "request_queue.h"
+#include <algorithm>
+#include <chrono>
 #include <execution>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 string GenerateWord(mt19937& generator, int max_length) {
     const int length = uniform_int_distribution(1, max_length)(generator);
@@ -58,14 +76,349 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
     cout << total_relevance << endl;
 }
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
-int main() {
+
+// shard <endpoint> [stop words]: serves one index shard for a broker
+int RunShard(const vector<string>& args) {
+    if (args.size() < 2) {
+        cerr << "usage: shard <tcp:host:port|unix:path> [stop words]"s << endl;
+        return 1;
+    }
+    ShardNode node(args.size() > 2 ? args[2] : ""s);
+    SocketListener listener(args[1]);
+    node.Serve(listener);
+    return 0;
+}
+
+ShardBroker ConnectBroker(const vector<string>& endpoints) {
+    // shards may still be starting
+    for (int attempt = 0;; ++attempt) {
+        try {
+            return ShardBroker(endpoints);
+        }
+        catch (const runtime_error&) {
+            if (attempt == 100) {
+                throw;
+            }
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+    }
+}
+
+// cluster [shards] [documents] [queries]: starts shard processes on unix sockets, loads them through
+// a broker, checks results against a single SearchServer and reports scatter-gather latency
+int RunClusterDemo(const vector<string>& args) {
+#if defined(_WIN32)
+    cerr << "cluster demo needs fork() and unix sockets"s << endl;
+    return 1;
+#else
+    const int shard_count = args.size() > 1 ? stoi(args[1]) : 4;
+    const int document_count = args.size() > 2 ? stoi(args[2]) : 10'000;
+    const int query_count = args.size() > 3 ? stoi(args[3]) : 1'000;
+
     mt19937 generator;
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
-    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
-    SearchServer search_server(dictionary[0]);
-    for (size_t i = 0; i < documents.size(); ++i) {
+    const auto documents = GenerateQueries(generator, dictionary, document_count, 70);
+    const auto queries = GenerateQueries(generator, dictionary, query_count, 7);
+
+    vector<string> endpoints;
+    vector<pid_t> children;
+    for (int i = 0; i < shard_count; ++i) {
+        endpoints.push_back("unix:/tmp/y_cpp_my_"s + to_string(getpid()) + "_"s + to_string(i) + ".sock"s);
+        const pid_t pid = fork();
+        if (pid == 0) {
+            ShardNode node(dictionary[0]);
+            SocketListener listener(endpoints.back());
+            node.Serve(listener);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    SearchServer reference(dictionary[0]);
+    ShardBroker broker = ConnectBroker(endpoints);
+    {
+        LOG_DURATION("cluster add"s);
+        for (int i = 0; i < document_count; ++i) {
+            broker.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+            reference.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    }
+    int mismatches = 0;
+    chrono::steady_clock::duration reference_time{};
+    for (const string& query : queries) {
+        const auto start_time = chrono::steady_clock::now();
+        const auto expected = reference.FindTopDocuments(query);
+        reference_time += chrono::steady_clock::now() - start_time;
+        const auto actual = broker.FindTopDocuments(query);
+        const bool same = expected.size() == actual.size() && equal(expected.begin(), expected.end(), actual.begin(),
+            [](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; });
+        mismatches += same ? 0 : 1;
+    }
+    const ScatterGatherReport report = broker.GetScatterGatherReport();
+    cout << "shards: "s << shard_count << ", documents: "s << document_count << ", queries: "s << report.query_count << endl;
+    cout << "results differing from a single server: "s << mismatches << endl;
+    cout << "single server mean: "s << chrono::duration_cast<chrono::microseconds>(reference_time).count() / max(query_count, 1) << " us"s << endl;
+    cout << "scatter-gather p50: "s << report.p50_us << " us, p99: "s << report.p99_us << " us, p999: "s << report.p999_us
+        << " us, max: "s << report.max_us << " us"s << endl;
+    cout << "broker serialization share: "s << report.serialization_share * 100.0 << " %"s << endl;
+    cout << "bytes sent: "s << report.bytes_sent << ", received: "s << report.bytes_received << endl;
+
+    broker.Shutdown();
+    for (const pid_t pid : children) {
+        waitpid(pid, nullptr, 0);
+    }
+    return mismatches == 0 ? 0 : 1;
+#endif
+}
+
+// Generated corpus of the demos: 1000 words dictionary, documents of 70 words
+void AddGeneratedDocuments(SearchServer& search_server, mt19937& generator, const vector<string>& dictionary, int document_count) {
+    const auto documents = GenerateQueries(generator, dictionary, document_count, 70);
+    for (int i = 0; i < document_count; ++i) {
         search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
     }
+}
+
+// serve <endpoint> [workers] [documents] [wal directory]: answers line protocol requests over a generated corpus
+// until stdin closes; with a wal directory updates are durable and the index is recovered from it on restart,
+// and the hot queries and terms saved at shutdown are replayed to warm the index before serving
+int RunQueryServer(const vector<string>& args) {
+    if (args.size() < 2) {
+        cerr << "usage: serve <tcp:host:port|unix:path> [workers] [documents] [wal directory]"s << endl;
+        return 1;
+    }
+    const size_t worker_count = args.size() > 2 ? stoul(args[2]) : max(1u, thread::hardware_concurrency());
+    const int document_count = args.size() > 3 ? stoi(args[3]) : 10'000;
+    const string wal_directory = args.size() > 4 ? args[4] : ""s;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    SearchServer search_server(dictionary[0]);
+    unique_ptr<WriteAheadLog> log;
+    const string snapshot_path = wal_directory + "/snapshot"s;
+    if (wal_directory.empty()) {
+        AddGeneratedDocuments(search_server, generator, dictionary, document_count);
+    }
+    else if (filesystem::exists(snapshot_path)) {
+        const auto start = chrono::steady_clock::now();
+        const uint64_t sequence = RecoverSearchServer(search_server, snapshot_path, wal_directory + "/log"s);
+        log = make_unique<WriteAheadLog>(wal_directory + "/log"s, sequence);
+        cout << "recovered "s << search_server.GetDocumentCount() << " documents up to record "s << sequence << " in "s
+            << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() << " ms"s << endl;
+    }
+    else {
+        filesystem::create_directories(wal_directory);
+        AddGeneratedDocuments(search_server, generator, dictionary, document_count);
+        log = make_unique<WriteAheadLog>(wal_directory + "/log"s);
+        WriteCheckpoint(search_server, *log, snapshot_path);
+    }
+
+    const string hot_set_path = wal_directory + "/hot_set"s;
+    if (!wal_directory.empty()) {
+        ifstream hot_set(hot_set_path);
+        if (hot_set) {
+            const auto start = chrono::steady_clock::now();
+            const size_t replayed = WarmUpSearchServer(search_server, hot_set);
+            cout << "warmed up with "s << replayed << " hot queries and terms in "s
+                << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() << " ms"s << endl;
+        }
+    }
+
+    RequestQueue request_queue(search_server);
+    QueryServer server(search_server, args[1], worker_count);
+    if (log) {
+        server.EnableDurability(*log, snapshot_path, 100'000);
+    }
+    server.EnableRequestTracking(request_queue);
+    server.Start();
+    cout << "serving "s << search_server.GetDocumentCount() << " documents on "s << args[1] << " with "s << worker_count << " workers"s << endl;
+    for (string line; getline(cin, line);) {
+    }
+    server.Stop();
+    cout << "requests: "s << server.GetRequestCount() << endl;
+    for (const HeavyHitter& query : request_queue.GetHotQueries(5)) {
+        cout << "hot query: "s << query.key << " ("s << query.count << ")"s << endl;
+    }
+    if (!wal_directory.empty()) {
+        ofstream hot_set(hot_set_path);
+        request_queue.ExportHotSet(hot_set);
+    }
+    return 0;
+}
+
+// load <endpoint|local> [connections] [requests per connection] [pipeline depth] [workers]:
+// drives a query server, "local" starts one in this process on a unix socket
+int RunLoad(const vector<string>& args) {
+#if defined(_WIN32)
+    cerr << "load generator needs POSIX sockets"s << endl;
+    return 1;
+#else
+    const string target = args.size() > 1 ? args[1] : "local"s;
+    const size_t connection_count = args.size() > 2 ? stoul(args[2]) : 16;
+    const size_t request_count = args.size() > 3 ? stoul(args[3]) : 200;
+    const size_t pipeline_depth = args.size() > 4 ? stoul(args[4]) : 1;
+    const size_t worker_count = args.size() > 5 ? stoul(args[5]) : max(1u, thread::hardware_concurrency());
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    SearchServer search_server(dictionary[0]);
+    string endpoint = target;
+    unique_ptr<QueryServer> server;
+    if (target == "local"s) {
+        AddGeneratedDocuments(search_server, generator, dictionary, 10'000);
+        endpoint = "unix:/tmp/y_cpp_my_query_"s + to_string(getpid()) + ".sock"s;
+        server = make_unique<QueryServer>(search_server, endpoint, worker_count);
+        server->Start();
+    }
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 7);
+    LoadReport report;
+    try {
+        report = RunLoadGenerator(endpoint, queries, connection_count, request_count, pipeline_depth);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    cout << "connections: "s << connection_count << ", pipeline depth: "s << pipeline_depth << ", requests: "s << report.requests
+        << ", errors: "s << report.errors << ", failed connections: "s << report.failed_connections << endl;
+    cout << "throughput: "s << static_cast<uint64_t>(report.qps) << " requests/s"s << endl;
+    cout << "latency p50: "s << report.p50_us << " us, p99: "s << report.p99_us << " us, p999: "s << report.p999_us << " us"s << endl;
+    return report.errors == 0 && report.failed_connections == 0 ? 0 : 1;
+#endif
+}
+
+// stats [documents] [top lists]: index statistics and memory of a generated corpus
+int RunIndexStatistics(const vector<string>& args) {
+    const int document_count = args.size() > 1 ? stoi(args[1]) : 10'000;
+    const size_t top_count = args.size() > 2 ? stoul(args[2]) : 10;
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    SearchServer search_server(dictionary[0]);
+    AddGeneratedDocuments(search_server, generator, dictionary, document_count);
+    const auto start = chrono::steady_clock::now();
+    const IndexStatistics statistics = search_server.GetIndexStatistics(top_count);
+    const auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    PrintIndexStatistics(cout, statistics);
+    cout << "collected in "s << elapsed << " us"s << endl;
+    return 0;
+}
+
+vector<int> ParseIntList(const string& text) {
+    vector<int> values;
+    for (size_t begin = 0; begin < text.size();) {
+        const size_t end = min(text.find(',', begin), text.size());
+        values.push_back(stoi(text.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+    return values;
+}
+
+// bench [--scales 10000,100000] [--queries N] [--seed N] [--zipf S] [--map-threads 1,2,...|-] [--map-operations N]
+//       [--wal-writers 1,8,...|-] [--wal-operations N] [--wal-dir directory] [--out file] [--baseline file] [--tolerance T]
+//       [--profile file|-]:
+// runs the benchmark suite, prints JSON, fails if results regressed against the baseline;
+// --profile writes per thread stage counters to the file or to stderr (timings include the profiling cost)
+int RunBenchmarkSuite(const vector<string>& args) {
+    BenchmarkConfig config;
+    string out_path;
+    string baseline_path;
+    double tolerance = 0.1;
+    string profile_path;
+    for (size_t i = 1; i + 1 < args.size(); i += 2) {
+        const string& option = args[i];
+        const string& value = args[i + 1];
+        if (option == "--scales"s) {
+            config.scales = ParseIntList(value);
+        }
+        else if (option == "--queries"s) {
+            config.query_count = stoi(value);
+        }
+        else if (option == "--seed"s) {
+            config.seed = static_cast<uint32_t>(stoul(value));
+        }
+        else if (option == "--map-threads"s) {
+            config.map_thread_counts = value == "-"s ? vector<int>{} : ParseIntList(value);
+        }
+        else if (option == "--map-operations"s) {
+            config.map_operations = stoi(value);
+        }
+        else if (option == "--wal-writers"s) {
+            config.wal_writer_counts = value == "-"s ? vector<int>{} : ParseIntList(value);
+        }
+        else if (option == "--wal-operations"s) {
+            config.wal_operations = stoi(value);
+        }
+        else if (option == "--wal-dir"s) {
+            config.wal_directory = value;
+        }
+        else if (option == "--zipf"s) {
+            config.zipf_exponent = stod(value);
+        }
+        else if (option == "--out"s) {
+            out_path = value;
+        }
+        else if (option == "--baseline"s) {
+            baseline_path = value;
+        }
+        else if (option == "--tolerance"s) {
+            tolerance = stod(value);
+        }
+        else if (option == "--profile"s) {
+            profile_path = value;
+        }
+        else {
+            cerr << "unknown option "s << option << endl;
+            return 1;
+        }
+    }
+
+    // checked before the run, not after the search benchmarks
+    if (!config.wal_directory.empty() && !config.wal_writer_counts.empty()) {
+        error_code error;
+        filesystem::create_directories(config.wal_directory, error);
+        if (error) {
+            cerr << "cannot create WAL directory "s << config.wal_directory << ": "s << error.message() << endl;
+            return 1;
+        }
+    }
+    EnableStageProfiling(!profile_path.empty());
+    const vector<BenchmarkResult> results = RunBenchmarks(config);
+    EnableStageProfiling(false);
+    if (profile_path == "-"s) {
+        PrintStageProfiles(cerr, GetStageProfiles());
+    }
+    else if (!profile_path.empty()) {
+        ofstream profile_file(profile_path);
+        PrintStageProfiles(profile_file, GetStageProfiles());
+    }
+    const string json = BenchmarksToJson(results);
+    cout << json;
+    if (!out_path.empty()) {
+        ofstream(out_path) << json;
+    }
+    if (baseline_path.empty()) {
+        return 0;
+    }
+    ifstream baseline_file(baseline_path);
+    if (!baseline_file) {
+        cerr << "cannot read baseline "s << baseline_path << endl;
+        return 1;
+    }
+    const string baseline_json{ istreambuf_iterator<char>(baseline_file), istreambuf_iterator<char>() };
+    const auto regressions = FindRegressions(BenchmarksFromJson(baseline_json), results, tolerance);
+    for (const BenchmarkRegression& regression : regressions) {
+        cerr << "REGRESSION "s << regression.name << " @"s << regression.documents << " "s << regression.metric
+            << ": "s << regression.baseline << " -> "s << regression.current << endl;
+    }
+    return regressions.empty() ? 0 : 2;
+}
+
+void ComparePolicies() {
+    mt19937 generator;
+
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    SearchServer search_server(dictionary[0]);
+    AddGeneratedDocuments(search_server, generator, dictionary, 10'000);
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
     TEST(seq);
     TEST(par);
@@ -78,3 +431,26 @@ int main() {
     }
     cout << total_relevance << endl;
 }
+
+int main(int argc, char* argv[]) {
+    const vector<string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "shard"s) {
+        return RunShard(args);
+    }
+    if (!args.empty() && args[0] == "cluster"s) {
+        return RunClusterDemo(args);
+    }
+    if (!args.empty() && args[0] == "serve"s) {
+        return RunQueryServer(args);
+    }
+    if (!args.empty() && args[0] == "stats"s) {
+        return RunIndexStatistics(args);
+    }
+    if (!args.empty() && args[0] == "load"s) {
+        return RunLoad(args);
+    }
+    if (!args.empty() && args[0] == "bench"s) {
+        return RunBenchmarkSuite(args);
+    }
+    ComparePolicies();
+}
@@ -0,0 +1,817 @@
+#include "search_server.h"
+#include "allocation_counter.h"
+#include "document_store.h"
+#include "lz_codec.h"
+#include "process_queries.h"
+#include "query_server.h"
+#include "score_kernels.h"
+#include "shard_broker.h"
+#include "shard_node.h"
+#include "shard_protocol.h"
+#include "sharded_search_server.h"
+#include "term_dictionary.h"
+#include "test_framework.h"
+#include "write_ahead_log.h"
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <csignal>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+SearchServer CreateTestServer() {
+    SearchServer server("and in on the with"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    server.AddDocument(4, "groomed starling evgeny"s, DocumentStatus::BANNED, { 9 });
+    server.AddDocument(5, "cat with the collar in the garden"s, DocumentStatus::ACTUAL, { 1, 2 });
+    server.AddDocument(6, "dog and cat on the fluffy carpet"s, DocumentStatus::ACTUAL, { 4 });
+    return server;
+}
+
+void AssertSameDocuments(const vector<Document>& lhs, const vector<Document>& rhs) {
+    ASSERT_EQUAL(lhs.size(), rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+        ASSERT_EQUAL(lhs[i].relevance, rhs[i].relevance);
+        ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+    }
+}
+
+void TestAllocationCounter() {
+    ASSERT(IsAllocationCountingEnabled());
+    const uint64_t start = GetThreadAllocationCount();
+    vector<int> numbers(16);
+    const uint64_t allocations = GetThreadAllocationCount() - start;
+    ASSERT_EQUAL(numbers.size(), 16u);
+    ASSERT_EQUAL(allocations, 1u);
+}
+
+void TestQueryContextDoesNotAllocate() {
+    const SearchServer server = CreateTestServer();
+    const vector<string> queries = { "fluffy groomed cat"s, "cat -collar"s, "dog eyes -tail"s, "starling"s, "parrot"s };
+    QueryContext context;
+    vector<Document> result;
+    // the first queries grow the buffers
+    for (const string& query : queries) {
+        server.FindTopDocuments(context, query, result);
+    }
+    for (const string& query : queries) {
+        const uint64_t start = GetThreadAllocationCount();
+        server.FindTopDocuments(context, query, result);
+        const uint64_t allocations = GetThreadAllocationCount() - start;
+        ASSERT_EQUAL(allocations, 0u);
+        AssertSameDocuments(result, server.FindTopDocuments(query));
+    }
+}
+
+template <typename Value>
+void TestAddScaled() {
+    mt19937 generator(7);
+    uniform_real_distribution<double> distribution(0.0, 1.0);
+    for (size_t count = 0; count < 40; ++count) {
+        // odd offsets leave the vectors unaligned
+        vector<Value> scores(count + 1);
+        vector<Value> values(count + 1);
+        for (size_t i = 0; i <= count; ++i) {
+            scores[i] = static_cast<Value>(distribution(generator));
+            values[i] = static_cast<Value>(distribution(generator));
+        }
+        const Value weight = static_cast<Value>(distribution(generator) * 5);
+        vector<Value> expected = scores;
+        for (size_t i = 1; i <= count; ++i) {
+            const Value product = values[i] * weight;
+            expected[i] += product;
+        }
+        AddScaled(scores.data() + 1, values.data() + 1, weight, count);
+        ASSERT(scores == expected);
+    }
+}
+
+void TestScoreKernelsMatchScalarLoop() {
+    TestAddScaled<double>();
+    TestAddScaled<float>();
+}
+
+// Documents of a small dictionary, so most terms are dense in the blocks of BatchQueryEvaluator
+vector<string> GenerateTestDocuments(mt19937& generator, const vector<string>& dictionary, int count) {
+    vector<string> documents;
+    for (int i = 0; i < count; ++i) {
+        const int length = uniform_int_distribution(1, 8)(generator);
+        string document;
+        for (int j = 0; j < length; ++j) {
+            document += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)];
+            document.push_back(' ');
+        }
+        documents.push_back(document);
+    }
+    return documents;
+}
+
+void TestTopDocumentsStableWithinEpsilon() {
+    // quantized term frequencies are off by up to half a step of 1/65535
+#if defined(SCORE_PRECISION_QUANTIZED)
+    const double tolerance = 1e-3;
+#else
+    const double tolerance = EPSILON;
+#endif
+    mt19937 generator(42);
+    vector<string> dictionary;
+    for (int i = 0; i < 30; ++i) {
+        dictionary.push_back("w"s + to_string(i));
+    }
+    const vector<string> documents = GenerateTestDocuments(generator, dictionary, 3000);
+    SearchServer server(""s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { id % 10 });
+    }
+    vector<string> queries;
+    for (int i = 0; i < 200; ++i) {
+        const string plus = GenerateTestDocuments(generator, dictionary, 1)[0];
+        queries.push_back(i % 2 == 0 ? plus : plus + "-"s + dictionary[i % dictionary.size()]);
+    }
+
+    // the shared scan adds dense blocks with the score kernels and must match the per-query path exactly
+    const vector<vector<Document>> shared = ProcessQueriesShared(server, queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const vector<Document> found = server.FindTopDocuments(queries[i]);
+        AssertSameDocuments(shared[i], found);
+
+        // relevance recomputed in double, the ranks may only swap documents within the tolerance
+        set<string_view> plus_words;
+        set<string_view> minus_words;
+        for (const string_view word : SplitIntoWords(string_view(queries[i]))) {
+            if (word[0] == '-') {
+                minus_words.insert(word.substr(1));
+            }
+            else {
+                plus_words.insert(word);
+            }
+        }
+        map<int, double> reference;
+        for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+            const vector<string_view> words = SplitIntoWords(string_view(documents[id]));
+            map<string_view, double> word_freqs;
+            for (const string_view word : words) {
+                word_freqs[word] += 1.0 / words.size();
+            }
+            if (any_of(minus_words.begin(), minus_words.end(), [&word_freqs](const string_view word) { return word_freqs.count(word) > 0; })) {
+                continue;
+            }
+            for (const string_view word : plus_words) {
+                const auto it = word_freqs.find(word);
+                if (it != word_freqs.end()) {
+                    reference[id] += it->second * log(server.GetDocumentCount() * 1.0 / server.GetWordDocumentCount(word));
+                }
+            }
+        }
+        ASSERT_EQUAL(found.size(), min<size_t>(reference.size(), MAX_RESULT_DOCUMENT_COUNT));
+        for (size_t rank = 0; rank < found.size(); ++rank) {
+            ASSERT(reference.count(found[rank].id) > 0);
+            const double relevance = reference.at(found[rank].id);
+            ASSERT(abs(found[rank].relevance - relevance) < tolerance);
+            // no document left out is more relevant beyond the tolerance
+            for (const auto& [id, other_relevance] : reference) {
+                const bool ranked_before = any_of(found.begin(), found.begin() + rank, [id = id](const Document& document) { return document.id == id; });
+                ASSERT(ranked_before || id == found[rank].id || other_relevance < relevance + 2 * tolerance);
+            }
+        }
+    }
+}
+
+void TestMessageReaderRejectsUnknownStatus() {
+    MessageWriter writer;
+    writer.WriteU8(static_cast<uint8_t>(DocumentStatus::REMOVED));
+    writer.WriteU8(static_cast<uint8_t>(DocumentStatus::REMOVED) + 1);
+    MessageReader reader(writer.GetData());
+    ASSERT(reader.ReadStatus() == DocumentStatus::REMOVED);
+    ASSERT_THROWS(reader.ReadStatus(), runtime_error);
+}
+
+vector<string> FindWithPrefix(const TermDictionary& dictionary, const string_view prefix) {
+    vector<string> terms;
+    dictionary.ForEachWithPrefix(prefix, 1000, [&terms](const string_view term) {
+        terms.emplace_back(term);
+        return true;
+        });
+    return terms;
+}
+
+void TestTermDictionaryErase() {
+    TermDictionary dictionary;
+    for (int i = 0; i < 3000; ++i) {
+        dictionary.Insert("t"s + to_string(i));
+    }
+    dictionary.Compact();
+    dictionary.Erase("t1"s);
+    dictionary.Erase("t12"s);
+    dictionary.Erase("t12"s);
+    dictionary.Erase("missing"s);
+    ASSERT_EQUAL(dictionary.Size(), 2998u);
+    ASSERT(!dictionary.Contains("t12"s));
+    ASSERT(dictionary.Contains("t120"s));
+    ASSERT_EQUAL(FindWithPrefix(dictionary, "t12"s).size(), 110u);
+    dictionary.Insert("t12"s);
+    ASSERT_EQUAL(FindWithPrefix(dictionary, "t12"s).size(), 111u);
+    // an eighth of the terms erased rebuilds the blocks without them
+    for (int i = 1000; i < 2000; ++i) {
+        dictionary.Erase("t"s + to_string(i));
+    }
+    ASSERT_EQUAL(dictionary.Size(), 1999u);
+    ASSERT_EQUAL(FindWithPrefix(dictionary, "t1"s).size(), 110u);
+    ASSERT(dictionary.GetAllocatedBytes() < 3000 * 8);
+}
+
+void TestPrefixSearchAfterRemovals() {
+    SearchServer server(""s);
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "ab"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    for (int id = 0; id < 100; ++id) {
+        server.RemoveDocument(id);
+    }
+    server.AddDocument(100, "abzz"s, DocumentStatus::ACTUAL, { 1 });
+    const vector<Document> found = server.FindTopDocuments("ab*"s);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 100);
+}
+
+// Removed terms closer to the query than the live one must not take its candidate slot
+template <typename Server>
+void TestFuzzyMatchAfterRemovals(Server& server) {
+    server.EnableFuzzySearch(1);
+    for (int id = 0; id < static_cast<int>(MAX_FUZZY_EXPANSION); ++id) {
+        server.AddDocument(id, "car"s + static_cast<char>('a' + id), DocumentStatus::ACTUAL, { 1 });
+    }
+    for (int id = 0; id < static_cast<int>(MAX_FUZZY_EXPANSION); ++id) {
+        server.RemoveDocument(id);
+    }
+    server.AddDocument(100, "curt"s, DocumentStatus::ACTUAL, { 1 });
+    const vector<Document> found = server.FindTopDocuments("cart"s);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 100);
+}
+
+void TestFuzzySearchSkipsRemovedTerms() {
+    SearchServer server(""s);
+    TestFuzzyMatchAfterRemovals(server);
+    ShardedSearchServer sharded_server(""s, 3);
+    TestFuzzyMatchAfterRemovals(sharded_server);
+}
+
+void TestShardedSearchMatchesSingleServer() {
+    mt19937 generator(11);
+    const vector<string> dictionary = { "cat"s, "cats"s, "catalog"s, "car"s, "cart"s, "carpet"s, "dog"s, "dogs"s, "door"s,
+        "white"s, "whale"s, "fluffy"s, "fly"s, "tail"s, "tall"s, "groomed"s, "green"s, "eyes"s, "evgeny"s, "starling"s };
+    const vector<string> documents = GenerateTestDocuments(generator, dictionary, 2000);
+    SearchServer server("and in on"s);
+    ShardedSearchServer sharded_server("and in on"s, 4);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        const DocumentStatus status = static_cast<DocumentStatus>(id % 3 == 0 ? id % 4 : 0);
+        const vector<int> ratings = { id % 7, id % 5 - 2 };
+        server.AddDocument(id, documents[id], status, ratings);
+        sharded_server.AddDocument(id, documents[id], status, ratings);
+    }
+    // removals change the corpus-wide counts and drop whole terms
+    for (int id = 0; id < static_cast<int>(documents.size()); id += 3) {
+        server.RemoveDocument(id);
+        sharded_server.RemoveDocument(id);
+    }
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        if (id % 3 != 0 && documents[id].find("starling"s) != string::npos) {
+            server.RemoveDocument(id);
+            sharded_server.RemoveDocument(id);
+        }
+    }
+    ASSERT_EQUAL(sharded_server.GetDocumentCount(), server.GetDocumentCount());
+    ASSERT_EQUAL(sharded_server.GetWordDocumentCount("starling"s), 0);
+
+    vector<string> queries = { "cat"s, "ca*"s, "car* -cart"s, "fluffy do* -dogs"s, "white -wh*"s, "starling"s, "sta*"s, "t* -tail"s };
+    for (int i = 0; i < 200; ++i) {
+        string query = GenerateTestDocuments(generator, dictionary, 1)[0];
+        const string& word = dictionary[i % dictionary.size()];
+        query += i % 3 == 0 ? "-"s + word : i % 3 == 1 ? word.substr(0, 2) + "*"s : "-"s + word.substr(0, 2) + "*"s;
+        queries.push_back(query);
+    }
+    size_t found_count = 0;
+    for (const string& query : queries) {
+        const vector<Document> found = server.FindTopDocuments(query);
+        found_count += found.size();
+        AssertSameDocuments(sharded_server.FindTopDocuments(query), found);
+        AssertSameDocuments(sharded_server.FindTopDocuments(std::execution::seq, query, DocumentStatus::BANNED),
+            server.FindTopDocuments(query, DocumentStatus::BANNED));
+        const auto predicate = [](int document_id, DocumentStatus, int rating) { return document_id % 2 == 0 && rating > 0; };
+        AssertSameDocuments(sharded_server.FindTopDocuments(query, predicate), server.FindTopDocuments(query, predicate));
+    }
+    ASSERT(found_count > queries.size() * MAX_RESULT_DOCUMENT_COUNT / 2);
+}
+
+void TestPlannerStrategiesMatch() {
+    mt19937 generator(5);
+    vector<string> dictionary;
+    for (int i = 0; i < 30; ++i) {
+        dictionary.push_back("w"s + to_string(i));
+    }
+    const vector<string> documents = GenerateTestDocuments(generator, dictionary, 5000);
+    SearchServer server(""s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        server.AddDocument(id, documents[id], id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 10 });
+    }
+    vector<string> queries = { "w1*"s, "w2* -w20"s, "w3 w1* -w12"s, "w0 -w1*"s };
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateTestDocuments(generator, dictionary, 1)[0] + "-"s + dictionary[i % dictionary.size()]);
+    }
+
+    // forced plans, threads and ranges fixed so the parallel plans run on any machine
+    for (const EvaluationStrategy strategy : { EvaluationStrategy::TERM_AT_A_TIME, EvaluationStrategy::DOCUMENT_AT_A_TIME }) {
+        for (const bool parallel : { false, true }) {
+            QueryPlannerOptions options;
+            options.strategy = strategy;
+            options.parallel_min_postings = parallel ? 0 : numeric_limits<uint64_t>::max();
+            options.range_postings = 256;
+            options.max_threads = 4;
+            server.SetQueryPlannerOptions(options);
+            const QueryPlannerStats before = server.GetQueryPlannerStats();
+            for (const string& query : queries) {
+                const QueryPlan plan = server.PlanQuery(query);
+                ASSERT(plan.strategy == strategy);
+                ASSERT_EQUAL(plan.parallel, parallel);
+                const vector<Document> expected = server.FindTopDocuments(std::execution::seq, query);
+                AssertSameDocuments(server.FindTopDocuments(std::execution::par, query), expected);
+                AssertSameDocuments(server.FindTopDocuments(auto_execution, query), expected);
+                AssertSameDocuments(server.FindTopDocuments(auto_execution, query, DocumentStatus::BANNED),
+                    server.FindTopDocuments(std::execution::seq, query, DocumentStatus::BANNED));
+            }
+            const QueryPlannerStats after = server.GetQueryPlannerStats();
+            const bool taat = strategy == EvaluationStrategy::TERM_AT_A_TIME;
+            ASSERT_EQUAL(after.taat_seq - before.taat_seq, taat && !parallel ? 2 * queries.size() : 0u);
+            ASSERT_EQUAL(after.taat_par - before.taat_par, taat && parallel ? 2 * queries.size() : 0u);
+            ASSERT_EQUAL(after.daat_seq - before.daat_seq, !taat && !parallel ? 2 * queries.size() : 0u);
+            ASSERT_EQUAL(after.daat_par - before.daat_par, !taat && parallel ? 2 * queries.size() : 0u);
+        }
+    }
+}
+
+void TestBudgetExceededQueryIsPartial() {
+    const SearchServer server = CreateTestServer();
+    const string query = "fluffy groomed cat"s;
+    QueryContext context;
+    vector<Document> result;
+
+    ASSERT(server.FindTopDocuments(context, QueryBudget{}, query, result) == QueryCompletion::COMPLETE);
+    const vector<Document> expected = server.FindTopDocuments(query);
+    ASSERT_EQUAL(result.size(), expected.size());
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_EQUAL(result[i].id, expected[i].id);
+    }
+
+    // terms run from the shortest posting list: fluffy and groomed fit, cat does not
+    QueryBudget budget;
+    budget.max_postings = 4;
+    ASSERT(server.FindTopDocuments(context, budget, query, result) == QueryCompletion::POSTINGS_EXHAUSTED);
+    set<int> ids;
+    for (const Document& document : result) {
+        ids.insert(document.id);
+    }
+    ASSERT(ids == (set<int>{ 2, 3, 6 }));
+
+    budget = QueryBudget::FromTimeout(-1s);
+    ASSERT(server.FindTopDocuments(context, budget, query, result) == QueryCompletion::DEADLINE_EXCEEDED);
+    ASSERT(result.empty());
+
+    const vector<SearchResult> results = ProcessQueries(server, { query, "starling"s }, 0s);
+    ASSERT(results[0].IsPartial());
+    ASSERT(results[1].IsPartial());
+    ASSERT(!ProcessQueries(server, { query }, 1h)[0].IsPartial());
+
+    const QueryBudgetStats stats = server.GetQueryBudgetStats();
+    ASSERT_EQUAL(stats.queries, 6u);
+    ASSERT_EQUAL(stats.postings_exhausted, 1u);
+    ASSERT_EQUAL(stats.deadline_exceeded, 3u);
+    ASSERT_EQUAL(stats.skipped_terms, 1u + 3u + 3u + 1u);
+}
+
+// Copies of a few texts with a few ratings, so most documents tie on relevance and rating
+template <typename Server>
+void TestPagesCoverRanking(Server& server) {
+    const vector<string> texts = { "cat dog"s, "cat"s, "cat fluffy tail"s, "dog"s };
+    for (int id = 0; id < 400; ++id) {
+        server.AddDocument(id, texts[id % texts.size()], DocumentStatus::ACTUAL, { id % 3 });
+    }
+    const vector<Document> ranking = server.FindTopDocumentsPage("cat"s, 1000).documents;
+    ASSERT_EQUAL(ranking.size(), 300u);
+    for (size_t i = 1; i < ranking.size(); ++i) {
+        ASSERT(IsMoreRelevant(ranking[i - 1], ranking[i]));
+    }
+    AssertSameDocuments(server.FindTopDocuments("cat"s),
+        vector<Document>(ranking.begin(), ranking.begin() + MAX_RESULT_DOCUMENT_COUNT));
+
+    for (const size_t page_size : { 1, 7, 100, 300 }) {
+        vector<Document> pages;
+        string cursor;
+        do {
+            DocumentPage page = server.FindTopDocumentsPage("cat"s, page_size, cursor);
+            ASSERT(!page.documents.empty());
+            ASSERT(page.documents.size() == page_size || page.next_cursor.empty());
+            pages.insert(pages.end(), page.documents.begin(), page.documents.end());
+            cursor = move(page.next_cursor);
+        } while (!cursor.empty());
+        AssertSameDocuments(pages, ranking);
+    }
+}
+
+void TestPagesConcatenateToRanking() {
+    SearchServer server(""s);
+    TestPagesCoverRanking(server);
+    ShardedSearchServer sharded_server(""s, 3);
+    TestPagesCoverRanking(sharded_server);
+}
+
+void AssertLzRoundTrip(const string& input) {
+    string compressed;
+    LzCompress(input, compressed);
+    string decompressed;
+    LzDecompress(compressed, decompressed);
+    ASSERT(decompressed == input);
+}
+
+void TestLzCodecRoundTrip() {
+    AssertLzRoundTrip(""s);
+    AssertLzRoundTrip("abc"s);
+    AssertLzRoundTrip("abcdabcd"s);
+
+    // incompressible: random bytes grow by the token and length bytes only
+    mt19937 generator(3);
+    string random_bytes(100'000, '\0');
+    for (char& c : random_bytes) {
+        c = static_cast<char>(generator());
+    }
+    AssertLzRoundTrip(random_bytes);
+    string compressed;
+    LzCompress(random_bytes, compressed);
+    ASSERT(compressed.size() <= random_bytes.size() + random_bytes.size() / 255 + 16);
+
+    // matches longer than the 15 of a nibble and than the 64 KiB window, overlapping their output
+    const string run(200'000, 'a');
+    AssertLzRoundTrip(run);
+    LzCompress(run, compressed);
+    ASSERT(compressed.size() < 1000);
+    const string repeated_block = random_bytes.substr(0, 70'000) + random_bytes.substr(0, 70'000);
+    AssertLzRoundTrip(repeated_block);
+    AssertLzRoundTrip(random_bytes.substr(0, 30'000) + run.substr(0, 5) + random_bytes.substr(0, 30'000) + "x"s);
+
+    // corrupt streams throw instead of reading out of bounds
+    LzCompress(repeated_block, compressed);
+    string decompressed;
+    ASSERT_THROWS(LzDecompress(compressed.substr(0, compressed.size() - 1), decompressed), invalid_argument);
+    ASSERT_THROWS(LzDecompress(string(3, '\0'), decompressed), invalid_argument);
+}
+
+void TestDocumentStore() {
+    DocumentStore store(1000, 2);
+    mt19937 generator(5);
+    const vector<string> dictionary = { "white"s, "cat"s, "fluffy"s, "tail"s, "groomed"s, "dog"s };
+    vector<string> texts;
+    vector<DocumentStore::Location> locations;
+    for (int i = 0; i < 150; ++i) {
+        texts.push_back(i % 10 == 0 ? ""s : GenerateTestDocuments(generator, dictionary, 1)[0]);
+        locations.push_back(store.Add(texts.back()));
+    }
+    // a document longer than a block seals the block it ends
+    texts.push_back(string(2500, 'z') + "end"s);
+    locations.push_back(store.Add(texts.back()));
+    texts.push_back("open block"s);
+    locations.push_back(store.Add(texts.back()));
+    for (size_t i = 0; i < texts.size(); ++i) {
+        ASSERT_EQUAL(store.Get(locations[i]), texts[i]);
+    }
+    DocumentStoreStats stats = store.GetStats();
+    ASSERT_EQUAL(stats.documents, texts.size());
+    ASSERT(stats.stored_bytes < stats.text_bytes);
+    ASSERT_EQUAL(stats.cached_blocks, 2u);
+
+    // the first document of every sealed block, the last document is in the open block
+    vector<DocumentStore::Location> block_starts;
+    for (size_t i = 0; i + 1 < locations.size(); ++i) {
+        if (block_starts.empty() || block_starts.back().block != locations[i].block) {
+            block_starts.push_back(locations[i]);
+        }
+    }
+    ASSERT(block_starts.size() >= 3);
+    ASSERT_EQUAL(stats.blocks, block_starts.size());
+
+    // LRU: after blocks 0, 1 and 0 again, block 2 evicts block 1
+    store.Get(block_starts[0]);
+    store.Get(block_starts[1]);
+    store.Get(block_starts[0]);
+    const uint64_t misses = store.GetStats().cache_misses;
+    store.Get(block_starts[2]);
+    store.Get(block_starts[0]);
+    ASSERT_EQUAL(store.GetStats().cache_misses, misses + 1);
+    store.Get(block_starts[1]);
+    ASSERT_EQUAL(store.GetStats().cache_misses, misses + 2);
+    ASSERT_EQUAL(store.GetStats().cached_blocks, 2u);
+
+    // removed documents leave the others readable, a block without documents is dropped
+    for (size_t i = 0; i < texts.size(); i += 2) {
+        store.Remove(locations[i]);
+    }
+    for (size_t i = 1; i < texts.size(); i += 2) {
+        ASSERT_EQUAL(store.Get(locations[i]), texts[i]);
+    }
+    ASSERT_EQUAL(store.GetStats().documents, texts.size() / 2);
+    for (size_t i = 1; i < texts.size(); i += 2) {
+        if (locations[i].block == block_starts[1].block) {
+            store.Remove(locations[i]);
+        }
+    }
+    stats = store.GetStats();
+    ASSERT_EQUAL(stats.blocks, block_starts.size() - 1);
+    for (size_t i = 1; i < texts.size(); i += 2) {
+        if (locations[i].block != block_starts[1].block) {
+            ASSERT_EQUAL(store.Get(locations[i]), texts[i]);
+        }
+    }
+}
+
+// Empty directory for the files of one test
+filesystem::path CreateTestDirectory(const string& name) {
+    const filesystem::path path = filesystem::temp_directory_path() / ("y_cpp_my_tests_"s + name);
+    filesystem::remove_all(path);
+    filesystem::create_directories(path);
+    return path;
+}
+
+void AppendTestRecords(WriteAheadLog& log) {
+    log.AppendAdd(1, "white cat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    log.AppendAdd(2, "fluffy dog"s, DocumentStatus::ACTUAL, { 5 });
+    log.AppendSetStatus(1, DocumentStatus::BANNED);
+    log.AppendAdd(3, "groomed starling"s, DocumentStatus::ACTUAL, {});
+    log.AppendSetRating(2, 7);
+    log.AppendRemove(3);
+    log.WaitDurable(log.GetLastSequence());
+}
+
+void AssertRecoveredTestRecords(const SearchServer& server) {
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT_EQUAL(server.GetDocumentText(1), "white cat"s);
+    ASSERT(server.GetDocumentStatus(1) == DocumentStatus::BANNED);
+    ASSERT_EQUAL(server.GetDocumentRating(1), 1);
+    ASSERT_EQUAL(server.GetDocumentText(2), "fluffy dog"s);
+    ASSERT_EQUAL(server.GetDocumentRating(2), 7);
+    ASSERT_EQUAL(server.GetWordDocumentCount("starling"s), 0);
+}
+
+void TestWalRecovery() {
+    const filesystem::path directory = CreateTestDirectory("wal_recovery"s);
+    const string log_path = (directory / "log"s).string();
+    const string snapshot_path = (directory / "snapshot"s).string();
+    {
+        WriteAheadLog log(log_path);
+        AppendTestRecords(log);
+        ASSERT_EQUAL(log.GetDurableSequence(), 6u);
+    }
+    const vector<WalRecord> records = ReadWalRecords(log_path);
+    ASSERT_EQUAL(records.size(), 6u);
+    ASSERT(records[4].type == WalRecordType::SET_RATING);
+    ASSERT_EQUAL(records[4].sequence, 5u);
+    ASSERT(records[0].ratings == vector<int>({ 1, 2 }));
+
+    SearchServer server(""s);
+    const uint64_t last_sequence = RecoverSearchServer(server, snapshot_path, log_path);
+    ASSERT_EQUAL(last_sequence, 6u);
+    AssertRecoveredTestRecords(server);
+    // a reopened log continues the sequence
+    WriteAheadLog log(log_path, last_sequence);
+    ASSERT_EQUAL(log.AppendRemove(2), 7u);
+    filesystem::remove_all(directory);
+}
+
+void TestWalCheckpoint() {
+    const filesystem::path directory = CreateTestDirectory("wal_checkpoint"s);
+    const string log_path = (directory / "log"s).string();
+    const string snapshot_path = (directory / "snapshot"s).string();
+    {
+        SearchServer server(""s);
+        WriteAheadLog log(log_path);
+        AppendTestRecords(log);
+        RecoverSearchServer(server, snapshot_path, log_path);
+        WriteCheckpoint(server, log, snapshot_path);
+        ASSERT(ReadWalRecords(log_path).empty());
+        log.AppendAdd(4, "dog"s, DocumentStatus::ACTUAL, { 3 });
+        log.AppendRemove(4);
+        log.AppendAdd(5, "cat and dog"s, DocumentStatus::ACTUAL, { 4 });
+        log.WaitDurable(log.GetLastSequence());
+        log.DropRecordsUpTo(7);
+        const vector<WalRecord> records = ReadWalRecords(log_path);
+        ASSERT_EQUAL(records.size(), 2u);
+        ASSERT_EQUAL(records[0].sequence, 8u);
+    }
+    // the snapshot covers up to 6 and the log starts at 8; record 8 removes the document of record 7 again
+    SearchServer server(""s);
+    ASSERT_EQUAL(RecoverSearchServer(server, snapshot_path, log_path), 9u);
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    ASSERT_EQUAL(server.GetWordDocumentCount("dog"s), 2);
+    ASSERT_EQUAL(server.GetDocumentRating(5), 4);
+    filesystem::remove_all(directory);
+}
+
+void TestWalDropsCorruptTail() {
+    const filesystem::path directory = CreateTestDirectory("wal_corrupt"s);
+    const string log_path = (directory / "log"s).string();
+    {
+        WriteAheadLog log(log_path);
+        AppendTestRecords(log);
+    }
+    const uintmax_t full_size = filesystem::file_size(log_path);
+    // torn: the last frame (REMOVE 3) lost its last byte
+    filesystem::resize_file(log_path, full_size - 1);
+    ASSERT_EQUAL(ReadWalRecords(log_path).size(), 5u);
+    {
+        SearchServer server(""s);
+        ASSERT_EQUAL(RecoverSearchServer(server, (directory / "snapshot"s).string(), log_path), 5u);
+        ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    }
+    // bad CRC: a flipped byte in the payload of SET_RATING 2 7, before the 21 bytes of the REMOVE frame
+    {
+        fstream file(log_path, ios::in | ios::out | ios::binary);
+        file.seekp(static_cast<streamoff>(full_size) - 21 - 1);
+        file.put('\x55');
+    }
+    ASSERT_EQUAL(ReadWalRecords(log_path).size(), 4u);
+    // reopening truncates the file after the last good record and continues from it
+    {
+        WriteAheadLog log(log_path);
+        ASSERT_EQUAL(log.AppendSetRating(2, 9), 5u);
+        log.WaitDurable(5);
+    }
+    const vector<WalRecord> records = ReadWalRecords(log_path);
+    ASSERT_EQUAL(records.size(), 5u);
+    ASSERT_EQUAL(records.back().ratings[0], 9);
+    filesystem::remove_all(directory);
+}
+
+#if defined(__linux__)
+
+// Makes writes that grow files past limit fail with EFBIG instead of raising SIGXFSZ
+void SetFileSizeLimit(rlim_t limit) {
+    signal(SIGXFSZ, SIG_IGN);
+    rlimit file_size{};
+    getrlimit(RLIMIT_FSIZE, &file_size);
+    file_size.rlim_cur = limit;
+    setrlimit(RLIMIT_FSIZE, &file_size);
+}
+
+string SendRequest(int fd, const string& line) {
+    const string request = line + "\n"s;
+    ASSERT_EQUAL(write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+    string response;
+    char c = 0;
+    while (read(fd, &c, 1) == 1 && c != '\n') {
+        response.push_back(c);
+    }
+    return response;
+}
+
+void TestFailedWalRejectsAppends() {
+    const filesystem::path directory = CreateTestDirectory("wal_failed"s);
+    const string log_path = (directory / "log"s).string();
+    {
+        WriteAheadLog log(log_path);
+        const uint64_t first = log.AppendAdd(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+        log.WaitDurable(first);
+        SetFileSizeLimit(filesystem::file_size(log_path) + 16);
+        const uint64_t second = log.AppendAdd(2, string(1000, 'x'), DocumentStatus::ACTUAL, { 1 });
+        ASSERT_THROWS(log.WaitDurable(second), runtime_error);
+        SetFileSizeLimit(RLIM_INFINITY);
+        ASSERT_THROWS(log.AppendRemove(1), runtime_error);
+        ASSERT_THROWS(log.AppendSetRating(1, 3), runtime_error);
+        ASSERT_THROWS(log.WaitDurable(second), runtime_error);
+        // records synced before the failure stay durable
+        log.WaitDurable(first);
+        ASSERT_EQUAL(log.GetDurableSequence(), first);
+    }
+    // the torn frame is dropped on reopening
+    WriteAheadLog log(log_path);
+    const vector<WalRecord> records = ReadWalRecords(log_path);
+    ASSERT_EQUAL(records.size(), 1u);
+    ASSERT_EQUAL(records[0].text, "white cat"s);
+    ASSERT_EQUAL(log.AppendRemove(1), 2u);
+    filesystem::remove_all(directory);
+}
+
+void TestQueryServerUndoesUnloggedUpdates() {
+    const filesystem::path directory = CreateTestDirectory("undo"s);
+    const string log_path = (directory / "log"s).string();
+    SearchServer server(""s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 5 });
+    {
+        WriteAheadLog log(log_path);
+        QueryServer query_server(server, "unix:"s + (directory / "sock"s).string(), 1);
+        query_server.EnableDurability(log, (directory / "snapshot"s).string(), 0);
+        query_server.Start();
+        const int fd = OpenConnectedSocket("unix:"s + (directory / "sock"s).string());
+        ASSERT_EQUAL(SendRequest(fd, "ADD 2 0 1,2 small dog"s), "OK"s);
+        ASSERT_EQUAL(SendRequest(fd, "SEARCH dog -cat"s).substr(0, 7), "OK 1 2 "s);
+
+        SetFileSizeLimit(filesystem::file_size(log_path) + 16);
+        ASSERT_EQUAL(SendRequest(fd, "ADD 3 0 - "s + string(1000, 'x')).substr(0, 3), "ERR"s);
+        SetFileSizeLimit(RLIM_INFINITY);
+        // the failed log rejects later updates before they are applied
+        ASSERT_EQUAL(SendRequest(fd, "REMOVE 1"s).substr(0, 3), "ERR"s);
+        ASSERT_EQUAL(SendRequest(fd, "STATUS 1 2 2 2"s).substr(0, 3), "ERR"s);
+        ASSERT_EQUAL(SendRequest(fd, "RATING 2 9"s).substr(0, 3), "ERR"s);
+        ASSERT_EQUAL(SendRequest(fd, "SEARCH xxxxxxxxxx"s), "OK 0"s);
+        close(fd);
+        query_server.Stop();
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT(server.GetDocumentStatus(1) == DocumentStatus::ACTUAL);
+    ASSERT(server.GetDocumentStatus(2) == DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(server.GetDocumentRating(2), 1);
+    ASSERT_EQUAL(server.GetWordDocumentCount("x"s + string(999, 'x')), 0);
+
+    // the log keeps the update that was answered OK
+    SearchServer recovered(""s);
+    RecoverSearchServer(recovered, (directory / "snapshot"s).string(), log_path);
+    ASSERT_EQUAL(recovered.GetDocumentCount(), 1);
+    ASSERT_EQUAL(recovered.GetDocumentText(2), "small dog"s);
+    filesystem::remove_all(directory);
+}
+
+void TestShardBrokerReconnectsAfterFailedQuery() {
+    const filesystem::path directory = CreateTestDirectory("broker"s);
+    const vector<string> endpoints = { "unix:"s + (directory / "0"s).string(), "unix:"s + (directory / "1"s).string() };
+    SocketListener failing_listener(endpoints[0]);
+    SocketListener listener(endpoints[1]);
+    ShardNode failing_node(""s);
+    ShardNode node(""s);
+    // shard 0 drops its first connection after reading a request, then serves normally
+    thread failing_shard([&]() {
+        {
+            SocketConnection connection = failing_listener.Accept();
+            string request;
+            connection.ReceiveMessage(request);
+        }
+        failing_node.Serve(failing_listener);
+        });
+    thread shard([&]() { node.Serve(listener); });
+
+    ShardBroker broker(endpoints);
+    ASSERT_THROWS(broker.FindTopDocuments("cat"s), runtime_error);
+    // the reply of shard 1 to the failed query must not answer the next request
+    broker.AddDocument(0, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    broker.AddDocument(1, "fluffy cat"s, DocumentStatus::ACTUAL, { 2 });
+    broker.AddDocument(2, "groomed dog"s, DocumentStatus::ACTUAL, { 3 });
+    const vector<Document> found = broker.FindTopDocuments("fluffy cat"s);
+    ASSERT_EQUAL(found.size(), 2u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT_EQUAL(found[1].id, 0);
+    broker.Shutdown();
+    failing_shard.join();
+    shard.join();
+    filesystem::remove_all(directory);
+}
+
+#endif
+
+int main() {
+    TestRunner tr;
+    RUN_TEST(tr, TestAllocationCounter);
+    RUN_TEST(tr, TestQueryContextDoesNotAllocate);
+    RUN_TEST(tr, TestScoreKernelsMatchScalarLoop);
+    RUN_TEST(tr, TestTopDocumentsStableWithinEpsilon);
+    RUN_TEST(tr, TestMessageReaderRejectsUnknownStatus);
+    RUN_TEST(tr, TestTermDictionaryErase);
+    RUN_TEST(tr, TestPrefixSearchAfterRemovals);
+    RUN_TEST(tr, TestFuzzySearchSkipsRemovedTerms);
+    RUN_TEST(tr, TestShardedSearchMatchesSingleServer);
+    RUN_TEST(tr, TestPlannerStrategiesMatch);
+    RUN_TEST(tr, TestBudgetExceededQueryIsPartial);
+    RUN_TEST(tr, TestPagesConcatenateToRanking);
+    RUN_TEST(tr, TestLzCodecRoundTrip);
+    RUN_TEST(tr, TestDocumentStore);
+    RUN_TEST(tr, TestWalRecovery);
+    RUN_TEST(tr, TestWalCheckpoint);
+    RUN_TEST(tr, TestWalDropsCorruptTail);
+#if defined(__linux__)
+    RUN_TEST(tr, TestFailedWalRejectsAppends);
+    RUN_TEST(tr, TestQueryServerUndoesUnloggedUpdates);
+    RUN_TEST(tr, TestShardBrokerReconnectsAfterFailedQuery);
+#endif
+}